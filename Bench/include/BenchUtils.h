@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef BENCHUTILS_H_INCLUDED
+#define BENCHUTILS_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Helpers shared by the headless benchmark and the soak test
+// ----------------------------------------------------------------------------
+#include <vector>
+
+#include <Ogre.h>
+
+#include <hydrocl/HydrOCLGrid.h>
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLBackend.h>
+
+/// Time step between frames [s]
+#define _def_TimeStep 0.016f
+/// Camera path radius [m]
+#define _def_PathRadius 100.f
+/// Grid near distance from the camera [m]
+#define _def_NearDistance 1.f
+/// Grid far distance from the camera [m]
+#define _def_FarDistance 1000.f
+
+/// Device vertexes layouts
+enum Layout
+{
+	L_ROWS = 0,
+	L_TILED,
+	L_SOA,
+	L_TILED_SOA,
+	N_LAYOUTS
+};
+
+/// Layouts names, used in the output
+extern const char* LayoutNames[N_LAYOUTS];
+
+/** Set the vertexes layout options
+    @param Opt Module options
+	@param L Layout
+ */
+void setLayout(Hydrax::Module::HydrOCL::Options &Opt, int L);
+
+/** Parse a comma separated list of integers
+    @param str List to parse
+	@param list Output list
+	@return false if any value can't be parsed
+ */
+bool parseList(const char *str, std::vector<int> &list);
+
+/** Test if a backend name is known by newBackend()
+    @param Backend Backend name
+	@return true if it is opencl, cpu or reference
+ */
+bool validBackend(const Ogre::String &Backend);
+
+/** Scripted camera path. The camera turns around the origin while bobbing
+ * and yawing a bit, so each frame the grid changes.
+    @param t Time [s]
+	@param Pos Output camera position
+	@param Dir Output camera direction
+ */
+void cameraPath(float t, Ogre::Vector3 &Pos, Ogre::Vector3 &Dir);
+
+/** Grid corners in homogeneous coordinates, like the module computes
+ * them: a trapezoid in front of the camera where each corner is divided
+ * by its view depth, so the vertexes are perspective distributed.
+    @param Pos Camera position
+	@param Dir Camera direction
+	@param Corners Output corners
+ */
+void gridCorners(const Ogre::Vector3 &Pos, const Ogre::Vector3 &Dir, Ogre::Vector4 *Corners);
+
+/** Add random waves to the noise, with the Demo1 dispersion
+    @param noise Noise module
+	@param nWaves Number of waves
+ */
+void addWaves(Hydrax::Noise::HydrOCLNoise *noise, int nWaves);
+
+/** Create a backend
+    @param Backend Backend name (opencl, cpu or reference)
+	@return Backend (not created yet)
+ */
+Hydrax::Module::HydrOCLBackend* newBackend(const Ogre::String &Backend);
+
+#endif  // BENCHUTILS_H_INCLUDED
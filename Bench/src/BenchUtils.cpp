@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <hydrocl/HydrOCLOpenCL.h>
+#include <hydrocl/HydrOCLCPU.h>
+#include <hydrocl/HydrOCLReference.h>
+
+#include <BenchUtils.h>
+
+using namespace Hydrax;
+using namespace Hydrax::Module;
+
+const char* LayoutNames[N_LAYOUTS] =
+{
+	"rows", "tiled", "soa", "tiled+soa"
+};
+
+void setLayout(HydrOCL::Options &Opt, int L)
+{
+	Opt.TiledLayout = (L == L_TILED) || (L == L_TILED_SOA);
+	Opt.SoALayout   = (L == L_SOA) || (L == L_TILED_SOA);
+}
+
+bool parseList(const char *str, std::vector<int> &list)
+{
+	list.clear();
+	const char *c = str;
+	while(*c) {
+		char *end;
+		long value = strtol(c, &end, 10);
+		if(end == c)
+			return false;
+		list.push_back((int)value);
+		c = end;
+		if(*c == ',')
+			c++;
+		else if(*c)
+			return false;
+	}
+	return !list.empty();
+}
+
+bool validBackend(const Ogre::String &Backend)
+{
+	return (Backend == "opencl") || (Backend == "cpu") || (Backend == "reference");
+}
+
+void cameraPath(float t, Ogre::Vector3 &Pos, Ogre::Vector3 &Dir)
+{
+	float a = 0.1f*t;
+	Pos = Ogre::Vector3(_def_PathRadius*cos(a), 10.f + 2.f*sin(0.7f*t), _def_PathRadius*sin(a));
+	float yaw = a + 0.5f*(float)M_PI + 0.2f*sin(0.3f*t);
+	Dir = Ogre::Vector3(cos(yaw), -0.3f, sin(yaw));
+	Dir.normalise();
+}
+
+void gridCorners(const Ogre::Vector3 &Pos, const Ogre::Vector3 &Dir, Ogre::Vector4 *Corners)
+{
+	unsigned int i;
+	Ogre::Vector3 f(Dir.x, 0.f, Dir.z);
+	f.normalise();
+	Ogre::Vector3 r(-f.z, 0.f, f.x);
+	const float u[4] = {-1.f, 1.f, -1.f, 1.f};
+	const float d[4] = {_def_NearDistance, _def_NearDistance, _def_FarDistance, _def_FarDistance};
+	for(i=0;i<4;i++) {
+		Ogre::Vector3 p = Ogre::Vector3(Pos.x, 0.f, Pos.z) + f*d[i] + r*(0.8f*u[i]*d[i]);
+		Corners[i] = Ogre::Vector4(p.x/d[i], 0.f, p.z/d[i], 1.f/d[i]);
+	}
+}
+
+void addWaves(Noise::HydrOCLNoise *noise, int nWaves)
+{
+	int i;
+	Ogre::Vector2 minDir=Ogre::Vector2(1.f,-0.2f), maxDir=Ogre::Vector2(1.f,0.2f);
+	float minA = 0.15f, maxA = 0.4f;
+	float minT = 7.0f, maxT = 10.f, varT = 1.f;
+	float varP = 2.f*M_PI;
+	for(i=0;i<nWaves;i++){
+		Ogre::Vector2 dir;
+		dir.x = Ogre::Math::RangeRandom(minDir.x, maxDir.x);
+		dir.y = Ogre::Math::RangeRandom(minDir.y, maxDir.y);
+		dir.normalise();
+		float A = Ogre::Math::RangeRandom(minA, maxA);
+		float factor = (maxA - A) / (maxA - minA);
+		float T = (1.f-factor)*minT + factor*maxT;
+		T = Ogre::Math::RangeRandom(T - 0.5f*varT, T + 0.5f*varT);
+		float P = Ogre::Math::RangeRandom(0.f, varP);
+		noise->addWave(Noise::HydrOCLNoise::Wave(dir,A,T,P));
+	}
+}
+
+HydrOCLBackend* newBackend(const Ogre::String &Backend)
+{
+	if(Backend == "cpu")
+		return new HydrOCLCPU();
+	if(Backend == "reference")
+		return new HydrOCLReference();
+	return new HydrOCLOpenCL();
+}
@@ -0,0 +1,702 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/** Headless HydrOCL benchmark. The projected grid backends are driven
+ * directly along a scripted camera path, without any window or rendering,
+ * sweeping the grid complexity, the number of waves, the Perlin noise
+ * octaves, the smoothing/choppy waves flags and the device vertexes
+ * layouts. For each combination the
+ * mean time of every stage, the mean and worst end-to-end frame time and
+ * the vertexes read back bandwidth are written as CSV or JSON.
+ *
+ * Each frame the noise is updated, the grid geometry regenerated, the
+ * heights computed and the vertexes read, i.e.- the work done by the
+ * module when the camera moves. The backend is waited after each stage,
+ * so the stage times don't overlap.
+ *
+ * When several layouts are swept, the smoothing, normals and choppy waves
+ * stencils times of each layout are compared with the rows one, i.e.- to
+ * measure the cache misses saved by the tiled layout on CPU devices
+ * (--device-type cpu).
+ *
+ * In the scaling mode the cost surface of the heights computation is
+ * mapped instead: the complexity is swept against the number of waves,
+ * and against the Perlin noise octaves. A frame cost model (see
+ * HydrOCLCost) is fitted to the results, the complexity where the frame
+ * time crosses the budget is reported for each number of waves, and the
+ * model is saved so the module can clamp the complexity and the waves to
+ * the budget.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <Ogre.h>
+
+#include <hydrocl/HydrOCLGrid.h>
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLBackend.h>
+#include <hydrocl/HydrOCLCost.h>
+
+#include <BenchUtils.h>
+
+using namespace Hydrax;
+using namespace Hydrax::Module;
+
+/// Timed stages
+enum Stage
+{
+	STAGE_UPDATE = 0,
+	STAGE_GEOMETRY,
+	STAGE_BASEPLANE,
+	STAGE_NOISE,
+	STAGE_SMOOTH,
+	STAGE_NORMALS,
+	STAGE_CHOPPY,
+	STAGE_READ,
+	N_STAGES
+};
+
+/// Stages names, used as columns
+static const char* StageNames[N_STAGES] =
+{
+	"update", "geometry", "basePlane", "noise", "smooth", "normals", "choppyWaves", "read"
+};
+
+/// Benchmark settings
+struct Settings
+{
+	/// Backend (opencl, cpu or reference)
+	Ogre::String Backend;
+	/// CPU backend threads
+	int CPUThreads;
+	/// Swept grid complexities
+	std::vector<int> Complexity;
+	/// Swept number of waves
+	std::vector<int> Waves;
+	/// Swept Perlin noise octaves
+	std::vector<int> Octaves;
+	/// Swept smoothing flags
+	std::vector<int> Smooth;
+	/// Swept choppy waves flags
+	std::vector<int> Choppy;
+	/// Swept device vertexes layouts (see Layout)
+	std::vector<int> Layouts;
+	/// OpenCL device type
+	cl_device_type DeviceType;
+	/// OpenCL platform or device name substring
+	Ogre::String Device;
+	/// Measured frames per combination
+	int Frames;
+	/// Frames computed before start measuring
+	int Warmup;
+	/// Output format (csv or json)
+	Ogre::String Format;
+	/// Output file (empty for the standard output)
+	Ogre::String Output;
+	/// Folder where the kernels can be found
+	Ogre::String Media;
+	/// Waves random seed
+	int Seed;
+	/// Benchmark mode (frames or scaling)
+	Ogre::String Mode;
+	/// Frame budget of the scaling mode [ms]
+	double Budget;
+	/// Cost models file written by the scaling mode
+	Ogre::String Model;
+
+	/** Default constructor
+	 */
+	Settings()
+		: Backend("opencl")
+		, CPUThreads(0)
+		, DeviceType(CL_DEVICE_TYPE_ALL)
+		, Device("")
+		, Frames(100)
+		, Warmup(10)
+		, Format("csv")
+		, Output("")
+		, Media("../Media/Hydrax")
+		, Seed(0)
+		, Mode("frames")
+		, Budget(4.0)
+		, Model("HydrOCLCost.cfg")
+	{
+	}
+};
+
+/// Results of a combination
+struct Result
+{
+	/// Grid complexity
+	int Complexity;
+	/// Number of waves
+	int Waves;
+	/// Perlin noise octaves
+	int Octaves;
+	/// Smoothing flag
+	bool Smooth;
+	/// Choppy waves flag
+	bool Choppy;
+	/// Device vertexes layout
+	int Layout;
+	/// Mean stages time [ms]
+	double Stage[N_STAGES];
+	/// Mean frame time [ms]
+	double Frame;
+	/// Worst frame time [ms]
+	double FrameMax;
+	/// Read back bandwidth [MB/s]
+	double ReadBandwidth;
+	/// Backend name
+	Ogre::String BackendName;
+	/// Device name
+	Ogre::String Device;
+};
+
+/** Print the usage help
+ */
+static void printHelp()
+{
+	printf("Usage: HydrOCLBench [options]\n");
+	printf("\t--mode frames|scaling (default frames)\n");
+	printf("\t--backend opencl|cpu|reference (default opencl)\n");
+	printf("\t--threads N          CPU backend threads (default 0, as many as processors)\n");
+	printf("\t--complexity LIST    Grid complexities (default 64,128,256,512,1024,2048)\n");
+	printf("\t--waves LIST         Number of waves (default 0,25, scaling 0,8,16,32,64)\n");
+	printf("\t--octaves LIST       Perlin noise octaves (default 8, scaling 8,2,4)\n");
+	printf("\t--smooth LIST        Smoothing flags (default 0,1)\n");
+	printf("\t--choppy LIST        Choppy waves flags (default 0,1)\n");
+	printf("\t--layouts LIST       Layouts, 0 rows, 1 tiled, 2 soa, 3 tiled+soa (default 0)\n");
+	printf("\t--device-type all|cpu|gpu  OpenCL device type (default all)\n");
+	printf("\t--device NAME        OpenCL platform or device name substring (default the best ranked)\n");
+	printf("\t--frames N           Measured frames per combination (default 100)\n");
+	printf("\t--warmup N           Unmeasured frames per combination (default 10)\n");
+	printf("\t--seed N             Waves random seed (default 0)\n");
+	printf("\t--media PATH         Hydrax resources folder (default ../Media/Hydrax)\n");
+	printf("\t--format csv|json    Output format (default csv)\n");
+	printf("\t--output FILE        Output file (default standard output)\n");
+	printf("\t--budget MS          Scaling mode frame budget (default 4)\n");
+	printf("\t--model FILE         Scaling mode cost models file (default HydrOCLCost.cfg)\n");
+	printf("LIST is a comma separated list of integers, i.e.- 256,512\n");
+	printf("The scaling mode sweeps the complexity against the waves (with the first\n");
+	printf("octaves value), and against the octaves (with the first waves value), with\n");
+	printf("the first smooth and choppy values. Copy the cost models file into the\n");
+	printf("Hydrax resources (i.e.- Media/Hydrax) to let the module fit PG_Budget.\n");
+	printf("The layouts only change the OpenCL backend. When several are swept, the\n");
+	printf("stencils times of each one are compared with the rows layout.\n");
+}
+
+/** Parse the command line arguments
+    @param argc Number of arguments
+	@param argv Arguments
+	@param S Output settings
+	@return false if the benchmark must not be executed
+ */
+static bool parseArguments(int argc, char *argv[], Settings &S)
+{
+	int i;
+	bool waves = false, octaves = false;
+	parseList("64,128,256,512,1024,2048", S.Complexity);
+	parseList("0,25", S.Waves);
+	parseList("8", S.Octaves);
+	parseList("0,1", S.Smooth);
+	parseList("0,1", S.Choppy);
+	parseList("0", S.Layouts);
+	Ogre::String deviceType = "all";
+	for(i=1;i<argc;i++) {
+		const char *key = argv[i];
+		if(!strcmp(key, "--help") || !strcmp(key, "-h")) {
+			printHelp();
+			return false;
+		}
+		if(i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", key);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if(!strcmp(key, "--mode"))            S.Mode = value;
+		else if(!strcmp(key, "--backend"))    S.Backend = value;
+		else if(!strcmp(key, "--threads"))    S.CPUThreads = atoi(value);
+		else if(!strcmp(key, "--complexity")) valid = parseList(value, S.Complexity);
+		else if(!strcmp(key, "--waves"))      valid = waves = parseList(value, S.Waves);
+		else if(!strcmp(key, "--octaves"))    valid = octaves = parseList(value, S.Octaves);
+		else if(!strcmp(key, "--smooth"))     valid = parseList(value, S.Smooth);
+		else if(!strcmp(key, "--choppy"))     valid = parseList(value, S.Choppy);
+		else if(!strcmp(key, "--layouts"))    valid = parseList(value, S.Layouts);
+		else if(!strcmp(key, "--device-type")) deviceType = value;
+		else if(!strcmp(key, "--device"))     S.Device = value;
+		else if(!strcmp(key, "--frames"))     S.Frames = atoi(value);
+		else if(!strcmp(key, "--warmup"))     S.Warmup = atoi(value);
+		else if(!strcmp(key, "--seed"))       S.Seed = atoi(value);
+		else if(!strcmp(key, "--media"))      S.Media = value;
+		else if(!strcmp(key, "--format"))     S.Format = value;
+		else if(!strcmp(key, "--output"))     S.Output = value;
+		else if(!strcmp(key, "--budget"))     S.Budget = atof(value);
+		else if(!strcmp(key, "--model"))      S.Model = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", key);
+			printHelp();
+			return false;
+		}
+		if(!valid) {
+			fprintf(stderr, "Invalid list for %s: %s\n", key, value);
+			return false;
+		}
+	}
+	if(!validBackend(S.Backend)) {
+		fprintf(stderr, "Unknown backend %s\n", S.Backend.c_str());
+		return false;
+	}
+	if(deviceType == "cpu")
+		S.DeviceType = CL_DEVICE_TYPE_CPU;
+	else if(deviceType == "gpu")
+		S.DeviceType = CL_DEVICE_TYPE_GPU;
+	else if(deviceType != "all") {
+		fprintf(stderr, "Unknown device type %s\n", deviceType.c_str());
+		return false;
+	}
+	for(i=0;i<(int)S.Layouts.size();i++) {
+		if((S.Layouts[i] < 0) || (S.Layouts[i] >= N_LAYOUTS)) {
+			fprintf(stderr, "Unknown layout %d\n", S.Layouts[i]);
+			return false;
+		}
+	}
+	if((S.Format != "csv") && (S.Format != "json")) {
+		fprintf(stderr, "Unknown format %s\n", S.Format.c_str());
+		return false;
+	}
+	if((S.Mode != "frames") && (S.Mode != "scaling")) {
+		fprintf(stderr, "Unknown mode %s\n", S.Mode.c_str());
+		return false;
+	}
+	if(S.Mode == "scaling") {
+		if(!waves)
+			parseList("0,8,16,32,64", S.Waves);
+		if(!octaves)
+			parseList("8,2,4", S.Octaves);
+	}
+	if(S.Frames < 1)
+		S.Frames = 1;
+	if(S.Warmup < 0)
+		S.Warmup = 0;
+	return true;
+}
+
+/** Benchmark a combination
+    @param S Benchmark settings
+	@param R Result, with the combination parameters already set
+	@return false if the backend can't be created or fails
+ */
+static bool bench(const Settings &S, Result &R)
+{
+	int i, frame;
+	HydrOCL::Options Opt;
+	Opt.Complexity  = R.Complexity;
+	Opt.Smooth      = R.Smooth;
+	Opt.ChoppyWaves = R.Choppy;
+	Opt.CPUThreads  = S.CPUThreads;
+	Opt.DeviceType  = S.DeviceType;
+	Opt.Device      = S.Device;
+	setLayout(Opt, R.Layout);
+
+	Noise::HydrOCLPerlin::Options NoiseOpt;
+	NoiseOpt.Octaves = R.Octaves;
+	Noise::HydrOCLNoise *noise = new Noise::HydrOCLNoise(NoiseOpt);
+	noise->create();
+	srand(S.Seed);
+	addWaves(noise, R.Waves);
+
+	HydrOCLBackend *backend = newBackend(S.Backend);
+	if(!backend->create(Opt, noise)) {
+		delete backend;
+		noise->remove();
+		delete noise;
+		return false;
+	}
+	R.BackendName = backend->getName();
+	R.Device = backend->getDeviceName();
+
+	Mesh::POS_NORM_VERTEX *Vertices = new Mesh::POS_NORM_VERTEX[R.Complexity*R.Complexity];
+	Ogre::Timer timer;
+	double t[N_STAGES];
+	for(i=0;i<N_STAGES;i++)
+		R.Stage[i] = 0.0;
+	R.Frame = 0.0;
+	R.FrameMax = 0.0;
+	bool ok = true;
+	for(frame=0;ok && (frame<S.Warmup+S.Frames);frame++) {
+		Ogre::Vector3 Pos, Dir;
+		Ogre::Vector4 Corners[4];
+		cameraPath(frame*_def_TimeStep, Pos, Dir);
+		gridCorners(Pos, Dir, Corners);
+
+		timer.reset();
+		noise->update(_def_TimeStep);
+		t[STAGE_UPDATE] = timer.getMicroseconds();
+		ok = ok && backend->geometry(Corners) && backend->finish();
+		t[STAGE_GEOMETRY] = timer.getMicroseconds();
+		ok = ok && backend->basePlane(0.f) && backend->finish();
+		t[STAGE_BASEPLANE] = timer.getMicroseconds();
+		ok = ok && backend->noise(Pos) && backend->finish();
+		t[STAGE_NOISE] = timer.getMicroseconds();
+		ok = ok && backend->smooth() && backend->finish();
+		t[STAGE_SMOOTH] = timer.getMicroseconds();
+		ok = ok && backend->normals() && backend->finish();
+		t[STAGE_NORMALS] = timer.getMicroseconds();
+		ok = ok && backend->choppyWaves(Dir, 1.f) && backend->finish();
+		t[STAGE_CHOPPY] = timer.getMicroseconds();
+		ok = ok && backend->read(Vertices);
+		t[STAGE_READ] = timer.getMicroseconds();
+
+		if(frame < S.Warmup)
+			continue;
+		for(i=N_STAGES-1;i>0;i--)
+			t[i] -= t[i-1];
+		double total = 0.0;
+		for(i=0;i<N_STAGES;i++) {
+			R.Stage[i] += 1e-3*t[i];
+			total += 1e-3*t[i];
+		}
+		R.Frame += total;
+		if(total > R.FrameMax)
+			R.FrameMax = total;
+	}
+	for(i=0;i<N_STAGES;i++)
+		R.Stage[i] /= S.Frames;
+	R.Frame /= S.Frames;
+	double bytes = (double)R.Complexity*R.Complexity*sizeof(Mesh::POS_NORM_VERTEX);
+	R.ReadBandwidth = R.Stage[STAGE_READ] > 0.0 ? 1e-3*bytes/R.Stage[STAGE_READ] : 0.0;
+
+	delete[] Vertices;
+	backend->remove();
+	delete backend;
+	noise->remove();
+	delete noise;
+	return ok;
+}
+
+/** Write the results as CSV
+    @param f Output file
+	@param S Benchmark settings
+	@param Results Results
+ */
+static void writeCSV(FILE *f, const Settings &S, const std::vector<Result> &Results)
+{
+	unsigned int i, j;
+	fprintf(f, "backend,complexity,waves,octaves,smooth,choppy,layout,frames");
+	for(j=0;j<N_STAGES;j++)
+		fprintf(f, ",%s_ms", StageNames[j]);
+	fprintf(f, ",frame_ms,frame_max_ms,read_MBs\n");
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		fprintf(f, "%s,%d,%d,%d,%d,%d,%s,%d", S.Backend.c_str(), R.Complexity, R.Waves,
+		        R.Octaves, R.Smooth ? 1 : 0, R.Choppy ? 1 : 0, LayoutNames[R.Layout], S.Frames);
+		for(j=0;j<N_STAGES;j++)
+			fprintf(f, ",%.4f", R.Stage[j]);
+		fprintf(f, ",%.4f,%.4f,%.1f\n", R.Frame, R.FrameMax, R.ReadBandwidth);
+	}
+}
+
+/** Write the results as JSON
+    @param f Output file
+	@param S Benchmark settings
+	@param Results Results
+ */
+static void writeJSON(FILE *f, const Settings &S, const std::vector<Result> &Results)
+{
+	unsigned int i, j;
+	fprintf(f, "{\n  \"backend\": \"%s\",\n  \"frames\": %d,\n  \"results\": [\n",
+	        S.Backend.c_str(), S.Frames);
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		fprintf(f, "    {\"complexity\": %d, \"waves\": %d, \"octaves\": %d, "
+		           "\"smooth\": %s, \"choppy\": %s, \"layout\": \"%s\", \"stages_ms\": {",
+		        R.Complexity, R.Waves, R.Octaves,
+		        R.Smooth ? "true" : "false", R.Choppy ? "true" : "false", LayoutNames[R.Layout]);
+		for(j=0;j<N_STAGES;j++)
+			fprintf(f, "%s\"%s\": %.4f", j ? ", " : "", StageNames[j], R.Stage[j]);
+		fprintf(f, "}, \"frame_ms\": %.4f, \"frame_max_ms\": %.4f, \"read_MBs\": %.1f}%s\n",
+		        R.Frame, R.FrameMax, R.ReadBandwidth, (i + 1 < Results.size()) ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+/** Fit the frame cost model to the results, by least squares of the
+ * relative error (so the small grids, which are the ones clamped to the
+ * budget, are fitted as well as the large ones)
+    @param Results Results
+	@param Cost Output cost model
+	@return Root mean square relative error
+ */
+static double fitCost(const std::vector<Result> &Results, HydrOCLCost &Cost)
+{
+	unsigned int i, j, k, n = 4;
+	double A[4][4], x[4], b[4], scale[4];
+	std::vector<double> row(n);
+	for(j=0;j<n;j++) {
+		scale[j] = 0.0;
+		b[j] = 0.0;
+		for(k=0;k<n;k++)
+			A[j][k] = 0.0;
+	}
+	// Features: 1, V, V*Waves, V*Octaves
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		double V = (double)R.Complexity*R.Complexity;
+		double f[4] = {1.0, V, V*R.Waves, V*R.Octaves};
+		for(j=0;j<n;j++)
+			scale[j] = std::max(scale[j], f[j]);
+	}
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		if(R.Frame <= 0.0)
+			continue;
+		double V = (double)R.Complexity*R.Complexity;
+		double f[4] = {1.0, V, V*R.Waves, V*R.Octaves};
+		for(j=0;j<n;j++)
+			row[j] = scale[j] > 0.0 ? f[j] / scale[j] / R.Frame : 0.0;
+		for(j=0;j<n;j++) {
+			for(k=0;k<n;k++)
+				A[j][k] += row[j]*row[k];
+			b[j] += row[j];
+		}
+	}
+	// Gaussian elimination with partial pivoting. The features which
+	// can't be resolved (i.e.- a single octaves value, so V*Octaves is
+	// proportional to V) get a null coefficient.
+	bool used[4] = {true, true, true, true};
+	for(j=0;j<n;j++) {
+		unsigned int p = j;
+		for(k=j+1;k<n;k++) {
+			if(fabs(A[k][j]) > fabs(A[p][j]))
+				p = k;
+		}
+		if(fabs(A[p][j]) < 1e-9) {
+			used[j] = false;
+			continue;
+		}
+		for(k=0;k<n;k++)
+			std::swap(A[j][k], A[p][k]);
+		std::swap(b[j], b[p]);
+		for(k=j+1;k<n;k++) {
+			double m = A[k][j] / A[j][j];
+			unsigned int l;
+			for(l=j;l<n;l++)
+				A[k][l] -= m*A[j][l];
+			b[k] -= m*b[j];
+		}
+	}
+	for(j=n;j-->0;) {
+		x[j] = 0.0;
+		if(!used[j])
+			continue;
+		double s = b[j];
+		for(k=j+1;k<n;k++)
+			s -= A[j][k]*x[k];
+		x[j] = s / A[j][j];
+	}
+	for(j=0;j<n;j++)
+		x[j] = scale[j] > 0.0 ? x[j] / scale[j] : 0.0;
+	// Negative per vertex costs are just noise, and would let the budget
+	// grow the grid without bounds
+	Cost.Constant     = (float)x[0];
+	Cost.Vertex       = (float)std::max(x[1], 0.0);
+	Cost.VertexWave   = (float)std::max(x[2], 0.0);
+	Cost.VertexOctave = (float)std::max(x[3], 0.0);
+
+	double error = 0.0;
+	unsigned int samples = 0;
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		if(R.Frame <= 0.0)
+			continue;
+		double e = (Cost.time(R.Complexity, R.Waves, R.Octaves) - R.Frame) / R.Frame;
+		error += e*e;
+		samples++;
+	}
+	return samples ? sqrt(error / samples) : 0.0;
+}
+
+/** Fit the cost model, report where the frame time crosses the budget
+ * and save the model
+    @param S Benchmark settings
+	@param Results Scaling study results
+	@return false if the model can't be fitted or saved
+ */
+static bool scaling(const Settings &S, const std::vector<Result> &Results)
+{
+	unsigned int i, j;
+	char line[256];
+	if(Results.size() < 4) {
+		fprintf(stderr, "Too few results to fit the cost model\n");
+		return false;
+	}
+	HydrOCLCost Cost;
+	double error = fitCost(Results, Cost);
+	Ogre::String Section = HydrOCLCost::getSection(Results[0].BackendName, Results[0].Device);
+	std::vector<Ogre::String> Comment;
+	snprintf(line, sizeof(line), "Fitted to %u results, rms relative error %.1f%%",
+	         (unsigned int)Results.size(), 100.0*error);
+	Comment.push_back(line);
+	fprintf(stderr, "\n%s\n", Section.c_str());
+	fprintf(stderr, "t[ms] = %g + V*(%g + Waves*%g + Octaves*%g), V = Complexity^2\n",
+	        Cost.Constant, Cost.Vertex, Cost.VertexWave, Cost.VertexOctave);
+	fprintf(stderr, "%s\n", Comment[0].c_str());
+	// Budget crossing for each number of waves, modelled and measured
+	int octaves = S.Octaves[0];
+	fprintf(stderr, "%.2f ms budget (octaves=%d):\n", S.Budget, octaves);
+	fprintf(stderr, "\twaves\tmodel complexity\tmeasured complexity\n");
+	for(i=0;i<S.Waves.size();i++) {
+		int model = Cost.maxComplexity((float)S.Budget, S.Waves[i], octaves);
+		int measured = 0;
+		for(j=0;j<Results.size();j++) {
+			const Result &R = Results[j];
+			if((R.Waves == S.Waves[i]) && (R.Octaves == octaves) &&
+			   (R.Frame <= S.Budget) && (R.Complexity > measured))
+				measured = R.Complexity;
+		}
+		if(model < 0)
+			snprintf(line, sizeof(line), "waves=%d: any complexity", S.Waves[i]);
+		else
+			snprintf(line, sizeof(line), "waves=%d: complexity %d", S.Waves[i], model);
+		Comment.push_back(Ogre::String(line) + " fits " + Ogre::StringConverter::toString((float)S.Budget) + " ms");
+		fprintf(stderr, "\t%d\t%d\t\t\t%d\n", S.Waves[i], model, measured);
+	}
+	if(!Cost.save(S.Model, Section, Comment)) {
+		fprintf(stderr, "Can't write %s\n", S.Model.c_str());
+		return false;
+	}
+	fprintf(stderr, "Cost model written into %s\n", S.Model.c_str());
+	return true;
+}
+
+/** Compare the stencils times of each layout with the rows layout ones
+    @param Results Results
+ */
+static void layouts(const std::vector<Result> &Results)
+{
+	unsigned int i, j, k;
+	const Stage Stencils[3] = {STAGE_SMOOTH, STAGE_NORMALS, STAGE_CHOPPY};
+	fprintf(stderr, "\nStencils speedup against the rows layout (%s):\n",
+	        Results[0].Device.c_str());
+	fprintf(stderr, "\tcomplexity\twaves\toctaves\tsmooth\tchoppy\tlayout\t\tsmooth\tnormals\tchoppyWaves\n");
+	for(i=0;i<Results.size();i++) {
+		const Result &R = Results[i];
+		if(R.Layout == L_ROWS)
+			continue;
+		for(j=0;j<Results.size();j++) {
+			const Result &B = Results[j];
+			if((B.Layout == L_ROWS) && (B.Complexity == R.Complexity) &&
+			   (B.Waves == R.Waves) && (B.Octaves == R.Octaves) &&
+			   (B.Smooth == R.Smooth) && (B.Choppy == R.Choppy))
+				break;
+		}
+		if(j == Results.size())
+			continue;
+		fprintf(stderr, "\t%d\t\t%d\t%d\t%d\t%d\t%-9s", R.Complexity, R.Waves, R.Octaves,
+		        R.Smooth ? 1 : 0, R.Choppy ? 1 : 0, LayoutNames[R.Layout]);
+		for(k=0;k<3;k++) {
+			double t = R.Stage[Stencils[k]], t0 = Results[j].Stage[Stencils[k]];
+			if(t > 0.0)
+				fprintf(stderr, "\t%.2fx", t0 / t);
+			else
+				fprintf(stderr, "\t-");
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int a, b, c, d, e, l;
+	Settings S;
+	if(!parseArguments(argc, argv, S))
+		return 1;
+
+	// Ogre is only needed for the log and to locate the kernels
+	Ogre::Root *root = new Ogre::Root("", "", "HydrOCLBench.log");
+	Ogre::ResourceGroupManager::getSingleton().addResourceLocation(S.Media, "FileSystem", HYDRAX_RESOURCE_GROUP);
+	Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup(HYDRAX_RESOURCE_GROUP);
+
+	// Combinations to benchmark. The scaling study sweeps the complexity
+	// against the waves, and against the octaves, but not all together.
+	std::vector<Result> Combinations;
+	bool scalingMode = S.Mode == "scaling";
+	for(a=0;a<S.Complexity.size();a++) {
+	for(b=0;b<S.Waves.size();b++) {
+	for(c=0;c<S.Octaves.size();c++) {
+	for(d=0;d<S.Smooth.size();d++) {
+	for(e=0;e<S.Choppy.size();e++) {
+	for(l=0;l<S.Layouts.size();l++) {
+		if(scalingMode && ((b && c) || d || e || l))
+			continue;
+		Result R;
+		R.Complexity = S.Complexity[a];
+		R.Waves      = S.Waves[b];
+		R.Octaves    = S.Octaves[c];
+		R.Smooth     = S.Smooth[d] != 0;
+		R.Choppy     = S.Choppy[e] != 0;
+		R.Layout     = S.Layouts[l];
+		Combinations.push_back(R);
+	}}}}}}
+
+	std::vector<Result> Results;
+	for(a=0;a<Combinations.size();a++) {
+		Result R = Combinations[a];
+		fprintf(stderr, "complexity=%d waves=%d octaves=%d smooth=%d choppy=%d layout=%s... ",
+		        R.Complexity, R.Waves, R.Octaves, R.Smooth ? 1 : 0, R.Choppy ? 1 : 0, LayoutNames[R.Layout]);
+		if(!bench(S, R)) {
+			fprintf(stderr, "FAIL (see HydrOCLBench.log)\n");
+			continue;
+		}
+		fprintf(stderr, "%.3f ms/frame\n", R.Frame);
+		Results.push_back(R);
+	}
+
+	FILE *f = stdout;
+	if(!S.Output.empty()) {
+		f = fopen(S.Output.c_str(), "w");
+		if(!f) {
+			fprintf(stderr, "Can't open %s\n", S.Output.c_str());
+			delete root;
+			return 1;
+		}
+	}
+	if(S.Format == "json")
+		writeJSON(f, S, Results);
+	else
+		writeCSV(f, S, Results);
+	if(f != stdout)
+		fclose(f);
+
+	bool ok = !Results.empty();
+	if(ok && !scalingMode && (S.Layouts.size() > 1))
+		layouts(Results);
+	if(ok && scalingMode)
+		ok = scaling(S, Results);
+	delete root;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/** HydrOCL host microbenchmarks. Each case times a host function that
+ * runs every frame (or at startup, initNoise) in a tight loop:
+ *  - initNoise: Perlin noise tables generation (create()).
+ *  - calculeNoise: Perlin noise octaves animation (update()).
+ *  - mapSample: Perlin noise octaves packing sample.
+ *  - getHeigthDual: Perlin noise height at a point.
+ *  - getValue: Perlin noise and waves height at a point.
+ *  - isModified: Waves modification check (each frame).
+ *  - repack, repackTiled, repackSoA: Device vertexes copy into the
+ *    Ogre vertex buffer, for each device layout.
+ * The number of iterations is calibrated, and each case is repeated
+ * several times, reporting the median and best time per operation as
+ * CSV. The results can be compared against a baseline CSV, generated
+ * with this same tool, failing if any case has regressed.
+ *
+ * HydrOCL::_getMinMax and HydrOCL::_calculeWorldPosition are not covered,
+ * since they require the rendering cameras, i.e.- a render system. They
+ * are traced as host spans (see HydrOCL::startTrace).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <Ogre.h>
+
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+#include <BenchUtils.h>
+
+using namespace Hydrax;
+
+/// Random sample points used by the point wise cases
+#define _def_Points 4096
+
+/// Microbenchmark settings
+struct Settings
+{
+	/// Substring that the cases name must contain (empty for all)
+	Ogre::String Filter;
+	/// Grid complexity of the repacking cases
+	int Complexity;
+	/// Number of waves
+	int Waves;
+	/// Time spent in each case [s]
+	float MinTime;
+	/// Repetitions of each case
+	int Repeats;
+	/// Baseline CSV file (empty to don't compare)
+	Ogre::String Baseline;
+	/// Allowed regression over the baseline [%]
+	float Tolerance;
+	/// Output file (empty for the standard output)
+	Ogre::String Output;
+
+	/** Default constructor
+	 */
+	Settings()
+		: Filter("")
+		, Complexity(512)
+		, Waves(25)
+		, MinTime(1.f)
+		, Repeats(5)
+		, Baseline("")
+		, Tolerance(10.f)
+		, Output("")
+	{
+	}
+};
+
+/// Case results
+struct Result
+{
+	/// Case name
+	Ogre::String Name;
+	/// Iterations of each repetition
+	unsigned long Iterations;
+	/// Median time per operation [ns]
+	double Median;
+	/// Best time per operation [ns]
+	double Best;
+};
+
+/** Noise module that exposes the protected hot paths
+ */
+class NoiseProbe : public Noise::HydrOCLNoise
+{
+public:
+	NoiseProbe(const Hydrax::Noise::HydrOCLPerlin::Options &Options) : Hydrax::Noise::HydrOCLNoise(Options) {}
+	void initNoise() {_initNoise();}
+	void calculeNoise() {_calculeNoise();}
+	int mapSample(int u, int v) {return _mapSample(u, v, 3, 0);}
+	float getHeigthDual(float u, float v) {return _getHeigthDual(u, v);}
+	bool modified() {return isModified();}
+};
+
+/// Benchmarked noise module
+static NoiseProbe *gNoise = NULL;
+/// Sample points
+static float gU[_def_Points], gV[_def_Points];
+/// Repacking input buffers
+static cl_float4 *gPos = NULL, *gNor = NULL;
+/// Repacking output buffer
+static Mesh::POS_NORM_VERTEX *gVertices = NULL;
+/// Repacked grid complexity
+static unsigned int gN = 0;
+/// Results sink, so the compiler can't discard the work
+static volatile float gSink = 0.f;
+
+static void caseInitNoise(unsigned long n)
+{
+	unsigned long i;
+	for(i=0;i<n;i++)
+		gNoise->initNoise();
+}
+
+static void caseCalculeNoise(unsigned long n)
+{
+	unsigned long i;
+	for(i=0;i<n;i++)
+		gNoise->calculeNoise();
+}
+
+static void caseMapSample(unsigned long n)
+{
+	unsigned long i;
+	int s = 0;
+	for(i=0;i<n;i++)
+		s += gNoise->mapSample(i & np_size_m1, (i >> (np_bits-1)) & np_size_m1);
+	gSink = (float)s;
+}
+
+static void caseGetHeigthDual(unsigned long n)
+{
+	unsigned long i;
+	float s = 0.f;
+	for(i=0;i<n;i++)
+		s += gNoise->getHeigthDual(gU[i % _def_Points], gV[i % _def_Points]);
+	gSink = s;
+}
+
+static void caseGetValue(unsigned long n)
+{
+	unsigned long i;
+	float s = 0.f;
+	for(i=0;i<n;i++)
+		s += gNoise->getValue(gU[i % _def_Points], gV[i % _def_Points]);
+	gSink = s;
+}
+
+static void caseIsModified(unsigned long n)
+{
+	unsigned long i;
+	int s = 0;
+	for(i=0;i<n;i++)
+		s += gNoise->modified() ? 1 : 0;
+	gSink = (float)s;
+}
+
+/** Repack the grid with the given device layout
+    @param n Iterations
+	@param Tiled 8x8 blocks layout
+	@param SoA Planes layout
+ */
+static void repack(unsigned long n, bool Tiled, bool SoA)
+{
+	unsigned long i;
+	cl_uint2 BufferN;
+	BufferN.x = Tiled ? roundUp(gN, 8) : gN;
+	BufferN.y = BufferN.x;
+	for(i=0;i<n;i++)
+		repackVertexes(gPos, gNor, gN, BufferN, Tiled, SoA, gVertices);
+	gSink = gVertices[gN*gN/2].y;
+}
+
+static void caseRepack(unsigned long n)      {repack(n, false, false);}
+static void caseRepackTiled(unsigned long n) {repack(n, true,  false);}
+static void caseRepackSoA(unsigned long n)   {repack(n, false, true);}
+
+/// Benchmark case
+struct Case
+{
+	/// Case name
+	const char *Name;
+	/// Function that runs the given number of iterations
+	void (*Run)(unsigned long);
+};
+
+/// Benchmark cases
+static const Case Cases[] =
+{
+	{"initNoise",     caseInitNoise},
+	{"calculeNoise",  caseCalculeNoise},
+	{"mapSample",     caseMapSample},
+	{"getHeigthDual", caseGetHeigthDual},
+	{"getValue",      caseGetValue},
+	{"isModified",    caseIsModified},
+	{"repack",        caseRepack},
+	{"repackTiled",   caseRepackTiled},
+	{"repackSoA",     caseRepackSoA}
+};
+
+/** Print the usage help
+ */
+static void printHelp()
+{
+	printf("Usage: HydrOCLMicro [options]\n");
+	printf("\t--filter NAME        Only run the cases whose name contains NAME\n");
+	printf("\t--complexity N       Grid complexity of the repacking cases (default 512)\n");
+	printf("\t--waves N            Number of waves (default 25)\n");
+	printf("\t--time S             Time spent in each case in seconds (default 1)\n");
+	printf("\t--repeats N          Repetitions of each case (default 5)\n");
+	printf("\t--baseline FILE      Compare against a CSV generated by this tool\n");
+	printf("\t--tolerance P        Allowed regression in percent (default 10)\n");
+	printf("\t--output FILE        Output CSV file (default standard output)\n");
+}
+
+/** Parse the command line arguments
+    @param argc Number of arguments
+	@param argv Arguments
+	@param S Output settings
+	@return false if the benchmarks must not be executed
+ */
+static bool parseArguments(int argc, char *argv[], Settings &S)
+{
+	int i;
+	for(i=1;i<argc;i++) {
+		const char *key = argv[i];
+		if(!strcmp(key, "--help") || !strcmp(key, "-h")) {
+			printHelp();
+			return false;
+		}
+		if(i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", key);
+			return false;
+		}
+		const char *value = argv[++i];
+		if(!strcmp(key, "--filter"))          S.Filter = value;
+		else if(!strcmp(key, "--complexity")) S.Complexity = atoi(value);
+		else if(!strcmp(key, "--waves"))      S.Waves = atoi(value);
+		else if(!strcmp(key, "--time"))       S.MinTime = (float)atof(value);
+		else if(!strcmp(key, "--repeats"))    S.Repeats = atoi(value);
+		else if(!strcmp(key, "--baseline"))   S.Baseline = value;
+		else if(!strcmp(key, "--tolerance"))  S.Tolerance = (float)atof(value);
+		else if(!strcmp(key, "--output"))     S.Output = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", key);
+			printHelp();
+			return false;
+		}
+	}
+	if(S.Complexity < 8)
+		S.Complexity = 8;
+	if(S.Waves < 0)
+		S.Waves = 0;
+	if(S.Repeats < 1)
+		S.Repeats = 1;
+	return true;
+}
+
+/** Time a case
+    @param C Case
+	@param n Iterations
+	@return Elapsed time [us]
+ */
+static double timeCase(const Case &C, unsigned long n)
+{
+	Ogre::Timer timer;
+	timer.reset();
+	C.Run(n);
+	return (double)timer.getMicroseconds();
+}
+
+/** Run a case, calibrating the iterations so each repetition lasts
+    MinTime / Repeats
+    @param S Settings
+	@param C Case
+	@return Results
+ */
+static Result runCase(const Settings &S, const Case &C)
+{
+	int i;
+	Result R;
+	R.Name = C.Name;
+	double target = 1e6*S.MinTime / S.Repeats;
+	unsigned long n = 1;
+	double t = timeCase(C, n);
+	while(t < 0.1*target) {
+		n *= 2;
+		t = timeCase(C, n);
+	}
+	n = (unsigned long)(n*target/t) + 1;
+	std::vector<double> ns;
+	for(i=0;i<S.Repeats;i++)
+		ns.push_back(1e3*timeCase(C, n) / n);
+	std::sort(ns.begin(), ns.end());
+	R.Iterations = n;
+	R.Median = ns[ns.size() / 2];
+	R.Best = ns[0];
+	return R;
+}
+
+/** Read a baseline CSV
+    @param File Baseline file
+	@param Baseline Output median times, by case name
+	@return false if the file can't be read
+ */
+static bool readBaseline(const Ogre::String &File, std::map<Ogre::String, double> &Baseline)
+{
+	char line[256], name[128];
+	unsigned long n;
+	double median, best;
+	FILE *f = fopen(File.c_str(), "r");
+	if(!f)
+		return false;
+	while(fgets(line, sizeof(line), f)) {
+		if(sscanf(line, "%127[^,],%lu,%lf,%lf", name, &n, &median, &best) == 4)
+			Baseline[name] = median;
+	}
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	Settings S;
+	if(!parseArguments(argc, argv, S))
+		return 1;
+
+	std::map<Ogre::String, double> Baseline;
+	if(!S.Baseline.empty() && !readBaseline(S.Baseline, Baseline)) {
+		fprintf(stderr, "Can't read %s\n", S.Baseline.c_str());
+		return 1;
+	}
+
+	// Ogre is only needed for the log
+	Ogre::Root *root = new Ogre::Root("", "", "HydrOCLMicro.log");
+
+	// Fixture
+	srand(0);
+	gNoise = new NoiseProbe(Noise::HydrOCLPerlin::Options());
+	gNoise->create();
+	addWaves(gNoise, S.Waves);
+	gNoise->update(_def_TimeStep);
+	for(i=0;i<_def_Points;i++) {
+		gU[i] = Ogre::Math::RangeRandom(-1000.f, 1000.f);
+		gV[i] = Ogre::Math::RangeRandom(-1000.f, 1000.f);
+	}
+	gN = (unsigned int)S.Complexity;
+	unsigned int size = roundUp(gN, 8)*roundUp(gN, 8);
+	gPos = new cl_float4[size];
+	gNor = new cl_float4[size];
+	for(i=0;i<size;i++) {
+		gPos[i].s[0] = (float)i; gPos[i].s[1] = 0.f;  gPos[i].s[2] = (float)i; gPos[i].s[3] = 1.f;
+		gNor[i].s[0] = 0.f;      gNor[i].s[1] = -1.f; gNor[i].s[2] = 0.f;      gNor[i].s[3] = 0.f;
+	}
+	gVertices = new Mesh::POS_NORM_VERTEX[gN*gN];
+
+	std::vector<Result> Results;
+	for(i=0;i<sizeof(Cases)/sizeof(Case);i++) {
+		if(!S.Filter.empty() && !strstr(Cases[i].Name, S.Filter.c_str()))
+			continue;
+		Result R = runCase(S, Cases[i]);
+		fprintf(stderr, "%-16s %12.1f ns/op\n", R.Name.c_str(), R.Median);
+		Results.push_back(R);
+	}
+
+	delete[] gPos; gPos=NULL;
+	delete[] gNor; gNor=NULL;
+	delete[] gVertices; gVertices=NULL;
+	gNoise->remove();
+	delete gNoise; gNoise=NULL;
+	delete root;
+
+	FILE *f = stdout;
+	if(!S.Output.empty()) {
+		f = fopen(S.Output.c_str(), "w");
+		if(!f) {
+			fprintf(stderr, "Can't open %s\n", S.Output.c_str());
+			return 1;
+		}
+	}
+	fprintf(f, "case,iterations,median_ns,best_ns\n");
+	for(i=0;i<Results.size();i++)
+		fprintf(f, "%s,%lu,%.2f,%.2f\n", Results[i].Name.c_str(), Results[i].Iterations,
+		        Results[i].Median, Results[i].Best);
+	if(f != stdout)
+		fclose(f);
+
+	// Compare against the baseline
+	bool regression = false;
+	for(i=0;i<Results.size();i++) {
+		std::map<Ogre::String, double>::const_iterator it = Baseline.find(Results[i].Name);
+		if(it == Baseline.end())
+			continue;
+		double change = 100.0*(Results[i].Median / it->second - 1.0);
+		if(change > S.Tolerance) {
+			fprintf(stderr, "REGRESSION: %s %.1f ns/op -> %.1f ns/op (%+.1f%%)\n",
+			        Results[i].Name.c_str(), it->second, Results[i].Median, change);
+			regression = true;
+		}
+	}
+	return regression ? 1 : 0;
+}
@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/** HydrOCL soak test. The headless pipeline of the benchmark runs for a
+ * long time (an hour by default) while the options and the waves are
+ * randomly churned: the backend is created again with another complexity
+ * (as HydrOCL::setOptions does), the smoothing and choppy waves flags are
+ * toggled, waves are added and removed, and the noise module is removed
+ * and created again.
+ *
+ * The time is split in epochs. For each epoch the frame time p50, p99,
+ * p99.9 and worst values, the host resident memory and the backend
+ * allocated memory are written as CSV. The first epoch after the warmup
+ * is the baseline, and the test fails (exit code 1) as soon as an epoch
+ * p50 or p99 frame time drifts above it more than the allowed tolerance,
+ * the resident memory grows more than the allowed amount, the backend
+ * allocated memory for a given complexity changes, or any stage fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <Ogre.h>
+
+#include <hydrocl/HydrOCLGrid.h>
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLBackend.h>
+
+#include <BenchUtils.h>
+
+using namespace Hydrax;
+using namespace Hydrax::Module;
+
+/// Frames after a rebuild that are not measured (caches, lazy driver work)
+#define _def_SettleFrames 5
+
+/// Soak test settings
+struct Settings
+{
+	/// Backend (opencl, cpu or reference)
+	Ogre::String Backend;
+	/// CPU backend threads
+	int CPUThreads;
+	/// Test duration [s]
+	int Duration;
+	/// Epoch duration [s]
+	int Epoch;
+	/// Time before the baseline epoch [s]
+	int Warmup;
+	/// Frames between churn events
+	int Churn;
+	/// Randomly selected grid complexities
+	std::vector<int> Complexity;
+	/// Randomly selected Perlin noise octaves
+	std::vector<int> Octaves;
+	/// Maximum number of waves
+	int MaxWaves;
+	/// Allowed p50/p99 drift over the baseline [%]
+	float MaxDrift;
+	/// Allowed resident memory growth over the baseline [MB]
+	float MaxRSSGrowth;
+	/// Output file (empty for the standard output)
+	Ogre::String Output;
+	/// Folder where the kernels can be found
+	Ogre::String Media;
+	/// Random seed
+	int Seed;
+
+	/** Default constructor
+	 */
+	Settings()
+		: Backend("opencl")
+		, CPUThreads(0)
+		, Duration(3600)
+		, Epoch(60)
+		, Warmup(30)
+		, Churn(300)
+		, MaxWaves(50)
+		, MaxDrift(25.f)
+		, MaxRSSGrowth(16.f)
+		, Output("")
+		, Media("../Media/Hydrax")
+		, Seed(0)
+	{
+	}
+};
+
+/// Epoch results
+struct EpochStats
+{
+	/// Measured frames
+	unsigned int Frames;
+	/// Churn events
+	unsigned int Churns;
+	/// Median frame time [ms]
+	float P50;
+	/// 99th percentile frame time [ms]
+	float P99;
+	/// 99.9th percentile frame time [ms]
+	float P999;
+	/// Worst frame time [ms]
+	float Max;
+	/// Worst host resident memory [MB]
+	float RSS;
+	/// Backend allocated memory at the end of the epoch [MB]
+	float Device;
+};
+
+/// Pipeline under test
+struct Pipeline
+{
+	/// Projected grid options
+	HydrOCL::Options Opt;
+	/// Noise options
+	Noise::HydrOCLPerlin::Options NoiseOpt;
+	/// Noise module
+	Noise::HydrOCLNoise *noise;
+	/// Backend
+	HydrOCLBackend *backend;
+	/// Vertexes read back
+	Mesh::POS_NORM_VERTEX *Vertices;
+};
+
+/** Print the usage help
+ */
+static void printHelp()
+{
+	printf("Usage: HydrOCLSoak [options]\n");
+	printf("\t--backend opencl|cpu|reference (default opencl)\n");
+	printf("\t--threads N          CPU backend threads (default 0, as many as processors)\n");
+	printf("\t--duration S         Test duration in seconds (default 3600)\n");
+	printf("\t--epoch S            Epoch duration in seconds (default 60)\n");
+	printf("\t--warmup S           Seconds before the baseline epoch (default 30)\n");
+	printf("\t--churn N            Frames between churn events (default 300)\n");
+	printf("\t--complexity LIST    Grid complexities (default 64,128,256,512)\n");
+	printf("\t--octaves LIST       Perlin noise octaves (default 4,8)\n");
+	printf("\t--waves N            Maximum number of waves (default 50)\n");
+	printf("\t--max-drift P        Allowed p50/p99 drift in percent (default 25)\n");
+	printf("\t--max-rss-growth MB  Allowed resident memory growth (default 16)\n");
+	printf("\t--seed N             Random seed (default 0)\n");
+	printf("\t--media PATH         Hydrax resources folder (default ../Media/Hydrax)\n");
+	printf("\t--output FILE        Epochs CSV file (default standard output)\n");
+	printf("LIST is a comma separated list of integers, i.e.- 256,512\n");
+}
+
+/** Parse the command line arguments
+    @param argc Number of arguments
+	@param argv Arguments
+	@param S Output settings
+	@return false if the test must not be executed
+ */
+static bool parseArguments(int argc, char *argv[], Settings &S)
+{
+	int i;
+	parseList("64,128,256,512", S.Complexity);
+	parseList("4,8", S.Octaves);
+	for(i=1;i<argc;i++) {
+		const char *key = argv[i];
+		if(!strcmp(key, "--help") || !strcmp(key, "-h")) {
+			printHelp();
+			return false;
+		}
+		if(i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", key);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if(!strcmp(key, "--backend"))             S.Backend = value;
+		else if(!strcmp(key, "--threads"))        S.CPUThreads = atoi(value);
+		else if(!strcmp(key, "--duration"))       S.Duration = atoi(value);
+		else if(!strcmp(key, "--epoch"))          S.Epoch = atoi(value);
+		else if(!strcmp(key, "--warmup"))         S.Warmup = atoi(value);
+		else if(!strcmp(key, "--churn"))          S.Churn = atoi(value);
+		else if(!strcmp(key, "--complexity"))     valid = parseList(value, S.Complexity);
+		else if(!strcmp(key, "--octaves"))        valid = parseList(value, S.Octaves);
+		else if(!strcmp(key, "--waves"))          S.MaxWaves = atoi(value);
+		else if(!strcmp(key, "--max-drift"))      S.MaxDrift = (float)atof(value);
+		else if(!strcmp(key, "--max-rss-growth")) S.MaxRSSGrowth = (float)atof(value);
+		else if(!strcmp(key, "--seed"))           S.Seed = atoi(value);
+		else if(!strcmp(key, "--media"))          S.Media = value;
+		else if(!strcmp(key, "--output"))         S.Output = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", key);
+			printHelp();
+			return false;
+		}
+		if(!valid) {
+			fprintf(stderr, "Invalid list for %s: %s\n", key, value);
+			return false;
+		}
+	}
+	if(!validBackend(S.Backend)) {
+		fprintf(stderr, "Unknown backend %s\n", S.Backend.c_str());
+		return false;
+	}
+	if(S.Epoch < 1)
+		S.Epoch = 1;
+	if(S.Duration < S.Warmup + 2*S.Epoch) {
+		fprintf(stderr, "The duration must hold the warmup and two epochs at least\n");
+		return false;
+	}
+	if(S.Churn < 1)
+		S.Churn = 1;
+	if(S.MaxWaves < 0)
+		S.MaxWaves = 0;
+	return true;
+}
+
+/** Host resident memory
+    @return Resident memory [MB], 0 if it can't be read
+ */
+static float residentMemory()
+{
+	long pages=0, resident=0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if(!f)
+		return 0.f;
+	if(fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * (float)sysconf(_SC_PAGESIZE) / (1024.f*1024.f);
+}
+
+/** Random item of a list
+    @param list List
+	@return Selected item
+ */
+static int randomItem(const std::vector<int> &list)
+{
+	return list[rand() % list.size()];
+}
+
+/** Percentile of a sorted set of samples
+    @param v Sorted samples
+	@param q Percentile, between 0 and 1
+	@return Sample value
+ */
+static float percentile(const std::vector<float> &v, float q)
+{
+	if(v.empty())
+		return 0.f;
+	return v[(size_t)(q*(v.size() - 1) + 0.5f)];
+}
+
+/** Remove the pipeline backend, and optionally the noise module
+    @param P Pipeline
+	@param Noise true if the noise module must be removed as well
+ */
+static void destroy(Pipeline &P, bool Noise)
+{
+	if(P.Vertices) delete[] P.Vertices; P.Vertices=NULL;
+	if(P.backend) {
+		P.backend->remove();
+		delete P.backend; P.backend=NULL;
+	}
+	if(Noise && P.noise) {
+		P.noise->remove();
+		delete P.noise; P.noise=NULL;
+	}
+}
+
+/** Create the pipeline backend, and the noise module if it doesn't exist
+    @param S Soak test settings
+	@param P Pipeline, with the options already set
+	@param nWaves Number of waves of a new noise module
+	@return false if the backend can't be created
+ */
+static bool build(const Settings &S, Pipeline &P, int nWaves)
+{
+	if(!P.noise) {
+		P.noise = new Noise::HydrOCLNoise(P.NoiseOpt);
+		P.noise->create();
+		addWaves(P.noise, nWaves);
+	}
+	P.backend = newBackend(S.Backend);
+	if(!P.backend->create(P.Opt, P.noise)) {
+		delete P.backend; P.backend=NULL;
+		return false;
+	}
+	P.Vertices = new Mesh::POS_NORM_VERTEX[P.Opt.Complexity*P.Opt.Complexity];
+	return true;
+}
+
+/** Apply a random churn event
+    @param S Soak test settings
+	@param P Pipeline
+	@return false if the pipeline can't be created again
+ */
+static bool churn(const Settings &S, Pipeline &P)
+{
+	int nWaves = (int)P.noise->getNumberOfWaves();
+	switch(rand() % 5) {
+	case 0:
+		// Complexity change, the backend is created again
+		P.Opt.Complexity = randomItem(S.Complexity);
+		destroy(P, false);
+		return build(S, P, nWaves);
+	case 1:
+		// Options that doesn't require to create the backend again
+		P.Opt.Smooth = !P.Opt.Smooth;
+		P.Opt.ChoppyWaves = rand() % 2 != 0;
+		P.Opt.ChoppyStrength = Ogre::Math::RangeRandom(0.5f, 5.f);
+		P.backend->setOptions(P.Opt);
+		return true;
+	case 2:
+		// Add waves
+		if(nWaves < S.MaxWaves)
+			addWaves(P.noise, 1 + rand() % (S.MaxWaves - nWaves));
+		return true;
+	case 3:
+		// Remove waves
+		if(nWaves) {
+			int i, n = 1 + rand() % nWaves;
+			for(i=0;i<n;i++)
+				P.noise->removeWave(rand() % P.noise->getNumberOfWaves());
+		}
+		return true;
+	default:
+		// Noise module created again, with other octaves
+		P.NoiseOpt.Octaves = randomItem(S.Octaves);
+		destroy(P, true);
+		return build(S, P, nWaves);
+	}
+}
+
+/** Compute a frame
+    @param P Pipeline
+	@param t Time [s]
+	@return false if any stage fails
+ */
+static bool frame(Pipeline &P, float t)
+{
+	Ogre::Vector3 Pos, Dir;
+	Ogre::Vector4 Corners[4];
+	cameraPath(t, Pos, Dir);
+	gridCorners(Pos, Dir, Corners);
+	P.noise->update(_def_TimeStep);
+	return P.backend->geometry(Corners) &&
+	       P.backend->basePlane(0.f) &&
+	       P.backend->noise(Pos) &&
+	       P.backend->smooth() &&
+	       P.backend->normals() &&
+	       P.backend->choppyWaves(Dir, 1.f) &&
+	       P.backend->read(P.Vertices);
+}
+
+int main(int argc, char *argv[])
+{
+	Settings S;
+	if(!parseArguments(argc, argv, S))
+		return 1;
+
+	FILE *f = stdout;
+	if(!S.Output.empty()) {
+		f = fopen(S.Output.c_str(), "w");
+		if(!f) {
+			fprintf(stderr, "Can't open %s\n", S.Output.c_str());
+			return 1;
+		}
+	}
+
+	// Ogre is only needed for the log and to locate the kernels
+	Ogre::Root *root = new Ogre::Root("", "", "HydrOCLSoak.log");
+	Ogre::ResourceGroupManager::getSingleton().addResourceLocation(S.Media, "FileSystem", HYDRAX_RESOURCE_GROUP);
+	Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup(HYDRAX_RESOURCE_GROUP);
+
+	srand(S.Seed);
+	Pipeline P;
+	P.Opt.Complexity = randomItem(S.Complexity);
+	P.Opt.CPUThreads = S.CPUThreads;
+	P.NoiseOpt.Octaves = randomItem(S.Octaves);
+	P.noise = NULL;
+	P.backend = NULL;
+	P.Vertices = NULL;
+	Ogre::String error = "";
+	if(!build(S, P, S.MaxWaves / 2))
+		error = "the backend can't be created";
+
+	// Allocated memory of each complexity, that must not change
+	std::map<int, size_t> Allocated;
+	std::vector<float> Samples;
+	EpochStats E, Baseline;
+	memset(&E, 0, sizeof(EpochStats));
+	memset(&Baseline, 0, sizeof(EpochStats));
+	bool warm = false, baseline = false;
+	unsigned int epoch = 0, frames = 0;
+	int settle = 0;
+	Ogre::Timer clock, timer;
+	unsigned long epochStart = 0;
+
+	fprintf(f, "epoch,elapsed_s,frames,churns,p50_ms,p99_ms,p999_ms,max_ms,rss_MB,device_MB\n");
+	while(error.empty() && (clock.getMilliseconds() < 1000ul*S.Duration)) {
+		if(frames && !(frames % S.Churn)) {
+			E.RSS = std::max(E.RSS, residentMemory());
+			if(!churn(S, P)) {
+				error = "the backend can't be created again";
+				break;
+			}
+			E.Churns++;
+			settle = _def_SettleFrames;
+			std::map<int, size_t>::iterator it = Allocated.find(P.Opt.Complexity);
+			size_t mem = P.backend->getAllocatedMemory();
+			if(it == Allocated.end())
+				Allocated[P.Opt.Complexity] = mem;
+			else if(it->second != mem)
+				error = "the backend allocated memory has changed for complexity " +
+				        Ogre::StringConverter::toString(P.Opt.Complexity);
+		}
+
+		timer.reset();
+		if(!frame(P, frames*_def_TimeStep)) {
+			error = "a stage has failed";
+			break;
+		}
+		float t = 1e-3f*timer.getMicroseconds();
+		frames++;
+		if(settle > 0)
+			settle--;
+		else
+			Samples.push_back(t);
+
+		unsigned long now = clock.getMilliseconds();
+		if(!warm) {
+			if(now >= 1000ul*S.Warmup) {
+				warm = true;
+				epochStart = now;
+				Samples.clear();
+				memset(&E, 0, sizeof(EpochStats));
+			}
+			continue;
+		}
+		if(now - epochStart < 1000ul*S.Epoch)
+			continue;
+
+		// Epoch finished
+		std::sort(Samples.begin(), Samples.end());
+		E.Frames = Samples.size();
+		E.P50 = percentile(Samples, 0.5f);
+		E.P99 = percentile(Samples, 0.99f);
+		E.P999 = percentile(Samples, 0.999f);
+		E.Max = Samples.empty() ? 0.f : Samples.back();
+		E.RSS = std::max(E.RSS, residentMemory());
+		E.Device = P.backend->getAllocatedMemory() / (1024.f*1024.f);
+		fprintf(f, "%u,%.1f,%u,%u,%.4f,%.4f,%.4f,%.4f,%.2f,%.2f\n", epoch, 1e-3f*now,
+		        E.Frames, E.Churns, E.P50, E.P99, E.P999, E.Max, E.RSS, E.Device);
+		fflush(f);
+		if(!baseline) {
+			Baseline = E;
+			baseline = true;
+		}
+		else {
+			float drift = 1.f + 0.01f*S.MaxDrift;
+			if(E.P50 > drift*Baseline.P50)
+				error = "p50 frame time drifted from " + Ogre::StringConverter::toString(Baseline.P50) +
+				        " ms to " + Ogre::StringConverter::toString(E.P50) + " ms";
+			else if(E.P99 > drift*Baseline.P99)
+				error = "p99 frame time drifted from " + Ogre::StringConverter::toString(Baseline.P99) +
+				        " ms to " + Ogre::StringConverter::toString(E.P99) + " ms";
+			else if(E.RSS - Baseline.RSS > S.MaxRSSGrowth)
+				error = "resident memory grew from " + Ogre::StringConverter::toString(Baseline.RSS) +
+				        " MB to " + Ogre::StringConverter::toString(E.RSS) + " MB";
+		}
+		epoch++;
+		epochStart = now;
+		Samples.clear();
+		memset(&E, 0, sizeof(EpochStats));
+	}
+
+	destroy(P, true);
+	if(f != stdout)
+		fclose(f);
+	delete root;
+
+	if(!error.empty()) {
+		fprintf(stderr, "FAIL: %s (see HydrOCLSoak.log)\n", error.c_str());
+		return 1;
+	}
+	fprintf(stderr, "PASS: %u epochs, %u frames\n", epoch, frames);
+	return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/** HydrOCL validation test. The OpenCL backend is run on a CPU device
+ * (pocl by default, so it can be run anywhere) side by side with the
+ * scalar reference backend (see HydrOCLValidation), for every
+ * combination of the grid complexities, device vertexes layouts,
+ * smoothing and choppy waves flags, number of waves and random seeds,
+ * along a few fixed camera poses of the benchmark path.
+ *
+ * A line is printed for each combination, and the test fails (exit code
+ * 1) if any read is out of tolerance, or any backend can't be created or
+ * fails. The stages and the vertexes out of tolerance are written into
+ * HydrOCLTest.log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <Ogre.h>
+
+#include <CL/cl.h>
+
+#include <hydrocl/HydrOCLGrid.h>
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLOpenCL.h>
+#include <hydrocl/HydrOCLRuntime.h>
+#include <hydrocl/HydrOCLValidation.h>
+
+#include <BenchUtils.h>
+
+using namespace Hydrax;
+using namespace Hydrax::Module;
+
+/// Time between the camera poses [s]
+#define _def_PoseStep 7.3f
+
+/// Test settings
+struct Settings
+{
+	/// Platform or device name substring of the tested device
+	Ogre::String Device;
+	/// Tested grid complexities
+	std::vector<int> Complexity;
+	/// Tested layouts
+	std::vector<int> Layouts;
+	/// Tested smoothing flags
+	std::vector<int> Smooth;
+	/// Tested choppy waves flags
+	std::vector<int> Choppy;
+	/// Tested number of waves
+	std::vector<int> Waves;
+	/// Tested random seeds
+	std::vector<int> Seeds;
+	/// Camera poses per combination
+	int Poses;
+	/// Folder where the Hydrax resources can be found
+	Ogre::String Media;
+
+	/** Default constructor
+	 */
+	Settings()
+		: Device("Portable Computing Language")
+		, Poses(4)
+		, Media("../Media/Hydrax")
+	{
+	}
+};
+
+/** Print the usage help
+ */
+static void printHelp()
+{
+	printf("Usage: HydrOCLTest [options]\n");
+	printf("\t--device NAME        Platform or device name substring (default \"Portable Computing Language\")\n");
+	printf("\t--complexity LIST    Grid complexities (default 64,100,300)\n");
+	printf("\t--layouts LIST       Layouts, 0 rows, 1 tiled, 2 soa, 3 tiled+soa (default 0,1,2,3)\n");
+	printf("\t--smooth LIST        Smoothing flags (default 0,1)\n");
+	printf("\t--choppy LIST        Choppy waves flags (default 0,1)\n");
+	printf("\t--waves LIST         Number of waves (default 0,8)\n");
+	printf("\t--seeds LIST         Random seeds (default 0,1)\n");
+	printf("\t--poses N            Camera poses per combination (default 4)\n");
+	printf("\t--media PATH         Hydrax resources folder (default ../Media/Hydrax)\n");
+	printf("LIST is a comma separated list of integers, i.e.- 256,512\n");
+	printf("The complexities should include some that are not multiple of 8, and some\n");
+	printf("larger than 256, to cover the rows end and the padding of the kernels.\n");
+}
+
+/** Parse the command line arguments
+    @param argc Number of arguments
+	@param argv Arguments
+	@param S Output settings
+	@return false if the test must not be executed
+ */
+static bool parseArguments(int argc, char *argv[], Settings &S)
+{
+	int i;
+	unsigned int j;
+	parseList("64,100,300", S.Complexity);
+	parseList("0,1,2,3", S.Layouts);
+	parseList("0,1", S.Smooth);
+	parseList("0,1", S.Choppy);
+	parseList("0,8", S.Waves);
+	parseList("0,1", S.Seeds);
+	for(i=1;i<argc;i++) {
+		const char *key = argv[i];
+		if(!strcmp(key, "--help") || !strcmp(key, "-h")) {
+			printHelp();
+			return false;
+		}
+		if(i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", key);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if(!strcmp(key, "--device"))          S.Device = value;
+		else if(!strcmp(key, "--complexity")) valid = parseList(value, S.Complexity);
+		else if(!strcmp(key, "--layouts"))    valid = parseList(value, S.Layouts);
+		else if(!strcmp(key, "--smooth"))     valid = parseList(value, S.Smooth);
+		else if(!strcmp(key, "--choppy"))     valid = parseList(value, S.Choppy);
+		else if(!strcmp(key, "--waves"))      valid = parseList(value, S.Waves);
+		else if(!strcmp(key, "--seeds"))      valid = parseList(value, S.Seeds);
+		else if(!strcmp(key, "--poses"))      S.Poses = atoi(value);
+		else if(!strcmp(key, "--media"))      S.Media = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", key);
+			printHelp();
+			return false;
+		}
+		if(!valid) {
+			fprintf(stderr, "Invalid list for %s: %s\n", key, value);
+			return false;
+		}
+	}
+	for(j=0;j<S.Layouts.size();j++) {
+		if((S.Layouts[j] < 0) || (S.Layouts[j] >= N_LAYOUTS)) {
+			fprintf(stderr, "Unknown layout %d\n", S.Layouts[j]);
+			return false;
+		}
+	}
+	if(S.Poses < 1)
+		S.Poses = 1;
+	return true;
+}
+
+/** Get the "platform: device" name of a device, as the runtime matches it
+    @param Device Device
+	@return Platform and device name
+ */
+static Ogre::String deviceName(cl_device_id Device)
+{
+	char name[1024];
+	cl_platform_id Platform;
+	Ogre::String Name;
+	if(clGetDeviceInfo(Device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &Platform, NULL) == CL_SUCCESS &&
+	   clGetPlatformInfo(Platform, CL_PLATFORM_NAME, sizeof(name), name, NULL) == CL_SUCCESS)
+		Name = Ogre::String(name) + ": ";
+	if(clGetDeviceInfo(Device, CL_DEVICE_NAME, sizeof(name), name, NULL) == CL_SUCCESS)
+		Name += name;
+	return Name;
+}
+
+/** Validate a combination
+    @param S Test settings
+	@param Opt Projected grid options, with the runtime and the
+	combination already set
+	@param nWaves Number of waves
+	@param Seed Random seed of the noise and the waves
+	@param Checks Output number of compared reads
+	@param Failures Output number of reads out of tolerance
+	@return false if the backends can't be created or fail
+ */
+static bool validate(const Settings &S, const HydrOCL::Options &Opt, int nWaves, int Seed,
+                     unsigned int &Checks, unsigned int &Failures)
+{
+	int pose;
+	Checks = 0;
+	Failures = 0;
+	// The Perlin noise is randomly initialized as well
+	srand(Seed);
+	Noise::HydrOCLPerlin::Options NoiseOpt;
+	Noise::HydrOCLNoise *noise = new Noise::HydrOCLNoise(NoiseOpt);
+	noise->create();
+	addWaves(noise, nWaves);
+
+	HydrOCLOpenCL *backend = new HydrOCLOpenCL();
+	if(!backend->create(Opt, noise)) {
+		delete backend;
+		noise->remove();
+		delete noise;
+		return false;
+	}
+	HydrOCLValidation *validation = new HydrOCLValidation(backend);
+	if(!validation->create(Opt, noise)) {
+		delete validation;
+		noise->remove();
+		delete noise;
+		return false;
+	}
+
+	Mesh::POS_NORM_VERTEX *Vertices = new Mesh::POS_NORM_VERTEX[Opt.Complexity*Opt.Complexity];
+	bool ok = true;
+	for(pose=0;ok && (pose<S.Poses);pose++) {
+		Ogre::Vector3 Pos, Dir;
+		Ogre::Vector4 Corners[4];
+		cameraPath(pose*_def_PoseStep, Pos, Dir);
+		gridCorners(Pos, Dir, Corners);
+		noise->update(_def_PoseStep);
+		ok = validation->geometry(Corners) &&
+		     validation->basePlane(0.f) &&
+		     validation->noise(Pos) &&
+		     validation->smooth() &&
+		     validation->normals() &&
+		     validation->choppyWaves(Dir, 1.f) &&
+		     validation->read(Vertices);
+	}
+	// The counters are reset when the backends are removed
+	Checks = validation->getChecks();
+	Failures = validation->getFailures();
+
+	delete[] Vertices;
+	delete validation;
+	noise->remove();
+	delete noise;
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int a, b, c, d, e, f;
+	Settings S;
+	if(!parseArguments(argc, argv, S))
+		return 1;
+
+	// Ogre is only needed for the log and the resources
+	Ogre::Root *root = new Ogre::Root("", "", "HydrOCLTest.log");
+	Ogre::ResourceGroupManager::getSingleton().addResourceLocation(S.Media, "FileSystem", HYDRAX_RESOURCE_GROUP);
+	Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup(HYDRAX_RESOURCE_GROUP);
+
+	// A single runtime is kept for all the combinations, so each program
+	// is built just once
+	HydrOCLRuntime *Runtime = HydrOCLRuntime::acquire(CL_DEVICE_TYPE_ALL, S.Device, false);
+	if(!Runtime) {
+		fprintf(stderr, "OpenCL is not available (see HydrOCLTest.log)\n");
+		delete root;
+		return 1;
+	}
+	// The runtime falls back to the best ranked device
+	Ogre::String Name = deviceName(Runtime->getDevices()[0]);
+	Ogre::String name = Name, filter = S.Device;
+	Ogre::StringUtil::toLowerCase(name);
+	Ogre::StringUtil::toLowerCase(filter);
+	if(name.find(filter) == Ogre::String::npos) {
+		fprintf(stderr, "No device matches \"%s\" (best ranked one is %s)\n", S.Device.c_str(), Name.c_str());
+		Runtime->release();
+		delete root;
+		return 1;
+	}
+	fprintf(stderr, "Validating %s\n", Name.c_str());
+
+	unsigned int nPassed = 0, nFailed = 0;
+	for(a=0;a<S.Complexity.size();a++) {
+	for(b=0;b<S.Layouts.size();b++) {
+	for(c=0;c<S.Smooth.size();c++) {
+	for(d=0;d<S.Choppy.size();d++) {
+	for(e=0;e<S.Waves.size();e++) {
+	for(f=0;f<S.Seeds.size();f++) {
+		HydrOCL::Options Opt;
+		Opt.Complexity  = S.Complexity[a];
+		setLayout(Opt, S.Layouts[b]);
+		Opt.Smooth      = S.Smooth[c] != 0;
+		Opt.ChoppyWaves = S.Choppy[d] != 0;
+		Opt.Runtime     = Runtime;
+		fprintf(stderr, "complexity=%d layout=%s smooth=%d choppy=%d waves=%d seed=%d... ",
+		        Opt.Complexity, LayoutNames[S.Layouts[b]], S.Smooth[c] ? 1 : 0, S.Choppy[d] ? 1 : 0,
+		        S.Waves[e], S.Seeds[f]);
+		unsigned int Checks, Failures;
+		if(!validate(S, Opt, S.Waves[e], S.Seeds[f], Checks, Failures)) {
+			fprintf(stderr, "FAIL (backend error, see HydrOCLTest.log)\n");
+			nFailed++;
+			continue;
+		}
+		if(Failures) {
+			fprintf(stderr, "FAIL (%u of %u reads out of tolerance, see HydrOCLTest.log)\n", Failures, Checks);
+			nFailed++;
+			continue;
+		}
+		fprintf(stderr, "ok\n");
+		nPassed++;
+	}}}}}}
+
+	fprintf(stderr, "%u passed, %u failed\n", nPassed, nFailed);
+	Runtime->release();
+	delete root;
+	return nFailed ? 1 : 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/** OpenCL transfer strategies benchmark. For each available device, the
+ * time to move a float4 grid between the device and the host is measured
+ * with each strategy, for the grid sizes of the supported complexities
+ * (and a single float4, which gives the latency):
+ *  - read: Blocking clEnqueueRead/WriteBuffer on host memory (getData and
+ *    sendData).
+ *  - async: Non-blocking clEnqueueRead/WriteBuffer, waiting the event.
+ *  - map: clEnqueueMapBuffer/clEnqueueUnmapMemObject of the device buffer.
+ *  - pinned: Blocking clEnqueueRead/WriteBuffer on a mapped
+ *    CL_MEM_ALLOC_HOST_PTR buffer (page-locked memory).
+ *  - hostptr: Map/unmap of a CL_MEM_USE_HOST_PTR buffer.
+ * The device buffer is modified by a kernel before each download, so the
+ * device owns the latest data as after the grid stages.
+ *
+ * The median times and bandwidths are written as CSV, and the fastest
+ * download strategy of the ones supported by HydrOCL (read, map or pinned)
+ * for the selected complexity is written for each device into a
+ * recommendations file. HydrOCL loads it from the Hydrax resources when
+ * OCL_TransferMode is 0 (HydrOCL::TT_AUTO).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <Ogre.h>
+
+#include <CL/cl.h>
+
+#include <BenchUtils.h>
+
+/// Transfer strategies
+enum Strategy
+{
+	S_READ = 0,
+	S_ASYNC,
+	S_MAP,
+	S_PINNED,
+	S_HOSTPTR,
+	N_STRATEGIES
+};
+
+/// Strategies names, used in the output
+static const char* StrategyNames[N_STRATEGIES] =
+{
+	"read", "async", "map", "pinned", "hostptr"
+};
+
+/// Transfer directions
+enum Direction
+{
+	D_DOWNLOAD = 0,
+	D_UPLOAD,
+	N_DIRECTIONS
+};
+
+/// Directions names, used in the output
+static const char* DirectionNames[N_DIRECTIONS] =
+{
+	"download", "upload"
+};
+
+/// Kernel that modifies the device buffer before each download
+static const char* TouchSource =
+	"__kernel void touch(__global float4 *v, unsigned int n)\n"
+	"{\n"
+	"    unsigned int i = get_global_id(0);\n"
+	"    if(i < n) v[i].w += 1.f;\n"
+	"}\n";
+
+/// Benchmark settings
+struct Settings
+{
+	/// Measured complexities
+	std::vector<int> Complexity;
+	/// Complexity used for the recommendation
+	int Target;
+	/// Repetitions of each transfer
+	int Repeats;
+	/// Output file (empty for the standard output)
+	Ogre::String Output;
+	/// Recommendations file
+	Ogre::String Recommend;
+
+	/** Default constructor
+	 */
+	Settings()
+		: Target(256)
+		, Repeats(20)
+		, Output("")
+		, Recommend("HydrOCLTransfer.cfg")
+	{
+	}
+};
+
+/// Device under test
+struct Device
+{
+	/// Device name
+	Ogre::String Name;
+	/// Device
+	cl_device_id Id;
+	/// Context
+	cl_context Context;
+	/// Command queue
+	cl_command_queue Queue;
+	/// Touch kernel program
+	cl_program Program;
+	/// Touch kernel
+	cl_kernel Touch;
+};
+
+/** Print the usage help
+ */
+static void printHelp()
+{
+	printf("Usage: HydrOCLTransferBench [options]\n");
+	printf("\t--complexity LIST    Grid complexities (default 64,128,256,512,1024,2048)\n");
+	printf("\t--target N           Complexity used for the recommendation (default 256)\n");
+	printf("\t--repeats N          Repetitions of each transfer (default 20)\n");
+	printf("\t--output FILE        Output CSV file (default standard output)\n");
+	printf("\t--recommend FILE     Recommendations file (default HydrOCLTransfer.cfg)\n");
+	printf("LIST is a comma separated list of integers, i.e.- 256,512\n");
+	printf("Copy the recommendations file into the Hydrax resources (i.e.- Media/Hydrax)\n");
+	printf("so HydrOCL can use it.\n");
+}
+
+/** Parse the command line arguments
+    @param argc Number of arguments
+	@param argv Arguments
+	@param S Output settings
+	@return false if the benchmark must not be executed
+ */
+static bool parseArguments(int argc, char *argv[], Settings &S)
+{
+	int i;
+	parseList("64,128,256,512,1024,2048", S.Complexity);
+	for(i=1;i<argc;i++) {
+		const char *key = argv[i];
+		if(!strcmp(key, "--help") || !strcmp(key, "-h")) {
+			printHelp();
+			return false;
+		}
+		if(i + 1 >= argc) {
+			fprintf(stderr, "Missing value for %s\n", key);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if(!strcmp(key, "--complexity"))     valid = parseList(value, S.Complexity);
+		else if(!strcmp(key, "--target"))    S.Target = atoi(value);
+		else if(!strcmp(key, "--repeats"))   S.Repeats = atoi(value);
+		else if(!strcmp(key, "--output"))    S.Output = value;
+		else if(!strcmp(key, "--recommend")) S.Recommend = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", key);
+			printHelp();
+			return false;
+		}
+		if(!valid) {
+			fprintf(stderr, "Invalid list for %s: %s\n", key, value);
+			return false;
+		}
+	}
+	if(std::find(S.Complexity.begin(), S.Complexity.end(), S.Target) == S.Complexity.end())
+		S.Complexity.push_back(S.Target);
+	if(S.Repeats < 1)
+		S.Repeats = 1;
+	return true;
+}
+
+/** Create the context, queue and touch kernel of a device
+    @param D Device, with the Id already set
+	@return false if the device can't be used
+ */
+static bool setupDevice(Device &D)
+{
+	cl_int clFlag;
+	char name[1024];
+	clGetDeviceInfo(D.Id, CL_DEVICE_NAME, sizeof(name), name, NULL);
+	D.Name = name;
+	Ogre::StringUtil::trim(D.Name);
+	D.Queue = 0;
+	D.Program = 0;
+	D.Touch = 0;
+	D.Context = clCreateContext(NULL, 1, &D.Id, NULL, NULL, &clFlag);
+	if(clFlag != CL_SUCCESS)
+		return false;
+	D.Queue = clCreateCommandQueue(D.Context, D.Id, 0, &clFlag);
+	if(clFlag != CL_SUCCESS)
+		return false;
+	D.Program = clCreateProgramWithSource(D.Context, 1, &TouchSource, NULL, &clFlag);
+	if(clFlag != CL_SUCCESS)
+		return false;
+	if(clBuildProgram(D.Program, 1, &D.Id, "", NULL, NULL) != CL_SUCCESS)
+		return false;
+	D.Touch = clCreateKernel(D.Program, "touch", &clFlag);
+	return clFlag == CL_SUCCESS;
+}
+
+/** Release a device
+    @param D Device
+ */
+static void releaseDevice(Device &D)
+{
+	if(D.Touch) clReleaseKernel(D.Touch);
+	if(D.Program) clReleaseProgram(D.Program);
+	if(D.Queue) clReleaseCommandQueue(D.Queue);
+	if(D.Context) clReleaseContext(D.Context);
+}
+
+/** Modify the device buffer, waiting until it is done
+    @param D Device
+	@param buffer Device buffer
+	@param n Number of float4
+	@return false if the kernel fails
+ */
+static bool touch(Device &D, cl_mem buffer, cl_uint n)
+{
+	size_t local = 64, global = ((n + local - 1) / local) * local;
+	cl_int clFlag = clSetKernelArg(D.Touch, 0, sizeof(cl_mem), &buffer);
+	clFlag |= clSetKernelArg(D.Touch, 1, sizeof(cl_uint), &n);
+	clFlag |= clEnqueueNDRangeKernel(D.Queue, D.Touch, 1, NULL, &global, &local, 0, NULL, NULL);
+	clFlag |= clFinish(D.Queue);
+	return clFlag == CL_SUCCESS;
+}
+
+/** Measure a strategy
+    @param D Device
+	@param s Strategy
+	@param d Direction
+	@param n Number of float4
+	@param Repeats Repetitions
+	@return Median time [ms], negative if the strategy is not supported
+ */
+static double measure(Device &D, Strategy s, Direction d, cl_uint n, int Repeats)
+{
+	int r;
+	cl_int clFlag;
+	size_t size = n*sizeof(cl_float4);
+	std::vector<double> times;
+	cl_float4 *host = new cl_float4[n];
+	memset(host, 0, size);
+	cl_mem buffer = 0, pinned = 0;
+	void *pinnedPtr = NULL;
+	if(s == S_HOSTPTR)
+		buffer = clCreateBuffer(D.Context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, host, &clFlag);
+	else
+		buffer = clCreateBuffer(D.Context, CL_MEM_READ_WRITE, size, NULL, &clFlag);
+	bool ok = clFlag == CL_SUCCESS;
+	if(ok && (s == S_PINNED)) {
+		pinned = clCreateBuffer(D.Context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &clFlag);
+		ok = clFlag == CL_SUCCESS;
+		if(ok) {
+			pinnedPtr = clEnqueueMapBuffer(D.Queue, pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, &clFlag);
+			ok = clFlag == CL_SUCCESS;
+		}
+	}
+	Ogre::Timer timer;
+	for(r=0;ok && (r<Repeats);r++) {
+		if(d == D_DOWNLOAD)
+			ok = touch(D, buffer, n);
+		if(!ok)
+			break;
+		cl_map_flags flags = (d == D_DOWNLOAD) ? CL_MAP_READ : CL_MAP_WRITE;
+		void *ptr;
+		cl_event event;
+		timer.reset();
+		switch(s) {
+		case S_READ:
+			if(d == D_DOWNLOAD)
+				clFlag = clEnqueueReadBuffer(D.Queue, buffer, CL_TRUE, 0, size, host, 0, NULL, NULL);
+			else
+				clFlag = clEnqueueWriteBuffer(D.Queue, buffer, CL_TRUE, 0, size, host, 0, NULL, NULL);
+			break;
+		case S_ASYNC:
+			if(d == D_DOWNLOAD)
+				clFlag = clEnqueueReadBuffer(D.Queue, buffer, CL_FALSE, 0, size, host, 0, NULL, &event);
+			else
+				clFlag = clEnqueueWriteBuffer(D.Queue, buffer, CL_FALSE, 0, size, host, 0, NULL, &event);
+			if(clFlag == CL_SUCCESS) {
+				clFlush(D.Queue);
+				clFlag = clWaitForEvents(1, &event);
+				clReleaseEvent(event);
+			}
+			break;
+		case S_PINNED:
+			if(d == D_DOWNLOAD)
+				clFlag = clEnqueueReadBuffer(D.Queue, buffer, CL_TRUE, 0, size, pinnedPtr, 0, NULL, NULL);
+			else
+				clFlag = clEnqueueWriteBuffer(D.Queue, buffer, CL_TRUE, 0, size, pinnedPtr, 0, NULL, NULL);
+			break;
+		default:
+			// Map and hostptr
+			ptr = clEnqueueMapBuffer(D.Queue, buffer, CL_TRUE, flags, 0, size, 0, NULL, NULL, &clFlag);
+			if(clFlag == CL_SUCCESS) {
+				// The data must be actually touched in the host
+				if(d == D_DOWNLOAD)
+					memcpy(host, ptr, size);
+				else
+					memcpy(ptr, host, size);
+				clFlag = clEnqueueUnmapMemObject(D.Queue, buffer, ptr, 0, NULL, NULL);
+				clFlag |= clFinish(D.Queue);
+			}
+		}
+		double t = 1e-3*timer.getMicroseconds();
+		ok = clFlag == CL_SUCCESS;
+		times.push_back(t);
+	}
+	if(pinnedPtr) clEnqueueUnmapMemObject(D.Queue, pinned, pinnedPtr, 0, NULL, NULL);
+	clFinish(D.Queue);
+	if(pinned) clReleaseMemObject(pinned);
+	if(buffer) clReleaseMemObject(buffer);
+	delete[] host;
+	if(!ok)
+		return -1.0;
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+/** Write the recommendations file, keeping the ones of the devices that
+    have not been measured
+    @param File Recommendations file
+	@param Recommend Recommended strategy of each measured device
+	@return false if the file can't be written
+ */
+static bool writeRecommendations(const Ogre::String &File, const std::map<Ogre::String, Ogre::String> &Recommend)
+{
+	char line[1024];
+	std::vector<Ogre::String> kept;
+	FILE *f = fopen(File.c_str(), "r");
+	if(f) {
+		while(fgets(line, sizeof(line), f)) {
+			Ogre::String l = line;
+			Ogre::StringUtil::trim(l);
+			size_t eq = l.find('=');
+			if(l.empty() || (l[0] == '#') || (eq == Ogre::String::npos))
+				continue;
+			Ogre::String name = l.substr(0, eq);
+			Ogre::StringUtil::trim(name);
+			if(Recommend.find(name) == Recommend.end())
+				kept.push_back(l);
+		}
+		fclose(f);
+	}
+	f = fopen(File.c_str(), "w");
+	if(!f)
+		return false;
+	fprintf(f, "# HydrOCL vertexes read strategy of each OpenCL device, written by\n");
+	fprintf(f, "# HydrOCLTransferBench and used if OCL_TransferMode=0.\n");
+	fprintf(f, "# Device name=read|map|pinned\n");
+	unsigned int i;
+	for(i=0;i<kept.size();i++)
+		fprintf(f, "%s\n", kept[i].c_str());
+	std::map<Ogre::String, Ogre::String>::const_iterator it;
+	for(it=Recommend.begin();it!=Recommend.end();it++)
+		fprintf(f, "%s=%s\n", it->first.c_str(), it->second.c_str());
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i, k;
+	int s, d;
+	Settings S;
+	if(!parseArguments(argc, argv, S))
+		return 1;
+
+	FILE *f = stdout;
+	if(!S.Output.empty()) {
+		f = fopen(S.Output.c_str(), "w");
+		if(!f) {
+			fprintf(stderr, "Can't open %s\n", S.Output.c_str());
+			return 1;
+		}
+	}
+
+	// Collect the devices of every platform
+	cl_uint nPlatforms = 0;
+	std::vector<cl_device_id> ids;
+	clGetPlatformIDs(0, NULL, &nPlatforms);
+	std::vector<cl_platform_id> platforms(nPlatforms);
+	if(nPlatforms)
+		clGetPlatformIDs(nPlatforms, &platforms[0], NULL);
+	for(i=0;i<nPlatforms;i++) {
+		cl_uint nDevices = 0;
+		clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &nDevices);
+		if(!nDevices)
+			continue;
+		std::vector<cl_device_id> devices(nDevices);
+		clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, nDevices, &devices[0], NULL);
+		ids.insert(ids.end(), devices.begin(), devices.end());
+	}
+	if(ids.empty()) {
+		fprintf(stderr, "No OpenCL devices found\n");
+		return 1;
+	}
+
+	std::map<Ogre::String, Ogre::String> Recommend;
+	fprintf(f, "device,strategy,direction,complexity,bytes,median_ms,MBs\n");
+	for(i=0;i<ids.size();i++) {
+		Device D;
+		D.Id = ids[i];
+		if(!setupDevice(D)) {
+			fprintf(stderr, "%s: can't be used, skipped\n", D.Name.c_str());
+			releaseDevice(D);
+			continue;
+		}
+		fprintf(stderr, "%s\n", D.Name.c_str());
+		// Complexity 0 is a single float4, i.e.- the latency
+		std::vector<int> sizes(1, 0);
+		sizes.insert(sizes.end(), S.Complexity.begin(), S.Complexity.end());
+		double best = -1.0;
+		Strategy bestStrategy = S_READ;
+		for(s=0;s<N_STRATEGIES;s++) {
+			for(d=0;d<N_DIRECTIONS;d++) {
+				for(k=0;k<sizes.size();k++) {
+					cl_uint n = sizes[k] ? sizes[k]*sizes[k] : 1;
+					double t = measure(D, (Strategy)s, (Direction)d, n, S.Repeats);
+					if(t < 0.0) {
+						fprintf(stderr, "\t%s %s not supported\n", StrategyNames[s], DirectionNames[d]);
+						break;
+					}
+					double bytes = (double)n*sizeof(cl_float4);
+					double rate = t > 0.0 ? 1e-3*bytes/t : 0.0;
+					fprintf(f, "\"%s\",%s,%s,%d,%.0f,%.4f,%.1f\n", D.Name.c_str(), StrategyNames[s],
+					        DirectionNames[d], sizes[k], bytes, t, rate);
+					fflush(f);
+					bool supported = (s == S_READ) || (s == S_MAP) || (s == S_PINNED);
+					if(supported && (d == D_DOWNLOAD) && (sizes[k] == S.Target) &&
+					   ((best < 0.0) || (t < best))) {
+						best = t;
+						bestStrategy = (Strategy)s;
+					}
+				}
+			}
+		}
+		if(best >= 0.0) {
+			Recommend[D.Name] = StrategyNames[bestStrategy];
+			fprintf(stderr, "\trecommended: %s (%.3f ms at complexity %d)\n",
+			        StrategyNames[bestStrategy], best, S.Target);
+		}
+		releaseDevice(D);
+	}
+	if(f != stdout)
+		fclose(f);
+
+	if(Recommend.empty()) {
+		fprintf(stderr, "No device could be measured\n");
+		return 1;
+	}
+	if(!writeRecommendations(S.Recommend, Recommend)) {
+		fprintf(stderr, "Can't write %s\n", S.Recommend.c_str());
+		return 1;
+	}
+	fprintf(stderr, "Recommendations written into %s\n", S.Recommend.c_str());
+	return 0;
+}
@@ -40,6 +40,7 @@ Jose Luis Cerc
 // ----------------------------------------------------------------------------
 #include <Ogre.h>
 #include <OgreTextAreaOverlayElement.h>
+#include <OgreOverlayManager.h>
 
 // ----------------------------------------------------------------------------
 // Include the OGRE example framework
@@ -67,6 +68,10 @@ Jose Luis Cerc
 #include "hydrocl.h"
 
 #define _def_SkyBoxNum 3
+/// Waves added/removed each time the waves hotkeys are pressed
+#define _def_WavesStep 5
+/// Performance overlay refresh period (seconds)
+#define _def_PerfRefresh 0.5f
 
 // Hydrax pointer
 Hydrax::Hydrax *mHydrax = 0;
@@ -88,9 +93,38 @@ Ogre::Vector3 mSunColor[_def_SkyBoxNum] =
 
 int mCurrentSkyBox = 0;
 
-// Just to wshow skyboxes information
+// Just to show the performance information
 Ogre::TextAreaOverlayElement* mTextArea = 0;
 
+/** Add random waves, travelling roughly along the x direction
+ * @param noise Noise module
+ * @param nWaves Number of waves to add
+ */
+void addWaves(Hydrax::Noise::HydrOCLNoise *noise, unsigned int nWaves)
+{
+	unsigned int i;
+	// Direction dispersion
+	Ogre::Vector2 minDir=Ogre::Vector2(1.f,-0.2f), maxDir=Ogre::Vector2(1.f,0.2f); 
+	// Amplitude dispersion (period will be related).
+	float minA = 0.15f, maxA = 0.4f;
+	float minT = 7.0f, maxT = 10.f, varT = 1.f;
+	// Phase dispersion
+	float varP = 2.f*M_PI;
+	for(i=0;i<nWaves;i++){
+		Ogre::Vector2 dir;
+		dir.x = Ogre::Math::RangeRandom(minDir.x, maxDir.x);
+		dir.y = Ogre::Math::RangeRandom(minDir.y, maxDir.y);
+		dir.normalise();
+		float A = Ogre::Math::RangeRandom(minA, maxA);
+		float factor = (maxA - A) / (maxA - minA);
+		float T = (1.f-factor)*minT + factor*maxT;
+		T = Ogre::Math::RangeRandom(T - 0.5f*varT, T + 0.5f*varT);
+		float P = Ogre::Math::RangeRandom(0.f, varP);
+		Hydrax::Noise::HydrOCLNoise::Wave w = Hydrax::Noise::HydrOCLNoise::Wave(dir,A,T,P);
+		noise->addWave(w);
+	}
+}
+
 // ----------------------------------------------------------------------------
 // Define the application object
 // This is derived from ExampleApplication which is the class OGRE provides to
@@ -105,12 +139,22 @@ class ExampleHydraxDemoListener : public ExampleFrameListener
 public:
     SceneManager *mSceneMgr;
     Real mKeyBuffer;
+    /// HydrOCL performance overlay
+    Overlay *mPerfOverlay;
+    /// Time since the performance overlay was refreshed
+    Real mPerfTime;
+    /// Transferred data when the performance overlay was refreshed
+    unsigned long long mPerfBytes;
 
     ExampleHydraxDemoListener(RenderWindow* win, Camera* cam, SceneManager *sm)
             : ExampleFrameListener(win,cam)
             , mSceneMgr(sm)
             , mKeyBuffer(-1)
+            , mPerfOverlay(0)
+            , mPerfTime(_def_PerfRefresh)
+            , mPerfBytes(0)
     {
+        createPerfOverlay();
     }
 
     bool frameStarted(const FrameEvent &e)
@@ -154,11 +198,152 @@ public:
 			mKeyBuffer = 0.5f;
 		}
 
+		// HydrOCL hotkeys
+		Hydrax::Module::HydrOCL *module = static_cast<Hydrax::Module::HydrOCL*>(mHydrax->getModule());
+		Hydrax::Noise::HydrOCLNoise *noise = static_cast<Hydrax::Noise::HydrOCLNoise*>(module->getNoise());
+		Hydrax::Module::HydrOCL::Options options = module->getOptions();
+		bool changed = false;
+		if (mKeyBuffer < 0)
+		{
+			if (mKeyboard->isKeyDown(OIS::KC_H))
+			{
+				if (mPerfOverlay->isVisible())
+					mPerfOverlay->hide();
+				else
+					mPerfOverlay->show();
+				mKeyBuffer = 0.5f;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_1))
+			{
+				options.Smooth = !options.Smooth;
+				changed = true;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_2))
+			{
+				options.ChoppyWaves = !options.ChoppyWaves;
+				changed = true;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_3) && options.Complexity > 64)
+			{
+				options.Complexity /= 2;
+				changed = true;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_4) && options.Complexity < 2048)
+			{
+				options.Complexity *= 2;
+				changed = true;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_5))
+			{
+				unsigned int i;
+				for(i=0;i<_def_WavesStep && noise->getNumberOfWaves();i++)
+					noise->removeWave(noise->getNumberOfWaves()-1);
+				mKeyBuffer = 0.5f;
+			}
+			else if (mKeyboard->isKeyDown(OIS::KC_6))
+			{
+				addWaves(noise, _def_WavesStep);
+				mKeyBuffer = 0.5f;
+			}
+		}
+		if (changed)
+		{
+			module->setOptions(options);
+			mKeyBuffer = 0.5f;
+		}
+
 		mKeyBuffer -= e.timeSinceLastFrame;
 
+		// Refresh the performance overlay
+		mPerfTime += e.timeSinceLastFrame;
+		if (mPerfTime >= _def_PerfRefresh)
+		{
+			updatePerfOverlay();
+		}
+
         return true;
     }
 
+    /** Create the HydrOCL performance overlay, at the top left corner of
+     * the window. Press H to show/hide it.
+     */
+    void createPerfOverlay()
+    {
+        OverlayManager &mgr = OverlayManager::getSingleton();
+        mPerfOverlay = mgr.create("HydrOCL/PerfOverlay");
+        OverlayContainer *panel = static_cast<OverlayContainer*>(
+            mgr.createOverlayElement("Panel", "HydrOCL/PerfPanel"));
+        panel->setMetricsMode(GMM_PIXELS);
+        panel->setPosition(5, 5);
+        panel->setDimensions(400, 300);
+        mTextArea = static_cast<TextAreaOverlayElement*>(
+            mgr.createOverlayElement("TextArea", "HydrOCL/PerfText"));
+        mTextArea->setMetricsMode(GMM_PIXELS);
+        mTextArea->setPosition(0, 0);
+        mTextArea->setDimensions(400, 300);
+        mTextArea->setFontName("BlueHighway");
+        mTextArea->setCharHeight(16);
+        mTextArea->setColourTop(ColourValue(1.0, 1.0, 0.7));
+        mTextArea->setColourBottom(ColourValue(1.0, 1.0, 0.7));
+        panel->addChild(mTextArea);
+        mPerfOverlay->add2D(panel);
+        mPerfOverlay->show();
+    }
+
+    /** Refresh the HydrOCL performance overlay with the current
+     * backend, options and telemetry.
+     */
+    void updatePerfOverlay()
+    {
+        unsigned int i;
+        Hydrax::Module::HydrOCL *module = static_cast<Hydrax::Module::HydrOCL*>(mHydrax->getModule());
+        Hydrax::Noise::HydrOCLNoise *noise = static_cast<Hydrax::Noise::HydrOCLNoise*>(module->getNoise());
+        const Hydrax::Module::HydrOCL::Options &options = module->getOptions();
+        String text = "Backend: " + module->getBackendName();
+        if (module->getDeviceName() != "")
+            text += " (" + module->getDeviceName() + ")";
+        const Hydrax::Module::HydrOCLMemory &memory = module->getMemoryUsage();
+        text += "\nMemory: " + StringConverter::toString(memory.getTotal(Hydrax::Module::HydrOCLMemory::MEM_DEVICE).Current / (1024*1024)) + " MB device, " +
+                StringConverter::toString(memory.getTotal(Hydrax::Module::HydrOCLMemory::MEM_HOST).Current / (1024*1024)) + " MB host (peak " +
+                StringConverter::toString(memory.getTotal().Peak / (1024*1024)) + " MB)";
+        text += "\n[1] Smooth: " + StringConverter::toString(options.Smooth) +
+                "  [2] Choppy: " + StringConverter::toString(options.ChoppyWaves);
+        text += "\n[3/4] Complexity: " + StringConverter::toString(options.Complexity) +
+                "  [5/6] Waves: " + StringConverter::toString(noise->getNumberOfWaves());
+
+        const Hydrax::Module::HydrOCLStats *stats = module->getStats();
+        if (!stats)
+        {
+            text += "\nTelemetry off (OCL_Telemetry)";
+        }
+        else
+        {
+            // Mean/p99 device time of each stage (ms)
+            for(i=0;i<Hydrax::Module::HydrOCLStats::N_STAGES;i++)
+            {
+                Hydrax::Module::HydrOCLStats::Stage s = (Hydrax::Module::HydrOCLStats::Stage)i;
+                Hydrax::Module::HydrOCLStats::Summary t = stats->getDevice(s);
+                text += "\n" + String(Hydrax::Module::HydrOCLStats::getStageName(s)) + ": " +
+                        StringConverter::toString(t.Mean, 3) + " / " +
+                        StringConverter::toString(t.P99, 3) + " ms";
+            }
+            Hydrax::Module::HydrOCLStats::Summary t = stats->getRepack();
+            text += "\nrepack: " + StringConverter::toString(t.Mean, 3) + " / " +
+                    StringConverter::toString(t.P99, 3) + " ms";
+            // Transfer rate since the last refresh. The counters are
+            // reset if the module has been created again
+            unsigned long long bytes = stats->getBytesSent() + stats->getBytesRead();
+            if (bytes < mPerfBytes)
+                mPerfBytes = 0;
+            float rate = (bytes - mPerfBytes) / (1024.f*1024.f*mPerfTime);
+            mPerfBytes = bytes;
+            text += "\nTransfer: " + StringConverter::toString(rate, 4) + " MB/s";
+        }
+        text += "\n[H] Hide";
+        mTextArea->setCaption(text);
+        mPerfTime = 0.f;
+    }
+
     void changeSkyBox()
     {
         // printf("\t%s\n", mSkyBoxes[mCurrentSkyBox]);
@@ -307,27 +492,7 @@ protected:
         mHydrax->create();
 
 		// Add some waves (ADD WAVES BEFORE CREATE HYDRAX, OPENCL MUST BE READY)
-		unsigned int i, nWaves = 25;
-		// Direction dispersion
-		Ogre::Vector2 minDir=Ogre::Vector2(1.f,-0.2f), maxDir=Ogre::Vector2(1.f,0.2f); 
-		// Amplitude dispersion (period will be related).
-		float minA = 0.15f, maxA = 0.4f;
-		float minT = 7.0f, maxT = 10.f, varT = 1.f;
-		// Phase dispersion
-		float varP = 2.f*M_PI;
-		for(i=0;i<nWaves;i++){
-			Ogre::Vector2 dir;
-			dir.x = Ogre::Math::RangeRandom(minDir.x, maxDir.x);
-			dir.y = Ogre::Math::RangeRandom(minDir.y, maxDir.y);
-			dir.normalise();
-			float A = Ogre::Math::RangeRandom(minA, maxA);
-			float factor = (maxA - A) / (maxA - minA);
-			float T = (1.f-factor)*minT + factor*maxT;
-			T = Ogre::Math::RangeRandom(T - 0.5f*varT, T + 0.5f*varT);
-			float P = Ogre::Math::RangeRandom(0.f, varP);
-			Hydrax::Noise::HydrOCLNoise::Wave w = Hydrax::Noise::HydrOCLNoise::Wave(dir,A,T,P);
-		    static_cast<Hydrax::Noise::HydrOCLNoise*>(mModule->getNoise())->addWave(w);
-		}
+		addWaves(static_cast<Hydrax::Noise::HydrOCLNoise*>(mModule->getNoise()), 25);
 
 		// Hydrax initialization code end -----------------------------------------
 		// ------------------------------------------------------------------------
@@ -24,5 +24,8 @@
 // Include needed stuff
 #include<hydrocl/HydrOCLGrid.h>
 #include<hydrocl/HydrOCLNoise.h>
+#include<hydrocl/HydrOCLStats.h>
+#include<hydrocl/HydrOCLMemory.h>
+#include<hydrocl/HydrOCLRuntime.h>
 
 #endif // HYDROCL_H_INCLUDED
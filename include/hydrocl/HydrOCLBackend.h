@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLBACKEND_H_INCLUDED
+#define HYDROCLBACKEND_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+#include <Hydrax/Hydrax.h>
+#include <Hydrax/Mesh.h>
+
+// ----------------------------------------------------------------------------
+// Projected grid module
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLGrid.h>
+#include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLStats.h>
+#include <hydrocl/HydrOCLTrace.h>
+#include <hydrocl/HydrOCLMemory.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Projected grid computation backend. The projected grid module
+	 * computes the camera dependent stuff (grid corners, camera direction),
+	 * while the backend owns the vertexes and computes the stages of the
+	 * pipeline:
+	 *  - geometry: Projected grid regeneration (x, z coordinates).
+	 *  - basePlane: Base plane height set.
+	 *  - noise: Perlin noise and waves heights.
+	 *  - smooth: Heights smoothing.
+	 *  - normals: Normals computation.
+	 *  - choppyWaves: Choppy waves displacement (normals included).
+	 * The stages must be called in that order.
+	 */
+	class DllExport HydrOCLBackend
+	{
+	public:
+		/** Destructor
+		 */
+		virtual ~HydrOCLBackend() {}
+
+		/** Backend name
+		    @return Name of the backend, used in the log
+		 */
+		virtual const char* getName() const = 0;
+
+		/** Create the backend resources
+		    @param Options Projected grid options
+			@param NoiseModule Noise module, that will compute the heights
+			@return true if the backend is ready to work
+			@note If false is returned, the backend has already released
+			everything that it could allocate, so another backend can be
+			tried.
+		 */
+		virtual bool create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule) = 0;
+
+		/** Release the backend resources
+		 */
+		virtual void remove() = 0;
+
+		/** Update the options that don't require to create the backend
+		    again (i.e.- Smooth, ChoppyWaves, ChoppyStrength).
+		    @param Options Projected grid options
+		 */
+		virtual void setOptions(const HydrOCL::Options &Options) = 0;
+
+		/** Change the grid complexity, keeping the resources that don't
+		    depend on it (i.e.- the OpenCL context and kernels).
+		    @param Options Projected grid options, where only the
+			complexity (and HydrOCL::Options::MaxComplexity) may change
+			@return false if the backend must be created again instead,
+			either because resizing is not supported or because it
+			failed
+		 */
+		virtual bool resize(const HydrOCL::Options &Options) {return false;}
+
+		/** Projected grid geometry regeneration
+		    @param Corners Grid bounds corners, in homogeneous coordinates
+			@return true if it's sucesfful
+		 */
+		virtual bool geometry(const Ogre::Vector4 *Corners) = 0;
+
+		/** Base plane height set
+		    @param h Base plane distance (the vertexes height will be -h)
+			@return true if it's sucesfful
+		 */
+		virtual bool basePlane(const float &h) = 0;
+
+		/** Noise heights computation
+		    @param World Rendering camera position
+			@return true if it's sucesfful
+		 */
+		virtual bool noise(const Ogre::Vector3 &World) = 0;
+
+		/** Heights smoothing, if smoothing is enabled
+			@return true if it's sucesfful
+		 */
+		virtual bool smooth() = 0;
+
+		/** Normals computation
+			@return true if it's sucesfful
+		    @note Nothing is done if choppy waves are enabled, since the
+			normals are computed together with the displacement.
+		 */
+		virtual bool normals() = 0;
+
+		/** Choppy waves displacement, if choppy waves are enabled
+		    @param CameraDir Rendering camera direction
+			@param Underwater -1 if the frame is being rendered underwater, 1 otherwise
+			@return true if it's sucesfful
+		 */
+		virtual bool choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater) = 0;
+
+		/** Read the last computed vertexes and normals, in row-major order
+		    @param Vertices Output vertexes, Complexity x Complexity
+			@return true if it's sucesfful
+		 */
+		virtual bool read(Mesh::POS_NORM_VERTEX *Vertices) = 0;
+
+		/** Wait until all the stages already called have been computed.
+		 * The stages of asynchronous backends may return as soon as the
+		 * work is queued, so this is needed to time them separately.
+			@return true if it's sucesfful
+		 */
+		virtual bool finish() {return true;}
+
+		/** Backend telemetry
+		    @return Telemetry, NULL if it is disabled or not supported by
+			the backend
+		 */
+		virtual const HydrOCLStats* getStats() const {return NULL;}
+
+		/** Set the trace recorder where the backend internal spans must be
+		    recorded
+		    @param Trace Trace recorder, NULL to stop tracing
+		 */
+		virtual void setTrace(HydrOCLTrace *Trace) {}
+
+		/** Set the memory accounting where the backend allocations must
+		    be registered. It must be called before create().
+		    @param Memory Memory accounting, NULL if it is not required
+		 */
+		virtual void setMemory(HydrOCLMemory *Memory) {}
+
+		/** Name of the device where the stages are computed
+		    @return Device name, empty if the backend has not a meaningful one
+		 */
+		virtual Ogre::String getDeviceName() const {return "";}
+
+		/** Memory allocated by the backend to store the grid
+		    @return Allocated memory, in bytes
+		 */
+		virtual size_t getAllocatedMemory() const {return 0;}
+	};
+}}
+
+#endif  // HYDROCLBACKEND_H_INCLUDED
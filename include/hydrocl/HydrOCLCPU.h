@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLCPU_H_INCLUDED
+#define HYDROCLCPU_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Projected grid backend
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLBackend.h>
+#include <hydrocl/HydrOCLThreadPool.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Native projected grid backend, used when OpenCL is not available.
+	 * The vertexes are stored as separate planes of x, y and z coordinates
+	 * in row-major order, so the inner loops along the rows can be
+	 * vectorized by the compiler (the noise loops avoid the calls and the
+	 * branches for that, see HydrOCLNoise::setHeight()). Each stage is
+	 * split in tasks of some consecutive rows, computed by a
+	 * work-stealing threads pool.
+	 * @note OpenCL specific options (DeviceType, TiledLayout, SoALayout)
+	 * are ignored.
+	 */
+	class DllExport HydrOCLCPU : public HydrOCLBackend, public HydrOCLThreadPool::Job
+	{
+	public:
+		/** Constructor
+		 */
+		HydrOCLCPU();
+
+		/** Destructor
+		 */
+		~HydrOCLCPU();
+
+		const char* getName() const {return "CPU";}
+		bool create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule);
+		void remove();
+		void setOptions(const HydrOCL::Options &Options);
+		/** Reallocate the grid arrays, keeping the threads pool
+		 */
+		bool resize(const HydrOCL::Options &Options);
+		bool geometry(const Ogre::Vector4 *Corners);
+		bool basePlane(const float &h);
+		bool noise(const Ogre::Vector3 &World);
+		bool smooth();
+		bool normals();
+		bool choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater);
+		bool read(Mesh::POS_NORM_VERTEX *Vertices);
+		Ogre::String getDeviceName() const;
+		size_t getAllocatedMemory() const {return mNX ? 9*mN*mN*sizeof(float) : 0;}
+		void setMemory(HydrOCLMemory *Memory) {mMemory = Memory;}
+
+		/** Computes a rows tile of the current stage
+		    @param task Tile index
+		 */
+		void run(unsigned int task);
+
+	private:
+		/** Pipeline stages
+		 */
+		enum Stage
+		{
+			STAGE_GEOMETRY,
+			STAGE_BASEPLANE,
+			STAGE_NOISE,
+			STAGE_SMOOTH,
+			STAGE_NORMALS,
+			STAGE_CHOPPY,
+			STAGE_READ
+		};
+
+		/** Allocate the grid arrays and set the initial values
+		 */
+		void _createGrid();
+
+		/** Release the grid arrays
+		 */
+		void _releaseGrid();
+
+		/** Split the rows in tasks for the threads pool
+		 */
+		void _rowsPerTask();
+
+		/** Computes a stage in the threads pool
+		    @param stage Stage to compute
+		 */
+		void _launch(Stage stage);
+
+		/** Projected grid regeneration of a rows tile
+		    @param j0 First row
+			@param j1 Last row (not included)
+		 */
+		void _geometry(unsigned int j0, unsigned int j1);
+
+		/** Heights smoothing of a rows tile
+		    @param j0 First row
+			@param j1 Last row (not included)
+		 */
+		void _smooth(unsigned int j0, unsigned int j1);
+
+		/** Normals computation of a rows tile
+		    @param j0 First row
+			@param j1 Last row (not included)
+		 */
+		void _normals(unsigned int j0, unsigned int j1);
+
+		/** Choppy waves displacement of a rows tile
+		    @param j0 First row
+			@param j1 Last row (not included)
+		 */
+		void _choppy(unsigned int j0, unsigned int j1);
+
+		/** Copy of a rows tile into the Ogre vertexes
+		    @param j0 First row
+			@param j1 Last row (not included)
+		 */
+		void _read(unsigned int j0, unsigned int j1);
+
+		/// Projected grid options
+		HydrOCL::Options mOptions;
+		/// Noise module
+		Noise::HydrOCLNoise *mNoise;
+		/// Threads pool
+		HydrOCLThreadPool *mPool;
+		/// Number of vertexes at each direction
+		unsigned int mN;
+		/// Rows computed by each task
+		unsigned int mRowsPerTask;
+		/** Vertexes coordinates ping-pong pair, in the same way than the
+		 * OpenCL backend (see mBase and mOutput).
+		 */
+		float *mX[2], *mY[2], *mZ[2];
+		/// Normals coordinates
+		float *mNX, *mNY, *mNZ;
+		/// Index of the pair that stores the undisplaced vertexes
+		unsigned int mBase;
+		/// Index of the pair that must be read to render
+		unsigned int mOutput;
+
+		/// Stage being computed
+		Stage mStage;
+		/// Grid bounds corners (geometry stage)
+		Ogre::Vector4 mCorners[4];
+		/// Base plane distance (base plane stage)
+		float mH;
+		/// Rendering camera position (noise stage)
+		Ogre::Vector3 mWorld;
+		/// Absolute camera direction in the x, z plane (choppy stage)
+		float mDirX, mDirZ;
+		/// -1 if underwater, 1 otherwise (choppy stage)
+		float mUnderwater;
+		/// Output Ogre vertexes (read stage)
+		Mesh::POS_NORM_VERTEX *mVertices;
+		/// Memory accounting, NULL if it is not required
+		HydrOCLMemory *mMemory;
+	};
+}}
+
+#endif  // HYDROCLCPU_H_INCLUDED
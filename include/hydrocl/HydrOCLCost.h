@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLCOST_H_INCLUDED
+#define HYDROCLCOST_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+#include <vector>
+
+namespace Hydrax{ namespace Module
+{
+	/** Frame cost model of a computation backend and device, fitted by
+	 * the HydrOCLBench scaling study. The frame time, in milliseconds, is
+	 * modelled as:
+	 * t = Constant + V*(Vertex + Waves*VertexWave + Octaves*VertexOctave)
+	 * where V = Complexity^2 is the number of vertexes. The models of
+	 * several devices are stored into a single file, one section per
+	 * device, so the module can clamp the complexity and the number of
+	 * waves to a frame budget (see HydrOCL::Options::Budget).
+	 */
+	class DllExport HydrOCLCost
+	{
+	public:
+		/// Time independent of the number of vertexes [ms]
+		float Constant;
+		/// Time per vertex [ms]
+		float Vertex;
+		/// Time per vertex and wave [ms]
+		float VertexWave;
+		/// Time per vertex and Perlin noise octave [ms]
+		float VertexOctave;
+
+		/** Default constructor, an empty (free) model
+		 */
+		HydrOCLCost();
+
+		/** Get the name of the section where the model of a device is
+		 * stored
+		    @param Backend Backend name
+			@param Device Device name
+			@return Section name
+		 */
+		static Ogre::String getSection(const Ogre::String &Backend, const Ogre::String &Device);
+
+		/** Load the model of a device
+		    @param File Models file
+			@param Section Device section (see getSection())
+			@return false if the file or the device model can't be found
+		 */
+		bool load(const Ogre::String &File, const Ogre::String &Section);
+
+		/** Save the model of a device, replacing its previous model and
+		 * keeping the other devices ones
+		    @param File Models file
+			@param Section Device section (see getSection())
+			@param Comment Additional comment lines (i.e.- the fit
+			residual), without the leading '#'
+			@return false if the file can't be written
+		 */
+		bool save(const Ogre::String &File, const Ogre::String &Section, const std::vector<Ogre::String> &Comment) const;
+
+		/** Get the modelled frame time
+		    @param Complexity Grid complexity
+			@param Waves Number of waves
+			@param Octaves Perlin noise octaves
+			@return Frame time [ms]
+		 */
+		float time(int Complexity, unsigned int Waves, int Octaves) const;
+
+		/** Get the largest complexity whose frame fits a budget
+		    @param Budget Frame budget [ms]
+			@param Waves Number of waves
+			@param Octaves Perlin noise octaves
+			@return Complexity, 0 if not even the cost independent of the
+			vertexes fits, or a negative value if the complexity is not
+			limited by the model
+		 */
+		int maxComplexity(float Budget, unsigned int Waves, int Octaves) const;
+
+		/** Get the largest number of waves whose frame fits a budget
+		    @param Budget Frame budget [ms]
+			@param Complexity Grid complexity
+			@param Octaves Perlin noise octaves
+			@return Number of waves, or a negative value if the waves are
+			not limited by the model
+		 */
+		int maxWaves(float Budget, int Complexity, int Octaves) const;
+	};
+}}
+
+#endif  // HYDROCLCOST_H_INCLUDED
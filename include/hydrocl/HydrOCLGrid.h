@@ -40,14 +40,54 @@ http://www.cnblogs.com/ArenAK/archive/2007/11/07/951713.html
 // OpenCL libraries
 // ----------------------------------------------------------------------------
 #include <CL/cl.h>
+
+#include <pthread.h>
+
+namespace Hydrax{ namespace Noise
+{
+	class HydrOCLNoise;
+}}
 
 namespace Hydrax{ namespace Module
 {
+	class HydrOCLBackend;
+	class HydrOCLOpenCL;
+	class HydrOCLStats;
+	class HydrOCLTrace;
+	class HydrOCLMemory;
+	class HydrOCLRuntime;
+
 	/** Hydrax projected grid module
 	 */
 	class DllExport HydrOCL : public Module
 	{
 	public:
+		/** Computation backends
+		 */
+		enum BackendType
+		{
+			/// OpenCL if available, CPU otherwise
+			BT_AUTO   = 0,
+			/// OpenCL only
+			BT_OPENCL = 1,
+			/// CPU only (OpenCL is not initialized)
+			BT_CPU    = 2
+		};
+
+		/** Strategies to read the vertexes from the OpenCL device
+		 */
+		enum TransferType
+		{
+			/// TT_MAP in the slim memory mode, the recommended one for the device (see HydrOCLTransfer.cfg), or TT_READ otherwise
+			TT_AUTO   = 0,
+			/// Blocking reads into host memory
+			TT_READ   = 1,
+			/// Map the device buffers (zero copy on CPU and integrated devices)
+			TT_MAP    = 2,
+			/// Blocking reads into page-locked (CL_MEM_ALLOC_HOST_PTR) host memory
+			TT_PINNED = 3
+		};
+
 		/** Struct wich contains Hydrax projected grid module options
 		 */
 		struct Options
@@ -63,12 +103,49 @@ namespace Hydrax{ namespace Module
 			float Elevation;
 			/// Smooth
 			bool Smooth;
+			/// Smoothing radius, in vertexes (1-8)
+			int SmoothRadius;
 			/// Force recalculate mesh geometry each frame
 			bool ForceRecalculateGeometry;
 			/// Choppy waves
 			bool ChoppyWaves;
 			/// Choppy waves strength
 			float ChoppyStrength;
+			/// Computation backend
+			BackendType Backend;
+			/// Threads used by the CPU backend (0 = as many as processors)
+			int CPUThreads;
+			/** Validate the backend results against a scalar reference
+			 * implementation each frame (very slow, debugging only)
+			 */
+			bool Validate;
+			/** Frame budget [ms]. If a cost model of the device has been
+			 * fitted (see HydrOCLCost), the complexity and the number of
+			 * evaluated waves are clamped to fit it. 0 disables it.
+			 */
+			float Budget;
+			/** Memory budget [MB], including the device and the host
+			 * memory of the module (see getMemoryUsage()) except the idle
+			 * buffers cached by the pool (HydrOCLMemory::MEM_POOL). 0
+			 * disables it.
+			 */
+			int MemoryBudget;
+			/** Downscale the complexity when the memory budget is
+			 * exceeded, instead of failing to create the module.
+			 */
+			bool MemoryDownscale;
+			/** Keep the host memory to the minimum: the vertexes are read
+			 * by mapping the device buffers when the read strategy is
+			 * TT_AUTO, so no host copies of the grid are kept, trading
+			 * some transfer speed on discrete devices.
+			 */
+			bool SlimMemory;
+			/** Largest complexity expected at runtime. The grid buffers
+			 * are allocated for it, so the complexity can be changed up
+			 * to it without reallocating them. 0 allocates just the
+			 * required ones.
+			 */
+			int MaxComplexity;
 		    // --------------------------------------------
 		    // OpenCL options
 		    // --------------------------------------------
@@ -80,6 +157,49 @@ namespace Hydrax{ namespace Module
 		     * CL_DEVICE_TYPE_ACCELERATOR
 		     */
             cl_device_type DeviceType;
+		    /** Platform or device name substring (case insensitive) of the
+		     * device used, i.e.- "NVIDIA" or "Intel(R) Core". If it is
+		     * empty, or no device matches it, the devices of DeviceType
+		     * are ranked (see the log) and the best one is used.
+		     */
+            Ogre::String Device;
+		    /** Store the vertexes in the device by blocks of 8x8 vertexes,
+		     * instead of row-major order, improving the cache locality of
+		     * the stencil kernels (mainly for CPU devices).
+		     */
+            bool TiledLayout;
+		    /** Store the vertexes and normals in the device as separate
+		     * planes of x, y, z and w components (structure of arrays),
+		     * which vectorizes better on CPU devices.
+		     */
+            bool SoALayout;
+		    /** Profile the OpenCL commands of each stage (see getStats()).
+		     * The command queues are created with profiling enabled only
+		     * if it is requested.
+		     */
+            bool Telemetry;
+		    /** Strategy to read the vertexes from the device. The
+		     * HydrOCLTransferBench benchmark measures them, writing the
+		     * recommendation for each device read by TT_AUTO.
+		     */
+            TransferType Transfer;
+		    /** OpenCL runtime where the vertexes are computed, i.e.- one
+		     * wrapping the application context (see HydrOCLRuntime). If
+		     * NULL the runtime is shared with the other modules that use
+		     * the same device type. The module keeps a reference.
+		     */
+            HydrOCLRuntime *Runtime;
+		    /** Create the OpenCL backend in a background thread, so the
+		     * device selection, the programs build and the initial
+		     * uploads don't stall the module creation. The CPU backend
+		     * output is rendered until it is ready.
+		     */
+            bool AsyncInit;
+		    /** Build variants of the kernels with the options that have not
+		     * changed for a while compiled as constants (see
+		     * HydrOCLVariants), replacing the generic ones when ready.
+		     */
+            bool Specialize;
 
 			/** Default constructor
 			 */
@@ -88,10 +208,27 @@ namespace Hydrax{ namespace Module
 				, Strength(35.0f)
 				, Elevation(50.0f)
 				, Smooth(false)
+				, SmoothRadius(1)
 				, ForceRecalculateGeometry(false)
 				, ChoppyWaves(true)
 				, ChoppyStrength(3.75f)
+				, Backend(BT_AUTO)
+				, CPUThreads(0)
+				, Validate(false)
+				, Budget(4.f)
+				, MemoryBudget(0)
+				, MemoryDownscale(true)
+				, SlimMemory(false)
+				, MaxComplexity(0)
 				, DeviceType(CL_DEVICE_TYPE_ALL)
+				, Device("")
+				, TiledLayout(false)
+				, SoALayout(false)
+				, Telemetry(false)
+				, Transfer(TT_AUTO)
+				, Runtime(NULL)
+				, AsyncInit(true)
+				, Specialize(true)
 			{
 			}
 
@@ -103,10 +240,27 @@ namespace Hydrax{ namespace Module
 				, Strength(35.0f)
 				, Elevation(50.0f)
 				, Smooth(false)
+				, SmoothRadius(1)
 				, ForceRecalculateGeometry(false)
 				, ChoppyWaves(true)
 				, ChoppyStrength(3.75f)
+				, Backend(BT_AUTO)
+				, CPUThreads(0)
+				, Validate(false)
+				, Budget(4.f)
+				, MemoryBudget(0)
+				, MemoryDownscale(true)
+				, SlimMemory(false)
+				, MaxComplexity(0)
 				, DeviceType(CL_DEVICE_TYPE_ALL)
+				, Device("")
+				, TiledLayout(false)
+				, SoALayout(false)
+				, Telemetry(false)
+				, Transfer(TT_AUTO)
+				, Runtime(NULL)
+				, AsyncInit(true)
+				, Specialize(true)
 			{
 			}
 
@@ -124,10 +278,27 @@ namespace Hydrax{ namespace Module
 				, Strength(_Strength)
 				, Elevation(_Elevation)
 				, Smooth(_Smooth)
+				, SmoothRadius(1)
 				, ForceRecalculateGeometry(false)
 				, ChoppyWaves(true)
 				, ChoppyStrength(3.75f)
+				, Backend(BT_AUTO)
+				, CPUThreads(0)
+				, Validate(false)
+				, Budget(4.f)
+				, MemoryBudget(0)
+				, MemoryDownscale(true)
+				, SlimMemory(false)
+				, MaxComplexity(0)
 				, DeviceType(CL_DEVICE_TYPE_ALL)
+				, Device("")
+				, TiledLayout(false)
+				, SoALayout(false)
+				, Telemetry(false)
+				, Transfer(TT_AUTO)
+				, Runtime(NULL)
+				, AsyncInit(true)
+				, Specialize(true)
 			{
 			}
 
@@ -152,10 +323,27 @@ namespace Hydrax{ namespace Module
 				, Strength(_Strength)
 				, Elevation(_Elevation)
 				, Smooth(_Smooth)
+				, SmoothRadius(1)
 				, ForceRecalculateGeometry(_ForceRecalculateGeometry)
 				, ChoppyWaves(_ChoppyWaves)
 				, ChoppyStrength(_ChoppyStrength)
+				, Backend(BT_AUTO)
+				, CPUThreads(0)
+				, Validate(false)
+				, Budget(4.f)
+				, MemoryBudget(0)
+				, MemoryDownscale(true)
+				, SlimMemory(false)
+				, MaxComplexity(0)
 				, DeviceType(_DeviceType)
+				, Device("")
+				, TiledLayout(false)
+				, SoALayout(false)
+				, Telemetry(false)
+				, Transfer(TT_AUTO)
+				, Runtime(NULL)
+				, AsyncInit(true)
+				, Specialize(true)
 			{
 			}
 		};
@@ -219,15 +407,57 @@ namespace Hydrax{ namespace Module
 		{
 			return mOptions;
 		}
+
+		/** Get the telemetry of the computation backend
+		    @return Per stage timings and transferred data, NULL if the
+			telemetry is disabled (see Options::Telemetry) or the backend
+			doesn't support it
+		 */
+		const HydrOCLStats* getStats() const;
+
+		/** Get the name of the active computation backend
+		    @return Backend name, empty if the module has not been created
+			@note It is the CPU one while the OpenCL backend is created in
+			background (see Options::AsyncInit).
+		 */
+		Ogre::String getBackendName() const;
+
+		/** Get the name of the device used by the computation backend
+		    @return Device name, empty if the backend doesn't report it
+		 */
+		Ogre::String getDeviceName() const;
+
+		/** Get the memory allocated by the computation backend
+		    @return Allocated memory, in bytes
+		 */
+		size_t getAllocatedMemory() const;
+
+		/** Get the memory used by the module, its backend and its noise,
+		 * broken down by subsystem, in the device and in the host. The
+		 * peaks are kept when the module is created again.
+		    @return Memory accounting
+		 */
+		const HydrOCLMemory& getMemoryUsage() const;
+
+		/** Start recording the frames into a Chrome trace_event JSON file
+		 * (chrome://tracing, Perfetto). The host spans are always traced,
+		 * and the OpenCL commands intervals too if Options::Telemetry is
+		 * enabled. The trace is kept if the module is created again.
+		    @param File Output file
+			@return true if the recording has started
+		 */
+		bool startTrace(const Ogre::String &File);
+
+		/** Stop recording the frames, closing the trace file
+		 */
+		void stopTrace();
 
 	private:
-		/** Calcule current normals
-		 */
-		void _calculeNormals();
-
-		/** Perform choppy waves
-		 */
-		void _performChoppyWaves();
+		/** Compute the vertexes heights, normals and choppy displacement
+		    @param WorldPos Origin world position
+			@return true if it's sucesfful
+		 */
+		bool _updateHeights(const Ogre::Vector3& WorldPos);
 
 		/** Render geometry
 		    @param m Range
@@ -251,33 +481,78 @@ namespace Hydrax{ namespace Module
 		 */
 	    bool _getMinMax(Ogre::Matrix4 *range);
 
+		/** Clamp the complexity and the number of evaluated waves to the
+		 * frame budget, if a cost model of the backend device is available.
+		 * The backend is resized, or created again, if the complexity is
+		 * clamped.
+		    @param Noise Noise module
+			@return false if the backend can't be resized or created again
+		 */
+		bool _fitBudget(Noise::HydrOCLNoise *Noise);
+
+		/** Finish the backend setup: apply the frame budget, the
+		 * validation and the trace, and allocate the vertexes.
+		    @param Noise Noise module
+			@return false if the module has been removed
+		 */
+		bool _setupBackend(Noise::HydrOCLNoise *Noise);
+
+		/** Start creating the OpenCL backend in a background thread
+			@return false if the thread can't be launched
+		 */
+		bool _startInit();
+
+		/** Background thread entry point
+		    @param data Module
+		 */
+		static void* _initMain(void *data);
+
+		/** Replace the CPU backend by the OpenCL one created in
+		 * background, keeping the CPU one if it has failed.
+		 */
+		void _completeInit();
+
+		/** Wait for the background creation, discarding the OpenCL
+		 * backend
+		 */
+		void _cancelInit();
+
+		/** Create the mesh again, with the current options
+		 */
+		void _createMesh();
+
+		/** Clamp the current options to their bounds
+		 */
+		void _clampOptions();
+
+		/** Allocate the vertexes uploaded to the mesh
+		 */
+		void _createVertices();
+
+		/** Change the complexity keeping the noise module and the backend
+		 * resources that don't depend on it (i.e.- the OpenCL context and
+		 * kernels).
+		    @param Options Options, where only the complexity (and
+			Options::MaxComplexity) changes
+			@return false if the module must be created again instead
+		 */
+		bool _resize(const Options &Options);
+
+		/** Log the memory usage and check it against the memory budget.
+		 * If it is exceeded the backend and the vertexes are resized to a
+		 * lower complexity if Options::MemoryDownscale is set, or the
+		 * module is removed otherwise.
+			@return false if the module has been removed
+		 */
+		bool _fitMemory();
+
 		/** Set displacement amplitude
 		    @param Amplitude Amplitude to set
 		 */
 		void _setDisplacementAmplitude(const float &Amplitude);
 
-        /** Creates OpenCL computational context.
-         * @return true if OpenCL has been already initializated.
-         */
-        bool setupOpenCL();
-        /** Method that looks for a valid platform.
-         * @return true if OpenCL platform has been already selected.
-         */
-        bool getPlatform();
-        /** Method that looks for a valid device.
-         * @return true if valid device has been already selected.
-         */
-        bool getDevices();
-
-        /** Allocates memory into the context.
-         * @return true if memory has been allocated.
-         */
-        bool allocMemory(cl_mem *clID, size_t size);
-
 		/// Vertex pointer (Mesh::POS_NORM_VERTEX or Mesh::POS_VERTEX)
 		void *mVertices;
-		/// Use it to store vertex positions when choppy displacement is enabled
-		Mesh::POS_NORM_VERTEX* mVerticesChoppyBuffer;
 		/// For corners
 		Ogre::Vector4 t_corners0,t_corners1,t_corners2,t_corners3;
 		/// Range matrix
@@ -301,49 +576,24 @@ namespace Hydrax{ namespace Module
 		/// Our Hydrax pointer
 		Hydrax* mHydrax;
 
-        // ------------------------------
-        // OpenCL stuff
-        // ------------------------------
-        /// Number of available platforms
-        cl_uint mNumberOfPlatforms;
-        /// Array of platforms
-        cl_platform_id *mPlatforms;
-        /// Selected platform
-        cl_platform_id mPlatform;
-        /// Number of devices
-        cl_uint mNumberOfDevices;
-        /// Array of devices
-        cl_device_id *mDevices;
-        /// OpenCL context
-        cl_context mContext;
-        /// OpenCL context
-        cl_command_queue *mComQueue;
-        /// Device allocated memory
-        size_t mAllocatedMem;
-        /// In device vertexes
-        cl_mem mVertexes;
-        /// In device normals
-        cl_mem mNormals;
-        /// In device vertexes
-        cl_mem mChoppyVertexes;
-        /// In device normals
-        cl_mem mChoppyNormals;
-        /// OpenCL geometry regeneration kernel.
-        cl_kernel kGeometryGen;
-        /// OpenCL base plane set.
-        cl_kernel kBasePlane;
-        /// OpenCL vertexes & normals copy operation.
-        cl_kernel kCopy;
-        /// OpenCL smoothing kernel.
-        cl_kernel kSmooth;
-        /// OpenCL normals computation kernel.
-        cl_kernel kNormals;
-        /// OpenCL choppy waves computation kernel.
-        cl_kernel kChoppy;
-        /// Positions transfer layer
-        cl_float4 *hPos;
-        /// Normals transfer layer
-        cl_float4 *hNor;
+		/// Computation backend
+		HydrOCLBackend *mBackend;
+		/// OpenCL backend created in background, NULL if there is none
+		HydrOCLOpenCL *mPending;
+		/// Options of the background creation
+		Options mInitOptions;
+		/// Background creation thread
+		pthread_t mInitThread;
+		/// Background creation state lock
+		pthread_mutex_t mInitMutex;
+		/// Background creation has finished
+		bool mInitDone;
+		/// Background creation has succeeded
+		bool mInitResult;
+		/// Frames trace recorder, NULL if tracing is disabled
+		HydrOCLTrace *mTrace;
+		/// Memory accounting
+		HydrOCLMemory *mMemory;
 	};
 }}
 
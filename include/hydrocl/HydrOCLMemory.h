@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLMEMORY_H_INCLUDED
+#define HYDROCLMEMORY_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL libraries
+// ----------------------------------------------------------------------------
+#include <CL/cl.h>
+
+#include <map>
+#include <pthread.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Memory accounting of a projected grid module. Every OpenCL buffer
+	 * and large host array of the module, its backend and its noise is
+	 * registered when allocated and unregistered when released, so the
+	 * current and peak usage can be queried for each subsystem, both in
+	 * the device and in the host.
+	 * @note Use the createBuffer/releaseBuffer and allocHost/releaseHost
+	 * helpers (see HydrOCLUtils.h), which accept a NULL accounting.
+	 * @note The allocations can be registered from several threads (see
+	 * HydrOCL::Options::AsyncInit).
+	 */
+	class DllExport HydrOCLMemory
+	{
+	public:
+		/// Subsystems owning the memory
+		enum Subsystem
+		{
+			/// Backend grid vertexes and normals
+			MEM_GRID      = 0,
+			/// Perlin noise and waves
+			MEM_NOISE     = 1,
+			/// Vertexes read back layers (host copies, pinned memory)
+			MEM_TRANSFER  = 2,
+			/// Module vertexes, uploaded to the Hydrax mesh
+			MEM_VERTEXES  = 3,
+			/// Released buffers kept for reuse (see HydrOCLBufferPool)
+			MEM_POOL      = 4,
+			N_SUBSYSTEMS  = 5
+		};
+
+		/// Memory location
+		enum Location
+		{
+			MEM_DEVICE  = 0,
+			MEM_HOST    = 1,
+			N_LOCATIONS = 2
+		};
+
+		/** Current and peak usage, in bytes
+		 */
+		struct Usage
+		{
+			/// Currently allocated
+			size_t Current;
+			/// Highest allocated since the accounting was reset
+			size_t Peak;
+
+			/** Default constructor
+			 */
+			Usage()
+				: Current(0)
+				, Peak(0)
+			{
+			}
+		};
+
+		/** Default constructor
+		 */
+		HydrOCLMemory();
+
+		/** Destructor
+		 */
+		~HydrOCLMemory();
+
+		/** Register an allocation
+		    @param Subsystem Owner subsystem
+			@param Where Memory location
+			@param Id Allocation identifier (i.e.- the pointer or cl_mem)
+			@param Size Allocated bytes
+		 */
+		void allocated(Subsystem Subsystem, Location Where, const void *Id, size_t Size);
+
+		/** Unregister an allocation. Unknown identifiers are ignored.
+		    @param Id Allocation identifier
+		 */
+		void released(const void *Id);
+
+		/** Get the usage of a subsystem
+		    @param Subsystem Subsystem
+			@param Where Memory location
+			@return Current and peak usage
+		 */
+		const Usage& getUsage(Subsystem Subsystem, Location Where) const {return mUsage[Subsystem][Where];}
+
+		/** Get the usage of all the subsystems
+		    @param Where Memory location
+			@return Current and peak usage
+		 */
+		const Usage& getTotal(Location Where) const {return mTotal[Where];}
+
+		/** Get the usage of all the subsystems, in the device and the host
+		    @return Current and peak usage
+		 */
+		const Usage& getTotal() const {return mAll;}
+
+		/** Reset the peaks to the current usage
+		 */
+		void resetPeaks();
+
+		/** Get a subsystem name
+		    @param Subsystem Subsystem
+			@return Name, used in the log
+		 */
+		static const char* getName(Subsystem Subsystem);
+
+	private:
+		/// Registered allocation
+		struct Record
+		{
+			Subsystem Owner;
+			Location Where;
+			size_t Size;
+		};
+
+		/** Add bytes to a usage, updating its peak
+		    @param U Usage
+			@param Size Bytes
+		 */
+		static void _add(Usage &U, size_t Size);
+
+		/** Unregister an allocation, with the lock already taken
+		    @param Id Allocation identifier
+		 */
+		void _released(const void *Id);
+
+		/// Records and usages lock
+		pthread_mutex_t mMutex;
+		/// Live allocations
+		std::map<const void*, Record> mRecords;
+		/// Usage of each subsystem and location
+		Usage mUsage[N_SUBSYSTEMS][N_LOCATIONS];
+		/// Usage of each location
+		Usage mTotal[N_LOCATIONS];
+		/// Overall usage
+		Usage mAll;
+	};
+}}
+
+#endif  // HYDROCLMEMORY_H_INCLUDED
@@ -109,15 +109,11 @@ namespace Hydrax{ namespace Noise
 
         /** Add wave.
          * @param w Wave to add.
-         * @warning Don't try to add waves until Hydrax has been
-         * created, OpenCL must be already built.
          */
         void wave(const HydrOCLNoise::Wave &w);
         /** Add wave.
          * @param w Wave to add.
          * @note This method simply redirects to wave method.
-         * @warning Don't try to add waves until Hydrax has been
-         * created, OpenCL must be already built.
          */
         void addWave(const HydrOCLNoise::Wave &w){wave(w);}
         /** Get a wave.
@@ -134,6 +130,22 @@ namespace Hydrax{ namespace Noise
          * @note Use this method to modify waves.
          */
         bool removeWave(unsigned int id);
+        /** Get the number of waves.
+         * @return Number of waves.
+         */
+        unsigned int getNumberOfWaves() const {return (unsigned int)mWaves.size();}
+        /** Limit the number of waves evaluated. Only the first waves
+         * are added to the heights, so the most relevant ones should be
+         * added first. The waves out of the limit are kept.
+         * @param n Maximum number of evaluated waves, negative for no
+         * limit.
+         */
+        void setMaxWaves(int n){mMaxWaves = n;}
+        /** Get the limit of evaluated waves.
+         * @return Maximum number of evaluated waves, negative if not
+         * limited.
+         */
+        int getMaxWaves() const {return mMaxWaves;}
 
 		/** Get the especified x/y noise value
          * @param x X Coord
@@ -147,36 +159,87 @@ namespace Hydrax{ namespace Noise
          * @param v Vertexes array.
          * @param N Number of vertexes at each direction.
          * @param world Rendering camera position.
+         * @param Stats Telemetry where the enqueued commands must be
+         * attached, NULL if telemetry is disabled.
          * @return true if sucessful.
 		 */
-		bool setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world);
+		bool setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world, Module::HydrOCLStats *Stats=NULL);
+
+		/** Add the noise and waves heights to a set of vertexes in the
+         * host, as the OpenCL kernels do.
+         * @param x Vertexes x coordinates.
+         * @param z Vertexes z coordinates.
+         * @param y Vertexes y coordinates, to be modified.
+         * @param n Number of vertexes.
+         * @param world Rendering camera position.
+         * @note It can be called from several threads at the same time,
+         * but not while the waves are being modified.
+		 */
+		void setHeight(const float *x, const float *z, float *y, unsigned int n, const Ogre::Vector3 &world) const;
 
         /** Sets the OpenCL stuff.
          * @param n Number of devices available.
          * @param context OpenCL context
          * @param devices Devices array.
          * @param comQueue Commands queues array.
+         * @param flags Additional kernels build flags (i.e.- Vertexes
+         * storage layout).
+         * @param pool Buffers pool of the context, NULL if the buffers
+         * must be created directly.
+         * @param runtime Runtime owning the context, where the built
+         * programs are cached. NULL if the kernels must be built here.
          * @note This object will not modify or destroy
          * OpenCL stuff, do it externally.
          * @return true if OpenCL is ready to work, false if errors
          * found (i.e.- Compiling kernels).
          */
-        bool setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue);
+        bool setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue, const char *flags="",
+                         Module::HydrOCLBufferPool *pool=NULL, Module::HydrOCLRuntime *runtime=NULL);
 
-	private:
-        /** Reallocate memory for objects
+        /** Get the OpenCL programs that setupOpenCL will build (the
+         * Perlin noise and the waves ones).
+         * @param device Device where the programs will be built.
+         * @param flags Additional kernels build flags.
+         * @param programs Output programs list.
+         * @return false if a program can't be found.
          */
-        bool reallocate();
-        /** Sends data to device
+        bool getPrograms(cl_device_id device, const char *flags, std::vector<Module::HydrOCLRuntime::Program> &programs) const;
+
+        /** Releases the OpenCL objects created by setupOpenCL, so the
+         * context can be destroyed. The waves are preserved, and the
+         * heights can still be computed in the host.
          */
-        bool send();
+        void releaseOpenCL();
+
+	protected:
         /** Test if waves has been modified.
          * @return true If waves has been modified, false otherwise.
          */
         bool isModified();
 
+	private:
+        /** Reallocate memory for objects. The device memory is only
+         * allocated if OpenCL has been set.
+         */
+        bool reallocate();
+        /** Sends data to device (if OpenCL has been set)
+         */
+        bool send();
+        /** Get the number of evaluated waves.
+         * @return Number of waves, limited to the maximum.
+         */
+        unsigned int _evaluatedWaves() const;
+        /** Waves program build flags.
+         * @param device Device where the program is built.
+         * @param flags Additional kernels build flags.
+         * @return Build flags.
+         */
+        Ogre::String _wavesFlags(cl_device_id device, const char *flags) const;
+
         /// Set of waves.
         std::deque<Wave*> mWaves;
+        /// Maximum number of evaluated waves (negative for no limit)
+        int mMaxWaves;
         /// Elapsed time
         float mTime;
         /// Device allocated waves direction
@@ -197,6 +260,10 @@ namespace Hydrax{ namespace Noise
 	    cl_float  *hP;
         /// OpenCL kernel.
         cl_kernel kWaves;
+        /// OpenCL waves kernel program
+        Module::HydrOCLRuntime::Program mWavesProgram;
+        /// OpenCL waves kernel specialised variants
+        Module::HydrOCLVariants mWavesVariants;
 
 	};
 }}  // namespace
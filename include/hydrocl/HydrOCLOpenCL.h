@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLOPENCL_H_INCLUDED
+#define HYDROCLOPENCL_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Projected grid backend
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLBackend.h>
+#include <hydrocl/HydrOCLStats.h>
+#include <hydrocl/HydrOCLRuntime.h>
+#include <hydrocl/HydrOCLVariants.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL libraries
+// ----------------------------------------------------------------------------
+#include <CL/cl.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** OpenCL projected grid backend. The vertexes are computed in the
+	 * device, and read back to be rendered.
+	 */
+	class DllExport HydrOCLOpenCL : public HydrOCLBackend
+	{
+	public:
+		/** Constructor
+		 */
+		HydrOCLOpenCL();
+
+		/** Destructor
+		 */
+		~HydrOCLOpenCL();
+
+		const char* getName() const {return "OpenCL";}
+		bool create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule);
+
+		/** First creation step: gets the runtime, builds the grid and the
+		    noise programs at the same time, and allocates the grid. It
+		    doesn't modify the noise module, nor access the Ogre resources
+		    not looked for before (see fileFromResources()), and its log
+		    messages are queued if it is called from a background thread
+		    (see deferLog()).
+		    @param Options Options
+			@param NoiseModule Noise module, whose programs are built
+			@return true if it's sucesfful. Otherwise remove() must be
+			called.
+		 */
+		bool prepare(const HydrOCL::Options &Options, const Noise::HydrOCLNoise *NoiseModule);
+
+		/** Second creation step, called from the thread where the module
+		    is updated: sets up the noise module OpenCL objects.
+		    @param NoiseModule Noise module
+			@return true if it's sucesfful. Otherwise remove() must be
+			called.
+		 */
+		bool complete(Noise::HydrOCLNoise *NoiseModule);
+
+		/** Look for the resource files used by prepare(), so it doesn't
+		    need to access the Ogre resources manager
+		 */
+		static void findResources();
+
+		void remove();
+		void setOptions(const HydrOCL::Options &Options);
+		/** Resize the grid buffers, keeping the context, the command
+		    queues and the kernels. The buffers are only reallocated if
+		    the grid does not fit in them, or if they are larger than
+		    HydrOCL::Options::MaxComplexity requires.
+		 */
+		bool resize(const HydrOCL::Options &Options);
+		bool geometry(const Ogre::Vector4 *Corners);
+		bool basePlane(const float &h);
+		bool noise(const Ogre::Vector3 &World);
+		bool smooth();
+		bool normals();
+		bool choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater);
+		bool read(Mesh::POS_NORM_VERTEX *Vertices);
+		bool finish();
+		const HydrOCLStats* getStats() const {return mStats;}
+		void setTrace(HydrOCLTrace *Trace) {mTrace = Trace;}
+		void setMemory(HydrOCLMemory *Memory) {mMemory = Memory;}
+		Ogre::String getDeviceName() const {return mDeviceName;}
+		size_t getAllocatedMemory() const {return mAllocatedMem;}
+
+	private:
+		/** Launch a grid kernel with Tile x Tile work-groups
+		    @param kernel Kernel to launch, with its arguments already set
+			@param Tile Work-group size at each direction the kernel is built for
+			@param s Stage where the kernel is profiled, if telemetry is enabled
+			@return true if it's sucesfful
+		 */
+		bool _launchTiled(cl_kernel kernel, unsigned int Tile, HydrOCLStats::Stage s);
+
+		/** Launch a vertex wise kernel over the whole device buffers, where
+		    each work-item computes mVectorWidth vertexes of a row
+		    @param kernel Kernel to launch, with its arguments already set
+			@param s Stage where the kernel is profiled, if telemetry is enabled
+			@return true if it's sucesfful
+		 */
+		bool _launchCoarsened(cl_kernel kernel, HydrOCLStats::Stage s);
+
+		/** Get the number of vertexes stored at each direction for a
+		    grid complexity, padding included
+		    @param Complexity Grid complexity
+			@return Stored vertexes at each direction
+		 */
+		cl_uint2 _bufferN(int Complexity) const;
+
+		/** Allocate the grid buffers, and the transfer layer, if they
+		    can't be reused, and send the initial values
+			@return true if it's sucesfful
+		 */
+		bool _createGrid();
+
+		/** Release the grid buffers, and the transfer layer
+		 */
+		void _releaseGrid();
+
+		/** Fill the initial vertexes and normals, in the device layout
+		    @param Pos Vertexes
+			@param Nor Normals
+			@param n Number of vertexes
+		 */
+		void _initValues(cl_float4 *Pos, cl_float4 *Nor, unsigned int n) const;
+
+		/** Select the vertexes read strategy. If HydrOCL::TT_AUTO is
+		    requested, the device buffers are mapped in the slim memory
+		    mode (see HydrOCL::Options::SlimMemory), and the
+		    recommendation for the device is looked for in the
+		    HydrOCLTransfer.cfg resource file otherwise.
+		    @return Read strategy, never HydrOCL::TT_AUTO
+		 */
+		HydrOCL::TransferType _transferType() const;
+
+		/** Create the host side transfer layer (hPos, hNor) according to
+		    the read strategy. Nothing is created if the device buffers
+		    are mapped.
+		    @param size Size of each layer
+			@return true if it's sucesfful
+		 */
+		bool _createTransfer(size_t size);
+
+		/** Release the host side transfer layer
+		 */
+		void _releaseTransfer();
+
+        /** Gets the OpenCL runtime, and builds the kernels.
+         * @param NoiseModule Noise module, whose programs are built at
+         * the same time that the grid one. NULL if they must not be built.
+         * @return true if OpenCL has been already initializated.
+         */
+        bool setupOpenCL(const Noise::HydrOCLNoise *NoiseModule);
+
+        /** Get the noise kernels build flags
+         * @return Build flags
+         */
+        const char* _noiseFlags() const;
+
+        /** Load the geometry, base plane and normals kernels, reducing
+         * mTileSize, and building the program again, until all of them
+         * can be launched with its work-groups.
+         * @return true if the kernels have been loaded.
+         */
+        bool _loadGridKernels();
+
+        /** Get a grid program
+         * @param Tile Work-group size at each direction
+         * @param Flags Stage specific build flags
+         * @return Program
+         */
+        HydrOCLRuntime::Program _gridProgram(unsigned int Tile, const char *Flags) const;
+
+        /** Get the smooth program, built just when smoothing is enabled
+         * @param Radius Smoothing radius
+         * @return Program
+         */
+        HydrOCLRuntime::Program _smoothProgram(unsigned int Radius) const;
+
+        /** Get the choppy waves program, built just when the choppy waves
+         * are enabled
+         * @return Program
+         */
+        HydrOCLRuntime::Program _choppyProgram() const;
+
+        /** Request the background build of the optional programs required
+         * by the current options, if they are not built yet.
+         */
+        void _requestPrograms();
+
+        /** Get the smooth kernel for the current radius. Meanwhile its
+         * program is being built, the kernel of the previous radius is
+         * kept.
+         * @return Smooth kernel, 0 if it is not available yet.
+         */
+        cl_kernel _smoothKernel();
+
+        /** Get the choppy waves kernel
+         * @return Choppy waves kernel, 0 if it is not available yet.
+         */
+        cl_kernel _choppyKernel();
+
+        /** Get the specialisation constants of the grid kernels (see
+         * HydrOCLVariants)
+         * @return Specialisation flags
+         */
+        Ogre::String _constants() const;
+
+        /** Get the kernel to launch: a specialised variant if it has been
+         * already built, the generic one otherwise.
+         * @param Variants Kernel variants
+         * @param Program Generic kernel program
+         * @param Generic Generic kernel
+         * @param Constants Specialisation flags
+         * @param Tile Work-group size at each direction the kernel is launched with
+         * @return Kernel to launch
+         */
+        cl_kernel _specialized(HydrOCLVariants &Variants, const HydrOCLRuntime::Program &Program,
+                               cl_kernel Generic, const Ogre::String &Constants, unsigned int Tile);
+
+        /** Allocates memory into the context.
+         * @return true if memory has been allocated.
+         */
+        bool allocMemory(cl_mem *clID, size_t size);
+
+		/// Projected grid options
+		HydrOCL::Options mOptions;
+		/// Noise module
+		Noise::HydrOCLNoise *mNoise;
+
+        /// OpenCL runtime (context, queues and programs)
+        HydrOCLRuntime *mRuntime;
+        /// Number of devices
+        cl_uint mNumberOfDevices;
+        /// Array of devices
+        cl_device_id *mDevices;
+        /// Name of the device where the grid is computed
+        Ogre::String mDeviceName;
+        /// OpenCL context
+        cl_context mContext;
+        /// OpenCL context
+        cl_command_queue *mComQueue;
+        /// Device allocated memory
+        size_t mAllocatedMem;
+        /** In device vertexes ping-pong pair. One of them stores the
+         * undisplaced vertexes (see mBase), while the other one receives
+         * the smoothed or choppy waves displaced vertexes. Smoothing
+         * swaps the role of both buffers.
+         */
+        cl_mem mVertexes[2];
+        /// Index of the pair buffer that stores the undisplaced vertexes
+        unsigned int mBase;
+        /// Index of the pair buffer that must be read to render
+        unsigned int mOutput;
+        /// In device normals
+        cl_mem mNormals;
+        /** Number of stored vertexes at each direction. Can be greater
+         * than the grid complexity if the device layout requires padding.
+         */
+        cl_uint2 mBufferN;
+        /// Vertexes that fit in each grid buffer
+        unsigned int mCapacity;
+        /// Work-group size at each direction for the geometry, base plane and normals kernels
+        unsigned int mTileSize;
+        /// Work-group size at each direction for the smoothing kernel
+        unsigned int mSmoothTile;
+        /// Work-group size at each direction for the choppy waves kernel
+        unsigned int mChoppyTile;
+        /// Vertexes computed by each work-item of the vertex wise kernels
+        unsigned int mVectorWidth;
+        /// OpenCL geometry regeneration kernel.
+        cl_kernel kGeometryGen;
+        /// OpenCL base plane set.
+        cl_kernel kBasePlane;
+        /// Grid program name
+        Ogre::String mProgramName;
+        /// Grid programs build flags, shared by all the stages but the tile size
+        Ogre::String mProgramFlags;
+        /// OpenCL smoothing kernel.
+        cl_kernel kSmooth;
+        /// Smoothing radius of kSmooth
+        unsigned int mSmoothRadius;
+        /// OpenCL normals computation kernel.
+        cl_kernel kNormals;
+        /// OpenCL choppy waves computation kernel.
+        cl_kernel kChoppy;
+        /// Geometry regeneration kernel specialised variants
+        HydrOCLVariants mGeometryVariants;
+        /// Smoothing kernel specialised variants
+        HydrOCLVariants mSmoothVariants;
+        /// Normals computation kernel specialised variants
+        HydrOCLVariants mNormalsVariants;
+        /// Choppy waves computation kernel specialised variants
+        HydrOCLVariants mChoppyVariants;
+        /// Vertexes read strategy
+        HydrOCL::TransferType mTransfer;
+        /// Page-locked buffers mapped as transfer layer (TT_PINNED only)
+        cl_mem mPinned[2];
+        /// Positions transfer layer
+        cl_float4 *hPos;
+        /// Normals transfer layer
+        cl_float4 *hNor;
+        /// Telemetry, NULL if it is disabled
+        HydrOCLStats *mStats;
+        /// Frames trace recorder, NULL if tracing is disabled
+        HydrOCLTrace *mTrace;
+        /// Memory accounting, NULL if it is not required
+        HydrOCLMemory *mMemory;
+        /// Buffers pool of the context, shared with the noise module
+        HydrOCLBufferPool *mPool;
+	};
+}}
+
+#endif  // HYDROCLOPENCL_H_INCLUDED
@@ -37,6 +37,14 @@ http://graphics.cs.lth.se/theses/projects/projgrid/
 // ----------------------------------------------------------------------------
 #include <CL/cl.h>
 
+// ----------------------------------------------------------------------------
+// Projected grid telemetry
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLStats.h>
+#include <hydrocl/HydrOCLMemory.h>
+#include <hydrocl/HydrOCLRuntime.h>
+#include <hydrocl/HydrOCLVariants.h>
+
 #define n_bits				5
 #define n_size				(1<<(n_bits-1))
 #define n_size_m1			(n_size - 1)
@@ -66,6 +74,11 @@ http://graphics.cs.lth.se/theses/projects/projgrid/
 #define scale_decimalbits	15
 #define scale_magnitude		(1<<(scale_decimalbits-1))
 
+namespace Hydrax{ namespace Module
+{
+	class HydrOCLBufferPool;
+}}
+
 namespace Hydrax{ namespace Noise
 {
 	/** OpenCL accelerated perlin noise module class
@@ -213,9 +226,22 @@ namespace Hydrax{ namespace Noise
 		    @param v Vertexes array.
 		    @param N Number of vertexes at each direction.
 			@param world Rendering camera position.
+			@param Stats Telemetry where the enqueued commands must be
+			attached, NULL if telemetry is disabled.
 			@return true if sucessful.
 		 */
-		bool setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world);
+		bool setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world, Module::HydrOCLStats *Stats=NULL);
+
+		/** Add the perlin noise heights to a set of vertexes in the host,
+		    as the OpenCL kernel does.
+		    @param x Vertexes x coordinates.
+		    @param z Vertexes z coordinates.
+		    @param y Vertexes y coordinates, to be modified.
+		    @param n Number of vertexes.
+			@param world Rendering camera position.
+			@note It can be called from several threads at the same time.
+		 */
+		void setHeight(const float *x, const float *z, float *y, unsigned int n, const Ogre::Vector3 &world) const;
 
 		/** Set/Update perlin noise options
 		    @param Options HydrOCLPerlin noise options
@@ -236,14 +262,61 @@ namespace Hydrax{ namespace Noise
          * @param context OpenCL context
          * @param devices Devices array.
          * @param comQueue Commands queues array.
+         * @param flags Additional kernels build flags (i.e.- Vertexes
+         * storage layout).
+         * @param pool Buffers pool of the context, NULL if the buffers
+         * must be created directly.
+         * @param runtime Runtime owning the context, where the built
+         * programs are cached. NULL if the kernels must be built here.
          * @note This object will not modify or destroy
          * OpenCL stuff, do it externally.
          * @return true if OpenCL is ready to work, false if errors
          * found (i.e.- Compiling kernels).
          */
-        bool setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue);
+        bool setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue, const char *flags="",
+                         Module::HydrOCLBufferPool *pool=NULL, Module::HydrOCLRuntime *runtime=NULL);
+
+        /** Get the OpenCL programs that setupOpenCL will build, so they
+         * can be built in advance (see Module::HydrOCLRuntime::build()).
+         * It doesn't modify the module, so it can be called from any
+         * thread.
+         * @param device Device where the programs will be built.
+         * @param flags Additional kernels build flags, the same ones
+         * passed to setupOpenCL.
+         * @param programs Output programs list, where the programs are
+         * appended.
+         * @return false if a program can't be found.
+         */
+        bool getPrograms(cl_device_id device, const char *flags, std::vector<Module::HydrOCLRuntime::Program> &programs) const;
+
+        /** Releases the OpenCL objects created by setupOpenCL, so the
+         * context can be destroyed. The noise can still be computed in
+         * the host.
+         */
+        void releaseOpenCL();
+
+        /** Set the memory accounting where the OpenCL buffers and host
+         * arrays must be registered.
+         * @param Memory Memory accounting, NULL if it is not required.
+         */
+        void setMemory(Module::HydrOCLMemory *Memory){mMemory = Memory;}
+
+        /** Enable or disable the kernels specialisation (see
+         * Module::HydrOCLVariants). It is enabled by default, but it
+         * requires a runtime (see setupOpenCL).
+         * @param Specialize true if the stable options must be compiled
+         * in the kernels.
+         */
+        void setSpecialize(bool Specialize){mSpecialize = Specialize;}
 
     protected:
+        /** Perlin program build flags.
+         * @param device Device where the program is built.
+         * @param flags Additional kernels build flags.
+         * @return Build flags.
+         */
+        Ogre::String _programFlags(cl_device_id device, const char *flags) const;
+
         /// Number of devices
         cl_uint mNumberOfDevices;
         /// Array of devices
@@ -252,8 +325,20 @@ namespace Hydrax{ namespace Noise
         cl_context mContext;
         /// OpenCL context
         cl_command_queue *mComQueue;
+        /// Vertexes computed by each work-item
+        unsigned int mVectorWidth;
+        /// Memory accounting, NULL if it is not required
+        Module::HydrOCLMemory *mMemory;
+        /// Buffers pool of the context, NULL if it is not used
+        Module::HydrOCLBufferPool *mPool;
+        /// Runtime owning the context, NULL if it is not known
+        Module::HydrOCLRuntime *mRuntime;
+        /// Kernels specialisation
+        bool mSpecialize;
+
+		// The noise helpers are protected so the host hot paths can be
+		// microbenchmarked (see Bench/src/micro.cpp)
 
-	private:
 		/** Initialize noise
 		 */
 		void _initNoise();
@@ -270,6 +355,19 @@ namespace Hydrax{ namespace Noise
 		 */
 	    int _readTexelLinearDual(const int &u, const int &v, const int &o);
 
+		/** Add an octaves pack of the Perlin noise to several vertexes,
+		    without touching the object state (see perlinValue at
+		    perlin.cl)
+		    @param x Vertexes x coordinates
+			@param z Vertexes z coordinates
+			@param value Noise values, noise_magnitude scaled, to be modified
+			@param n Number of vertexes
+			@param world Rendering camera position
+			@param o Octaves pack
+		 */
+		void _perlinOctave(const float *x, const float *z, int * __restrict value, unsigned int n,
+		                   const Ogre::Vector3 &world, int o) const;
+
 		/** Read texel linear
 		    @param u u
 			@param v v
@@ -286,6 +384,8 @@ namespace Hydrax{ namespace Noise
 		 */
 		int _mapSample(const int &u, const int &v, const int &upsamplepower, const int &octave);
 
+	private:
+
 		/// HydrOCLPerlin noise variables
 		int noise[n_size_sq*noise_frames];
 		int o_noise[n_size_sq*max_octaves];
@@ -303,6 +403,10 @@ namespace Hydrax{ namespace Noise
 		cl_mem clNoise;
         /// OpenCL kernel.
         cl_kernel kHeight;
+        /// OpenCL kernel program
+        Module::HydrOCLRuntime::Program mHeightProgram;
+        /// OpenCL kernel specialised variants
+        Module::HydrOCLVariants mHeightVariants;
 
 	};
 }}  // namespace
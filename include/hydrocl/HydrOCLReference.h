@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLREFERENCE_H_INCLUDED
+#define HYDROCLREFERENCE_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Projected grid backend
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLBackend.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Scalar reference backend. Each stage is a straightforward single
+	 * threaded translation of the grid.cl kernels, vertex by vertex, with
+	 * no layout, tiling or vectorization tricks. It is too slow to render,
+	 * but the optimized backends can be validated against it (see
+	 * HydrOCLValidation).
+	 */
+	class DllExport HydrOCLReference : public HydrOCLBackend
+	{
+	public:
+		/** Constructor
+		 */
+		HydrOCLReference();
+
+		/** Destructor
+		 */
+		~HydrOCLReference();
+
+		const char* getName() const {return "Reference";}
+		bool create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule);
+		void remove();
+		void setOptions(const HydrOCL::Options &Options);
+		bool resize(const HydrOCL::Options &Options);
+		bool geometry(const Ogre::Vector4 *Corners);
+		bool basePlane(const float &h);
+		bool noise(const Ogre::Vector3 &World);
+		bool smooth();
+		bool normals();
+		bool choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater);
+		bool read(Mesh::POS_NORM_VERTEX *Vertices);
+		void setMemory(HydrOCLMemory *Memory) {mMemory = Memory;}
+
+	private:
+		/** Normal of an interior vertex (see tileNormal at grid.cl)
+		    @param v Vertexes
+			@param id Vertex index
+			@return Vertex normal
+		 */
+		Ogre::Vector3 _normal(const Ogre::Vector4 *v, unsigned int id) const;
+
+		/// Projected grid options
+		HydrOCL::Options mOptions;
+		/// Noise module
+		Noise::HydrOCLNoise *mNoise;
+		/// Number of vertexes at each direction
+		unsigned int mN;
+		/// Vertexes ping-pong pair (see HydrOCLOpenCL)
+		Ogre::Vector4 *mVertexes[2];
+		/// Normals
+		Ogre::Vector4 *mNormals;
+		/// Memory accounting, NULL if it is not required
+		HydrOCLMemory *mMemory;
+		/// Index of the pair that stores the undisplaced vertexes
+		unsigned int mBase;
+		/// Index of the pair that must be read to render
+		unsigned int mOutput;
+	};
+}}
+
+#endif  // HYDROCLREFERENCE_H_INCLUDED
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLRUNTIME_H_INCLUDED
+#define HYDROCLRUNTIME_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL libraries
+// ----------------------------------------------------------------------------
+#include <CL/cl.h>
+
+#include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** OpenCL runtime: the context, the command queues of its devices, and
+	 * the cache of the programs built on it. It is reference counted, so
+	 * several projected grid modules (and their noise modules) share the
+	 * same runtime, building each program just once.
+	 *
+	 * The runtimes created by the modules are shared by all the modules
+	 * requesting the same device type, device name and queue profiling
+	 * (see acquire()). Each one is created on a single device: the one
+	 * whose "platform: device" name contains the requested name, or the
+	 * best ranked one otherwise. The devices are ranked by their compute
+	 * units, clock, global memory and image support, and, if there are
+	 * several, by a short calibration run of the grid kernels.
+	 *
+	 * An application that already has an OpenCL context can wrap it into
+	 * a runtime, and hand it to the modules through
+	 * HydrOCL::Options::Runtime, so the vertexes are computed in its
+	 * context:
+	 * @code
+	 * HydrOCLRuntime *Runtime = new HydrOCLRuntime(Context, 1, &Device, &Queue);
+	 * Options.Runtime = Runtime;
+	 * // ... Create the modules
+	 * Runtime->release();
+	 * @endcode
+	 */
+	class DllExport HydrOCLRuntime
+	{
+	public:
+		/** Program source and build flags
+		 */
+		struct Program
+		{
+			/// Program name (i.e.- grid.cl, see programSource())
+			Ogre::String Name;
+			/// Preprocessor flags
+			Ogre::String Flags;
+
+			/** Default constructor
+			 */
+			Program()
+			{
+			}
+
+			/** Constructor
+			    @param _Name Program name
+				@param _Flags Preprocessor flags
+			 */
+			Program(const Ogre::String &_Name, const Ogre::String &_Flags)
+				: Name(_Name)
+				, Flags(_Flags)
+			{
+			}
+		};
+
+		/** Wrap an external context. The context and the queues are
+		    retained, so the application can release its own references
+		    whenever it wants.
+		    @param Context OpenCL context
+			@param NumberOfDevices Number of devices
+			@param Devices Devices of the context
+			@param Queues A command queue for each device
+			@note The runtime is created with a reference, owned by the
+			caller, which must call release() when it is not required
+			anymore.
+		 */
+		HydrOCLRuntime(cl_context Context, cl_uint NumberOfDevices,
+		               const cl_device_id *Devices, const cl_command_queue *Queues);
+
+		/** Get a shared runtime, creating it if it doesn't exist yet
+		    @param DeviceType Device type (see HydrOCL::Options::DeviceType)
+			@param Device Platform or device name substring, case
+			insensitive (see HydrOCL::Options::Device). Empty to select the
+			best ranked device.
+			@param Profiling true if the command queues must be profiled
+			@return Runtime, with a new reference owned by the caller. NULL
+			if OpenCL is not available.
+		 */
+		static HydrOCLRuntime* acquire(cl_device_type DeviceType, const Ogre::String &Device, bool Profiling);
+
+		/** Add a reference
+		 */
+		void addRef();
+
+		/** Remove a reference. The runtime is destroyed when the last one
+		    is removed.
+		 */
+		void release();
+
+		/** Get the OpenCL context
+		    @return Context
+		 */
+		cl_context getContext() const {return mContext;}
+
+		/** Get the number of devices
+		    @return Number of devices
+		 */
+		cl_uint getNumberOfDevices() const {return mNumberOfDevices;}
+
+		/** Get the devices
+		    @return Devices array
+		 */
+		cl_device_id* getDevices() const {return mDevices;}
+
+		/** Get the command queues
+		    @return A command queue for each device
+		 */
+		cl_command_queue* getQueues() const {return mQueues;}
+
+		/** Get the name of the first device
+		    @return Device name
+		 */
+		const Ogre::String& getDeviceName() const {return mDeviceName;}
+
+		/** Get if the command queues are profiled
+		    @return true if the events can be profiled
+		 */
+		bool isProfiling() const {return mProfiling;}
+
+		/** Create a kernel for the first device, building its program just
+		    if it has not been already built with the same flags. It can be
+		    called from any thread.
+		    @param name Program name
+			@param entryPoint Kernel function
+			@param flags Preprocessor flags
+			@return Kernel, owned by the caller. 0 if it can't be created.
+		 */
+		cl_kernel loadKernel(const char *name, const char *entryPoint, const char *flags);
+
+		/** Build several programs at the same time, one thread for each
+		    one, keeping them for the following loadKernel() calls. The
+		    programs already built are skipped.
+		    @param Programs Programs to build
+			@return true if all the programs have been built
+			@note It can be called from any thread.
+		 */
+		bool build(const std::vector<Program> &Programs);
+
+		/** Build a program in a background thread, unless it has been
+		    already built or requested. The runtime is kept alive until
+		    the build finishes. If the build fails the program is not
+		    requested again.
+		    @param Program Program to build
+		 */
+		void request(const Program &Program);
+
+		/** Undo a request() call. Once all its requesters have forgotten
+		    it, the program is dropped, so it is released along with the
+		    kernels created from it, and a build still running is
+		    discarded. It will be built again if it is requested. It can
+		    be called from any thread.
+		    @param Program Program requested
+		 */
+		void forget(const Program &Program);
+
+		/** Create a kernel for the first device if its program has been
+		    already built, without building it.
+		    @param name Program name
+			@param entryPoint Kernel function
+			@param flags Preprocessor flags
+			@return Kernel, owned by the caller. 0 if the program is not
+			built yet, or it can't be created.
+		 */
+		cl_kernel findKernel(const char *name, const char *entryPoint, const char *flags);
+
+	private:
+		/** Device found in the platforms
+		 */
+		struct Candidate
+		{
+			/// Device
+			cl_device_id Device;
+			/// "platform: device" name
+			Ogre::String Name;
+			/// Device name
+			Ogre::String DeviceName;
+			/// Compute units
+			cl_uint ComputeUnits;
+			/// Clock [MHz]
+			cl_uint Clock;
+			/// Global memory [MB]
+			cl_ulong GlobalMemory;
+			/// Image support
+			bool Images;
+			/// Score from the device info
+			float Score;
+			/// Grid kernels throughput [Mvertexes/s], 0 if not calibrated
+			float Throughput;
+		};
+
+		/** Default constructor, use acquire()
+		 */
+		HydrOCLRuntime();
+
+		/** Destructor, use release()
+		 */
+		~HydrOCLRuntime();
+
+		/** Select the device, and create the context and the command
+		    queue
+		    @param DeviceType Device type
+			@param Device Platform or device name substring
+			@param Profiling true if the command queues must be profiled
+			@return true if it's sucesfful
+		 */
+		bool _create(cl_device_type DeviceType, const Ogre::String &Device, bool Profiling);
+
+		/** Look for the devices of the requested type in all the platforms
+		    @param DeviceType Device type
+			@param Candidates Found devices, scored from their info
+		 */
+		static void _getCandidates(cl_device_type DeviceType, std::vector<Candidate> &Candidates);
+
+		/** Time the grid kernels in a device
+		    @param Device Device
+			@return Throughput [Mvertexes/s], 0 if the kernels can't be run
+		 */
+		static float _calibrate(cl_device_id Device);
+
+		/** Ranking order
+		    @param a First device
+			@param b Second device
+			@return true if a is better than b
+		 */
+		static bool _better(const Candidate &a, const Candidate &b);
+
+		/** Get a built program
+		    @param key Name and flags
+			@return Program, 0 if it has not been built
+		 */
+		cl_program _findProgram(const Ogre::String &key);
+
+		/** Keep a built program. If other thread has built the same
+		    program meanwhile, it is kept instead.
+		    @param key Name and flags
+			@param program Built program
+			@return Kept program
+		 */
+		cl_program _addProgram(const Ogre::String &key, cl_program program);
+
+		/** Background build thread entry point
+		    @param data Build request
+		 */
+		static void* _requestMain(void *data);
+
+		/// References
+		unsigned int mRefs;
+		/// true if it is shared through acquire()
+		bool mShared;
+		/// Requested device type (shared runtimes)
+		cl_device_type mDeviceType;
+		/// Requested device name (shared runtimes)
+		Ogre::String mDeviceFilter;
+		/// Number of devices
+		cl_uint mNumberOfDevices;
+		/// Array of devices
+		cl_device_id *mDevices;
+		/// Name of the first device
+		Ogre::String mDeviceName;
+		/// OpenCL context
+		cl_context mContext;
+		/// Command queues, one for each device
+		cl_command_queue *mQueues;
+		/// Command queues profiling
+		bool mProfiling;
+		/// Built programs, by name and flags
+		std::map<Ogre::String, cl_program> mPrograms;
+		/// Programs requested (see request()) and not built yet, or failed
+		std::set<Ogre::String> mRequested;
+		/// Number of request() calls not forgotten yet, by program
+		std::map<Ogre::String, unsigned int> mRequesters;
+		/// Built programs lock
+		pthread_mutex_t mMutex;
+	};
+}}
+
+#endif  // HYDROCLRUNTIME_H_INCLUDED
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLSTATS_H_INCLUDED
+#define HYDROCLSTATS_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL libraries
+// ----------------------------------------------------------------------------
+#include <CL/cl.h>
+
+#include <vector>
+
+#include <hydrocl/HydrOCLTrace.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Projected grid telemetry. The backend attaches an OpenCL event to
+	 * each command that it enqueues, and once the commands have been
+	 * completed (i.e.- after reading the vertexes) the events profiling
+	 * info is aggregated per stage, over a rolling window of the last
+	 * resolved frames.
+	 * @note It only exists if HydrOCL::Options::Telemetry is enabled, so
+	 * disabled telemetry costs nothing.
+	 */
+	class DllExport HydrOCLStats
+	{
+	public:
+		/// Pipeline stages
+		enum Stage
+		{
+			STAGE_GEOMETRY  = 0,
+			STAGE_BASEPLANE = 1,
+			STAGE_NOISE     = 2,
+			STAGE_SMOOTH    = 3,
+			STAGE_NORMALS   = 4,
+			STAGE_CHOPPY    = 5,
+			STAGE_READ      = 6,
+			N_STAGES        = 7
+		};
+
+		/** Aggregated times of the rolling window, in milliseconds
+		 */
+		struct Summary
+		{
+			/// Number of samples into the window
+			unsigned int Samples;
+			/// Rolling average
+			float Mean;
+			/// Median
+			float P50;
+			/// 99th percentile
+			float P99;
+			/// Worst sample
+			float Max;
+
+			/** Default constructor
+			 */
+			Summary()
+				: Samples(0)
+				, Mean(0.f)
+				, P50(0.f)
+				, P99(0.f)
+				, Max(0.f)
+			{
+			}
+		};
+
+		/** Constructor
+		 */
+		HydrOCLStats();
+
+		/** Destructor
+		 */
+		~HydrOCLStats();
+
+		/** Attach a command to a stage. Several commands can be attached to
+		    the same stage each frame, and their times are added.
+		    @param s Stage
+			@param Event Event of the enqueued command. This object takes
+			its ownership.
+			@param Bytes Data transferred by the command (0 for kernels)
+		 */
+		void event(Stage s, cl_event Event, size_t Bytes=0);
+
+		/** Aggregate the attached events, that must be already completed,
+		    and release them.
+		    @param Trace Trace recorder where the commands intervals must
+			be recorded as well, NULL if tracing is disabled. The device
+			clock is aligned with the trace one assuming that the last
+			completed command has just finished.
+		    @return false if the profiling info can't be retrieved
+		 */
+		bool resolve(HydrOCLTrace *Trace=NULL);
+
+		/** Start timing the host side repacking of the vertexes
+		 */
+		void repackBegin();
+
+		/** Stop timing the host side repacking of the vertexes
+		 */
+		void repackEnd();
+
+		/** Release the attached events and forget all the samples
+		 */
+		void reset();
+
+		/** Time spent by the commands of a stage in the device
+		    @param s Stage
+			@return Stage times (end - start)
+		 */
+		Summary getDevice(Stage s) const;
+
+		/** Time spent by the commands of a stage waiting to be submitted
+		    to the device
+		    @param s Stage
+			@return Stage times (submit - queued)
+		 */
+		Summary getQueued(Stage s) const;
+
+		/** Time spent by the commands of a stage, already submitted,
+		    waiting to be executed
+		    @param s Stage
+			@return Stage times (start - submit)
+		 */
+		Summary getSubmitted(Stage s) const;
+
+		/** Host side repacking time
+			@return Repacking times
+		 */
+		Summary getRepack() const;
+
+		/** Data sent to the device since the telemetry was reset
+			@return Bytes
+		 */
+		unsigned long long getBytesSent() const {return mBytesSent;}
+
+		/** Data read from the device since the telemetry was reset
+			@return Bytes
+		 */
+		unsigned long long getBytesRead() const {return mBytesRead;}
+
+		/** Stage name
+		    @param s Stage
+			@return Name of the stage
+		 */
+		static const char* getStageName(Stage s);
+
+	private:
+		/** Rolling window of samples
+		 */
+		class Window
+		{
+		public:
+			/** Constructor
+			 */
+			Window();
+			/** Add a sample, overwriting the oldest one if full
+			    @param v Sample
+			 */
+			void add(float v);
+			/** Forget all the samples
+			 */
+			void clear();
+			/** Aggregate the samples
+			    @return Summary
+			 */
+			Summary get() const;
+		private:
+			/// Samples
+			std::vector<float> mSamples;
+			/// Position of the next sample
+			unsigned int mNext;
+			/// Number of valid samples
+			unsigned int mCount;
+		};
+
+		/// Attached command
+		struct Command
+		{
+			/// Stage
+			Stage s;
+			/// Event
+			cl_event Event;
+			/// Transferred data
+			size_t Bytes;
+		};
+
+		/// Attached commands waiting to be resolved
+		std::vector<Command> mCommands;
+		/// Device times
+		Window mDevice[N_STAGES];
+		/// Queued times
+		Window mQueued[N_STAGES];
+		/// Submitted times
+		Window mSubmitted[N_STAGES];
+		/// Repacking times
+		Window mRepack;
+		/// Repacking timer
+		Ogre::Timer mTimer;
+		/// Sent data
+		unsigned long long mBytesSent;
+		/// Read data
+		unsigned long long mBytesRead;
+	};
+}}
+
+#endif  // HYDROCLSTATS_H_INCLUDED
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLTHREADPOOL_H_INCLUDED
+#define HYDROCLTHREADPOOL_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Standar libraries
+// ----------------------------------------------------------------------------
+#include <deque>
+#include <pthread.h>
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Work-stealing threads pool. Each job is split in a number of tasks,
+	 * distributed in contiguous blocks among the workers queues. Each
+	 * worker takes the tasks from the front of its own queue, and when it
+	 * becomes empty steals them from the back of the other ones, so the
+	 * unbalanced jobs are still evenly computed. The thread that launches
+	 * the job works as well.
+	 */
+	class DllExport HydrOCLThreadPool
+	{
+	public:
+		/** Job to be computed by the pool.
+		 */
+		class Job
+		{
+		public:
+			/** Destructor
+			 */
+			virtual ~Job() {}
+
+			/** Computes a task of the job.
+			    @param task Task index.
+			    @note It is called from several threads at the same time.
+			 */
+			virtual void run(unsigned int task) = 0;
+		};
+
+		/** Constructor
+		    @param nThreads Number of threads, the calling one included. 0
+		    to use as many threads as available processors.
+		 */
+		HydrOCLThreadPool(unsigned int nThreads=0);
+
+		/** Destructor
+		 */
+		~HydrOCLThreadPool();
+
+		/** Computes a job, returning when all its tasks have been computed.
+		    @param job Job to compute.
+		    @param nTasks Number of tasks.
+		    @warning It must be called from a single thread.
+		 */
+		void run(Job *job, unsigned int nTasks);
+
+		/** Get the number of threads
+		    @return Number of threads, the calling one included
+		 */
+		inline unsigned int getNumberOfThreads() const
+		{
+			return mNumberOfThreads;
+		}
+
+	private:
+		/** Tasks queue of a worker.
+		 */
+		struct Queue
+		{
+			/// Queue lock
+			pthread_mutex_t mutex;
+			/// Pending tasks
+			std::deque<unsigned int> tasks;
+		};
+
+		/** Worker thread data.
+		 */
+		struct Worker
+		{
+			/// Owner pool
+			HydrOCLThreadPool *pool;
+			/// Worker index (0 is the calling thread)
+			unsigned int id;
+		};
+
+		/** Worker threads entry point.
+		    @param data Worker data.
+		 */
+		static void* _main(void *data);
+
+		/** Computes tasks of the current job until all the queues are empty.
+		    @param id Worker index.
+		 */
+		void _work(unsigned int id);
+
+		/** Takes a task from the front of a worker queue.
+		    @param id Worker index.
+		    @param task Output task index.
+		    @return false if the queue is empty.
+		 */
+		bool _pop(unsigned int id, unsigned int &task);
+
+		/** Takes a task from the back of other worker queue.
+		    @param id Thief worker index.
+		    @param task Output task index.
+		    @return false if all the queues are empty.
+		 */
+		bool _steal(unsigned int id, unsigned int &task);
+
+		/// Number of threads, the calling one included
+		unsigned int mNumberOfThreads;
+		/// Worker threads (mNumberOfThreads - 1)
+		pthread_t *mThreads;
+		/// Workers data
+		Worker *mWorkers;
+		/// Workers queues
+		Queue *mQueues;
+		/// Job state lock
+		pthread_mutex_t mMutex;
+		/// Signaled when a new job is available
+		pthread_cond_t mJobReady;
+		/// Signaled when the last worker leaves the job
+		pthread_cond_t mJobDone;
+		/// Current job
+		Job *mJob;
+		/// Launched jobs counter, used to wake up the workers
+		unsigned int mGeneration;
+		/// Worker threads still computing the current job
+		unsigned int mActive;
+		/// Workers must exit
+		bool mExit;
+	};
+}}
+
+#endif  // HYDROCLTHREADPOOL_H_INCLUDED
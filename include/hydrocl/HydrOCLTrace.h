@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLTRACE_H_INCLUDED
+#define HYDROCLTRACE_H_INCLUDED
+
+#include <stdio.h>
+#include <pthread.h>
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Frames trace recorder, written as a Chrome trace_event JSON file
+	 * that can be opened with chrome://tracing or Perfetto. Host spans
+	 * and device commands intervals are recorded in separate tracks.
+	 *
+	 * Spans must be recorded from the rendering thread. They are stored
+	 * in a bounded single producer / single consumer lock-free ring
+	 * buffer, and written to the file by a background thread, so the
+	 * recording thread never blocks nor does I/O. If the buffer is full
+	 * the span is dropped (see getDropped()).
+	 */
+	class DllExport HydrOCLTrace
+	{
+	public:
+		/// Trace tracks
+		enum Track
+		{
+			/// Host (rendering thread) spans
+			TRACK_HOST   = 0,
+			/// Device commands intervals
+			TRACK_DEVICE = 1
+		};
+
+		/** Scoped host span, recorded when destroyed. Nothing is done
+		 * if no trace is given, so it can be left in the hot paths.
+		 */
+		class Scope
+		{
+		public:
+			/** Constructor
+			    @param Trace Trace recorder, NULL if tracing is disabled
+				@param Name Span name (must be a static string)
+			 */
+			Scope(HydrOCLTrace *Trace, const char *Name)
+				: mTrace(Trace)
+				, mName(Name)
+				, mBegin(Trace ? Trace->now() : 0.0)
+			{
+			}
+
+			/** Destructor
+			 */
+			~Scope()
+			{
+				if(mTrace) mTrace->span(mName, mBegin, mTrace->now());
+			}
+		private:
+			/// Trace recorder
+			HydrOCLTrace *mTrace;
+			/// Span name
+			const char *mName;
+			/// Span begin [us]
+			double mBegin;
+		};
+
+		/** Constructor
+		 */
+		HydrOCLTrace();
+
+		/** Destructor
+		 */
+		~HydrOCLTrace();
+
+		/** Start recording
+		    @param File Output JSON file
+			@return true if the file has been opened and the flushing
+			thread started
+		 */
+		bool start(const Ogre::String &File);
+
+		/** Stop recording, writing the pending spans and closing the file
+		 */
+		void stop();
+
+		/** Time since the recording started
+		    @return Time [us]
+		 */
+		double now() {return (double)mTimer.getMicroseconds();}
+
+		/** Record a span
+		    @param Name Span name (must be a static string)
+			@param Begin Begin time [us], see now()
+			@param End End time [us], see now()
+			@param t Track
+		 */
+		void span(const char *Name, double Begin, double End, Track t=TRACK_HOST);
+
+		/** Number of spans dropped because the buffer was full
+		    @return Dropped spans
+		 */
+		unsigned int getDropped() const {return mDropped;}
+
+	private:
+		/** Flushing thread entry point
+		    @param Trace Trace recorder
+		 */
+		static void* _run(void *Trace);
+
+		/** Write the recorded spans to the file
+		 */
+		void _flush();
+
+		/// Recorded span
+		struct Span
+		{
+			/// Name
+			const char *Name;
+			/// Begin [us]
+			double Begin;
+			/// End [us]
+			double End;
+			/// Track
+			Track t;
+		};
+
+		/// Ring buffer
+		Span *mSpans;
+		/// Next span to be written by the recording thread
+		volatile unsigned int mHead;
+		/// Next span to be read by the flushing thread
+		volatile unsigned int mTail;
+		/// Dropped spans
+		unsigned int mDropped;
+		/// Output file
+		FILE *mFile;
+		/// Flushing thread
+		pthread_t mThread;
+		/// false when the flushing thread must exit
+		volatile bool mRunning;
+		/// Trace clock
+		Ogre::Timer mTimer;
+	};
+}}
+
+#endif  // HYDROCLTRACE_H_INCLUDED
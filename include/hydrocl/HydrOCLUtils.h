@@ -32,6 +32,119 @@
 // ----------------------------------------------------------------------------
 #include <CL/cl.h>
 
+#include <hydrocl/HydrOCLMemory.h>
+
+#include <list>
+
+namespace Hydrax{ namespace Module
+{
+	/** Pool of OpenCL buffers of a context. Released buffers are kept in
+	 * the pool, and reused by the next buffers of the same flags and size
+	 * class, so reallocating the grid, the Perlin noise or the waves
+	 * doesn't create and release OpenCL buffers in the steady state.
+	 * The sizes are rounded up to quarter power of two steps, so up to a
+	 * 25% of each buffer may be wasted. The cached buffers are registered
+	 * into the memory accounting as HydrOCLMemory::MEM_POOL, and the
+	 * oldest ones are released when the cached memory exceeds a limit.
+	 * @note Use it through createBuffer/releaseBuffer.
+	 */
+	class DllExport HydrOCLBufferPool
+	{
+	public:
+		/** Constructor
+		    @param Context OpenCL context where the buffers are created
+			@param Memory Memory accounting, NULL if it is not required
+			@param MaxCached Maximum memory kept in the pool, in bytes
+		 */
+		HydrOCLBufferPool(cl_context Context, HydrOCLMemory *Memory, size_t MaxCached);
+
+		/** Destructor. The cached buffers are released, while the
+		    acquired ones must have been already released.
+		 */
+		~HydrOCLBufferPool();
+
+		/** Get a buffer, from the pool if possible
+		    @param Subsystem Subsystem that owns the buffer
+			@param flags Buffer flags
+			@param size Buffer size, it will be rounded up to its class
+			@param clFlag Output error code, as clCreateBuffer
+			@return Buffer, 0 if it can't be created
+		 */
+		cl_mem acquire(HydrOCLMemory::Subsystem Subsystem, cl_mem_flags flags, size_t size, cl_int *clFlag);
+
+		/** Return a buffer to the pool
+		    @param buffer Buffer acquired from this pool
+		 */
+		void release(cl_mem buffer);
+
+		/** Release all the cached buffers
+		 */
+		void trim();
+
+		/** Get the size class of a buffer
+		    @param size Requested size
+			@return Allocated size
+		 */
+		static size_t sizeClass(size_t size);
+
+		/// Buffers taken from the pool
+		unsigned int getHits() const {return mHits;}
+		/// Buffers created because none was available in the pool
+		unsigned int getMisses() const {return mMisses;}
+		/// Cached buffers released because the pool was full
+		unsigned int getEvictions() const {return mEvictions;}
+		/// Memory kept in the pool, in bytes
+		size_t getCached() const {return mCached;}
+
+	private:
+		/// Cached buffer
+		struct Entry
+		{
+			cl_mem Buffer;
+			cl_mem_flags Flags;
+			size_t Size;
+		};
+
+		/** Release the oldest cached buffer
+		 */
+		void _evict();
+
+		/// OpenCL context
+		cl_context mContext;
+		/// Memory accounting, NULL if it is not required
+		HydrOCLMemory *mMemory;
+		/// Maximum cached memory
+		size_t mMaxCached;
+		/// Cached memory
+		size_t mCached;
+		/// Cached buffers, the oldest first
+		std::list<Entry> mFree;
+		/// Pool statistics
+		unsigned int mHits, mMisses, mEvictions;
+	};
+}}
+
+/** Write a message into the Hydrax log. The Ogre log manager can't be
+ * used from several threads, so the messages of the threads marked with
+ * deferLog() are queued, and written by the main thread along with its
+ * next message, or at the next flushLog() call.
+ * @param msg Message.
+ */
+void logMessage(const Ogre::String &msg);
+
+/** Queue the log messages of the calling thread (see logMessage()). It
+ * must be called at the start of the background threads.
+ */
+void deferLog();
+
+/** Write the queued log messages. It does nothing if it is called from a
+ * background thread (see deferLog()).
+ */
+void flushLog();
+
+/// Log a message, from any thread (see logMessage())
+#define HydrOCLLOG(msg) ::logMessage(msg)
+
 /** Method that returns the next number to n that is divisible by divisor.
  * @param n Number to rounded up.
  * @param divisor Divisor.
@@ -39,23 +152,93 @@
  */
 unsigned int roundUp(unsigned int n, unsigned int divisor);
 
+/** Number of consecutive vertexes that each work-item of the vertex wise
+ * kernels (base plane, noise) should process on the device. GPUs work
+ * better with one vertex per work-item, while CPU devices require fewer
+ * and fatter work-items in order to fill their SIMD units.
+ * @param device Device.
+ * @return 1, 4 or 8 vertexes per work-item.
+ */
+unsigned int vectorWidth(cl_device_id device);
+
+/** Biggest square work-group side, not greater than the one the kernel
+ * has been built for, that the kernel can be launched with. Kernels
+ * using lots of local memory or registers may accept work-groups smaller
+ * than the device maximum one.
+ * @param kernel Kernel built with tile x tile work-groups.
+ * @param device Device where the kernel is launched.
+ * @param tile Work-group size at each direction the kernel is built for.
+ * @return Work-group size at each direction, a power of two.
+ */
+unsigned int tileSize(cl_kernel kernel, cl_device_id device, unsigned int tile);
+
+/** Copy the vertexes read from the device into an Ogre vertex buffer, in
+ * row-major order.
+ * @param Pos Device positions.
+ * @param Nor Device normals.
+ * @param N Number of vertexes at each direction (grid complexity).
+ * @param BufferN Number of stored vertexes at each direction.
+ * @param Tiled true if the vertexes are stored by 8x8 blocks.
+ * @param SoA true if the vertexes are stored as x, y, z, w planes.
+ * @param Vertices Ogre vertexes.
+ */
+void repackVertexes(const cl_float4 *Pos, const cl_float4 *Nor, unsigned int N, cl_uint2 BufferN,
+                    bool Tiled, bool SoA, Hydrax::Mesh::POS_NORM_VERTEX *Vertices);
+
 /** Resource file path. Looks for into resources manager specified file
- * and returns the location.
+ * and returns the location. The result is kept, so the next calls
+ * (i.e.- from a background thread) don't access the resources manager.
+ * It is used for the configuration files, the OpenCL programs are
+ * embedded into the library (see programSource()).
  * @param fileName File name.
  * @return file path, NULL if can't be find.
  */
 const char* fileFromResources(const char* fileName);
 
+/** Embedded OpenCL program source (see HydrOCLSources.cpp).
+ * @param name Program name (i.e.- grid.cl).
+ * @param length Output source length, ignored if NULL.
+ * @return Program source, NULL if there is not such program.
+ */
+const char* embeddedSource(const char* name, size_t *length=NULL);
+
+/** OpenCL program source. The embedded one is used, unless the
+ * HYDROCL_PROGRAMS environment variable is set to a folder with a file
+ * of the same name (i.e.- src/hydrocl/cl), so the programs can be
+ * modified without building the library again.
+ * @param name Program name (i.e.- grid.cl).
+ * @param source Output program source.
+ * @return false if the program can't be found.
+ */
+bool programSource(const char* name, Ogre::String &source);
+
+/** Builds an OpenCL program.
+ * @param clContext Context where the program must loaded.
+ * @param clDevide Device whose build log is reported.
+ * @param name Program name (see programSource()).
+ * @param flags Preprocessor flags.
+ * @return Built program, 0 if can't be built.
+ */
+cl_program buildProgram(cl_context clContext, cl_device_id clDevice,
+                        const char* name, const char* flags);
+
+/** Creates a kernel of an already built program.
+ * @param program Built program.
+ * @param entryPoint Method into the program that must be called.
+ * @return Kernel, 0 if can't be created.
+ */
+cl_kernel loadKernel(cl_program program, const char* entryPoint);
+
 /** Loads an OpenCL kernel.
  * @param clContext Context where the program must loaded.
  * @param clDevide Device that must use the kernel.
- * @param path Path of the kernel file.
+ * @param name Program name (see programSource()).
  * @param entryPoint Method into the kernel that must be called.
  * @param flags Preprocessor flags.
  * @return Loaded kernel, 0 if can't be loaded.
  */
-cl_kernel loadKernelFromFile(cl_context clContext, cl_device_id clDevice,
-                          const char* path, const char* entryPoint, const char* flags);
+cl_kernel buildKernel(cl_context clContext, cl_device_id clDevice,
+                      const char* name, const char* entryPoint, const char* flags);
 
 /** Method that sends an argument to OpenCL kernel.
  * @param kernel Kernel that must receive the argument.
@@ -71,17 +254,69 @@ int sendArgument(cl_kernel kernel, int index, size_t size, void* ptr);
  * @param Dest Host allocated memory.
  * @param Orig Device allocated memopry.
  * @param Size Data size to transfer.
+ * @param Event Event of the transfer, NULL if it is not required.
  * @return true if sucessfully transfer.
  */
-bool getData(cl_command_queue Queue, void *Dest, cl_mem Orig, size_t Size);
+bool getData(cl_command_queue Queue, void *Dest, cl_mem Orig, size_t Size, cl_event *Event=NULL);
 
 /** Send data to device.
  * @param Queue Command queue.
  * @param Dest Device allocated memory.
  * @param Orig Host allocated memory.
  * @param Size Data size to send.
+ * @param Event Event of the transfer, NULL if it is not required.
  * @return true if sucessfully transfer.
  */
-bool sendData(cl_command_queue Queue, cl_mem Dest, void* Orig, size_t Size);
+bool sendData(cl_command_queue Queue, cl_mem Dest, void* Orig, size_t Size, cl_event *Event=NULL);
 
+/** Create an OpenCL buffer, registering it into the memory accounting.
+ * The CL_MEM_ALLOC_HOST_PTR buffers are accounted as host memory.
+ * @param Memory Memory accounting, NULL if it is not required.
+ * @param Subsystem Subsystem that owns the buffer.
+ * @param context Context.
+ * @param flags Buffer flags.
+ * @param size Buffer size.
+ * @param clFlag Output error code, as clCreateBuffer.
+ * @param Pool Buffers pool of the context, NULL to create the buffer
+ * directly. The pool registers the buffer into its own accounting.
+ * @return Buffer, 0 if it can't be created.
+ */
+cl_mem createBuffer(Hydrax::Module::HydrOCLMemory *Memory, Hydrax::Module::HydrOCLMemory::Subsystem Subsystem,
+                    cl_context context, cl_mem_flags flags, size_t size, cl_int *clFlag,
+                    Hydrax::Module::HydrOCLBufferPool *Pool=NULL);
+
+/** Release an OpenCL buffer, unregistering it from the memory accounting.
+ * @param Memory Memory accounting, NULL if it is not required.
+ * @param buffer Buffer, it can be 0.
+ * @param Pool Buffers pool where the buffer was created, NULL if it was
+ * created directly.
+ */
+void releaseBuffer(Hydrax::Module::HydrOCLMemory *Memory, cl_mem buffer,
+                   Hydrax::Module::HydrOCLBufferPool *Pool=NULL);
+
+/** Allocate a host array, registering it into the memory accounting.
+ * @param Memory Memory accounting, NULL if it is not required.
+ * @param Subsystem Subsystem that owns the array.
+ * @param n Number of elements.
+ * @return Array, to be released with releaseHost.
+ */
+template<class T> T* allocHost(Hydrax::Module::HydrOCLMemory *Memory, Hydrax::Module::HydrOCLMemory::Subsystem Subsystem, size_t n)
+{
+    T *p = new T[n];
+    if(Memory) Memory->allocated(Subsystem, Hydrax::Module::HydrOCLMemory::MEM_HOST, p, n*sizeof(T));
+    return p;
+}
+
+/** Release a host array allocated with allocHost.
+ * @param Memory Memory accounting, NULL if it is not required.
+ * @param p Array, it can be NULL.
+ */
+template<class T> void releaseHost(Hydrax::Module::HydrOCLMemory *Memory, T *p)
+{
+    if(!p)
+        return;
+    if(Memory) Memory->released(p);
+    delete[] p;
+}
+
 #endif // HYDROCLUTILS_H_INCLUDED
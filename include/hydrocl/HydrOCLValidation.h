@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLVALIDATION_H_INCLUDED
+#define HYDROCLVALIDATION_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Projected grid backends
+// ----------------------------------------------------------------------------
+#include <hydrocl/HydrOCLBackend.h>
+#include <hydrocl/HydrOCLReference.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Validation backend. Forwards every stage both to the backend being
+	 * validated and to the scalar reference one, and each time the
+	 * vertexes are read compares both results, logging the stages whose
+	 * results are out of tolerance. The rendered vertexes are the
+	 * validated backend ones.
+	 * @note It is meant for debugging (see HydrOCL::Options::Validate),
+	 * since the reference backend is very slow.
+	 */
+	class DllExport HydrOCLValidation : public HydrOCLBackend
+	{
+	public:
+		/** Constructor
+		    @param Backend Backend to validate, already created. This
+			object takes its ownership.
+		 */
+		HydrOCLValidation(HydrOCLBackend *Backend);
+
+		/** Destructor
+		 */
+		~HydrOCLValidation();
+
+		const char* getName() const {return mBackend->getName();}
+		/** Create the reference backend (the validated one must be
+		    already created)
+		 */
+		bool create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule);
+		void remove();
+		void setOptions(const HydrOCL::Options &Options);
+		bool resize(const HydrOCL::Options &Options);
+		bool geometry(const Ogre::Vector4 *Corners);
+		bool basePlane(const float &h);
+		bool noise(const Ogre::Vector3 &World);
+		bool smooth();
+		bool normals();
+		bool choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater);
+		bool read(Mesh::POS_NORM_VERTEX *Vertices);
+		bool finish();
+		const HydrOCLStats* getStats() const {return mBackend->getStats();}
+		void setTrace(HydrOCLTrace *Trace) {mBackend->setTrace(Trace);}
+		Ogre::String getDeviceName() const {return mBackend->getDeviceName();}
+		size_t getAllocatedMemory() const {return mBackend->getAllocatedMemory();}
+		void setMemory(HydrOCLMemory *Memory) {mMemory = Memory; mBackend->setMemory(Memory);}
+
+		/** Number of reads compared since the backends were created
+		    @return Compared reads
+		 */
+		unsigned int getChecks() const {return mChecks;}
+
+		/** Number of reads out of tolerance since the backends were created
+		    @return Reads out of tolerance
+		 */
+		unsigned int getFailures() const {return mFailures;}
+
+	private:
+		/// Backend being validated
+		HydrOCLBackend *mBackend;
+		/// Reference backend
+		HydrOCLReference *mReference;
+		/// Reference vertexes
+		Mesh::POS_NORM_VERTEX *mVertices;
+		/// Number of vertexes
+		unsigned int mN;
+		/// Stages computed since the last read
+		Ogre::String mStages;
+		/// Number of compared reads
+		unsigned int mChecks;
+		/// Number of reads out of tolerance
+		unsigned int mFailures;
+		/// Memory accounting, NULL if it is not required
+		HydrOCLMemory *mMemory;
+	};
+}}
+
+#endif  // HYDROCLVALIDATION_H_INCLUDED
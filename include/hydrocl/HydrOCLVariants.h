@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef HYDROCLVARIANTS_H_INCLUDED
+#define HYDROCLVARIANTS_H_INCLUDED
+
+// ----------------------------------------------------------------------------
+// Hydrax plugin
+// ----------------------------------------------------------------------------
+#include <Hydrax/Prerequisites.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL libraries
+// ----------------------------------------------------------------------------
+#include <CL/cl.h>
+
+#include <map>
+#include <set>
+
+#include <hydrocl/HydrOCLRuntime.h>
+
+namespace Hydrax{ namespace Module
+{
+	/** Specialised variants of a kernel. The kernels receive the options as
+	 * arguments, so a single build serves all of them, but the loops
+	 * bounded by them can't be unrolled, nor the expressions folded. A
+	 * variant is the same program built with some of these arguments
+	 * injected as constants (-DCONST_* flags, see the programs), keeping
+	 * the arguments list, so the generic kernel and its variants are
+	 * launched in the same way.
+	 *
+	 * The variants are built in background (see HydrOCLRuntime::request())
+	 * once the same constants have been requested for a while, so the
+	 * options being tweaked don't flood the device compiler. Meanwhile the
+	 * generic kernel must be used. The built variants are cached by their
+	 * constants, so switching back to a previous options set is immediate.
+	 * The cache is bounded: when too many variants have been requested,
+	 * their kernels are released and their programs dropped from the
+	 * runtime (see HydrOCLRuntime::forget()).
+	 */
+	class DllExport HydrOCLVariants
+	{
+	public:
+		/** Default constructor
+		 */
+		HydrOCLVariants();
+
+		/** Destructor
+		 */
+		~HydrOCLVariants();
+
+		/** Set the runtime where the variants are built
+		    @param Runtime Runtime. NULL to disable the variants.
+			@param EntryPoint Kernel function
+		 */
+		void setup(HydrOCLRuntime *Runtime, const char *EntryPoint);
+
+		/** Release the variants kernels
+		 */
+		void release();
+
+		/** Get the variant of the current constants
+		    @param Generic Generic kernel program
+			@param Constants Specialisation flags, appended to the generic
+			program ones
+			@return Variant kernel. 0 if it is not available yet, so the
+			generic one must be used instead.
+		 */
+		cl_kernel get(const HydrOCLRuntime::Program &Generic, const Ogre::String &Constants);
+
+		/** Get a specialisation flag
+		    @param Name Constant name
+			@param Value Constant value
+			@return " -DName=Value"
+		 */
+		static Ogre::String constant(const char *Name, unsigned int Value);
+
+		/** Get a specialisation flag
+		    @param Name Constant name
+			@param Value Constant value, exactly represented
+			@return " -DName=Value"
+		 */
+		static Ogre::String constant(const char *Name, float Value);
+
+	private:
+		/** Release the variants kernels, and drop their programs from the
+		 * runtime
+		 */
+		void _evict();
+
+		/// Runtime, NULL if the variants are disabled
+		HydrOCLRuntime *mRuntime;
+		/// Kernel function
+		Ogre::String mEntryPoint;
+		/// Last requested program flags
+		Ogre::String mFlags;
+		/// Number of consecutive requests of mFlags
+		unsigned int mStable;
+		/// Built variants kernels, by program flags
+		std::map<Ogre::String, cl_kernel> mVariants;
+		/// Program name of the variants
+		Ogre::String mName;
+		/// Requested variants program flags
+		std::set<Ogre::String> mRequested;
+	};
+}}
+
+#endif  // HYDROCLVARIANTS_H_INCLUDED
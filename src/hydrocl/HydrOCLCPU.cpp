@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <hydrocl/HydrOCLCPU.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLCPU::HydrOCLCPU()
+		: mNoise(NULL)
+		, mPool(NULL)
+		, mN(0)
+		, mRowsPerTask(1)
+		, mNX(NULL)
+		, mNY(NULL)
+		, mNZ(NULL)
+		, mBase(0)
+		, mOutput(0)
+		, mStage(STAGE_GEOMETRY)
+		, mH(0.f)
+		, mDirX(0.f)
+		, mDirZ(0.f)
+		, mUnderwater(1.f)
+		, mVertices(NULL)
+		, mMemory(NULL)
+	{
+	    unsigned int i;
+	    for(i=0;i<2;i++) {
+	        mX[i] = NULL; mY[i] = NULL; mZ[i] = NULL;
+	    }
+	}
+
+	HydrOCLCPU::~HydrOCLCPU()
+	{
+		remove();
+	}
+
+	bool HydrOCLCPU::create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule)
+	{
+	    mOptions = Options;
+	    mNoise   = NoiseModule;
+	    _createGrid();
+	    mPool = new HydrOCLThreadPool(mOptions.CPUThreads > 0 ? (unsigned int)mOptions.CPUThreads : 0);
+	    _rowsPerTask();
+	    HydrOCLLOG("\tCPU backend ready, using " + Ogre::StringConverter::toString(mPool->getNumberOfThreads()) + " threads.");
+	    return true;
+	}
+
+	void HydrOCLCPU::remove()
+	{
+	    if(mPool) delete mPool; mPool=NULL;
+	    _releaseGrid();
+	    mNoise = NULL;
+	}
+
+	void HydrOCLCPU::setOptions(const HydrOCL::Options &Options)
+	{
+		mOptions = Options;
+	}
+
+	bool HydrOCLCPU::resize(const HydrOCL::Options &Options)
+	{
+	    if(!mPool)
+	        return false;
+	    mOptions = Options;
+	    // The threads pool is kept
+	    _releaseGrid();
+	    _createGrid();
+	    _rowsPerTask();
+	    return true;
+	}
+
+	void HydrOCLCPU::_createGrid()
+	{
+	    unsigned int i, k;
+	    mN = (unsigned int)mOptions.Complexity;
+	    unsigned int n = mN*mN;
+	    for(i=0;i<2;i++) {
+	        mX[i] = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	        mY[i] = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	        mZ[i] = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	    }
+	    mNX = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	    mNY = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	    mNZ = allocHost<float>(mMemory, HydrOCLMemory::MEM_GRID, n);
+	    for(i=0;i<2;i++) {
+	        for(k=0;k<n;k++) {
+	            mX[i][k] = 0.f; mY[i][k] = 0.f; mZ[i][k] = 0.f;
+	        }
+	    }
+	    for(k=0;k<n;k++) {
+	        mNX[k] = 0.f; mNY[k] = -1.f; mNZ[k] = 0.f;
+	    }
+	    mBase   = 0;
+	    mOutput = 0;
+	}
+
+	void HydrOCLCPU::_releaseGrid()
+	{
+	    unsigned int i;
+	    for(i=0;i<2;i++) {
+	        releaseHost(mMemory, mX[i]); mX[i]=NULL;
+	        releaseHost(mMemory, mY[i]); mY[i]=NULL;
+	        releaseHost(mMemory, mZ[i]); mZ[i]=NULL;
+	    }
+	    releaseHost(mMemory, mNX); mNX=NULL;
+	    releaseHost(mMemory, mNY); mNY=NULL;
+	    releaseHost(mMemory, mNZ); mNZ=NULL;
+	    mN = 0;
+	}
+
+	void HydrOCLCPU::_rowsPerTask()
+	{
+	    // Some tasks per thread, so the work can be stolen by the idle ones
+	    mRowsPerTask = mN / (8*mPool->getNumberOfThreads());
+	    if(!mRowsPerTask)
+	        mRowsPerTask = 1;
+	}
+
+	bool HydrOCLCPU::geometry(const Ogre::Vector4 *Corners)
+	{
+	    unsigned int i;
+	    for(i=0;i<4;i++)
+	        mCorners[i] = Corners[i];
+	    _launch(STAGE_GEOMETRY);
+        // The regenerated vertexes must be rendered at once
+	    mOutput = mBase;
+	    return true;
+	}
+
+	bool HydrOCLCPU::basePlane(const float &h)
+	{
+	    mH = h;
+	    _launch(STAGE_BASEPLANE);
+	    return true;
+	}
+
+	bool HydrOCLCPU::noise(const Ogre::Vector3 &World)
+	{
+	    mWorld = World;
+	    _launch(STAGE_NOISE);
+	    return true;
+	}
+
+	bool HydrOCLCPU::smooth()
+	{
+		if (!mOptions.Smooth) {
+			return true;
+		}
+	    _launch(STAGE_SMOOTH);
+        // The smoothed vertexes are still undisplaced, so the pair roles swap
+	    mBase = 1 - mBase;
+	    return true;
+	}
+
+	bool HydrOCLCPU::normals()
+	{
+		// Choppy waves stage computes the normals by itself
+		if (mOptions.ChoppyWaves) {
+			return true;
+		}
+	    _launch(STAGE_NORMALS);
+	    return true;
+	}
+
+	bool HydrOCLCPU::choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater)
+	{
+		if (!mOptions.ChoppyWaves) {
+			mOutput = mBase;
+			return true;
+		}
+	    // Absolute value of the normalized camera direction (x, z)
+	    float l = sqrt(CameraDir.x*CameraDir.x + CameraDir.z*CameraDir.z);
+	    mDirX = (l > 0.f) ? fabs(CameraDir.x / l) : 0.f;
+	    mDirZ = (l > 0.f) ? fabs(CameraDir.z / l) : 0.f;
+	    mUnderwater = Underwater;
+	    _launch(STAGE_CHOPPY);
+	    mOutput = 1 - mBase;
+	    return true;
+	}
+
+	bool HydrOCLCPU::read(Mesh::POS_NORM_VERTEX *Vertices)
+	{
+	    mVertices = Vertices;
+	    _launch(STAGE_READ);
+	    mVertices = NULL;
+	    return true;
+	}
+
+	Ogre::String HydrOCLCPU::getDeviceName() const
+	{
+	    if(!mPool)
+	        return "";
+	    return Ogre::StringConverter::toString(mPool->getNumberOfThreads()) + " threads";
+	}
+
+	void HydrOCLCPU::run(unsigned int task)
+	{
+	    unsigned int j0 = task*mRowsPerTask;
+	    unsigned int j1 = j0 + mRowsPerTask;
+	    unsigned int j;
+	    if(j1 > mN)
+	        j1 = mN;
+	    switch(mStage) {
+	    case STAGE_GEOMETRY:
+	        _geometry(j0, j1);
+	        break;
+	    case STAGE_BASEPLANE:
+	        {
+	            float *y = mY[mBase];
+	            float h = -mH;
+	            unsigned int k;
+	            for(k=j0*mN;k<j1*mN;k++)
+	                y[k] = h;
+	        }
+	        break;
+	    case STAGE_NOISE:
+	        for(j=j0;j<j1;j++)
+	            mNoise->setHeight(mX[mBase] + j*mN, mZ[mBase] + j*mN, mY[mBase] + j*mN, mN, mWorld);
+	        break;
+	    case STAGE_SMOOTH:
+	        _smooth(j0, j1);
+	        break;
+	    case STAGE_NORMALS:
+	        _normals(j0, j1);
+	        break;
+	    case STAGE_CHOPPY:
+	        _normals(j0, j1);
+	        _choppy(j0, j1);
+	        break;
+	    case STAGE_READ:
+	        _read(j0, j1);
+	        break;
+	    }
+	}
+
+	void HydrOCLCPU::_launch(Stage stage)
+	{
+	    mStage = stage;
+	    mPool->run(this, (mN + mRowsPerTask - 1) / mRowsPerTask);
+	}
+
+	void HydrOCLCPU::_geometry(unsigned int j0, unsigned int j1)
+	{
+	    unsigned int i, j;
+	    float *x = mX[mBase], *z = mZ[mBase];
+	    const Ogre::Vector4 *c = mCorners;
+	    float dN = 1.f / mN;
+	    for(j=j0;j<j1;j++) {
+	        // Bilinear interpolation, solved first at the row ends
+	        float v = j*dN, vDi = 1.f - v;
+	        float ax = vDi*c[0].x + v*c[2].x, bx = vDi*c[1].x + v*c[3].x;
+	        float az = vDi*c[0].z + v*c[2].z, bz = vDi*c[1].z + v*c[3].z;
+	        float aw = vDi*c[0].w + v*c[2].w, bw = vDi*c[1].w + v*c[3].w;
+	        float *xr = x + j*mN, *zr = z + j*mN;
+	        for(i=0;i<mN;i++) {
+	            float u = i*dN, uDi = 1.f - u;
+	            float divide = 1.f / (uDi*aw + u*bw);
+	            xr[i] = (uDi*ax + u*bx)*divide;
+	            zr[i] = (uDi*az + u*bz)*divide;
+	        }
+	    }
+	}
+
+	void HydrOCLCPU::_smooth(unsigned int j0, unsigned int j1)
+	{
+	    unsigned int i, j, r;
+	    unsigned int N = mN, R = (unsigned int)mOptions.SmoothRadius;
+	    unsigned int out = 1 - mBase;
+	    const float *y = mY[mBase];
+	    float *ys = mY[out];
+	    float f = 1.f / (4*R + 1);
+	    // Positions are not modified
+	    memcpy(mX[out] + j0*N, mX[mBase] + j0*N, (j1 - j0)*N*sizeof(float));
+	    memcpy(mZ[out] + j0*N, mZ[mBase] + j0*N, (j1 - j0)*N*sizeof(float));
+	    for(j=j0;j<j1;j++) {
+	        const float *c = y + j*N;
+	        float *o = ys + j*N;
+	        // Boundaries are not smoothed
+	        memcpy(o, c, N*sizeof(float));
+	        if((j < R) || (j + R >= N) || (2*R >= N))
+	            continue;
+	        for(r=1;r<=R;r++) {
+	            const float *up = c - r*N, *dn = c + r*N;
+	            for(i=R;i<N-R;i++)
+	                o[i] += c[i-r] + c[i+r] + up[i] + dn[i];
+	        }
+	        for(i=R;i<N-R;i++)
+	            o[i] *= f;
+	    }
+	}
+
+	void HydrOCLCPU::_normals(unsigned int j0, unsigned int j1)
+	{
+	    unsigned int i, j, N = mN;
+	    const float *x = mX[mBase], *y = mY[mBase], *z = mZ[mBase];
+	    for(j=j0;j<j1;j++) {
+	        float *nx = mNX + j*N, *ny = mNY + j*N, *nz = mNZ + j*N;
+	        // Set boundaries with plane normal
+	        if((j < 1) || (j + 1 >= N) || (N < 3)) {
+	            for(i=0;i<N;i++) {
+	                nx[i] = 0.f; ny[i] = -1.f; nz[i] = 0.f;
+	            }
+	            continue;
+	        }
+	        nx[0]   = 0.f; ny[0]   = -1.f; nz[0]   = 0.f;
+	        nx[N-1] = 0.f; ny[N-1] = -1.f; nz[N-1] = 0.f;
+	        const float *xc = x + j*N, *yc = y + j*N, *zc = z + j*N;
+	        for(i=1;i<N-1;i++) {
+	            // normalize(cross(vec2, vec1)), see tileNormal at grid.cl
+	            float ax = xc[i-N] - xc[i+N], ay = yc[i-N] - yc[i+N], az = zc[i-N] - zc[i+N];
+	            float bx = xc[i-1] - xc[i+1], by = yc[i-1] - yc[i+1], bz = zc[i-1] - zc[i+1];
+	            float cx = ay*bz - az*by;
+	            float cy = az*bx - ax*bz;
+	            float cz = ax*by - ay*bx;
+	            float l = 1.f / sqrtf(cx*cx + cy*cy + cz*cz);
+	            nx[i] = cx*l; ny[i] = cy*l; nz[i] = cz*l;
+	        }
+	    }
+	}
+
+	void HydrOCLCPU::_choppy(unsigned int j0, unsigned int j1)
+	{
+	    unsigned int i, j, N = mN;
+	    unsigned int out = 1 - mBase;
+	    const float *x = mX[mBase], *z = mZ[mBase];
+	    float *xo = mX[out], *zo = mZ[out];
+	    float s = mOptions.ChoppyStrength*mUnderwater;
+	    float Dx = mDirX, Dz = mDirZ;
+	    // Heights are not modified
+	    memcpy(mY[out] + j0*N, mY[mBase] + j0*N, (j1 - j0)*N*sizeof(float));
+	    for(j=j0;j<j1;j++) {
+	        const float *xc = x + j*N, *zc = z + j*N;
+	        float *xr = xo + j*N, *zr = zo + j*N;
+	        // Boundaries are not displaced
+	        if((j < 1) || (j + 1 >= N) || (N < 3)) {
+	            memcpy(xr, xc, N*sizeof(float));
+	            memcpy(zr, zc, N*sizeof(float));
+	            continue;
+	        }
+	        xr[0] = xc[0]; xr[N-1] = xc[N-1];
+	        zr[0] = zc[0]; zr[N-1] = zc[N-1];
+	        const float *nx = mNX + j*N, *nz = mNZ + j*N;
+	        for(i=1;i<N-1;i++) {
+	            float dx1 = xc[i+N] - xc[i], dz1 = zc[i+N] - zc[i];
+	            float dx2 = xc[i+1] - xc[i], dz2 = zc[i+1] - zc[i];
+	            float Dis1 = sqrtf(dx1*dx1 + dz1*dz1);
+	            float Dis2 = sqrtf(dx2*dx2 + dz2*dz2);
+	            xr[i] = xc[i] + s*nx[i]*(Dx*Dis1 - Dz*Dis2);
+	            zr[i] = zc[i] + s*nz[i]*(Dz*Dis1 + Dx*Dis2);
+	        }
+	    }
+	}
+
+	void HydrOCLCPU::_read(unsigned int j0, unsigned int j1)
+	{
+	    unsigned int k;
+	    const float *x = mX[mOutput], *y = mY[mOutput], *z = mZ[mOutput];
+	    for(k=j0*mN;k<j1*mN;k++) {
+	        mVertices[k].x  = x[k];   mVertices[k].y  = y[k];   mVertices[k].z  = z[k];
+	        mVertices[k].nx = mNX[k]; mVertices[k].ny = mNY[k]; mVertices[k].nz = mNZ[k];
+	    }
+	}
+}}
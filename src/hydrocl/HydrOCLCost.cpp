@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <hydrocl/HydrOCLCost.h>
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLCost::HydrOCLCost()
+		: Constant(0.f)
+		, Vertex(0.f)
+		, VertexWave(0.f)
+		, VertexOctave(0.f)
+	{
+	}
+
+	Ogre::String HydrOCLCost::getSection(const Ogre::String &Backend, const Ogre::String &Device)
+	{
+	    Ogre::String device = Device;
+	    Ogre::StringUtil::trim(device);
+	    return Backend + ": " + device;
+	}
+
+	bool HydrOCLCost::load(const Ogre::String &File, const Ogre::String &Section)
+	{
+	    FILE *f = fopen(File.c_str(), "r");
+	    if(!f)
+	        return false;
+	    fclose(f);
+	    Ogre::ConfigFile cfg;
+	    cfg.load(File, "=", true);
+	    Ogre::String value = cfg.getSetting("Vertex", Section);
+	    if(value.empty())
+	        return false;
+	    Vertex       = Ogre::StringConverter::parseReal(value);
+	    Constant     = Ogre::StringConverter::parseReal(cfg.getSetting("Constant", Section));
+	    VertexWave   = Ogre::StringConverter::parseReal(cfg.getSetting("VertexWave", Section));
+	    VertexOctave = Ogre::StringConverter::parseReal(cfg.getSetting("VertexOctave", Section));
+	    return true;
+	}
+
+	bool HydrOCLCost::save(const Ogre::String &File, const Ogre::String &Section, const std::vector<Ogre::String> &Comment) const
+	{
+	    unsigned int i;
+	    char line[1024];
+	    // Keep the other sections, and the file header
+	    std::vector<Ogre::String> kept;
+	    bool skip = false;
+	    FILE *f = fopen(File.c_str(), "r");
+	    if(f) {
+	        while(fgets(line, sizeof(line), f)) {
+	            Ogre::String l = line;
+	            Ogre::StringUtil::trim(l);
+	            if(!l.empty() && (l[0] == '[') && (l[l.size() - 1] == ']'))
+	                skip = l.substr(1, l.size() - 2) == Section;
+	            if(!skip)
+	                kept.push_back(l);
+	        }
+	        fclose(f);
+	    }
+	    // Drop the trailing empty lines
+	    while(!kept.empty() && kept.back().empty())
+	        kept.pop_back();
+	    f = fopen(File.c_str(), "w");
+	    if(!f)
+	        return false;
+	    if(kept.empty()) {
+	        fprintf(f, "# HydrOCL frame cost models, written by HydrOCLBench --mode scaling.\n");
+	        fprintf(f, "# t[ms] = Constant + V*(Vertex + Waves*VertexWave + Octaves*VertexOctave)\n");
+	        fprintf(f, "# with V = Complexity^2. Copy it into the Hydrax resources to let the\n");
+	        fprintf(f, "# module clamp the complexity and the waves to PG_Budget.\n");
+	    }
+	    for(i=0;i<kept.size();i++)
+	        fprintf(f, "%s\n", kept[i].c_str());
+	    fprintf(f, "\n[%s]\n", Section.c_str());
+	    for(i=0;i<Comment.size();i++)
+	        fprintf(f, "# %s\n", Comment[i].c_str());
+	    fprintf(f, "Constant=%g\n", Constant);
+	    fprintf(f, "Vertex=%g\n", Vertex);
+	    fprintf(f, "VertexWave=%g\n", VertexWave);
+	    fprintf(f, "VertexOctave=%g\n", VertexOctave);
+	    fclose(f);
+	    return true;
+	}
+
+	float HydrOCLCost::time(int Complexity, unsigned int Waves, int Octaves) const
+	{
+	    float V = (float)Complexity*Complexity;
+	    return Constant + V*(Vertex + Waves*VertexWave + Octaves*VertexOctave);
+	}
+
+	int HydrOCLCost::maxComplexity(float Budget, unsigned int Waves, int Octaves) const
+	{
+	    float perVertex = Vertex + Waves*VertexWave + Octaves*VertexOctave;
+	    if(perVertex <= 0.f)
+	        return -1;
+	    if(Budget <= Constant)
+	        return 0;
+	    return (int)sqrtf((Budget - Constant) / perVertex);
+	}
+
+	int HydrOCLCost::maxWaves(float Budget, int Complexity, int Octaves) const
+	{
+	    if(VertexWave <= 0.f)
+	        return -1;
+	    float V = (float)Complexity*Complexity;
+	    float left = Budget - Constant - V*(Vertex + Octaves*VertexOctave);
+	    if(left <= 0.f)
+	        return 0;
+	    return (int)(left / (V*VertexWave));
+	}
+}}
@@ -25,13 +25,28 @@ http://www.cnblogs.com/ArenAK/archive/2007/11/07/951713.html
 --------------------------------------------------------------------------------
 */
 
+#include <math.h>
+
 #include <hydrocl/HydrOCLGrid.h>
-#include <hydrocl/HydrOCLUtils.h>
 #include <hydrocl/HydrOCLNoise.h>
+#include <hydrocl/HydrOCLOpenCL.h>
+#include <hydrocl/HydrOCLCPU.h>
+#include <hydrocl/HydrOCLValidation.h>
+#include <hydrocl/HydrOCLTrace.h>
+#include <hydrocl/HydrOCLCost.h>
+#include <hydrocl/HydrOCLUtils.h>
 
 #ifndef _def_MaxFarClipDistance
     #define _def_MaxFarClipDistance 99999
 #endif
+
+/// Frame cost models of the devices (see HydrOCLBench --mode scaling)
+#define _def_CostFile "HydrOCLCost.cfg"
+/// Waves reserved into the budget when the complexity is clamped, since
+/// the waves are usually added after the module creation
+#define _def_BudgetWaves 16
+/// Lowest complexity the budget can clamp to
+#define _def_BudgetMinComplexity 16
 
 namespace Hydrax{namespace Module
 {
@@ -39,76 +54,54 @@ namespace Hydrax{namespace Module
 		: Module("HydrOCL", new Noise::HydrOCLNoise(), Mesh::Options(256, Size(0), Mesh::VT_POS_NORM), MaterialManager::NM_VERTEX)
 		, mHydrax(h)
 		, mVertices(0)
-		, mVerticesChoppyBuffer(0)
 		, mBasePlane(BasePlane)
 		, mNormal(BasePlane.normal)
 		, mPos(Ogre::Vector3(0,0,0))
 		, mProjectingCamera(0)
 		, mTmpRndrngCamera(0)
 		, mRenderingCamera(h->getCamera())
-        , mNumberOfPlatforms(0)
-        , mPlatforms(NULL)
-        , mPlatform(0)
-        , mNumberOfDevices(0)
-        , mDevices(NULL)
-        , mContext(0)
-        , mComQueue(NULL)
-        , mAllocatedMem(0)
-        , mVertexes(0)
-        , mNormals(0)
-        , mChoppyVertexes(0)
-        , mChoppyNormals(0)
-        , kGeometryGen(0)
-        , kBasePlane(0)
-        , kCopy(0)
-        , kSmooth(0)
-        , kNormals(0)
-        , kChoppy(0)
-        , hPos(NULL)
-        , hNor(NULL)
+		, mBackend(NULL)
+		, mPending(NULL)
+		, mInitDone(false)
+		, mInitResult(false)
+		, mTrace(NULL)
+		, mMemory(new HydrOCLMemory())
 	{
+		pthread_mutex_init(&mInitMutex, NULL);
 	}
 
 	HydrOCL::HydrOCL(Hydrax *h, const Ogre::Plane &BasePlane, const Options &Options)
 		: Module("HydrOCL", new Noise::HydrOCLNoise(), Mesh::Options(Options.Complexity, Size(0), Mesh::VT_POS_NORM), MaterialManager::NM_VERTEX)
 		, mHydrax(h)
 		, mVertices(0)
-		, mVerticesChoppyBuffer(0)
 		, mBasePlane(BasePlane)
 		, mNormal(BasePlane.normal)
 		, mPos(Ogre::Vector3(0,0,0))
 		, mProjectingCamera(0)
 		, mTmpRndrngCamera(0)
 		, mRenderingCamera(h->getCamera())
-        , mNumberOfPlatforms(0)
-        , mPlatforms(NULL)
-        , mPlatform(0)
-        , mNumberOfDevices(0)
-        , mDevices(NULL)
-        , mContext(0)
-        , mComQueue(NULL)
-        , mAllocatedMem(0)
-        , mVertexes(0)
-        , mNormals(0)
-        , mChoppyVertexes(0)
-        , mChoppyNormals(0)
-        , kGeometryGen(0)
-        , kBasePlane(0)
-        , kCopy(0)
-        , kSmooth(0)
-        , kNormals(0)
-        , kChoppy(0)
-        , hPos(NULL)
-        , hNor(NULL)
+		, mBackend(NULL)
+		, mPending(NULL)
+		, mInitDone(false)
+		, mInitResult(false)
+		, mTrace(NULL)
+		, mMemory(new HydrOCLMemory())
 	{
+		pthread_mutex_init(&mInitMutex, NULL);
 		setOptions(Options);
 	}
 
 	HydrOCL::~HydrOCL()
 	{
 		remove();
-
-		HydraxLOG(getName() + " destroyed.");
+		stopTrace();
+		// The noise module (destroyed by the base class) must not
+		// register anything else
+		static_cast<Noise::HydrOCLNoise*>(mNoise)->setMemory(NULL);
+		delete mMemory; mMemory=NULL;
+		pthread_mutex_destroy(&mInitMutex);
+
+		HydrOCLLOG(getName() + " destroyed.");
 	}
 
 	void HydrOCL::setOptions(const Options &Options)
@@ -122,104 +115,228 @@ namespace Hydrax{namespace Module
 		mHydrax->_setStrength(Options.Strength);
 
 		// Re-create geometry if it's needed
-		if (isCreated() && Options.Complexity != mOptions.Complexity) {
-			remove();
-			mOptions = Options;
-			create();
-
-		    Ogre::String MaterialNameTmp = mHydrax->getMesh()->getMaterialName();
-		    mHydrax->getMesh()->remove();
-		    mHydrax->getMesh()->setOptions(getMeshOptions());
-		    mHydrax->getMesh()->setMaterialName(MaterialNameTmp);
-		    mHydrax->getMesh()->create();
-
-			// Force to recalculate the geometry on next frame
-			mLastPosition = Ogre::Vector3(0,0,0);
-			mLastOrientation = Ogre::Quaternion();
+		// Vertexes layout is compiled in the kernels, and the telemetry
+		// requires profiling command queues. The smoothing radius is
+		// compiled too, but the backend builds the new kernel in background.
+		bool Recreate = isCreated() && (
+		                    Options.TiledLayout  != mOptions.TiledLayout  ||
+		                    Options.SoALayout    != mOptions.SoALayout    ||
+		                    Options.Telemetry    != mOptions.Telemetry    ||
+		                    Options.Transfer     != mOptions.Transfer     ||
+		                    Options.Runtime      != mOptions.Runtime      ||
+		                    Options.DeviceType   != mOptions.DeviceType   ||
+		                    Options.Device       != mOptions.Device       ||
+		                    Options.SlimMemory   != mOptions.SlimMemory   ||
+		                    Options.Backend      != mOptions.Backend      ||
+		                    Options.CPUThreads   != mOptions.CPUThreads   ||
+		                    Options.Validate     != mOptions.Validate);
+		// While the complexity just resizes the grid
+		bool Resize = isCreated() && (
+		                    Options.Complexity    != mOptions.Complexity    ||
+		                    Options.MaxComplexity != mOptions.MaxComplexity);
+		if (Recreate || Resize) {
+			if (Recreate || !_resize(Options)) {
+				remove();
+				mOptions = Options;
+				create();
+			}
+
+			_createMesh();
 
 			return;
 		}
 
 		mOptions = Options;
+		_clampOptions();
+		if (mBackend) {
+			mBackend->setOptions(mOptions);
+		}
 	}
 
 	void HydrOCL::create()
 	{
-	    int i;
 	    // Create base module
-		HydraxLOG("Creating " + getName() + " module.");
+		HydrOCLLOG("Creating " + getName() + " module.");
 		Module::create();
 
-	    // Create Vertexes buffers
-        mVertices = new Mesh::POS_NORM_VERTEX[mOptions.Complexity*mOptions.Complexity];
-        Mesh::POS_NORM_VERTEX* Vertices = static_cast<Mesh::POS_NORM_VERTEX*>(mVertices);
-        for (int i = 0; i < mOptions.Complexity*mOptions.Complexity; i++) {
-            Vertices[i].nx = 0;
-            Vertices[i].ny = -1;
-            Vertices[i].nz = 0;
-        }
-        mVerticesChoppyBuffer = new Mesh::POS_NORM_VERTEX[mOptions.Complexity*mOptions.Complexity];
 	    _setDisplacementAmplitude(0.0f);
 	    // Set rendering cameras
 		mTmpRndrngCamera  = new Ogre::Camera("PG_TmpRndrngCamera", NULL);
 		mProjectingCamera = new Ogre::Camera("PG_ProjectingCamera", NULL);
-        // Start OpenCL platform
-        if(!setupOpenCL()) {
-            remove();
-            return;
-        }
-        bool Error=false;
-        // Use float4, is faster than float3
-        Error |= !allocMemory(&mVertexes,       mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        Error |= !allocMemory(&mNormals,        mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        Error |= !allocMemory(&mChoppyVertexes, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        Error |= !allocMemory(&mChoppyNormals,  mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        if(Error) {
-            remove();
-            return;
+        _clampOptions();
+        // Computation backend. OpenCL is preferred, but if it is not
+        // available the CPU one is used instead.
+        Noise::HydrOCLNoise *noise = (Noise::HydrOCLNoise*)mNoise;
+        noise->setMemory(mMemory);
+        bool Async = (mOptions.Backend != BT_CPU) && mOptions.AsyncInit && _startInit();
+        if(mOptions.Backend != BT_CPU && !Async) {
+            mBackend = new HydrOCLOpenCL();
+            mBackend->setMemory(mMemory);
+            if(!mBackend->create(mOptions, noise)) {
+                delete mBackend; mBackend=NULL;
+                if(mOptions.Backend == BT_OPENCL) {
+                    HydrOCLLOG("OpenCL backend can't be created.");
+                    remove();
+                    return;
+                }
+                HydrOCLLOG("OpenCL is not available, falling back to the CPU backend.");
+            }
         }
-        // Send initial values
-        cl_uint clFlag=0;
-        hPos = new cl_float4[mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 )];
-        hNor = new cl_float4[mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 )];
-        for(i=0;i<mOptions.Complexity*mOptions.Complexity;i++){
-            hPos[i].x=0.f; hPos[i].y=0.f; hPos[i].z=0.f; hPos[i].w=1.f;
-            hNor[i].x=0.f; hNor[i].y=-1.f; hNor[i].z=0.f; hNor[i].w=0.f;
+        if(!mBackend) {
+            mBackend = new HydrOCLCPU();
+            mBackend->setMemory(mMemory);
+            if(!mBackend->create(mOptions, noise)) {
+                delete mBackend; mBackend=NULL;
+                remove();
+                return;
+            }
         }
-        //! @todo allow several devices usage
-        clFlag |= sendData(mComQueue[0], mVertexes, hPos, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        clFlag |= sendData(mComQueue[0], mNormals,  hNor, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        clFlag |= sendData(mComQueue[0], mChoppyVertexes, hPos, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        clFlag |= sendData(mComQueue[0], mChoppyNormals,  hNor, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Fail sending initial data to device.");
-            remove();
+        HydrOCLLOG(Ogre::String("\tUsing the ") + mBackend->getName() + " backend.");
+        if(!_setupBackend(noise)) {
             return;
         }
-        // Send OpenCL stuff to noise module.
-        if(! ((Noise::HydrOCLNoise*)mNoise)->setupOpenCL(mNumberOfDevices, mContext, mDevices, mComQueue)){
+
+		HydrOCLLOG(getName() + " created.");
+	}
+
+	bool HydrOCL::_setupBackend(Noise::HydrOCLNoise *Noise)
+	{
+        if(!_fitBudget(Noise)) {
+            delete mBackend; mBackend=NULL;
             remove();
-            return;
+            return false;
+        }
+        if(mOptions.Validate) {
+            mBackend = new HydrOCLValidation(mBackend);
+            mBackend->setMemory(mMemory);
+            if(!mBackend->create(mOptions, Noise)) {
+                delete mBackend; mBackend=NULL;
+                remove();
+                return false;
+            }
         }
+        mBackend->setTrace(mTrace);
 
-		HydraxLOG(getName() + " created.");
+	    // Create Vertexes buffers, once the complexity has been clamped
+        _createVertices();
+
+        return _fitMemory();
+	}
+
+	bool HydrOCL::_startInit()
+	{
+		// The background thread must not access the Ogre resources
+		HydrOCLOpenCL::findResources();
+		mPending = new HydrOCLOpenCL();
+		mPending->setMemory(mMemory);
+		mInitOptions = mOptions;
+		mInitDone    = false;
+		mInitResult  = false;
+		if (pthread_create(&mInitThread, NULL, _initMain, this)) {
+			HydrOCLLOG("\tThe OpenCL backend can't be created in background.");
+			delete mPending; mPending=NULL;
+			return false;
+		}
+		HydrOCLLOG("\tCreating the OpenCL backend in background, the CPU one is used meanwhile.");
+		return true;
+	}
+
+	void* HydrOCL::_initMain(void *data)
+	{
+		HydrOCL *Grid = (HydrOCL*)data;
+		deferLog();
+		bool Result = Grid->mPending->prepare(Grid->mInitOptions, static_cast<Noise::HydrOCLNoise*>(Grid->mNoise));
+		pthread_mutex_lock(&Grid->mInitMutex);
+		Grid->mInitResult = Result;
+		Grid->mInitDone   = true;
+		pthread_mutex_unlock(&Grid->mInitMutex);
+		return NULL;
+	}
+
+	void HydrOCL::_completeInit()
+	{
+		pthread_join(mInitThread, NULL);
+		flushLog();
+		HydrOCLOpenCL *Backend = mPending;
+		mPending = NULL;
+		Noise::HydrOCLNoise *noise = static_cast<Noise::HydrOCLNoise*>(mNoise);
+		// The options may have been changed meanwhile
+		bool Result = mInitResult && Backend->complete(noise);
+		if (Result) {
+			Backend->setOptions(mOptions);
+			if (mOptions.Complexity    != mInitOptions.Complexity ||
+			    mOptions.MaxComplexity != mInitOptions.MaxComplexity) {
+				Result = Backend->resize(mOptions);
+			}
+		}
+		if (!Result) {
+			// Its noise OpenCL objects are released as well
+			delete Backend;
+			if (mOptions.Backend == BT_OPENCL) {
+				HydrOCLLOG("OpenCL backend can't be created.");
+				remove();
+				return;
+			}
+			HydrOCLLOG("OpenCL is not available, keeping the CPU backend.");
+			return;
+		}
+		HydrOCLLOG("OpenCL backend of " + getName() + " ready.");
+		delete mBackend;
+		mBackend = Backend;
+		releaseHost(mMemory, static_cast<Mesh::POS_NORM_VERTEX*>(mVertices)); mVertices=NULL;
+		if (!_setupBackend(noise)) {
+			return;
+		}
+		// The frame or the memory budgets may have clamped the complexity
+		if (mHydrax->getMesh()->getOptions().MeshComplexity != mOptions.Complexity) {
+			_createMesh();
+		}
+		mLastPosition = Ogre::Vector3(0,0,0);
+	}
+
+	void HydrOCL::_cancelInit()
+	{
+		if (!mPending) {
+			return;
+		}
+		pthread_join(mInitThread, NULL);
+		flushLog();
+		delete mPending; mPending=NULL;
+	}
+
+	void HydrOCL::_createMesh()
+	{
+	    Ogre::String MaterialNameTmp = mHydrax->getMesh()->getMaterialName();
+	    mHydrax->getMesh()->remove();
+	    mHydrax->getMesh()->setOptions(getMeshOptions());
+	    mHydrax->getMesh()->setMaterialName(MaterialNameTmp);
+	    mHydrax->getMesh()->create();
+
+		// Force to recalculate the geometry on next frame
+		mLastPosition = Ogre::Vector3(0,0,0);
+		mLastOrientation = Ogre::Quaternion();
 	}
 
+	void HydrOCL::_clampOptions()
+	{
+        // Smoothing radius bounds (a missing config value reads as 0)
+        if(mOptions.SmoothRadius < 1)
+            mOptions.SmoothRadius = 1;
+        if(mOptions.SmoothRadius > 8)
+            mOptions.SmoothRadius = 8;
+	}
+
 	void HydrOCL::remove()
 	{
-	    unsigned int i;
 		if (!isCreated()) {
 			return;
 		}
 
+		_cancelInit();
+
 		Module::remove();
 
-		if (mVertices) {
-            delete [] static_cast<Mesh::POS_NORM_VERTEX*>(mVertices); mVertices=NULL;
-		}
-		if (mVerticesChoppyBuffer) {
-			delete [] mVerticesChoppyBuffer; mVerticesChoppyBuffer=NULL;
-		}
+		releaseHost(mMemory, static_cast<Mesh::POS_NORM_VERTEX*>(mVertices)); mVertices=NULL;
 
 		if (mTmpRndrngCamera) {
 			delete mTmpRndrngCamera; mTmpRndrngCamera=NULL;
@@ -228,31 +345,9 @@ namespace Hydrax{namespace Module
 		mLastPosition = Ogre::Vector3(0,0,0);
 		mLastOrientation = Ogre::Quaternion();
 
-		// Destroy OpenCL
-		if(hPos) delete[] hPos; hPos=NULL;
-		if(hNor) delete[] hNor; hNor=NULL;
-        if(mVertexes)clReleaseMemObject(mVertexes); mVertexes=0;
-        if(mNormals)clReleaseMemObject(mNormals); mNormals=0;
-        if(mChoppyVertexes)clReleaseMemObject(mChoppyVertexes); mChoppyVertexes=0;
-        if(mChoppyNormals)clReleaseMemObject(mChoppyNormals); mChoppyNormals=0;
-        mAllocatedMem = 0;
-        HydraxLOG("\tShutting down OpenCL...");
-        if(kGeometryGen)clReleaseKernel(kGeometryGen); kGeometryGen=0;
-        if(kBasePlane)clReleaseKernel(kBasePlane); kBasePlane=0;
-        if(kCopy)clReleaseKernel(kCopy); kCopy=0;
-        if(kSmooth)clReleaseKernel(kSmooth); kSmooth=0;
-        if(kNormals)clReleaseKernel(kNormals); kNormals=0;
-        if(kChoppy)clReleaseKernel(kChoppy); kChoppy=0;
-        for(i=0;i<mNumberOfDevices;i++) {
-            if(mComQueue[i])clReleaseCommandQueue(mComQueue[i]);
-        }
-        delete[] mComQueue; mComQueue=NULL;
-        if(mContext) clReleaseContext(mContext); mContext=0;
-        if(mDevices) delete[] mDevices; mDevices=NULL;
-        mNumberOfDevices = 0;
-        if(mPlatforms) delete[] mPlatforms; mPlatforms=NULL;
-        mPlatform=0;
-        mNumberOfPlatforms=0;
+		if (mBackend) {
+			delete mBackend; mBackend=NULL;
+		}
 	}
 
 	void HydrOCL::saveCfg(Ogre::String &Data)
@@ -265,8 +360,24 @@ namespace Hydrax{namespace Module
 		Data += CfgFileManager::_getCfgString("PG_Elevation", mOptions.Elevation);
 		Data += CfgFileManager::_getCfgString("PG_ForceRecalculateGeometry", mOptions.ForceRecalculateGeometry);
 		Data += CfgFileManager::_getCfgString("PG_Smooth", mOptions.Smooth);
-		Data += CfgFileManager::_getCfgString("PG_Strength", mOptions.Strength); Data += "\n";
-		Data += CfgFileManager::_getCfgString("OCL_DeviceType", (int)mOptions.DeviceType); Data += "\n";
+		Data += CfgFileManager::_getCfgString("PG_SmoothRadius", mOptions.SmoothRadius);
+		Data += CfgFileManager::_getCfgString("PG_Strength", mOptions.Strength);
+		Data += CfgFileManager::_getCfgString("PG_Validate", mOptions.Validate);
+		Data += CfgFileManager::_getCfgString("PG_Budget", mOptions.Budget);
+		Data += CfgFileManager::_getCfgString("PG_MemoryBudget", mOptions.MemoryBudget);
+		Data += CfgFileManager::_getCfgString("PG_MemoryDownscale", mOptions.MemoryDownscale);
+		Data += CfgFileManager::_getCfgString("PG_SlimMemory", mOptions.SlimMemory);
+		Data += CfgFileManager::_getCfgString("PG_MaxComplexity", mOptions.MaxComplexity); Data += "\n";
+		Data += CfgFileManager::_getCfgString("OCL_Backend", (int)mOptions.Backend);
+		Data += CfgFileManager::_getCfgString("CPU_Threads", mOptions.CPUThreads);
+		Data += CfgFileManager::_getCfgString("OCL_DeviceType", (int)mOptions.DeviceType);
+		Data += CfgFileManager::_getCfgString("OCL_Device", mOptions.Device);
+		Data += CfgFileManager::_getCfgString("OCL_TiledLayout", mOptions.TiledLayout);
+		Data += CfgFileManager::_getCfgString("OCL_SoALayout", mOptions.SoALayout);
+		Data += CfgFileManager::_getCfgString("OCL_Telemetry", mOptions.Telemetry);
+		Data += CfgFileManager::_getCfgString("OCL_TransferMode", (int)mOptions.Transfer);
+		Data += CfgFileManager::_getCfgString("OCL_AsyncInit", mOptions.AsyncInit);
+		Data += CfgFileManager::_getCfgString("OCL_Specialize", mOptions.Specialize); Data += "\n";
 	}
 
 	bool HydrOCL::loadCfg(Ogre::ConfigFile &CfgFile)
@@ -276,29 +387,63 @@ namespace Hydrax{namespace Module
 			return false;
 		}
 
-        HydraxLOG("\tReading options...");
-		setOptions(
-			Options(CfgFileManager::_getIntValue(CfgFile,   "PG_Complexity"),
+        HydrOCLLOG("\tReading options...");
+		Options Opt(CfgFileManager::_getIntValue(CfgFile,   "PG_Complexity"),
 			        CfgFileManager::_getFloatValue(CfgFile, "PG_Strength"),
 					CfgFileManager::_getFloatValue(CfgFile, "PG_Elevation"),
 					CfgFileManager::_getBoolValue(CfgFile,  "PG_Smooth"),
 					CfgFileManager::_getBoolValue(CfgFile,  "PG_ForceRecalculateGeometry"),
 					CfgFileManager::_getBoolValue(CfgFile,  "PG_ChoppyWaves"),
 					CfgFileManager::_getFloatValue(CfgFile, "PG_ChoopyStrength"),
-					(cl_device_type)CfgFileManager::_getIntValue(CfgFile, "OCL_DeviceType")));
+					(cl_device_type)CfgFileManager::_getIntValue(CfgFile, "OCL_DeviceType"));
+		Opt.SmoothRadius = CfgFileManager::_getIntValue(CfgFile, "PG_SmoothRadius");
+		Opt.Device       = CfgFileManager::_getStringValue(CfgFile, "OCL_Device");
+		Opt.TiledLayout  = CfgFileManager::_getBoolValue(CfgFile, "OCL_TiledLayout");
+		Opt.SoALayout    = CfgFileManager::_getBoolValue(CfgFile, "OCL_SoALayout");
+		Opt.Telemetry    = CfgFileManager::_getBoolValue(CfgFile, "OCL_Telemetry");
+		Opt.Transfer     = (TransferType)CfgFileManager::_getIntValue(CfgFile, "OCL_TransferMode");
+		Opt.AsyncInit    = CfgFileManager::_getBoolValue(CfgFile, "OCL_AsyncInit");
+		Opt.Specialize   = CfgFileManager::_getBoolValue(CfgFile, "OCL_Specialize");
+		Opt.Backend      = (BackendType)CfgFileManager::_getIntValue(CfgFile, "OCL_Backend");
+		Opt.CPUThreads   = CfgFileManager::_getIntValue(CfgFile, "CPU_Threads");
+		Opt.Validate     = CfgFileManager::_getBoolValue(CfgFile, "PG_Validate");
+		Opt.Budget       = CfgFileManager::_getFloatValue(CfgFile, "PG_Budget");
+		Opt.MemoryBudget    = CfgFileManager::_getIntValue(CfgFile, "PG_MemoryBudget");
+		Opt.MemoryDownscale = CfgFileManager::_getBoolValue(CfgFile, "PG_MemoryDownscale");
+		Opt.SlimMemory      = CfgFileManager::_getBoolValue(CfgFile, "PG_SlimMemory");
+		Opt.MaxComplexity   = CfgFileManager::_getIntValue(CfgFile, "PG_MaxComplexity");
+		setOptions(Opt);
 
-        HydraxLOG("\tOptions readed.");
+        HydrOCLLOG("\tOptions readed.");
 
 		return true;
 	}
 
 	void HydrOCL::update(const Ogre::Real &timeSinceLastFrame)
 	{
+		// Messages of the background builds
+		flushLog();
 		if (!isCreated()) {
 			return;
 		}
 
-		Module::update(timeSinceLastFrame);
+		if (mPending) {
+			pthread_mutex_lock(&mInitMutex);
+			bool Done = mInitDone;
+			pthread_mutex_unlock(&mInitMutex);
+			if (Done) {
+				_completeInit();
+				if (!isCreated()) {
+					return;
+				}
+			}
+		}
+
+		HydrOCLTrace::Scope frameScope(mTrace, "update");
+		{
+			HydrOCLTrace::Scope scope(mTrace, "_calculeNoise");
+			Module::update(timeSinceLastFrame);
+		}
 
 		Ogre::Vector3 RenderingCameraPos = mRenderingCamera->getDerivedPosition();
 
@@ -322,274 +467,90 @@ namespace Hydrax{namespace Module
 			    mRenderingCamera->setFarClipDistance(_def_MaxFarClipDistance);
 		    }
 
-			mLastMinMax = _getMinMax(&mRange);
+			{
+				HydrOCLTrace::Scope scope(mTrace, "_getMinMax");
+				mLastMinMax = _getMinMax(&mRange);
+			}
 
 		    if (mLastMinMax) {
 			    _renderGeometry(mRange, mProjectingCamera->getViewMatrix(), RenderingCameraPos);
+			    HydrOCLTrace::Scope scope(mTrace, "updateGeometry");
 			    mHydrax->getMesh()->updateGeometry(mOptions.Complexity*mOptions.Complexity, mVertices);
 		    }
 
 			mRenderingCamera->setFarClipDistance(RenderingFarClipDistance);
 		}
 		else if (mLastMinMax) {
-            int i;
-            cl_int clFlag=0;
-            // Recover data from server. We will update geometry now in order to allow OpenCL compute next time step
+            // Recover data from the backend. We will update geometry now in order to allow it compute next time step
             // while we wait for a new frame. So free surface height (y component) have one time step of delay.
-            //! @todo allow several devices usage
-            clFlag |= getData(mComQueue[0], hPos, mVertexes, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-            clFlag |= getData(mComQueue[0], hNor, mNormals,  mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Can't get data from device.");
-                return;
-            }
-            Mesh::POS_NORM_VERTEX* Vertices = static_cast<Mesh::POS_NORM_VERTEX*>(mVertices);
-            for(i=0;i<mOptions.Complexity*mOptions.Complexity;i++){
-                Vertices[i].x  = hPos[i].x; Vertices[i].y  = hPos[i].y; Vertices[i].z  = hPos[i].z;
-                Vertices[i].nx = hNor[i].x; Vertices[i].ny = hNor[i].y; Vertices[i].nz = hNor[i].z;
-            }
-			mHydrax->getMesh()->updateGeometry(mOptions.Complexity*mOptions.Complexity, mVertices);
-            //! @todo allow several devices usage
-            cl_uint2 N;
-            N.x = (unsigned int)mOptions.Complexity;
-            N.y = (unsigned int)mOptions.Complexity;
-            size_t localWorkSize[2], globalWorkSize[2];
-            localWorkSize[0] = 256;
-            localWorkSize[1] = 256;
-            globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
-            globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
-            // Backup
-            if (mOptions.ChoppyWaves) {
-                clFlag |= sendArgument(kCopy,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-                clFlag |= sendArgument(kCopy,  1, sizeof(cl_mem   ), (void*)&mNormals);
-                clFlag |= sendArgument(kCopy,  2, sizeof(cl_mem   ), (void*)&mChoppyVertexes);
-                clFlag |= sendArgument(kCopy,  3, sizeof(cl_mem   ), (void*)&mChoppyNormals);
-                clFlag |= sendArgument(kCopy,  4, sizeof(cl_uint2 ), (void*)&N);
-                if(clFlag != CL_SUCCESS) {
-                    HydraxLOG("Can't send arguments to copy processor.");
+            {
+                HydrOCLTrace::Scope scope(mTrace, "read");
+                if(!mBackend->read(static_cast<Mesh::POS_NORM_VERTEX*>(mVertices)))
                     return;
-                }
-                clFlag = clEnqueueNDRangeKernel(mComQueue[0], kCopy, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-                if(clFlag != CL_SUCCESS) {
-                    HydraxLOG("Copy data execution fail.");
-                    return;
-                }
-            }
-            // Base plane set
-            float h = mBasePlane.d;
-            clFlag |= sendArgument(kBasePlane,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-            clFlag |= sendArgument(kBasePlane,  1, sizeof(cl_float ), (void*)&h);
-            clFlag |= sendArgument(kBasePlane,  2, sizeof(cl_uint2 ), (void*)&N);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Can't send arguments to base plane set processor.");
-                return;
             }
-            clFlag = clEnqueueNDRangeKernel(mComQueue[0], kBasePlane, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Set base plane execution fail.");
-                return;
+            {
+                HydrOCLTrace::Scope scope(mTrace, "updateGeometry");
+                mHydrax->getMesh()->updateGeometry(mOptions.Complexity*mOptions.Complexity, mVertices);
             }
-            // Noise computation
-            ((Noise::HydrOCLNoise*)mNoise)->setHeight(mVertexes, N, RenderingCameraPos);
-            // Smooth the height data
-            if (mOptions.Smooth) {
-                clFlag |= sendArgument(kSmooth,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-                clFlag |= sendArgument(kSmooth,  1, sizeof(cl_uint2 ), (void*)&N);
-                if(clFlag != CL_SUCCESS) {
-                    HydraxLOG("Can't send arguments to copy processor.");
-                    return;
-                }
-                clFlag = clEnqueueNDRangeKernel(mComQueue[0], kSmooth, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-                if(clFlag != CL_SUCCESS) {
-                    HydraxLOG("Copy data execution fail.");
-                    return;
-                }
-            }
-
-            _calculeNormals();
-            _performChoppyWaves();
+            // Choppy waves have been written in the other buffer of the
+            // pair, so the backend still stores the undisplaced vertexes.
+            _updateHeights(RenderingCameraPos);
 		}
 
 		mLastPosition = RenderingCameraPos;
 		mLastOrientation = mRenderingCamera->getDerivedOrientation();
 	}
 
+	bool HydrOCL::_updateHeights(const Ogre::Vector3& WorldPos)
+	{
+		HydrOCLTrace::Scope scope(mTrace, "_updateHeights");
+		if (!mBackend->basePlane(mBasePlane.d)) {
+			return false;
+		}
+		if (!mBackend->noise(WorldPos)) {
+			return false;
+		}
+		// Smooth the heightdata
+		if (!mBackend->smooth()) {
+			return false;
+		}
+		if (!mBackend->normals()) {
+			return false;
+		}
+
+		float underwater = 1.f;
+		if (mHydrax->_isCurrentFrameUnderwater()) {
+			underwater = -1.f;
+		}
+		return mBackend->choppyWaves(mRenderingCamera->getDerivedDirection(), underwater);
+	}
+
 	bool HydrOCL::_renderGeometry(const Ogre::Matrix4& m,const Ogre::Matrix4& _viewMat, const Ogre::Vector3& WorldPos)
 	{
-	    int i;
-        cl_int clFlag=0;
 		t_corners0 = _calculeWorldPosition(Ogre::Vector2( 0.0f, 0.0f),m,_viewMat);
 		t_corners1 = _calculeWorldPosition(Ogre::Vector2(+1.0f, 0.0f),m,_viewMat);
 		t_corners2 = _calculeWorldPosition(Ogre::Vector2( 0.0f,+1.0f),m,_viewMat);
 		t_corners3 = _calculeWorldPosition(Ogre::Vector2(+1.0f,+1.0f),m,_viewMat);
 
-        //! @todo allow several devices usage
-        cl_uint2 N;
-        N.x = (unsigned int)mOptions.Complexity;
-        N.y = (unsigned int)mOptions.Complexity;
-        size_t localWorkSize[2], globalWorkSize[2];
-        localWorkSize[0] = 256;
-        localWorkSize[1] = 256;
-        globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
-        globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
-        // Geometry regeneration
-        cl_float4 c0, c1, c2, c3;
-        c0.x=t_corners0.x; c0.y=t_corners0.y; c0.z=t_corners0.z; c0.w=t_corners0.w;
-        c1.x=t_corners1.x; c1.y=t_corners1.y; c1.z=t_corners1.z; c1.w=t_corners1.w;
-        c2.x=t_corners2.x; c2.y=t_corners2.y; c2.z=t_corners2.z; c2.w=t_corners2.w;
-        c3.x=t_corners3.x; c3.y=t_corners3.y; c3.z=t_corners3.z; c3.w=t_corners3.w;
-        clFlag |= sendArgument(kGeometryGen,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-        clFlag |= sendArgument(kGeometryGen,  1, sizeof(cl_float4), (void*)&c0);
-        clFlag |= sendArgument(kGeometryGen,  2, sizeof(cl_float4), (void*)&c1);
-        clFlag |= sendArgument(kGeometryGen,  3, sizeof(cl_float4), (void*)&c2);
-        clFlag |= sendArgument(kGeometryGen,  4, sizeof(cl_float4), (void*)&c3);
-        clFlag |= sendArgument(kGeometryGen,  5, sizeof(cl_uint2 ), (void*)&N);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to geometry generator.");
-            return false;
-        }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kGeometryGen, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Geometry generator execution fail.");
-            return false;
-        }
-        /* Recover data from server. We will update geometry now in order to allow OpenCL compute next time step
+		Ogre::Vector4 Corners[4] = {t_corners0, t_corners1, t_corners2, t_corners3};
+		{
+			HydrOCLTrace::Scope scope(mTrace, "geometry");
+			if (!mBackend->geometry(Corners)) {
+				return false;
+			}
+		}
+        /* Recover data from the backend. We will update geometry now in order to allow it compute next time step
          * while we wait for a new frame. So free surface height (y component) have one time step of delay,
          * but vertexes position have been already updated (in order to avoid holes when camera is moved).
          */
-        //! @todo allow several devices usage
-        clFlag |= getData(mComQueue[0], hPos, mVertexes, mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        clFlag |= getData(mComQueue[0], hNor, mNormals,  mOptions.Complexity*mOptions.Complexity*sizeof( cl_float4 ));
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't get data from device.");
-            return false;
-        }
-        Mesh::POS_NORM_VERTEX* Vertices = static_cast<Mesh::POS_NORM_VERTEX*>(mVertices);
-        for(i=0;i<mOptions.Complexity*mOptions.Complexity;i++){
-            Vertices[i].x  = hPos[i].x; Vertices[i].y  = hPos[i].y; Vertices[i].z  = hPos[i].z;
-            Vertices[i].nx = hNor[i].x; Vertices[i].ny = hNor[i].y; Vertices[i].nz = hNor[i].z;
-        }
-        // Base plane set
-        float h = mBasePlane.d;
-        clFlag |= sendArgument(kBasePlane,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-        clFlag |= sendArgument(kBasePlane,  1, sizeof(cl_float ), (void*)&h);
-        clFlag |= sendArgument(kBasePlane,  2, sizeof(cl_uint2 ), (void*)&N);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to base plane set processor.");
-            return false;
-        }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kBasePlane, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Set base plane execution fail.");
-            return false;
-        }
-        // Noise computation
-        ((Noise::HydrOCLNoise*)mNoise)->setHeight(mVertexes, N, WorldPos);
-        // Backup
-        if (mOptions.ChoppyWaves) {
-            clFlag |= sendArgument(kCopy,  0, sizeof(cl_mem   ), (void*)&mChoppyVertexes);
-            clFlag |= sendArgument(kCopy,  1, sizeof(cl_mem   ), (void*)&mChoppyNormals);
-            clFlag |= sendArgument(kCopy,  2, sizeof(cl_mem   ), (void*)&mVertexes);
-            clFlag |= sendArgument(kCopy,  3, sizeof(cl_mem   ), (void*)&mNormals);
-            clFlag |= sendArgument(kCopy,  4, sizeof(cl_uint2 ), (void*)&N);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Can't send arguments to copy processor.");
-                return false;
-            }
-            clFlag = clEnqueueNDRangeKernel(mComQueue[0], kCopy, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Copy data execution fail.");
-                return false;
-            }
-        }
-		// Smooth the heightdata
-		if (mOptions.Smooth) {
-            clFlag |= sendArgument(kSmooth,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-            clFlag |= sendArgument(kSmooth,  1, sizeof(cl_uint2 ), (void*)&N);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Can't send arguments to copy processor.");
-                return false;
-            }
-            clFlag = clEnqueueNDRangeKernel(mComQueue[0], kSmooth, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("Copy data execution fail.");
-                return false;
-            }
-		}
-
-		_calculeNormals();
-		_performChoppyWaves();
+		{
+			HydrOCLTrace::Scope scope(mTrace, "read");
+			if (!mBackend->read(static_cast<Mesh::POS_NORM_VERTEX*>(mVertices))) {
+				return false;
+			}
+		}
 
-		return true;
-	}
-
-	void HydrOCL::_calculeNormals()
-	{
-        cl_int clFlag=0;
-        //! @todo allow several devices usage
-        cl_uint2 N;
-        N.x = (unsigned int)mOptions.Complexity;
-        N.y = (unsigned int)mOptions.Complexity;
-        size_t localWorkSize[2], globalWorkSize[2];
-        localWorkSize[0] = 256;
-        localWorkSize[1] = 256;
-        globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
-        globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
-        // Normals computation
-        clFlag |= sendArgument(kNormals,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-        clFlag |= sendArgument(kNormals,  1, sizeof(cl_mem   ), (void*)&mNormals);
-        clFlag |= sendArgument(kNormals,  2, sizeof(cl_uint2 ), (void*)&N);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to normals computator.");
-            return;
-        }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kNormals, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Normals computation execution fail.");
-            return;
-        }
-	}
-
-	void HydrOCL::_performChoppyWaves()
-	{
-		if (!mOptions.ChoppyWaves) {
-			return;
-		}
-
-        cl_int clFlag=0;
-        //! @todo allow several devices usage
-        cl_uint2 N;
-        N.x = (unsigned int)mOptions.Complexity;
-        N.y = (unsigned int)mOptions.Complexity;
-        size_t localWorkSize[2], globalWorkSize[2];
-        localWorkSize[0] = 256;
-        localWorkSize[1] = 256;
-        globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
-        globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
-        // Choppy waves computation
-        float underwater = 1.f;
-        if (mHydrax->_isCurrentFrameUnderwater()) {
-			underwater = -1.f;
-		}
-        Ogre::Vector3 CameraDir = mRenderingCamera->getDerivedDirection();
-        cl_float4 camDir;
-        camDir.z = CameraDir.z; camDir.z = CameraDir.z; camDir.z = CameraDir.z; camDir.w = 0.f;
-        clFlag |= sendArgument(kChoppy,  0, sizeof(cl_mem   ), (void*)&mVertexes);
-        clFlag |= sendArgument(kChoppy,  1, sizeof(cl_mem   ), (void*)&mChoppyVertexes);
-        clFlag |= sendArgument(kChoppy,  2, sizeof(cl_mem   ), (void*)&mNormals);
-        clFlag |= sendArgument(kChoppy,  3, sizeof(cl_float4), (void*)&camDir);
-        clFlag |= sendArgument(kChoppy,  4, sizeof(cl_float ), (void*)&mOptions.ChoppyStrength);
-        clFlag |= sendArgument(kChoppy,  5, sizeof(cl_float ), (void*)&underwater);
-        clFlag |= sendArgument(kChoppy,  6, sizeof(cl_uint2 ), (void*)&N);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to choppy waves computation.");
-            return;
-        }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kChoppy, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Choppy waves execution fail.");
-            return;
-        }
+		return _updateHeights(WorldPos);
 	}
 
 	// Check the point of intersection with the plane (0,1,0,0) and return the position in homogenous coordinates
@@ -788,6 +749,143 @@ namespace Hydrax{namespace Module
 		return false;
 	}
 
+	bool HydrOCL::_fitBudget(Noise::HydrOCLNoise *Noise)
+	{
+		Noise->setMaxWaves(-1);
+		// The budget is applied to the OpenCL backend when it is ready
+		if (mOptions.Budget <= 0.f || mPending) {
+			return true;
+		}
+		const char *path = fileFromResources(_def_CostFile);
+		if (!path) {
+			return true;
+		}
+		HydrOCLCost Cost;
+		Ogre::String Section = HydrOCLCost::getSection(mBackend->getName(), mBackend->getDeviceName());
+		if (!Cost.load(path, Section)) {
+			HydrOCLLOG("\tNo frame cost model for " + Section + ", the budget is not applied.");
+			return true;
+		}
+		int Octaves = Noise->getOptions().Octaves;
+		unsigned int Waves = Noise->getNumberOfWaves();
+		if (Waves < _def_BudgetWaves) {
+			Waves = _def_BudgetWaves;
+		}
+		int Complexity = Cost.maxComplexity(mOptions.Budget, Waves, Octaves);
+		if (Complexity < _def_BudgetMinComplexity && Complexity >= 0) {
+			Complexity = _def_BudgetMinComplexity;
+		}
+		if (Complexity >= 0 && Complexity < mOptions.Complexity) {
+			HydrOCLLOG("\tComplexity clamped from " + Ogre::StringConverter::toString(mOptions.Complexity) +
+			          " to " + Ogre::StringConverter::toString(Complexity) + " to fit the " +
+			          Ogre::StringConverter::toString(mOptions.Budget) + " ms budget.");
+			mOptions.Complexity = Complexity;
+			mMeshOptions.MeshComplexity = Complexity;
+			if (!mBackend->resize(mOptions)) {
+				mBackend->remove();
+				if (!mBackend->create(mOptions, Noise)) {
+					return false;
+				}
+			}
+		}
+		int MaxWaves = Cost.maxWaves(mOptions.Budget, mOptions.Complexity, Octaves);
+		if (MaxWaves >= 0) {
+			HydrOCLLOG("\tUp to " + Ogre::StringConverter::toString(MaxWaves) +
+			          " waves evaluated to fit the budget.");
+			Noise->setMaxWaves(MaxWaves);
+		}
+		return true;
+	}
+
+	void HydrOCL::_createVertices()
+	{
+		Mesh::POS_NORM_VERTEX* Vertices = allocHost<Mesh::POS_NORM_VERTEX>(mMemory, HydrOCLMemory::MEM_VERTEXES, mOptions.Complexity*mOptions.Complexity);
+		mVertices = Vertices;
+		for (int i = 0; i < mOptions.Complexity*mOptions.Complexity; i++) {
+			Vertices[i].nx = 0;
+			Vertices[i].ny = -1;
+			Vertices[i].nz = 0;
+		}
+	}
+
+	bool HydrOCL::_resize(const Options &Options)
+	{
+		HydrOCLLOG("Resizing " + getName() + " module.");
+		mOptions = Options;
+		_clampOptions();
+		mMeshOptions.MeshComplexity = mOptions.Complexity;
+		if (!mBackend->resize(mOptions)) {
+			HydrOCLLOG("\tThe backend can't be resized, so it will be created again.");
+			return false;
+		}
+		// The budget must be applied to the new complexity, while the
+		// waves cap depends on it as well
+		if (!_fitBudget(static_cast<Noise::HydrOCLNoise*>(mNoise))) {
+			return false;
+		}
+		releaseHost(mMemory, static_cast<Mesh::POS_NORM_VERTEX*>(mVertices)); mVertices=NULL;
+		_createVertices();
+		if (!_fitMemory()) {
+			// Already removed
+			return true;
+		}
+		HydrOCLLOG(getName() + " resized.");
+		return true;
+	}
+
+	bool HydrOCL::_fitMemory()
+	{
+		unsigned int i;
+		const HydrOCLMemory &M = *mMemory;
+		Ogre::String Usage = "\tMemory usage (device/host KB):";
+		for (i = 0; i < HydrOCLMemory::N_SUBSYSTEMS; i++) {
+			HydrOCLMemory::Subsystem s = (HydrOCLMemory::Subsystem)i;
+			Usage += Ogre::String(" ") + HydrOCLMemory::getName(s) + " " +
+			         Ogre::StringConverter::toString(M.getUsage(s, HydrOCLMemory::MEM_DEVICE).Current >> 10) + "/" +
+			         Ogre::StringConverter::toString(M.getUsage(s, HydrOCLMemory::MEM_HOST).Current >> 10);
+		}
+		HydrOCLLOG(Usage);
+		if (mOptions.MemoryBudget <= 0) {
+			return true;
+		}
+		size_t Budget = (size_t)mOptions.MemoryBudget << 20;
+		// The pool just caches idle buffers for reuse, trimming itself
+		size_t Pooled = M.getUsage(HydrOCLMemory::MEM_POOL, HydrOCLMemory::MEM_DEVICE).Current +
+		                M.getUsage(HydrOCLMemory::MEM_POOL, HydrOCLMemory::MEM_HOST).Current;
+		size_t Used = M.getTotal().Current - Pooled;
+		if (Used <= Budget) {
+			return true;
+		}
+		// The noise memory doesn't depend on the complexity
+		size_t Fixed = M.getUsage(HydrOCLMemory::MEM_NOISE, HydrOCLMemory::MEM_DEVICE).Current +
+		               M.getUsage(HydrOCLMemory::MEM_NOISE, HydrOCLMemory::MEM_HOST).Current;
+		int Complexity = 0;
+		if (Budget > Fixed) {
+			Complexity = (int)(mOptions.Complexity*sqrt((double)(Budget - Fixed) / (Used - Fixed)));
+		}
+		if (!mOptions.MemoryDownscale || Complexity < _def_BudgetMinComplexity) {
+			HydrOCLLOG("The " + Ogre::StringConverter::toString(Used >> 20) + " MB used exceed the " +
+			          Ogre::StringConverter::toString(mOptions.MemoryBudget) + " MB memory budget.");
+			remove();
+			return false;
+		}
+		HydrOCLLOG("\tComplexity downscaled from " + Ogre::StringConverter::toString(mOptions.Complexity) +
+		          " to " + Ogre::StringConverter::toString(Complexity) + " to fit the " +
+		          Ogre::StringConverter::toString(mOptions.MemoryBudget) + " MB memory budget.");
+		mOptions.Complexity = Complexity;
+		mMeshOptions.MeshComplexity = Complexity;
+		if (!mBackend->resize(mOptions)) {
+			mBackend->remove();
+			if (!mBackend->create(mOptions, static_cast<Noise::HydrOCLNoise*>(mNoise))) {
+				remove();
+				return false;
+			}
+		}
+		releaseHost(mMemory, static_cast<Mesh::POS_NORM_VERTEX*>(mVertices)); mVertices=NULL;
+		_createVertices();
+		return true;
+	}
+
 	void HydrOCL::_setDisplacementAmplitude(const float &Amplitude)
 	{
 		mUpperBoundPlane = Ogre::Plane( mNormal, mPos + Amplitude * mNormal);
@@ -799,151 +897,70 @@ namespace Hydrax{namespace Module
 		return mHydrax->getPosition().y + mNoise->getValue(Position.x, Position.y)*mOptions.Strength;
 	}
 
-    bool HydrOCL::setupOpenCL()
-    {
-        HydraxLOG("\tInitializating OpenCL...");
+	bool HydrOCL::startTrace(const Ogre::String &File)
+	{
+		stopTrace();
+		mTrace = new HydrOCLTrace();
+		if (!mTrace->start(File)) {
+			delete mTrace; mTrace=NULL;
+			return false;
+		}
+		if (!mOptions.Telemetry) {
+			HydrOCLLOG("Telemetry is disabled, so only the host spans will be traced.");
+		}
+		if (mBackend) {
+			mBackend->setTrace(mTrace);
+		}
+		return true;
+	}
 
-        //! Get platform
-        if(!getPlatform()){
-            return false;
-        }
-        //! Get available devices
-        if(!getDevices()){
-            return false;
-        }
-        //! Build kernels
-        const char* path = fileFromResources("grid.cl");
-        if(!path){
-            HydraxLOG("\tGrid OpenCL program can't be found!");
-            return false;
-        }
-        //! @todo Allow several devices use.
-        kGeometryGen = loadKernelFromFile(mContext, mDevices[0], path, "geometry", "");
-        kBasePlane   = loadKernelFromFile(mContext, mDevices[0], path, "setBasePlane", "");
-        kCopy        = loadKernelFromFile(mContext, mDevices[0], path, "copy", "");
-        kSmooth      = loadKernelFromFile(mContext, mDevices[0], path, "smooth", "");
-        kNormals     = loadKernelFromFile(mContext, mDevices[0], path, "normals", "");
-        kChoppy      = loadKernelFromFile(mContext, mDevices[0], path, "choppyWaves", "");
-        if( !kGeometryGen || !kBasePlane || !kCopy || !kSmooth || !kNormals || !kChoppy ){
-            return false;
-        }
+	void HydrOCL::stopTrace()
+	{
+		if (!mTrace) {
+			return;
+		}
+		if (mBackend) {
+			mBackend->setTrace(NULL);
+		}
+		mTrace->stop();
+		delete mTrace; mTrace=NULL;
+	}
 
-        HydraxLOG("\tOpenCL ready to work!");
-        return true;
-    }
-
-    bool HydrOCL::getPlatform()
-    {
-        cl_uint i;
-        cl_int clFlag;
-        char PlatformName[1024];
-        bool HavePlatform=false;
-
-        // Gets the number of valid platforms
-        clFlag = clGetPlatformIDs(0, NULL, &mNumberOfPlatforms);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tCan't get number of platforms.");
-            return false;
-        }
-        if(mNumberOfPlatforms <= 0) {
-            HydraxLOG("\t\tNot valid platforms present.");
-            return false;
-        }
-        // Gets the platform array
-        mPlatforms = new cl_platform_id[mNumberOfPlatforms];
-        clFlag = clGetPlatformIDs(mNumberOfPlatforms, mPlatforms, NULL);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tPlatforms can't be written.");
-            return false;
-        }
-        // Gets the names of platforms
-        for(i=0;i<mNumberOfPlatforms;i++) {
-            clFlag = clGetPlatformInfo(mPlatforms[i], CL_PLATFORM_NAME, 1024*sizeof(char), &PlatformName, NULL);
-            if(clFlag != CL_SUCCESS) {
-                continue;
-            }
-            HydraxLOG(Ogre::String("\t\tFound platform: ") + PlatformName);
-            // Look for valid devices into the platform
-            clFlag = clGetDeviceIDs (mPlatforms[i], mOptions.DeviceType, 0, NULL, &mNumberOfDevices);
-            if( (clFlag != CL_SUCCESS) || (mNumberOfDevices <= 0) ){
-                HydraxLOG("\t\tDiscarded.");
-                continue;
-            }
-            mPlatform = mPlatforms[i];
-            HydraxLOG("\t\tPlatform selected!");
-            HavePlatform=true;
-            return true;
-        }
-        if(!HavePlatform) {
-            HydraxLOG("\t\tAny platform matchs with requested platform (probaly because device type is not available).");
-            return false;
-        }
-        return true;
-    }
-
-    bool HydrOCL::getDevices()
-    {
-        cl_uint i;
-        cl_int clFlag;
-        char DeviceName[1024];
-
-        // Gets the number of valid devices
-        clFlag = clGetDeviceIDs (mPlatform, mOptions.DeviceType, 0, NULL, &mNumberOfDevices);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tCan't take the number of devices.");
-            return false;
-        }
-        if(mNumberOfDevices <= 0) {
-            HydraxLOG("\t\tCan't find any valid device of selected type.");
-            return false;
-        }
-        // Gets the devices array
-        mDevices = new cl_device_id[mNumberOfDevices];
-        clFlag = clGetDeviceIDs(mPlatform, mOptions.DeviceType, mNumberOfDevices, mDevices, &mNumberOfDevices);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tCan't write devices array.");
-            return false;
-        }
-        // Create an OpenCL context
-        mContext = clCreateContext(0, mNumberOfDevices, mDevices, NULL, NULL, &clFlag);
-        if(clFlag != CL_SUCCESS) {
-            if(clFlag == CL_DEVICE_NOT_AVAILABLE){
-                HydraxLOG("\t\tCan't create the context, selected devices are not availables.");
-            }
-            else if(clFlag == CL_OUT_OF_HOST_MEMORY){
-                HydraxLOG("\t\tCan't create the context, host is out of memory.");
-            }
-            return false;
-        }
-        // Create command queues for each device
-        mComQueue = new cl_command_queue[mNumberOfDevices];
-        for(i=0;i<mNumberOfDevices;i++) {
-            mComQueue[i] = clCreateCommandQueue(mContext, mDevices[i], 0, &clFlag);
-            if(clFlag != CL_SUCCESS) {
-                HydraxLOG("\t\tCan't create command queue.");
-                return false;
-            }
-        }
-        // Gets devices name
-        HydraxLOG("\t\tDevices found:");
-        for(i=0;i<mNumberOfDevices;i++) {
-            clGetDeviceInfo(mDevices[i], CL_DEVICE_NAME, 1024*sizeof(char), &DeviceName, NULL);
-            HydraxLOG(Ogre::String("\t\t\t") + DeviceName);
-        }
-        return true;
-    }
-
-    bool HydrOCL::allocMemory(cl_mem *clID, size_t size)
-    {
-        int clFlag;
-        *clID = clCreateBuffer(mContext, CL_MEM_READ_WRITE, size, NULL, &clFlag);
-        if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tDevice memory allocation fail.");
-            return false;
-        }
+	const HydrOCLStats* HydrOCL::getStats() const
+	{
+		if (!mBackend) {
+			return NULL;
+		}
+		return mBackend->getStats();
+	}
+
+	Ogre::String HydrOCL::getBackendName() const
+	{
+		if (!mBackend) {
+			return "";
+		}
+		return mBackend->getName();
+	}
+
+	Ogre::String HydrOCL::getDeviceName() const
+	{
+		if (!mBackend) {
+			return "";
+		}
+		return mBackend->getDeviceName();
+	}
+
+	size_t HydrOCL::getAllocatedMemory() const
+	{
+		if (!mBackend) {
+			return 0;
+		}
+		return mBackend->getAllocatedMemory();
+	}
+
+	const HydrOCLMemory& HydrOCL::getMemoryUsage() const
+	{
+		return *mMemory;
+	}
 
-        mAllocatedMem += size;
-        return true;
-    }
-
 }}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <hydrocl/HydrOCLMemory.h>
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLMemory::HydrOCLMemory()
+	{
+	    pthread_mutex_init(&mMutex, NULL);
+	}
+
+	HydrOCLMemory::~HydrOCLMemory()
+	{
+	    pthread_mutex_destroy(&mMutex);
+	}
+
+	void HydrOCLMemory::allocated(Subsystem Subsystem, Location Where, const void *Id, size_t Size)
+	{
+	    if(!Id)
+	        return;
+	    pthread_mutex_lock(&mMutex);
+	    // An identifier can't be alive twice (i.e.- reused by the driver
+	    // after a release that has not been registered)
+	    _released(Id);
+	    Record R;
+	    R.Owner = Subsystem;
+	    R.Where = Where;
+	    R.Size  = Size;
+	    mRecords[Id] = R;
+	    _add(mUsage[Subsystem][Where], Size);
+	    _add(mTotal[Where], Size);
+	    _add(mAll, Size);
+	    pthread_mutex_unlock(&mMutex);
+	}
+
+	void HydrOCLMemory::released(const void *Id)
+	{
+	    pthread_mutex_lock(&mMutex);
+	    _released(Id);
+	    pthread_mutex_unlock(&mMutex);
+	}
+
+	void HydrOCLMemory::_released(const void *Id)
+	{
+	    std::map<const void*, Record>::iterator it = mRecords.find(Id);
+	    if(it == mRecords.end())
+	        return;
+	    const Record &R = it->second;
+	    mUsage[R.Owner][R.Where].Current -= R.Size;
+	    mTotal[R.Where].Current -= R.Size;
+	    mAll.Current -= R.Size;
+	    mRecords.erase(it);
+	}
+
+	void HydrOCLMemory::resetPeaks()
+	{
+	    unsigned int i, j;
+	    pthread_mutex_lock(&mMutex);
+	    for(i=0;i<N_SUBSYSTEMS;i++) {
+	        for(j=0;j<N_LOCATIONS;j++)
+	            mUsage[i][j].Peak = mUsage[i][j].Current;
+	    }
+	    for(j=0;j<N_LOCATIONS;j++)
+	        mTotal[j].Peak = mTotal[j].Current;
+	    mAll.Peak = mAll.Current;
+	    pthread_mutex_unlock(&mMutex);
+	}
+
+	const char* HydrOCLMemory::getName(Subsystem Subsystem)
+	{
+	    static const char* Names[N_SUBSYSTEMS] = {"grid", "noise", "transfer", "vertexes", "pool"};
+	    return Names[Subsystem];
+	}
+
+	void HydrOCLMemory::_add(Usage &U, size_t Size)
+	{
+	    U.Current += Size;
+	    if(U.Current > U.Peak)
+	        U.Peak = U.Current;
+	}
+}}
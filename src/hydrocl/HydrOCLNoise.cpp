@@ -21,39 +21,76 @@
 Based on the perlin noise code from Claes Johanson thesis:
 http://graphics.cs.lth.se/theses/projects/projgrid/
 --------------------------------------------------------------------------------
- */
-
+ */
+
 #include <hydrocl/HydrOCLNoise.h>
 #include <hydrocl/HydrOCLUtils.h>
+#include <hydrocl/HydrOCLRuntime.h>
 
 #include <Hydrax/Hydrax.h>
 
 #define _def_PackedNoise true
 
+/** Sine without branches nor calls, so the waves loops are vectorized.
+ * The argument is reduced to [-pi/4, pi/4] by quadrants (with pi/2 split
+ * in three parts, so the large phases keep their accuracy), where the
+ * sine and cosine are approximated by their Taylor series. The error is
+ * below 2e-7 for |x| < 2000.
+ * @param x Angle [rad].
+ * @return sin(x).
+ */
+static inline float fastSin(float x)
+{
+    // Nearest quadrant, rounded by the float precision
+    float q = (x*0.636619772f + 12582912.f) - 12582912.f;
+    int k = (int)q;
+    float r = ((x - q*1.5703125f) - q*4.837512969970703125e-4f) - q*7.54978995489188216e-8f;
+    float r2 = r*r;
+    float s = r + r*r2*(-1.f/6.f + r2*(1.f/120.f + r2*(-1.f/5040.f + r2*(1.f/362880.f))));
+    float c = 1.f + r2*(-0.5f + r2*(1.f/24.f + r2*(-1.f/720.f + r2*(1.f/40320.f))));
+    // Odd quadrants take the cosine, and the last two change the sign
+    float v = s + (float)(k & 1)*(c - s);
+    return (float)(1 - (k & 2))*v;
+}
+
 namespace Hydrax{namespace Noise
 {
 	HydrOCLNoise::HydrOCLNoise()
 		: HydrOCLPerlin()
+		, mMaxWaves(-1)
 		, mTime(0.f)
 		, mDir(0)
 		, mA(0)
 		, mT(0)
 		, mP(0)
+		, hDir(0)
+		, hA(0)
+		, hT(0)
+		, hP(0)
+		, kWaves(0)
 	{
 	}
 
 	HydrOCLNoise::HydrOCLNoise(const HydrOCLPerlin::Options &Options)
 		: HydrOCLPerlin(Options)
+		, mMaxWaves(-1)
 		, mTime(0.f)
 		, mDir(0)
 		, mA(0)
 		, mT(0)
 		, mP(0)
+		, hDir(0)
+		, hA(0)
+		, hT(0)
+		, hP(0)
+		, kWaves(0)
 	{
 	}
 
 	HydrOCLNoise::~HydrOCLNoise()
 	{
+		// The base class destructor can't release the waves
+		remove();
 	}
 
 	void HydrOCLNoise::create()
@@ -72,15 +109,11 @@ namespace Hydrax{namespace Noise
             delete mWaves.at(i);
 	    }
 	    mWaves.clear();
-        if(kWaves)clReleaseKernel(kWaves); kWaves=0;
-        if(mDir)clReleaseMemObject(mDir); mDir=0;
-        if(mA)clReleaseMemObject(mA); mA=0;
-        if(mT)clReleaseMemObject(mT); mT=0;
-        if(mP)clReleaseMemObject(mP); mP=0;
-        if(hDir) delete[] hDir; hDir=0;
-        if(hA)   delete[] hA; hA=0;
-        if(hT)   delete[] hT; hT=0;
-        if(hP)   delete[] hP; hP=0;
+        releaseOpenCL();
+        releaseHost(mMemory, hDir); hDir=0;
+        releaseHost(mMemory, hA);   hA=0;
+        releaseHost(mMemory, hT);   hT=0;
+        releaseHost(mMemory, hP);   hP=0;
 
 		if (!isCreated()) {
 			return;
@@ -132,11 +165,29 @@ namespace Hydrax{namespace Noise
         return true;
     }
 
+    void HydrOCLNoise::setHeight(const float *x, const float *z, float *y, unsigned int n, const Ogre::Vector3 &world) const
+    {
+        unsigned int i, k, nWaves = _evaluatedWaves();
+        HydrOCLPerlin::setHeight(x, z, y, n, world);
+        for(k=0;k<nWaves;k++){
+            const Wave* w = mWaves.at(k);
+            float L = 1.5625f*w->T*w->T;
+            float F = 2.f*M_PI/w->T;
+            float K = 2.f*M_PI/L;
+            float phase = F*mTime - K*(w->dir.x*world.x + w->dir.y*world.z) + w->P;
+            float Kx = K*w->dir.x, Kz = K*w->dir.y;
+            float A = w->A;
+            for(i=0;i<n;i++){
+                y[i] += A * fastSin(phase - Kx*x[i] - Kz*z[i]);
+            }
+        }
+    }
+
 	float HydrOCLNoise::getValue(const float &x, const float &y)
 	{
-	    unsigned int i;
+	    unsigned int i, nWaves = _evaluatedWaves();
 	    float value = HydrOCLPerlin::getValue(x,y);
-	    for(i=0;i<mWaves.size();i++){
+	    for(i=0;i<nWaves;i++){
 	        Wave* w = mWaves.at(i);
             float X = w->dir.x*x + w->dir.y*y;
             float L = 1.5625f*w->T*w->T;
@@ -147,106 +198,154 @@ namespace Hydrax{namespace Noise
 		return value;
 	}
 
-    bool HydrOCLNoise::setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world)
+    bool HydrOCLNoise::setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world, Module::HydrOCLStats *Stats)
     {
-        if(!HydrOCLPerlin::setHeight(v, N, world))
+        if(!HydrOCLPerlin::setHeight(v, N, world, Stats))
             return false;
-        if(!mWaves.size())
+        if(!_evaluatedWaves())
             return true;
         cl_int clFlag=0;
         //! @todo allow several devices usage
         size_t localWorkSize[2], globalWorkSize[2];
         localWorkSize[0] = 256;
         localWorkSize[1] = 256;
-        globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
+        globalWorkSize[0] = roundUp((N.x + mVectorWidth - 1) / mVectorWidth, localWorkSize[0]);
         globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
         // Launch kernel
         if(isModified()){
             if(!send())
                 return false;
         }
-        cl_uint nWaves = (unsigned int)mWaves.size();
-        clFlag |= sendArgument(kWaves,  0, sizeof(cl_mem   ), (void*)&v);
-        clFlag |= sendArgument(kWaves,  1, sizeof(cl_mem   ), (void*)&mDir);
-        clFlag |= sendArgument(kWaves,  2, sizeof(cl_mem   ), (void*)&mA);
-        clFlag |= sendArgument(kWaves,  3, sizeof(cl_mem   ), (void*)&mT);
-        clFlag |= sendArgument(kWaves,  4, sizeof(cl_mem   ), (void*)&mP);
-        clFlag |= sendArgument(kWaves,  5, sizeof(cl_float4), (void*)&world);
-        clFlag |= sendArgument(kWaves,  6, sizeof(cl_float ), (void*)&mTime);
-        clFlag |= sendArgument(kWaves,  7, sizeof(cl_uint  ), (void*)&nWaves);
-        clFlag |= sendArgument(kWaves,  8, sizeof(cl_uint2 ), (void*)&N);
+        cl_uint nWaves = _evaluatedWaves();
+        // Specialised kernel, generic one while the options are changing
+        cl_kernel kernel = 0;
+        if(mSpecialize) {
+            Ogre::String constants = Module::HydrOCLVariants::constant("CONST_NX", N.x) +
+                                     Module::HydrOCLVariants::constant("CONST_NY", N.y) +
+                                     Module::HydrOCLVariants::constant("CONST_WAVES", nWaves);
+            kernel = mWavesVariants.get(mWavesProgram, constants);
+        }
+        if(!kernel)
+            kernel = kWaves;
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&v);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_mem   ), (void*)&mDir);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_mem   ), (void*)&mA);
+        clFlag |= sendArgument(kernel,  3, sizeof(cl_mem   ), (void*)&mT);
+        clFlag |= sendArgument(kernel,  4, sizeof(cl_mem   ), (void*)&mP);
+        clFlag |= sendArgument(kernel,  5, sizeof(cl_float4), (void*)&world);
+        clFlag |= sendArgument(kernel,  6, sizeof(cl_float ), (void*)&mTime);
+        clFlag |= sendArgument(kernel,  7, sizeof(cl_uint  ), (void*)&nWaves);
+        clFlag |= sendArgument(kernel,  8, sizeof(cl_uint2 ), (void*)&N);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to waves computation.");
+            HydrOCLLOG("Can't send arguments to waves computation.");
             return false;
         }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kWaves, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        cl_event event, *pEvent = Stats ? &event : NULL;
+        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, pEvent);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Waves computation execution fail.");
+            HydrOCLLOG("Waves computation execution fail.");
             return false;
         }
+        if(Stats) Stats->event(Module::HydrOCLStats::STAGE_NOISE, event);
         return true;
     }
 
-	bool HydrOCLNoise::setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue)
+	bool HydrOCLNoise::setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue, const char *flags,
+	                               Module::HydrOCLBufferPool *pool, Module::HydrOCLRuntime *runtime)
 	{
-        if(!HydrOCLPerlin::setupOpenCL(n, context, devices, comQueue))
+        if(!HydrOCLPerlin::setupOpenCL(n, context, devices, comQueue, flags, pool, runtime))
             return false;
         // Load kernel
         //! @todo allow several devices usage
-        const char* path = fileFromResources("waves.cl");
-        if(!path){
-            HydraxLOG("\tPerlin OpenCL program can't be found!");
-            return false;
-        }
-        kWaves = loadKernelFromFile(mContext, mDevices[0], path, "height", "");
+        const char* name = "waves.cl";
+        Ogre::String wFlags = _wavesFlags(mDevices[0], flags);
+        kWaves = mRuntime ? mRuntime->loadKernel(name, "height", wFlags.c_str()) :
+                            buildKernel(mContext, mDevices[0], name, "height", wFlags.c_str());
         if( !kWaves ){
             return false;
         }
+        // The variants are built by the runtime
+        mWavesProgram = Module::HydrOCLRuntime::Program(name, wFlags);
+        mWavesVariants.setup(mRuntime, "height");
+        // Waves added before have only been stored in the host
+        if(!reallocate())
+            return false;
+        if(!send())
+            return false;
         return true;
 	}
 
+	bool HydrOCLNoise::getPrograms(cl_device_id device, const char *flags, std::vector<Module::HydrOCLRuntime::Program> &programs) const
+	{
+        if(!HydrOCLPerlin::getPrograms(device, flags, programs))
+            return false;
+        programs.push_back(Module::HydrOCLRuntime::Program("waves.cl", _wavesFlags(device, flags)));
+        return true;
+	}
+
+	Ogre::String HydrOCLNoise::_wavesFlags(cl_device_id device, const char *flags) const
+	{
+        // Must match the launch size computed in setHeight()
+        char wFlags[256];
+        sprintf(wFlags, "-DVECTOR_WIDTH=%u %s", vectorWidth(device), flags);
+        return wFlags;
+	}
+
+	void HydrOCLNoise::releaseOpenCL()
+	{
+        if(kWaves)clReleaseKernel(kWaves); kWaves=0;
+        mWavesVariants.release();
+        releaseBuffer(mMemory, mDir, mPool); mDir=0;
+        releaseBuffer(mMemory, mA, mPool); mA=0;
+        releaseBuffer(mMemory, mT, mPool); mT=0;
+        releaseBuffer(mMemory, mP, mPool); mP=0;
+        HydrOCLPerlin::releaseOpenCL();
+	}
+
 	bool HydrOCLNoise::reallocate()
 	{
         cl_int clFlag=0;
-        if(mDir)clReleaseMemObject(mDir); mDir=0;
-        if(mA)clReleaseMemObject(mA); mA=0;
-        if(mT)clReleaseMemObject(mT); mT=0;
-        if(mP)clReleaseMemObject(mP); mP=0;
-        if(hDir) delete[] hDir; hDir=0;
-        if(hA)   delete[] hA; hA=0;
-        if(hT)   delete[] hT; hT=0;
-        if(hP)   delete[] hP; hP=0;
+        releaseBuffer(mMemory, mDir, mPool); mDir=0;
+        releaseBuffer(mMemory, mA, mPool); mA=0;
+        releaseBuffer(mMemory, mT, mPool); mT=0;
+        releaseBuffer(mMemory, mP, mPool); mP=0;
+        releaseHost(mMemory, hDir); hDir=0;
+        releaseHost(mMemory, hA);   hA=0;
+        releaseHost(mMemory, hT);   hT=0;
+        releaseHost(mMemory, hP);   hP=0;
         unsigned int N = mWaves.size();
         if(!N)
             return true;
-        mDir = clCreateBuffer(mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float2), NULL, &clFlag);
+	    hDir = allocHost<cl_float2>(mMemory, Module::HydrOCLMemory::MEM_NOISE, N);
+	    hA   = allocHost<cl_float>(mMemory, Module::HydrOCLMemory::MEM_NOISE, N);
+	    hT   = allocHost<cl_float>(mMemory, Module::HydrOCLMemory::MEM_NOISE, N);
+	    hP   = allocHost<cl_float>(mMemory, Module::HydrOCLMemory::MEM_NOISE, N);
+        if(!mContext)
+            return true;
+        mDir = createBuffer(mMemory, Module::HydrOCLMemory::MEM_NOISE, mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float2), &clFlag, mPool);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tWaves directions allocation failure.");
+            HydrOCLLOG("\t\tWaves directions allocation failure.");
             mDir = 0;
             return false;
         }
-        mA = clCreateBuffer(mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), NULL, &clFlag);
+        mA = createBuffer(mMemory, Module::HydrOCLMemory::MEM_NOISE, mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), &clFlag, mPool);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tWaves amplitudes allocation failure.");
+            HydrOCLLOG("\t\tWaves amplitudes allocation failure.");
             mA = 0;
             return false;
         }
-        mT = clCreateBuffer(mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), NULL, &clFlag);
+        mT = createBuffer(mMemory, Module::HydrOCLMemory::MEM_NOISE, mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), &clFlag, mPool);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tWaves periods allocation failure.");
+            HydrOCLLOG("\t\tWaves periods allocation failure.");
             mT = 0;
             return false;
         }
-        mP = clCreateBuffer(mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), NULL, &clFlag);
+        mP = createBuffer(mMemory, Module::HydrOCLMemory::MEM_NOISE, mContext, CL_MEM_READ_WRITE, N*sizeof(cl_float), &clFlag, mPool);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tWaves phases allocation failure.");
+            HydrOCLLOG("\t\tWaves phases allocation failure.");
             mP = 0;
             return false;
         }
-	    hDir = new cl_float2[N];
-	    hA   = new cl_float[N];
-	    hT   = new cl_float[N];
-	    hP   = new cl_float[N];
         return true;
 	}
 
@@ -263,17 +362,27 @@ namespace Hydrax{namespace Noise
             hT[i]     = mWaves.at(i)->T;
             hP[i]     = mWaves.at(i)->P;
 	    }
+        if(!mContext)
+            return true;
         clFlag |= sendData(mComQueue[0], mDir, hDir, N*sizeof( cl_float2 ));
         clFlag |= sendData(mComQueue[0], mA,   hA,   N*sizeof( cl_float  ));
         clFlag |= sendData(mComQueue[0], mT,   hT,   N*sizeof( cl_float  ));
         clFlag |= sendData(mComQueue[0], mP,   hP,   N*sizeof( cl_float  ));
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send waves data to device.");
+            HydrOCLLOG("Can't send waves data to device.");
             return false;
         }
         return true;
 	}
 
+	unsigned int HydrOCLNoise::_evaluatedWaves() const
+	{
+	    unsigned int N = (unsigned int)mWaves.size();
+	    if((mMaxWaves >= 0) && ((unsigned int)mMaxWaves < N))
+	        return (unsigned int)mMaxWaves;
+	    return N;
+	}
+
 	bool HydrOCLNoise::isModified()
 	{
         unsigned int i, N = mWaves.size();
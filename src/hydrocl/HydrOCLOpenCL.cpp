@@ -0,0 +1,797 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <hydrocl/HydrOCLOpenCL.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+/// Per device vertexes read strategy recommendations (see HydrOCLTransferBench)
+#define _def_TransferFile "HydrOCLTransfer.cfg"
+/// Memory kept by the buffers pool for reuse [bytes]
+#define _def_PoolCache (32 << 20)
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLOpenCL::HydrOCLOpenCL()
+		: mNoise(NULL)
+        , mRuntime(NULL)
+        , mNumberOfDevices(0)
+        , mDevices(NULL)
+        , mContext(0)
+        , mComQueue(NULL)
+        , mAllocatedMem(0)
+        , mBase(0)
+        , mOutput(0)
+        , mNormals(0)
+        , mCapacity(0)
+        , mTileSize(16)
+        , mSmoothTile(16)
+        , mChoppyTile(16)
+        , mVectorWidth(1)
+        , kGeometryGen(0)
+        , kBasePlane(0)
+        , kSmooth(0)
+        , mSmoothRadius(0)
+        , kNormals(0)
+        , kChoppy(0)
+        , mTransfer(HydrOCL::TT_READ)
+        , hPos(NULL)
+        , hNor(NULL)
+        , mStats(NULL)
+        , mTrace(NULL)
+        , mMemory(NULL)
+        , mPool(NULL)
+	{
+        mVertexes[0] = 0;
+        mVertexes[1] = 0;
+        mPinned[0] = 0;
+        mPinned[1] = 0;
+	}
+
+	HydrOCLOpenCL::~HydrOCLOpenCL()
+	{
+		remove();
+	}
+
+	bool HydrOCLOpenCL::create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule)
+	{
+	    if(!prepare(Options, NoiseModule) || !complete(NoiseModule)) {
+	        remove();
+	        return false;
+	    }
+	    return true;
+	}
+
+	bool HydrOCLOpenCL::prepare(const HydrOCL::Options &Options, const Noise::HydrOCLNoise *NoiseModule)
+	{
+	    mOptions = Options;
+        // Start OpenCL platform
+        if(!setupOpenCL(NoiseModule))
+            return false;
+        if(mOptions.Telemetry) {
+            if(mRuntime->isProfiling())
+                mStats = new HydrOCLStats();
+            else
+                HydrOCLLOG("\tThe command queues are not profiled, so the telemetry is disabled.");
+        }
+        mPool = new HydrOCLBufferPool(mContext, mMemory, _def_PoolCache);
+        if(!_createGrid())
+            return false;
+        return true;
+	}
+
+	bool HydrOCLOpenCL::complete(Noise::HydrOCLNoise *NoiseModule)
+	{
+	    mNoise = NoiseModule;
+        // Send OpenCL stuff to noise module, whose programs have been
+        // already built.
+        mNoise->setSpecialize(mOptions.Specialize);
+        if(!mNoise->setupOpenCL(mNumberOfDevices, mContext, mDevices, mComQueue,
+                                _noiseFlags(), mPool, mRuntime)){
+            return false;
+        }
+        return true;
+	}
+
+	void HydrOCLOpenCL::findResources()
+	{
+	    fileFromResources(_def_TransferFile);
+	}
+
+	void HydrOCLOpenCL::remove()
+	{
+	    // The noise module must drop its OpenCL objects before the context
+	    if(mNoise) mNoise->releaseOpenCL(); mNoise=NULL;
+	    // Pending events must be released before the queues
+	    if(mStats) delete mStats; mStats=NULL;
+        _releaseGrid();
+        // The pool must release its buffers before the context
+        if(mPool) delete mPool; mPool=NULL;
+        mDeviceName = "";
+        if(kGeometryGen)clReleaseKernel(kGeometryGen); kGeometryGen=0;
+        if(kBasePlane)clReleaseKernel(kBasePlane); kBasePlane=0;
+        if(kSmooth)clReleaseKernel(kSmooth); kSmooth=0;
+        if(kNormals)clReleaseKernel(kNormals); kNormals=0;
+        if(kChoppy)clReleaseKernel(kChoppy); kChoppy=0;
+        mGeometryVariants.release();
+        mSmoothVariants.release();
+        mNormalsVariants.release();
+        mChoppyVariants.release();
+        // The context and the queues belong to the runtime
+        mComQueue = NULL;
+        mContext = 0;
+        mDevices = NULL;
+        mNumberOfDevices = 0;
+        if(mRuntime) mRuntime->release(); mRuntime=NULL;
+	}
+
+	void HydrOCLOpenCL::setOptions(const HydrOCL::Options &Options)
+	{
+		mOptions = Options;
+		// The toggled stages are built in background, without stalling the
+		// frames
+		if(mRuntime)
+		    _requestPrograms();
+		if(mNoise)
+		    mNoise->setSpecialize(mOptions.Specialize);
+	}
+
+	bool HydrOCLOpenCL::resize(const HydrOCL::Options &Options)
+	{
+	    if(!mContext)
+	        return false;
+	    mOptions = Options;
+	    // Context, queues and kernels are kept, only the grid changes
+	    if(!_createGrid()) {
+	        _releaseGrid();
+	        return false;
+	    }
+	    return true;
+	}
+
+	bool HydrOCLOpenCL::geometry(const Ogre::Vector4 *Corners)
+	{
+        cl_int clFlag=0;
+        //! @todo allow several devices usage
+        cl_uint2 N;
+        N.x = (unsigned int)mOptions.Complexity;
+        N.y = (unsigned int)mOptions.Complexity;
+        // Geometry regeneration
+        cl_float4 c[4];
+        for(unsigned int i=0;i<4;i++) {
+            c[i].x=Corners[i].x; c[i].y=Corners[i].y; c[i].z=Corners[i].z; c[i].w=Corners[i].w;
+        }
+        cl_kernel kernel = _specialized(mGeometryVariants, _gridProgram(mTileSize, ""), kGeometryGen,
+                                        _constants(), mTileSize);
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&mVertexes[mBase]);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_float4), (void*)&c[0]);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_float4), (void*)&c[1]);
+        clFlag |= sendArgument(kernel,  3, sizeof(cl_float4), (void*)&c[2]);
+        clFlag |= sendArgument(kernel,  4, sizeof(cl_float4), (void*)&c[3]);
+        clFlag |= sendArgument(kernel,  5, sizeof(cl_uint2 ), (void*)&N);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't send arguments to geometry generator.");
+            return false;
+        }
+        if(!_launchCoarsened(kernel, HydrOCLStats::STAGE_GEOMETRY)) {
+            HydrOCLLOG("Geometry generator execution fail.");
+            return false;
+        }
+        // The regenerated vertexes must be rendered at once
+        mOutput = mBase;
+        return true;
+	}
+
+	bool HydrOCLOpenCL::basePlane(const float &h)
+	{
+        cl_int clFlag=0;
+        float H = h;
+        clFlag |= sendArgument(kBasePlane,  0, sizeof(cl_mem   ), (void*)&mVertexes[mBase]);
+        clFlag |= sendArgument(kBasePlane,  1, sizeof(cl_float ), (void*)&H);
+        clFlag |= sendArgument(kBasePlane,  2, sizeof(cl_uint2 ), (void*)&mBufferN);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't send arguments to base plane set processor.");
+            return false;
+        }
+        if(!_launchCoarsened(kBasePlane, HydrOCLStats::STAGE_BASEPLANE)) {
+            HydrOCLLOG("Set base plane execution fail.");
+            return false;
+        }
+        return true;
+	}
+
+	bool HydrOCLOpenCL::noise(const Ogre::Vector3 &World)
+	{
+        // Noise computation (it does not depend on the vertexes layout)
+        return mNoise->setHeight(mVertexes[mBase], mBufferN, World, mStats);
+	}
+
+	bool HydrOCLOpenCL::smooth()
+	{
+		// Not smoothed until the kernel is built
+		cl_kernel kernel = mOptions.Smooth ? _smoothKernel() : 0;
+		if (!kernel) {
+			return true;
+		}
+		kernel = _specialized(mSmoothVariants, _smoothProgram(mSmoothRadius), kernel, _constants(), mSmoothTile);
+
+        cl_int clFlag=0;
+        cl_uint2 N;
+        N.x = (unsigned int)mOptions.Complexity;
+        N.y = (unsigned int)mOptions.Complexity;
+        // Smoothing is computed out of place, so each vertex is averaged
+        // with the unsmoothed heights of its neighbours.
+        unsigned int out = 1 - mBase;
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&mVertexes[mBase]);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_mem   ), (void*)&mVertexes[out]);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_uint2 ), (void*)&N);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't send arguments to smoothing processor.");
+            return false;
+        }
+        if(!_launchTiled(kernel, mSmoothTile, HydrOCLStats::STAGE_SMOOTH)) {
+            HydrOCLLOG("Smoothing execution fail.");
+            return false;
+        }
+        // The smoothed vertexes are still undisplaced, so the pair roles swap
+        mBase = out;
+        return true;
+	}
+
+	bool HydrOCLOpenCL::normals()
+	{
+		// Choppy waves kernel computes the normals by itself, if it is
+		// already built
+		if (mOptions.ChoppyWaves && _choppyKernel()) {
+			return true;
+		}
+
+        cl_int clFlag=0;
+        cl_uint2 N;
+        N.x = (unsigned int)mOptions.Complexity;
+        N.y = (unsigned int)mOptions.Complexity;
+        // Normals computation
+        cl_kernel kernel = _specialized(mNormalsVariants, _gridProgram(mTileSize, ""), kNormals,
+                                        _constants(), mTileSize);
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&mVertexes[mBase]);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_mem   ), (void*)&mNormals);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_uint2 ), (void*)&N);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't send arguments to normals computator.");
+            return false;
+        }
+        if(!_launchTiled(kernel, mTileSize, HydrOCLStats::STAGE_NORMALS)) {
+            HydrOCLLOG("Normals computation execution fail.");
+            return false;
+        }
+        return true;
+	}
+
+	bool HydrOCLOpenCL::choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater)
+	{
+		if (!mOptions.ChoppyWaves || !_choppyKernel()) {
+			mOutput = mBase;
+			return true;
+		}
+
+        cl_int clFlag=0;
+        cl_uint2 N;
+        N.x = (unsigned int)mOptions.Complexity;
+        N.y = (unsigned int)mOptions.Complexity;
+        // Choppy waves computation, normals are computed as well
+        float underwater = Underwater;
+        cl_float4 camDir;
+        camDir.x = CameraDir.x; camDir.y = CameraDir.y; camDir.z = CameraDir.z; camDir.w = 0.f;
+        // Undisplaced vertexes are read from the base buffer, and the
+        // displaced ones written into the other one of the pair, together
+        // with the normals.
+        unsigned int out = 1 - mBase;
+        cl_kernel kernel = _specialized(mChoppyVariants, _choppyProgram(), kChoppy,
+                                        _constants() + HydrOCLVariants::constant("CONST_CHOPPY_STRENGTH", mOptions.ChoppyStrength),
+                                        mChoppyTile);
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&mVertexes[mBase]);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_mem   ), (void*)&mVertexes[out]);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_mem   ), (void*)&mNormals);
+        clFlag |= sendArgument(kernel,  3, sizeof(cl_float4), (void*)&camDir);
+        clFlag |= sendArgument(kernel,  4, sizeof(cl_float ), (void*)&mOptions.ChoppyStrength);
+        clFlag |= sendArgument(kernel,  5, sizeof(cl_float ), (void*)&underwater);
+        clFlag |= sendArgument(kernel,  6, sizeof(cl_uint2 ), (void*)&N);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't send arguments to choppy waves computation.");
+            return false;
+        }
+        if(!_launchTiled(kernel, mChoppyTile, HydrOCLStats::STAGE_CHOPPY)) {
+            HydrOCLLOG("Choppy waves execution fail.");
+            return false;
+        }
+        mOutput = out;
+        return true;
+	}
+
+	bool HydrOCLOpenCL::read(Mesh::POS_NORM_VERTEX *Vertices)
+	{
+        cl_int clFlag=0, mapFlag=0;
+        cl_event events[2];
+        size_t size = mBufferN.x*mBufferN.y*sizeof( cl_float4 );
+        const cl_float4 *pos = hPos, *nor = hNor;
+        //! @todo allow several devices usage
+        if(mTransfer == HydrOCL::TT_MAP) {
+            pos = (const cl_float4*)clEnqueueMapBuffer(mComQueue[0], mVertexes[mOutput], CL_TRUE, CL_MAP_READ, 0, size,
+                                                       0, NULL, mStats ? &events[0] : NULL, &mapFlag);
+            clFlag |= mapFlag;
+            nor = (const cl_float4*)clEnqueueMapBuffer(mComQueue[0], mNormals, CL_TRUE, CL_MAP_READ, 0, size,
+                                                       0, NULL, mStats ? &events[1] : NULL, &mapFlag);
+            clFlag |= mapFlag;
+        }
+        else {
+            clFlag |= getData(mComQueue[0], hPos, mVertexes[mOutput], size, mStats ? &events[0] : NULL);
+            clFlag |= getData(mComQueue[0], hNor, mNormals,           size, mStats ? &events[1] : NULL);
+        }
+        if(clFlag == CL_SUCCESS) {
+            if(mStats) {
+                // The reads are blocking, so every command enqueued before
+                // them has been completed and can be profiled.
+                mStats->event(HydrOCLStats::STAGE_READ, events[0], size);
+                mStats->event(HydrOCLStats::STAGE_READ, events[1], size);
+                mStats->resolve(mTrace);
+            }
+            HydrOCLTrace::Scope scope(mTrace, "repack");
+            if(mStats) mStats->repackBegin();
+            repackVertexes(pos, nor, mOptions.Complexity, mBufferN,
+                           mOptions.TiledLayout, mOptions.SoALayout, Vertices);
+            if(mStats) mStats->repackEnd();
+        }
+        if(mTransfer == HydrOCL::TT_MAP) {
+            if(pos) clFlag |= clEnqueueUnmapMemObject(mComQueue[0], mVertexes[mOutput], (void*)pos, 0, NULL, NULL);
+            if(nor) clFlag |= clEnqueueUnmapMemObject(mComQueue[0], mNormals, (void*)nor, 0, NULL, NULL);
+        }
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("Can't get data from device.");
+            return false;
+        }
+        return true;
+	}
+
+	bool HydrOCLOpenCL::finish()
+	{
+        //! @todo allow several devices usage
+        if(clFinish(mComQueue[0]) != CL_SUCCESS) {
+            HydrOCLLOG("Can't wait for the device.");
+            return false;
+        }
+        return true;
+	}
+
+	bool HydrOCLOpenCL::_launchTiled(cl_kernel kernel, unsigned int Tile, HydrOCLStats::Stage s)
+	{
+        //! @todo allow several devices usage
+        size_t localWorkSize[2], globalWorkSize[2];
+        localWorkSize[0] = Tile;
+        localWorkSize[1] = Tile;
+        globalWorkSize[0] = roundUp(mBufferN.x, localWorkSize[0]);
+        globalWorkSize[1] = roundUp(mBufferN.y, localWorkSize[1]);
+        cl_event event, *pEvent = mStats ? &event : NULL;
+        cl_int clFlag = clEnqueueNDRangeKernel(mComQueue[0], kernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, pEvent);
+        if(clFlag != CL_SUCCESS)
+            return false;
+        if(mStats) mStats->event(s, event);
+        return true;
+	}
+
+	bool HydrOCLOpenCL::_launchCoarsened(cl_kernel kernel, HydrOCLStats::Stage s)
+	{
+        //! @todo allow several devices usage
+        size_t localWorkSize[2], globalWorkSize[2];
+        localWorkSize[0] = mTileSize;
+        localWorkSize[1] = mTileSize;
+        globalWorkSize[0] = roundUp((mBufferN.x + mVectorWidth - 1) / mVectorWidth, localWorkSize[0]);
+        globalWorkSize[1] = roundUp(mBufferN.y, localWorkSize[1]);
+        cl_event event, *pEvent = mStats ? &event : NULL;
+        cl_int clFlag = clEnqueueNDRangeKernel(mComQueue[0], kernel, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, pEvent);
+        if(clFlag != CL_SUCCESS)
+            return false;
+        if(mStats) mStats->event(s, event);
+        return true;
+	}
+
+	cl_uint2 HydrOCLOpenCL::_bufferN(int Complexity) const
+	{
+	    cl_uint2 N;
+	    N.x = Complexity > 0 ? (unsigned int)Complexity : 0;
+	    N.y = N.x;
+	    // Tiled layout requires whole blocks of vertexes
+	    if(mOptions.TiledLayout) {
+	        N.x = roundUp(N.x, 8);
+	        N.y = roundUp(N.y, 8);
+	    }
+	    return N;
+	}
+
+	bool HydrOCLOpenCL::_createGrid()
+	{
+	    mBufferN = _bufferN(mOptions.Complexity);
+	    unsigned int nBuffer = mBufferN.x*mBufferN.y;
+	    // The buffers are allocated for the largest expected complexity,
+	    // and kept while the grid fits in them without wasting memory
+	    cl_uint2 maxN = _bufferN(mOptions.MaxComplexity);
+	    unsigned int nReserve = maxN.x*maxN.y;
+	    if(nReserve < nBuffer)
+	        nReserve = nBuffer;
+	    if((nBuffer > mCapacity) || (mCapacity > nReserve)) {
+	        _releaseGrid();
+	        bool Error=false;
+	        // Use float4, is faster than float3
+	        Error |= !allocMemory(&mVertexes[0], nReserve*sizeof( cl_float4 ));
+	        Error |= !allocMemory(&mVertexes[1], nReserve*sizeof( cl_float4 ));
+	        Error |= !allocMemory(&mNormals,     nReserve*sizeof( cl_float4 ));
+	        if(Error)
+	            return false;
+	        if(!_createTransfer(nReserve*sizeof( cl_float4 )))
+	            return false;
+	        mCapacity = nReserve;
+	    }
+	    // Send initial values. If the device buffers are mapped they are
+	    // filled in place, without any host copy.
+	    //! @todo allow several devices usage
+	    cl_int clFlag=CL_SUCCESS;
+	    size_t size = nBuffer*sizeof( cl_float4 );
+	    if(hPos) {
+	        _initValues(hPos, hNor, nBuffer);
+	        clFlag |= sendData(mComQueue[0], mVertexes[0], hPos, size);
+	        clFlag |= sendData(mComQueue[0], mVertexes[1], hPos, size);
+	        clFlag |= sendData(mComQueue[0], mNormals,     hNor, size);
+	    }
+	    else {
+	        cl_int mapFlag;
+	        cl_float4 *pos = (cl_float4*)clEnqueueMapBuffer(mComQueue[0], mVertexes[0], CL_TRUE, CL_MAP_WRITE, 0, size,
+	                                                        0, NULL, NULL, &mapFlag);
+	        clFlag |= mapFlag;
+	        cl_float4 *nor = (cl_float4*)clEnqueueMapBuffer(mComQueue[0], mNormals, CL_TRUE, CL_MAP_WRITE, 0, size,
+	                                                        0, NULL, NULL, &mapFlag);
+	        clFlag |= mapFlag;
+	        if(pos && nor)
+	            _initValues(pos, nor, nBuffer);
+	        if(pos) clFlag |= clEnqueueUnmapMemObject(mComQueue[0], mVertexes[0], pos, 0, NULL, NULL);
+	        if(nor) clFlag |= clEnqueueUnmapMemObject(mComQueue[0], mNormals, nor, 0, NULL, NULL);
+	        clFlag |= clEnqueueCopyBuffer(mComQueue[0], mVertexes[0], mVertexes[1], 0, 0, size, 0, NULL, NULL);
+	        clFlag |= clFinish(mComQueue[0]);
+	    }
+	    mBase   = 0;
+	    mOutput = 0;
+	    if(clFlag != CL_SUCCESS) {
+	        HydrOCLLOG("Fail sending initial data to device.");
+	        return false;
+	    }
+	    return true;
+	}
+
+	void HydrOCLOpenCL::_releaseGrid()
+	{
+	    unsigned int i;
+	    _releaseTransfer();
+	    for(i=0;i<2;i++) {
+	        releaseBuffer(mMemory, mVertexes[i], mPool); mVertexes[i]=0;
+	    }
+	    releaseBuffer(mMemory, mNormals, mPool); mNormals=0;
+	    mAllocatedMem = 0;
+	    mCapacity = 0;
+	}
+
+	void HydrOCLOpenCL::_initValues(cl_float4 *Pos, cl_float4 *Nor, unsigned int n) const
+	{
+	    unsigned int i;
+	    if(mOptions.SoALayout) {
+	        // Four planes of n floats (x, y, z, w)
+	        float *pos = (float*)Pos, *nor = (float*)Nor;
+	        for(i=0;i<n;i++){
+	            pos[i]=0.f; pos[n+i]=0.f;  pos[2*n+i]=0.f; pos[3*n+i]=1.f;
+	            nor[i]=0.f; nor[n+i]=-1.f; nor[2*n+i]=0.f; nor[3*n+i]=0.f;
+	        }
+	        return;
+	    }
+	    for(i=0;i<n;i++){
+	        Pos[i].x=0.f; Pos[i].y=0.f; Pos[i].z=0.f; Pos[i].w=1.f;
+	        Nor[i].x=0.f; Nor[i].y=-1.f; Nor[i].z=0.f; Nor[i].w=0.f;
+	    }
+	}
+
+	HydrOCL::TransferType HydrOCLOpenCL::_transferType() const
+	{
+	    if(mOptions.Transfer != HydrOCL::TT_AUTO)
+	        return mOptions.Transfer;
+	    // Mapping the device buffers needs no host copies at all
+	    if(mOptions.SlimMemory)
+	        return HydrOCL::TT_MAP;
+	    const char *path = fileFromResources(_def_TransferFile);
+	    if(!path)
+	        return HydrOCL::TT_READ;
+	    Ogre::ConfigFile cfg;
+	    cfg.load(path, "=", true);
+	    Ogre::String name = mDeviceName;
+	    Ogre::StringUtil::trim(name);
+	    Ogre::String mode = cfg.getSetting(name);
+	    if(mode == "map")
+	        return HydrOCL::TT_MAP;
+	    if(mode == "pinned")
+	        return HydrOCL::TT_PINNED;
+	    return HydrOCL::TT_READ;
+	}
+
+	bool HydrOCLOpenCL::_createTransfer(size_t size)
+	{
+	    unsigned int i;
+	    cl_int clFlag;
+	    mTransfer = _transferType();
+	    if(mTransfer == HydrOCL::TT_MAP) {
+	        HydrOCLLOG("\tVertexes read by mapping the device buffers.");
+	        return true;
+	    }
+	    if(mTransfer == HydrOCL::TT_READ) {
+	        HydrOCLLOG("\tVertexes read into host memory.");
+	        hPos = allocHost<cl_float4>(mMemory, HydrOCLMemory::MEM_TRANSFER, size / sizeof(cl_float4));
+	        hNor = allocHost<cl_float4>(mMemory, HydrOCLMemory::MEM_TRANSFER, size / sizeof(cl_float4));
+	        return true;
+	    }
+	    HydrOCLLOG("\tVertexes read into page-locked host memory.");
+	    cl_float4 **layer[2] = {&hPos, &hNor};
+	    for(i=0;i<2;i++) {
+	        mPinned[i] = createBuffer(mMemory, HydrOCLMemory::MEM_TRANSFER, mContext,
+	                                  CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, &clFlag, mPool);
+	        if(clFlag != CL_SUCCESS) {
+	            HydrOCLLOG("\t\tCan't allocate page-locked memory.");
+	            mPinned[i] = 0;
+	            return false;
+	        }
+	        //! @todo allow several devices usage
+	        *layer[i] = (cl_float4*)clEnqueueMapBuffer(mComQueue[0], mPinned[i], CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+	                                                   0, size, 0, NULL, NULL, &clFlag);
+	        if(clFlag != CL_SUCCESS) {
+	            HydrOCLLOG("\t\tCan't map page-locked memory.");
+	            *layer[i] = NULL;
+	            return false;
+	        }
+	    }
+	    return true;
+	}
+
+	void HydrOCLOpenCL::_releaseTransfer()
+	{
+	    unsigned int i;
+	    cl_float4 **layer[2] = {&hPos, &hNor};
+	    for(i=0;i<2;i++) {
+	        if(mPinned[i]) {
+	            if(*layer[i]) clEnqueueUnmapMemObject(mComQueue[0], mPinned[i], *layer[i], 0, NULL, NULL);
+	            releaseBuffer(mMemory, mPinned[i], mPool); mPinned[i]=0;
+	        }
+	        else {
+	            releaseHost(mMemory, *layer[i]);
+	        }
+	        *layer[i] = NULL;
+	    }
+	}
+
+    bool HydrOCLOpenCL::setupOpenCL(const Noise::HydrOCLNoise *NoiseModule)
+    {
+        HydrOCLLOG("\tInitializating OpenCL...");
+
+        //! Get the runtime, provided by the application or shared with
+        //! the other modules
+        if(mOptions.Runtime) {
+            mRuntime = mOptions.Runtime;
+            mRuntime->addRef();
+        }
+        else {
+            mRuntime = HydrOCLRuntime::acquire(mOptions.DeviceType, mOptions.Device, mOptions.Telemetry);
+            if(!mRuntime)
+                return false;
+        }
+        mNumberOfDevices = mRuntime->getNumberOfDevices();
+        mDevices         = mRuntime->getDevices();
+        mContext         = mRuntime->getContext();
+        mComQueue        = mRuntime->getQueues();
+        mDeviceName      = mRuntime->getDeviceName();
+        //! Build kernels
+        const char* name = "grid.cl";
+        //! @todo Allow several devices use.
+        // Stencil kernels use square work-groups, so start from the biggest
+        // tile that fits in the device work-group size. It is reduced later
+        // for the kernels that can't be launched with it (see tileSize()).
+        size_t maxWorkGroupSize=0;
+        clGetDeviceInfo(mDevices[0], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+        mTileSize = 16;
+        while(mTileSize > 1 && mTileSize*mTileSize > maxWorkGroupSize)
+            mTileSize /= 2;
+        mSmoothTile = mTileSize;
+        mChoppyTile = mTileSize;
+        // CPU devices process several vertexes per work-item
+        mVectorWidth = vectorWidth(mDevices[0]);
+        char flags[256];
+        sprintf(flags, "-DVECTOR_WIDTH=%u", mVectorWidth);
+        if(mOptions.TiledLayout)
+            strcat(flags, " -DTILED_LAYOUT");
+        if(mOptions.SoALayout)
+            strcat(flags, " -DSOA_LAYOUT");
+        mProgramName  = name;
+        mProgramFlags = flags;
+        // The programs are built at the same time, each one in a thread.
+        // The smooth and choppy waves stages are built apart, and just if
+        // they are enabled (see _requestPrograms()).
+        std::vector<HydrOCLRuntime::Program> Programs;
+        Programs.push_back(_gridProgram(mTileSize, ""));
+        if(mOptions.Smooth)
+            Programs.push_back(_smoothProgram((unsigned int)mOptions.SmoothRadius));
+        if(mOptions.ChoppyWaves)
+            Programs.push_back(_choppyProgram());
+        if(NoiseModule && !NoiseModule->getPrograms(mDevices[0], _noiseFlags(), Programs))
+            return false;
+        // Build failures are detected when the kernels are loaded
+        mRuntime->build(Programs);
+        if(!_loadGridKernels())
+            return false;
+        mGeometryVariants.setup(mRuntime, "geometry");
+        mSmoothVariants.setup(mRuntime, "smooth");
+        mNormalsVariants.setup(mRuntime, "normals");
+        mChoppyVariants.setup(mRuntime, "choppyWaves");
+        // The optional stages are just skipped if they can't be built
+        if(mOptions.Smooth && !_smoothKernel())
+            HydrOCLLOG("\tSmoothing kernel can't be built, it will be disabled.");
+        if(mOptions.ChoppyWaves && !_choppyKernel())
+            HydrOCLLOG("\tChoppy waves kernel can't be built, it will be disabled.");
+
+        HydrOCLLOG("\tOpenCL ready to work!");
+        return true;
+    }
+
+    const char* HydrOCLOpenCL::_noiseFlags() const
+    {
+        return mOptions.SoALayout ? "-DSOA_LAYOUT" : "";
+    }
+
+    bool HydrOCLOpenCL::_loadGridKernels()
+    {
+        const char *name = mProgramName.c_str();
+        while(true) {
+            Ogre::String flags = _gridProgram(mTileSize, "").Flags;
+            kGeometryGen = mRuntime->loadKernel(name, "geometry", flags.c_str());
+            kBasePlane   = mRuntime->loadKernel(name, "setBasePlane", flags.c_str());
+            kNormals     = mRuntime->loadKernel(name, "normals", flags.c_str());
+            if( !kGeometryGen || !kBasePlane || !kNormals ){
+                return false;
+            }
+            // All of them are launched with the same work-groups
+            unsigned int Tile = tileSize(kGeometryGen, mDevices[0], mTileSize);
+            Tile = tileSize(kBasePlane, mDevices[0], Tile);
+            Tile = tileSize(kNormals, mDevices[0], Tile);
+            if(Tile == mTileSize)
+                return true;
+            char msg[128];
+            sprintf(msg, "\tGrid kernels can't be launched with %ux%u work-groups, %ux%u will be used.",
+                    mTileSize, mTileSize, Tile, Tile);
+            HydrOCLLOG(msg);
+            clReleaseKernel(kGeometryGen); kGeometryGen=0;
+            clReleaseKernel(kBasePlane); kBasePlane=0;
+            clReleaseKernel(kNormals); kNormals=0;
+            mTileSize = Tile;
+        }
+    }
+
+    HydrOCLRuntime::Program HydrOCLOpenCL::_gridProgram(unsigned int Tile, const char *Flags) const
+    {
+        char flags[32];
+        sprintf(flags, " -DTILE_SIZE=%u", Tile);
+        return HydrOCLRuntime::Program(mProgramName, mProgramFlags + flags + Flags);
+    }
+
+    HydrOCLRuntime::Program HydrOCLOpenCL::_smoothProgram(unsigned int Radius) const
+    {
+        char flags[64];
+        sprintf(flags, " -DSMOOTH_KERNEL -DSMOOTH_RADIUS=%u", Radius);
+        return _gridProgram(mSmoothTile, flags);
+    }
+
+    HydrOCLRuntime::Program HydrOCLOpenCL::_choppyProgram() const
+    {
+        return _gridProgram(mChoppyTile, " -DCHOPPY_KERNEL");
+    }
+
+    void HydrOCLOpenCL::_requestPrograms()
+    {
+        if(mOptions.Smooth && (!kSmooth || (mSmoothRadius != (unsigned int)mOptions.SmoothRadius)))
+            mRuntime->request(_smoothProgram((unsigned int)mOptions.SmoothRadius));
+        if(mOptions.ChoppyWaves && !kChoppy)
+            mRuntime->request(_choppyProgram());
+    }
+
+    cl_kernel HydrOCLOpenCL::_smoothKernel()
+    {
+        unsigned int Radius = (unsigned int)mOptions.SmoothRadius;
+        if(kSmooth && (mSmoothRadius == Radius))
+            return kSmooth;
+        HydrOCLRuntime::Program P = _smoothProgram(Radius);
+        cl_kernel kernel = mRuntime->findKernel(P.Name.c_str(), "smooth", P.Flags.c_str());
+        if(kernel) {
+            // Large radius tiles may not fit, so the program is built again
+            // with smaller ones. Meanwhile smoothing is skipped.
+            unsigned int Tile = tileSize(kernel, mDevices[0], mSmoothTile);
+            if(kSmooth)clReleaseKernel(kSmooth);
+            kSmooth = 0;
+            if(Tile != mSmoothTile) {
+                clReleaseKernel(kernel);
+                mSmoothTile = Tile;
+                mRuntime->request(_smoothProgram(Radius));
+                return 0;
+            }
+            kSmooth = kernel;
+            mSmoothRadius = Radius;
+        }
+        return kSmooth;
+    }
+
+    cl_kernel HydrOCLOpenCL::_choppyKernel()
+    {
+        if(!kChoppy) {
+            HydrOCLRuntime::Program P = _choppyProgram();
+            cl_kernel kernel = mRuntime->findKernel(P.Name.c_str(), "choppyWaves", P.Flags.c_str());
+            if(!kernel)
+                return 0;
+            // Built again with smaller tiles if they don't fit
+            unsigned int Tile = tileSize(kernel, mDevices[0], mChoppyTile);
+            if(Tile != mChoppyTile) {
+                clReleaseKernel(kernel);
+                mChoppyTile = Tile;
+                mRuntime->request(_choppyProgram());
+                return 0;
+            }
+            kChoppy = kernel;
+        }
+        return kChoppy;
+    }
+
+    Ogre::String HydrOCLOpenCL::_constants() const
+    {
+        return HydrOCLVariants::constant("CONST_NX", (unsigned int)mOptions.Complexity) +
+               HydrOCLVariants::constant("CONST_NY", (unsigned int)mOptions.Complexity);
+    }
+
+    cl_kernel HydrOCLOpenCL::_specialized(HydrOCLVariants &Variants, const HydrOCLRuntime::Program &Program,
+                                          cl_kernel Generic, const Ogre::String &Constants, unsigned int Tile)
+    {
+        if(!mOptions.Specialize)
+            return Generic;
+        cl_kernel kernel = Variants.get(Program, Constants);
+        // The unrolled variants may require more resources per work-item
+        if(!kernel || (tileSize(kernel, mDevices[0], Tile) != Tile))
+            return Generic;
+        return kernel;
+    }
+
+    bool HydrOCLOpenCL::allocMemory(cl_mem *clID, size_t size)
+    {
+        cl_int clFlag;
+        *clID = createBuffer(mMemory, HydrOCLMemory::MEM_GRID, mContext, CL_MEM_READ_WRITE, size, &clFlag, mPool);
+        if(clFlag != CL_SUCCESS) {
+            HydrOCLLOG("\t\tDevice memory allocation fail.");
+            *clID = 0;
+            return false;
+        }
+
+        mAllocatedMem += size;
+        return true;
+    }
+}}
@@ -25,10 +25,13 @@ http://graphics.cs.lth.se/theses/projects/projgrid/
 
 #include <hydrocl/HydrOCLPerlin.h>
 #include <hydrocl/HydrOCLUtils.h>
+#include <hydrocl/HydrOCLRuntime.h>
 
 #include <Hydrax/Hydrax.h>
 
 #define _def_PackedNoise true
+/// Vertexes of the host noise computed at once, octave by octave
+#define _def_PerlinChunk 256
 
 namespace Hydrax{namespace Noise
 {
@@ -41,6 +44,11 @@ namespace Hydrax{namespace Noise
 		, mDevices(NULL)
 		, mContext(0)
 		, mComQueue(NULL)
+		, mVectorWidth(1)
+		, mMemory(NULL)
+		, mPool(NULL)
+		, mRuntime(NULL)
+		, mSpecialize(true)
 		, clNoise(0)
 		, kHeight(0)
 	{
@@ -56,6 +64,11 @@ namespace Hydrax{namespace Noise
 		, mDevices(NULL)
 		, mContext(0)
 		, mComQueue(NULL)
+		, mVectorWidth(1)
+		, mMemory(NULL)
+		, mPool(NULL)
+		, mRuntime(NULL)
+		, mSpecialize(true)
 		, clNoise(0)
 		, kHeight(0)
 	{
@@ -65,7 +78,7 @@ namespace Hydrax{namespace Noise
 	{
 		remove();
 
-		HydraxLOG(getName() + " destroyed.");
+		HydrOCLLOG(getName() + " destroyed.");
 	}
 
 	void HydrOCLPerlin::create()
@@ -88,12 +101,20 @@ namespace Hydrax{namespace Noise
 
 		Noise::remove();
 
+		releaseOpenCL();
+	}
+
+	void HydrOCLPerlin::releaseOpenCL()
+	{
 		mNumberOfDevices = 0;
 		mDevices = NULL;
 		mContext = 0;
 		mComQueue = NULL;
         if(kHeight)clReleaseKernel(kHeight); kHeight=0;
-        if(clNoise)clReleaseMemObject(clNoise); clNoise=0;
+        mHeightVariants.release();
+        releaseBuffer(mMemory, clNoise, mPool); clNoise=0;
+        mPool = NULL;
+        mRuntime = NULL;
 	}
 
 	void HydrOCLPerlin::setOptions(const Options &Options)
@@ -151,44 +172,78 @@ namespace Hydrax{namespace Noise
 		return _getHeigthDual(x,y);
 	}
 
-    bool HydrOCLPerlin::setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world)
+    bool HydrOCLPerlin::setHeight(cl_mem v, cl_uint2 N, Ogre::Vector3 world, Module::HydrOCLStats *Stats)
     {
         cl_int clFlag=0;
+        cl_event event, *pEvent = Stats ? &event : NULL;
         //! @todo allow several devices usage
         size_t localWorkSize[2], globalWorkSize[2];
         localWorkSize[0] = 256;
         localWorkSize[1] = 256;
-        globalWorkSize[0] = roundUp(N.x, localWorkSize[0]);
+        globalWorkSize[0] = roundUp((N.x + mVectorWidth - 1) / mVectorWidth, localWorkSize[0]);
         globalWorkSize[1] = roundUp(N.y, localWorkSize[1]);
         // Launch kernel
         cl_uint octaves = (unsigned int)mOptions.Octaves;
         cl_float4 w;
         w.x=world.x; w.y=world.y; w.z=world.z; w.w=0.f;
         float strength = mOptions.GPU_Strength;
-        clFlag |= sendData(mComQueue[0], clNoise, p_noise, np_size_sq*(max_octaves>>(n_packsize-1))*sizeof( cl_int ));
+        size_t noiseSize = np_size_sq*(max_octaves>>(n_packsize-1))*sizeof( cl_int );
+        clFlag |= sendData(mComQueue[0], clNoise, p_noise, noiseSize, pEvent);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send noise to perlin computation.");
+            HydrOCLLOG("Can't send noise to perlin computation.");
             return false;
         }
-        clFlag |= sendArgument(kHeight,  0, sizeof(cl_mem   ), (void*)&v);
-        clFlag |= sendArgument(kHeight,  1, sizeof(cl_mem   ), (void*)&clNoise);
-        clFlag |= sendArgument(kHeight,  2, sizeof(cl_float4), (void*)&world);
-        clFlag |= sendArgument(kHeight,  3, sizeof(cl_float ), (void*)&strength);
-        clFlag |= sendArgument(kHeight,  4, sizeof(cl_float ), (void*)&magnitude);
-        clFlag |= sendArgument(kHeight,  5, sizeof(cl_uint  ), (void*)&octaves);
-        clFlag |= sendArgument(kHeight,  6, sizeof(cl_uint2 ), (void*)&N);
+        if(Stats) Stats->event(Module::HydrOCLStats::STAGE_NOISE, event, noiseSize);
+        // Specialised kernel, generic one while the options are changing
+        cl_kernel kernel = 0;
+        if(mSpecialize) {
+            Ogre::String constants = Module::HydrOCLVariants::constant("CONST_NX", N.x) +
+                                     Module::HydrOCLVariants::constant("CONST_NY", N.y) +
+                                     Module::HydrOCLVariants::constant("CONST_OCTAVES", octaves) +
+                                     Module::HydrOCLVariants::constant("CONST_STRENGTH", strength) +
+                                     Module::HydrOCLVariants::constant("CONST_MAGNITUDE", magnitude);
+            kernel = mHeightVariants.get(mHeightProgram, constants);
+        }
+        if(!kernel)
+            kernel = kHeight;
+        clFlag |= sendArgument(kernel,  0, sizeof(cl_mem   ), (void*)&v);
+        clFlag |= sendArgument(kernel,  1, sizeof(cl_mem   ), (void*)&clNoise);
+        clFlag |= sendArgument(kernel,  2, sizeof(cl_float4), (void*)&w);
+        clFlag |= sendArgument(kernel,  3, sizeof(cl_float ), (void*)&strength);
+        clFlag |= sendArgument(kernel,  4, sizeof(cl_float ), (void*)&magnitude);
+        clFlag |= sendArgument(kernel,  5, sizeof(cl_uint  ), (void*)&octaves);
+        clFlag |= sendArgument(kernel,  6, sizeof(cl_uint2 ), (void*)&N);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Can't send arguments to perlin computation.");
+            HydrOCLLOG("Can't send arguments to perlin computation.");
             return false;
         }
-        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kHeight, 2, NULL, globalWorkSize, NULL, 0, NULL, NULL);
+        clFlag = clEnqueueNDRangeKernel(mComQueue[0], kernel, 2, NULL, globalWorkSize, NULL, 0, NULL, pEvent);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("Perlin vertexes modifier execution fail.");
+            HydrOCLLOG("Perlin vertexes modifier execution fail.");
             return false;
         }
+        if(Stats) Stats->event(Module::HydrOCLStats::STAGE_NOISE, event);
         return true;
     }
 
+    void HydrOCLPerlin::setHeight(const float *x, const float *z, float *y, unsigned int n, const Ogre::Vector3 &world) const
+    {
+        unsigned int i, j, m;
+        int o, hoct = mOptions.Octaves / n_packsize;
+        float strength = mOptions.GPU_Strength / noise_magnitude;
+        int value[_def_PerlinChunk];
+        // Octave by octave, so the vertexes loop is vectorized
+        for(j=0;j<n;j+=_def_PerlinChunk){
+            m = (n - j < _def_PerlinChunk) ? n - j : _def_PerlinChunk;
+            for(i=0;i<m;i++)
+                value[i] = 0;
+            for(o=0;o<hoct;o++)
+                _perlinOctave(x + j, z + j, value, m, world, o);
+            for(i=0;i<m;i++)
+                y[j + i] += strength*static_cast<float>(value[i]);
+        }
+    }
+
 	void HydrOCLPerlin::_initNoise()
 	{
 		// Create noise (uniform)
@@ -336,6 +391,33 @@ namespace Hydrax{namespace Noise
 		return static_cast<float>(value)/noise_magnitude;
 	}
 
+	void HydrOCLPerlin::_perlinOctave(const float *x, const float *z, int * __restrict value, unsigned int n,
+	                                  const Ogre::Vector3 &world, int o) const
+	{
+		const int * __restrict r = p_noise + o*np_size_sq;
+		int shift = o*n_packsize;
+		unsigned int i;
+
+		for(i=0; i<n; i++) {
+			int ui = static_cast<int>((world.x + x[i])*magnitude) << shift,
+			    vi = static_cast<int>((world.z + z[i])*magnitude) << shift,
+				iu, iup, iv, ivp, fu, fv, ut01, ut23;
+
+			iu = (ui>>n_dec_bits)&np_size_m1;
+			iv = ((vi>>n_dec_bits)&np_size_m1)*np_size;
+
+			iup = ((ui>>n_dec_bits) + 1)&np_size_m1;
+			ivp = (((vi>>n_dec_bits) + 1)&np_size_m1)*np_size;
+
+			fu = ui & n_dec_magn_m1;
+			fv = vi & n_dec_magn_m1;
+
+			ut01 = ((n_dec_magn-fu)*r[iv + iu] + fu*r[iv + iup])>>n_dec_bits;
+			ut23 = ((n_dec_magn-fu)*r[ivp + iu] + fu*r[ivp + iup])>>n_dec_bits;
+			value[i] += ((n_dec_magn-fv)*ut01 + fv*ut23) >> n_dec_bits;
+		}
+	}
+
 	int HydrOCLPerlin::_mapSample(const int &u, const int &v, const int &upsamplepower, const int &octave)
 	{
 		int magnitude = 1<<upsamplepower,
@@ -357,7 +439,8 @@ namespace Hydrax{namespace Noise
 		return o >> (upsamplepower+upsamplepower);
 	}
 
-	bool HydrOCLPerlin::setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue)
+	bool HydrOCLPerlin::setupOpenCL(cl_uint n, cl_context context, cl_device_id *devices, cl_command_queue *comQueue, const char *flags,
+	                                Module::HydrOCLBufferPool *pool, Module::HydrOCLRuntime *runtime)
 	{
         cl_int clFlag=0;
 	    // Store data
@@ -365,28 +448,42 @@ namespace Hydrax{namespace Noise
         mDevices         = devices;
         mContext         = context;
         mComQueue        = comQueue;
+        mPool            = pool;
+        mRuntime         = runtime;
         // Create memory objects
         size_t size = np_size_sq*(max_octaves>>(n_packsize-1))*sizeof(int);
-        clNoise = clCreateBuffer(mContext, CL_MEM_READ_WRITE, size, NULL, &clFlag);
+        clNoise = createBuffer(mMemory, Module::HydrOCLMemory::MEM_NOISE, mContext, CL_MEM_READ_WRITE, size, &clFlag, mPool);
         if(clFlag != CL_SUCCESS) {
-            HydraxLOG("\t\tPerlin noise memory allocation fail.");
+            HydrOCLLOG("\t\tPerlin noise memory allocation fail.");
             return false;
         }
         // Load kernels
         //! @todo allow several devices usage
-        const char* path = fileFromResources("perlin.cl");
-        if(!path){
-            HydraxLOG("\tPerlin OpenCL program can't be found!");
-            return false;
-        }
-        char* flags = new char[1024];
-        sprintf(flags, "-Dn_packsize=%u -Dn_bits=%u -Dn_dec_bits=%u -Dn_dec_magn=%u -Dn_dec_magn_m1=%u -Dnoise_decimalbits=%u",
-                n_packsize, n_bits, n_dec_bits, n_dec_magn, n_dec_magn_m1, noise_decimalbits);
-        kHeight = loadKernelFromFile(mContext, mDevices[0], path, "height", flags);
-        delete[] flags; flags=0;
+        const char* name = "perlin.cl";
+        mVectorWidth = vectorWidth(mDevices[0]);
+        Ogre::String pFlags = _programFlags(mDevices[0], flags);
+        kHeight = mRuntime ? mRuntime->loadKernel(name, "height", pFlags.c_str()) :
+                             buildKernel(mContext, mDevices[0], name, "height", pFlags.c_str());
         if( !kHeight ){
             return false;
         }
+        // The variants are built by the runtime
+        mHeightProgram = Module::HydrOCLRuntime::Program(name, pFlags);
+        mHeightVariants.setup(mRuntime, "height");
         return true;
 	}
+
+	bool HydrOCLPerlin::getPrograms(cl_device_id device, const char *flags, std::vector<Module::HydrOCLRuntime::Program> &programs) const
+	{
+        programs.push_back(Module::HydrOCLRuntime::Program("perlin.cl", _programFlags(device, flags)));
+        return true;
+	}
+
+	Ogre::String HydrOCLPerlin::_programFlags(cl_device_id device, const char *flags) const
+	{
+        char pFlags[1024];
+        sprintf(pFlags, "-Dn_packsize=%u -Dn_bits=%u -Dn_dec_bits=%u -Dn_dec_magn=%u -Dn_dec_magn_m1=%u -Dnoise_decimalbits=%u -DVECTOR_WIDTH=%u %s",
+                n_packsize, n_bits, n_dec_bits, n_dec_magn, n_dec_magn_m1, noise_decimalbits, vectorWidth(device), flags);
+        return pFlags;
+	}
 }}
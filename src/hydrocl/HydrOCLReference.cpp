@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <math.h>
+
+#include <hydrocl/HydrOCLReference.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLReference::HydrOCLReference()
+		: mNoise(NULL)
+		, mN(0)
+		, mNormals(NULL)
+		, mMemory(NULL)
+		, mBase(0)
+		, mOutput(0)
+	{
+	    mVertexes[0] = NULL;
+	    mVertexes[1] = NULL;
+	}
+
+	HydrOCLReference::~HydrOCLReference()
+	{
+		remove();
+	}
+
+	bool HydrOCLReference::create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule)
+	{
+	    unsigned int i, k;
+	    mOptions = Options;
+	    mNoise   = NoiseModule;
+	    mN       = (unsigned int)mOptions.Complexity;
+	    for(i=0;i<2;i++) {
+	        mVertexes[i] = allocHost<Ogre::Vector4>(mMemory, HydrOCLMemory::MEM_GRID, mN*mN);
+	        for(k=0;k<mN*mN;k++)
+	            mVertexes[i][k] = Ogre::Vector4(0.f, 0.f, 0.f, 1.f);
+	    }
+	    mNormals = allocHost<Ogre::Vector4>(mMemory, HydrOCLMemory::MEM_GRID, mN*mN);
+	    for(k=0;k<mN*mN;k++)
+	        mNormals[k] = Ogre::Vector4(0.f, -1.f, 0.f, 0.f);
+	    mBase   = 0;
+	    mOutput = 0;
+	    return true;
+	}
+
+	void HydrOCLReference::remove()
+	{
+	    unsigned int i;
+	    for(i=0;i<2;i++) {
+	        releaseHost(mMemory, mVertexes[i]); mVertexes[i]=NULL;
+	    }
+	    releaseHost(mMemory, mNormals); mNormals=NULL;
+	    mNoise = NULL;
+	    mN = 0;
+	}
+
+	void HydrOCLReference::setOptions(const HydrOCL::Options &Options)
+	{
+		mOptions = Options;
+	}
+
+	bool HydrOCLReference::resize(const HydrOCL::Options &Options)
+	{
+	    // Nothing else than the grid to keep
+	    Noise::HydrOCLNoise *noise = mNoise;
+	    remove();
+	    return create(Options, noise);
+	}
+
+	bool HydrOCLReference::geometry(const Ogre::Vector4 *Corners)
+	{
+	    unsigned int i, j;
+	    Ogre::Vector4 *v = mVertexes[mBase];
+	    for(j=0;j<mN;j++) {
+	        for(i=0;i<mN;i++) {
+	            Ogre::Vector2 uv(i/(float)mN, j/(float)mN);
+	            Ogre::Vector2 uvDi = Ogre::Vector2(1.f, 1.f) - uv;
+	            Ogre::Vector4 result;
+	            result = uvDi.y*(uvDi.x*Corners[0] + uv.x*Corners[1]) + uv.y*(uvDi.x*Corners[2] + uv.x*Corners[3]);
+	            v[j*mN + i].x = result.x / result.w;
+	            v[j*mN + i].z = result.z / result.w;
+	            v[j*mN + i].w = 1.f;
+	        }
+	    }
+	    mOutput = mBase;
+	    return true;
+	}
+
+	bool HydrOCLReference::basePlane(const float &h)
+	{
+	    unsigned int k;
+	    for(k=0;k<mN*mN;k++)
+	        mVertexes[mBase][k].y = -h;
+	    return true;
+	}
+
+	bool HydrOCLReference::noise(const Ogre::Vector3 &World)
+	{
+	    unsigned int k;
+	    Ogre::Vector4 *v = mVertexes[mBase];
+	    for(k=0;k<mN*mN;k++) {
+	        float x = v[k].x, y = v[k].y, z = v[k].z;
+	        mNoise->setHeight(&x, &z, &y, 1, World);
+	        v[k].y = y;
+	    }
+	    return true;
+	}
+
+	bool HydrOCLReference::smooth()
+	{
+		if (!mOptions.Smooth) {
+			return true;
+		}
+
+	    unsigned int i, j, r, R = (unsigned int)mOptions.SmoothRadius;
+	    unsigned int out = 1 - mBase;
+	    const Ogre::Vector4 *v = mVertexes[mBase];
+	    Ogre::Vector4 *s = mVertexes[out];
+	    for(j=0;j<mN;j++) {
+	        for(i=0;i<mN;i++) {
+	            unsigned int id = j*mN + i;
+	            s[id] = v[id];
+	            if((i < R) || (j < R) || (i + R >= mN) || (j + R >= mN))
+	                continue;
+	            float y = v[id].y;
+	            for(r=1;r<=R;r++)
+	                y += v[id-r].y + v[id+r].y + v[id-r*mN].y + v[id+r*mN].y;
+	            s[id].y = y / (4*R + 1);
+	        }
+	    }
+	    mBase = out;
+	    return true;
+	}
+
+	bool HydrOCLReference::normals()
+	{
+		if (mOptions.ChoppyWaves) {
+			return true;
+		}
+
+	    unsigned int i, j;
+	    for(j=0;j<mN;j++) {
+	        for(i=0;i<mN;i++) {
+	            unsigned int id = j*mN + i;
+	            if((i < 1) || (j < 1) || (i + 1 >= mN) || (j + 1 >= mN)) {
+	                mNormals[id] = Ogre::Vector4(0.f, -1.f, 0.f, 0.f);
+	                continue;
+	            }
+	            Ogre::Vector3 n = _normal(mVertexes[mBase], id);
+	            mNormals[id] = Ogre::Vector4(n.x, n.y, n.z, 0.f);
+	        }
+	    }
+	    return true;
+	}
+
+	bool HydrOCLReference::choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater)
+	{
+		if (!mOptions.ChoppyWaves) {
+			mOutput = mBase;
+			return true;
+		}
+
+	    unsigned int i, j;
+	    unsigned int out = 1 - mBase;
+	    const Ogre::Vector4 *v = mVertexes[mBase];
+	    Ogre::Vector4 *c = mVertexes[out];
+	    Ogre::Vector2 Dir(CameraDir.x, CameraDir.z);
+	    Dir.normalise();
+	    Dir = Ogre::Vector2(fabs(Dir.x), fabs(Dir.y));
+	    Ogre::Vector2 Perp(-Dir.y, Dir.x);
+	    for(j=0;j<mN;j++) {
+	        for(i=0;i<mN;i++) {
+	            unsigned int id = j*mN + i;
+	            c[id] = v[id];
+	            if((i < 1) || (j < 1) || (i + 1 >= mN) || (j + 1 >= mN)) {
+	                mNormals[id] = Ogre::Vector4(0.f, -1.f, 0.f, 0.f);
+	                continue;
+	            }
+	            Ogre::Vector3 n = _normal(v, id);
+	            mNormals[id] = Ogre::Vector4(n.x, n.y, n.z, 0.f);
+	            Ogre::Vector2 xz(v[id].x, v[id].z);
+	            float Dis1 = xz.distance(Ogre::Vector2(v[id+mN].x, v[id+mN].z));
+	            float Dis2 = xz.distance(Ogre::Vector2(v[id+1].x, v[id+1].z));
+	            Ogre::Vector2 Norm2 = Ogre::Vector2(n.x, n.z) * (Dir*Dis1 + Perp*Dis2) * mOptions.ChoppyStrength;
+	            c[id].x += Underwater*Norm2.x;
+	            c[id].z += Underwater*Norm2.y;
+	        }
+	    }
+	    mOutput = out;
+	    return true;
+	}
+
+	bool HydrOCLReference::read(Mesh::POS_NORM_VERTEX *Vertices)
+	{
+	    unsigned int k;
+	    const Ogre::Vector4 *v = mVertexes[mOutput];
+	    for(k=0;k<mN*mN;k++) {
+	        Vertices[k].x  = v[k].x;          Vertices[k].y  = v[k].y;          Vertices[k].z  = v[k].z;
+	        Vertices[k].nx = mNormals[k].x;   Vertices[k].ny = mNormals[k].y;   Vertices[k].nz = mNormals[k].z;
+	    }
+	    return true;
+	}
+
+	Ogre::Vector3 HydrOCLReference::_normal(const Ogre::Vector4 *v, unsigned int id) const
+	{
+	    Ogre::Vector4 vec1 = v[id-1]  - v[id+1];
+	    Ogre::Vector4 vec2 = v[id-mN] - v[id+mN];
+	    Ogre::Vector3 n = Ogre::Vector3(vec2.x, vec2.y, vec2.z).crossProduct(Ogre::Vector3(vec1.x, vec1.y, vec1.z));
+	    n.normalise();
+	    return n;
+	}
+}}
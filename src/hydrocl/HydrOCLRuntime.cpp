@@ -0,0 +1,616 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+#include <hydrocl/HydrOCLRuntime.h>
+#include <hydrocl/HydrOCLThreadPool.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+/// Lanes per compute unit assumed for GPU devices
+#define _def_GPULanes 16
+/// Global memory [MB] below which the devices are penalized
+#define _def_MinGlobalMemory 512
+/// Calibration grid size
+#define _def_CalibrationN 256
+/// Calibration timed iterations
+#define _def_CalibrationIters 4
+
+namespace Hydrax{namespace Module
+{
+	/// Runtimes shared through HydrOCLRuntime::acquire()
+	static std::vector<HydrOCLRuntime*> sShared;
+	/// Shared runtimes and references lock
+	static pthread_mutex_t sSharedMutex = PTHREAD_MUTEX_INITIALIZER;
+
+	/** Builds a program for each task
+	 */
+	class HydrOCLBuildJob : public HydrOCLThreadPool::Job
+	{
+	public:
+		/** Constructor
+		    @param Context OpenCL context
+			@param Device Device whose build log is reported
+			@param Programs Programs to build
+		 */
+		HydrOCLBuildJob(cl_context Context, cl_device_id Device, const std::vector<HydrOCLRuntime::Program> &Programs)
+			: mContext(Context)
+			, mDevice(Device)
+			, mPrograms(Programs)
+			, mBuilt(Programs.size(), (cl_program)0)
+		{
+		}
+
+		void run(unsigned int task)
+		{
+		    mBuilt[task] = buildProgram(mContext, mDevice, mPrograms[task].Name.c_str(), mPrograms[task].Flags.c_str());
+		}
+
+		/** Get a built program
+		    @param i Program index
+			@return Program, 0 if it can't be built
+		 */
+		cl_program getBuilt(unsigned int i) const {return mBuilt[i];}
+
+	private:
+		/// OpenCL context
+		cl_context mContext;
+		/// Device
+		cl_device_id mDevice;
+		/// Programs to build
+		const std::vector<HydrOCLRuntime::Program> &mPrograms;
+		/// Built programs
+		std::vector<cl_program> mBuilt;
+	};
+
+	HydrOCLRuntime::HydrOCLRuntime()
+		: mRefs(1)
+		, mShared(false)
+		, mDeviceType(CL_DEVICE_TYPE_ALL)
+		, mNumberOfDevices(0)
+		, mDevices(NULL)
+		, mContext(0)
+		, mQueues(NULL)
+		, mProfiling(false)
+	{
+	    pthread_mutex_init(&mMutex, NULL);
+	}
+
+	HydrOCLRuntime::HydrOCLRuntime(cl_context Context, cl_uint NumberOfDevices,
+	                               const cl_device_id *Devices, const cl_command_queue *Queues)
+		: mRefs(1)
+		, mShared(false)
+		, mDeviceType(CL_DEVICE_TYPE_ALL)
+		, mNumberOfDevices(NumberOfDevices)
+		, mDevices(NULL)
+		, mContext(Context)
+		, mQueues(NULL)
+		, mProfiling(true)
+	{
+	    cl_uint i;
+	    char DeviceName[1024];
+	    pthread_mutex_init(&mMutex, NULL);
+	    clRetainContext(mContext);
+	    mDevices = new cl_device_id[mNumberOfDevices];
+	    mQueues  = new cl_command_queue[mNumberOfDevices];
+	    for(i=0;i<mNumberOfDevices;i++) {
+	        mDevices[i] = Devices[i];
+	        mQueues[i]  = Queues[i];
+	        clRetainCommandQueue(mQueues[i]);
+	        cl_command_queue_properties props = 0;
+	        clGetCommandQueueInfo(mQueues[i], CL_QUEUE_PROPERTIES, sizeof(cl_command_queue_properties), &props, NULL);
+	        if(!(props & CL_QUEUE_PROFILING_ENABLE))
+	            mProfiling = false;
+	    }
+	    if(mNumberOfDevices) {
+	        clGetDeviceInfo(mDevices[0], CL_DEVICE_NAME, 1024*sizeof(char), &DeviceName, NULL);
+	        mDeviceName = DeviceName;
+	    }
+	    HydrOCLLOG("OpenCL runtime provided by the application, using " + mDeviceName + ".");
+	}
+
+	HydrOCLRuntime::~HydrOCLRuntime()
+	{
+	    cl_uint i;
+	    std::map<Ogre::String, cl_program>::iterator it;
+	    for(it=mPrograms.begin();it!=mPrograms.end();++it)
+	        clReleaseProgram(it->second);
+	    mPrograms.clear();
+	    if(mQueues) {
+	        for(i=0;i<mNumberOfDevices;i++) {
+	            if(mQueues[i])clReleaseCommandQueue(mQueues[i]);
+	        }
+	        delete[] mQueues; mQueues=NULL;
+	    }
+	    if(mContext) clReleaseContext(mContext); mContext=0;
+	    if(mDevices) delete[] mDevices; mDevices=NULL;
+	    mNumberOfDevices = 0;
+	    pthread_mutex_destroy(&mMutex);
+	}
+
+	HydrOCLRuntime* HydrOCLRuntime::acquire(cl_device_type DeviceType, const Ogre::String &Device, bool Profiling)
+	{
+	    unsigned int i;
+	    // The lock is kept while the runtime is created, so the modules
+	    // created at the same time share it as well
+	    pthread_mutex_lock(&sSharedMutex);
+	    for(i=0;i<sShared.size();i++) {
+	        HydrOCLRuntime *R = sShared[i];
+	        if((R->mDeviceType == DeviceType) && (R->mDeviceFilter == Device) && (R->mProfiling == Profiling)) {
+	            R->mRefs++;
+	            pthread_mutex_unlock(&sSharedMutex);
+	            HydrOCLLOG("\tSharing the OpenCL runtime on " + R->mDeviceName + ".");
+	            return R;
+	        }
+	    }
+	    HydrOCLRuntime *R = new HydrOCLRuntime();
+	    if(!R->_create(DeviceType, Device, Profiling)) {
+	        pthread_mutex_unlock(&sSharedMutex);
+	        delete R;
+	        return NULL;
+	    }
+	    R->mShared = true;
+	    sShared.push_back(R);
+	    pthread_mutex_unlock(&sSharedMutex);
+	    return R;
+	}
+
+	void HydrOCLRuntime::addRef()
+	{
+	    pthread_mutex_lock(&sSharedMutex);
+	    mRefs++;
+	    pthread_mutex_unlock(&sSharedMutex);
+	}
+
+	void HydrOCLRuntime::release()
+	{
+	    unsigned int i;
+	    pthread_mutex_lock(&sSharedMutex);
+	    if(--mRefs) {
+	        pthread_mutex_unlock(&sSharedMutex);
+	        return;
+	    }
+	    if(mShared) {
+	        for(i=0;i<sShared.size();i++) {
+	            if(sShared[i] == this) {
+	                sShared.erase(sShared.begin() + i);
+	                break;
+	            }
+	        }
+	    }
+	    pthread_mutex_unlock(&sSharedMutex);
+	    delete this;
+	}
+
+	cl_kernel HydrOCLRuntime::loadKernel(const char *name, const char *entryPoint, const char *flags)
+	{
+	    Ogre::String key = Ogre::String(name) + "\n" + flags;
+	    cl_program program = _findProgram(key);
+	    if(!program) {
+	        //! @todo allow several devices usage
+	        program = buildProgram(mContext, mDevices[0], name, flags);
+	        if(!program)
+	            return 0;
+	        program = _addProgram(key, program);
+	    }
+	    return ::loadKernel(program, entryPoint);
+	}
+
+	cl_kernel HydrOCLRuntime::findKernel(const char *name, const char *entryPoint, const char *flags)
+	{
+	    cl_program program = _findProgram(Ogre::String(name) + "\n" + flags);
+	    if(!program)
+	        return 0;
+	    return ::loadKernel(program, entryPoint);
+	}
+
+	/** Background build request
+	 */
+	struct HydrOCLBuildRequest
+	{
+		/// Runtime, with a reference owned by the request
+		HydrOCLRuntime *Runtime;
+		/// Program to build
+		HydrOCLRuntime::Program Program;
+		/// true if it is built in a background thread
+		bool Background;
+
+		HydrOCLBuildRequest(HydrOCLRuntime *_Runtime, const HydrOCLRuntime::Program &_Program)
+			: Runtime(_Runtime)
+			, Program(_Program)
+			, Background(true)
+		{
+		}
+	};
+
+	void HydrOCLRuntime::request(const Program &Program)
+	{
+	    Ogre::String key = Program.Name + "\n" + Program.Flags;
+	    pthread_mutex_lock(&mMutex);
+	    mRequesters[key]++;
+	    bool Skip = (mPrograms.find(key) != mPrograms.end()) || (mRequested.find(key) != mRequested.end());
+	    if(!Skip)
+	        mRequested.insert(key);
+	    pthread_mutex_unlock(&mMutex);
+	    if(Skip)
+	        return;
+	    addRef();
+	    HydrOCLBuildRequest *Request = new HydrOCLBuildRequest(this, Program);
+	    pthread_t thread;
+	    pthread_attr_t attr;
+	    pthread_attr_init(&attr);
+	    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	    if(pthread_create(&thread, &attr, _requestMain, Request)) {
+	        HydrOCLLOG("Can't launch the background build, building it now.");
+	        Request->Background = false;
+	        _requestMain(Request);
+	    }
+	    pthread_attr_destroy(&attr);
+	}
+
+	void* HydrOCLRuntime::_requestMain(void *data)
+	{
+	    HydrOCLBuildRequest *Request = (HydrOCLBuildRequest*)data;
+	    if(Request->Background)
+	        deferLog();
+	    HydrOCLRuntime *R = Request->Runtime;
+	    const Program &P = Request->Program;
+	    Ogre::String key = P.Name + "\n" + P.Flags;
+	    //! @todo allow several devices usage
+	    cl_program program = buildProgram(R->mContext, R->mDevices[0], P.Name.c_str(), P.Flags.c_str());
+	    if(program) {
+	        pthread_mutex_lock(&R->mMutex);
+	        // Every requester may have forgotten it meanwhile
+	        if(R->mRequesters.find(key) == R->mRequesters.end()) {
+	            clReleaseProgram(program);
+	        }
+	        else if(R->mPrograms.find(key) != R->mPrograms.end()) {
+	            clReleaseProgram(program);
+	            R->mRequested.erase(key);
+	        }
+	        else {
+	            R->mPrograms[key] = program;
+	            R->mRequested.erase(key);
+	        }
+	        pthread_mutex_unlock(&R->mMutex);
+	    }
+	    delete Request;
+	    R->release();
+	    return NULL;
+	}
+
+	void HydrOCLRuntime::forget(const Program &Program)
+	{
+	    Ogre::String key = Program.Name + "\n" + Program.Flags;
+	    pthread_mutex_lock(&mMutex);
+	    std::map<Ogre::String, unsigned int>::iterator users = mRequesters.find(key);
+	    if((users == mRequesters.end()) || --users->second) {
+	        pthread_mutex_unlock(&mMutex);
+	        return;
+	    }
+	    mRequesters.erase(users);
+	    std::map<Ogre::String, cl_program>::iterator it = mPrograms.find(key);
+	    if(it != mPrograms.end()) {
+	        clReleaseProgram(it->second);
+	        mPrograms.erase(it);
+	    }
+	    // A build still running is dropped when it finishes (see
+	    // _requestMain()), and a failed one may be requested again
+	    mRequested.erase(key);
+	    pthread_mutex_unlock(&mMutex);
+	}
+
+	bool HydrOCLRuntime::build(const std::vector<Program> &Programs)
+	{
+	    unsigned int i;
+	    bool Result = true;
+	    std::vector<Program> Pending;
+	    for(i=0;i<Programs.size();i++) {
+	        if(!_findProgram(Programs[i].Name + "\n" + Programs[i].Flags))
+	            Pending.push_back(Programs[i]);
+	    }
+	    if(!Pending.size())
+	        return true;
+	    //! @todo allow several devices usage
+	    HydrOCLBuildJob Job(mContext, mDevices[0], Pending);
+	    HydrOCLThreadPool Pool(Pending.size());
+	    Pool.run(&Job, Pending.size());
+	    // The workers build logs are queued
+	    flushLog();
+	    for(i=0;i<Pending.size();i++) {
+	        if(!Job.getBuilt(i)) {
+	            Result = false;
+	            continue;
+	        }
+	        _addProgram(Pending[i].Name + "\n" + Pending[i].Flags, Job.getBuilt(i));
+	    }
+	    return Result;
+	}
+
+	cl_program HydrOCLRuntime::_findProgram(const Ogre::String &key)
+	{
+	    cl_program program = 0;
+	    pthread_mutex_lock(&mMutex);
+	    std::map<Ogre::String, cl_program>::iterator it = mPrograms.find(key);
+	    if(it != mPrograms.end())
+	        program = it->second;
+	    pthread_mutex_unlock(&mMutex);
+	    return program;
+	}
+
+	cl_program HydrOCLRuntime::_addProgram(const Ogre::String &key, cl_program program)
+	{
+	    pthread_mutex_lock(&mMutex);
+	    std::map<Ogre::String, cl_program>::iterator it = mPrograms.find(key);
+	    if(it != mPrograms.end()) {
+	        clReleaseProgram(program);
+	        program = it->second;
+	    }
+	    else {
+	        mPrograms[key] = program;
+	    }
+	    pthread_mutex_unlock(&mMutex);
+	    return program;
+	}
+
+	bool HydrOCLRuntime::_create(cl_device_type DeviceType, const Ogre::String &Device, bool Profiling)
+	{
+	    unsigned int i, selected;
+	    cl_int clFlag;
+	    char line[1024];
+	    mDeviceType   = DeviceType;
+	    mDeviceFilter = Device;
+	    mProfiling    = Profiling;
+	    HydrOCLLOG("\tCreating the OpenCL runtime...");
+	    std::vector<Candidate> Candidates;
+	    _getCandidates(DeviceType, Candidates);
+	    if(!Candidates.size()) {
+	        HydrOCLLOG("\t\tCan't find any valid device of selected type.");
+	        return false;
+	    }
+
+	    // Look for the requested device
+	    selected = Candidates.size();
+	    if(!Device.empty()) {
+	        Ogre::String filter = Device;
+	        Ogre::StringUtil::toLowerCase(filter);
+	        for(i=0;i<Candidates.size();i++) {
+	            Ogre::String name = Candidates[i].Name;
+	            Ogre::StringUtil::toLowerCase(name);
+	            if(name.find(filter) != Ogre::String::npos) {
+	                selected = i;
+	                break;
+	            }
+	        }
+	        if(selected == Candidates.size())
+	            HydrOCLLOG("\t\tNo device matches \"" + Device + "\", the best ranked one will be used.");
+	    }
+	    // Rank the devices, calibrating them if there are several to choose
+	    if(selected == Candidates.size()) {
+	        if(Candidates.size() > 1) {
+	            for(i=0;i<Candidates.size();i++)
+	                Candidates[i].Throughput = _calibrate(Candidates[i].Device);
+	        }
+	        std::stable_sort(Candidates.begin(), Candidates.end(), _better);
+	        selected = 0;
+	    }
+	    HydrOCLLOG("\t\tDevices ranking:");
+	    for(i=0;i<Candidates.size();i++) {
+	        const Candidate &C = Candidates[i];
+	        sprintf(line, "\t\t\t%u. %s: %u CUs at %u MHz, %lu MB, %s, score %g",
+	                i + 1, C.Name.c_str(), C.ComputeUnits, C.Clock,
+	                (unsigned long)C.GlobalMemory, C.Images ? "images" : "no images", C.Score);
+	        Ogre::String l = line;
+	        if(C.Throughput > 0.f) {
+	            sprintf(line, ", %g Mvertexes/s", C.Throughput);
+	            l += line;
+	        }
+	        if(i == selected)
+	            l += " (selected)";
+	        HydrOCLLOG(l);
+	    }
+
+	    // Create an OpenCL context
+	    mNumberOfDevices = 1;
+	    mDevices = new cl_device_id[mNumberOfDevices];
+	    mDevices[0] = Candidates[selected].Device;
+	    mDeviceName = Candidates[selected].DeviceName;
+	    mContext = clCreateContext(0, mNumberOfDevices, mDevices, NULL, NULL, &clFlag);
+	    if(clFlag != CL_SUCCESS) {
+	        if(clFlag == CL_DEVICE_NOT_AVAILABLE){
+	            HydrOCLLOG("\t\tCan't create the context, selected devices are not availables.");
+	        }
+	        else if(clFlag == CL_OUT_OF_HOST_MEMORY){
+	            HydrOCLLOG("\t\tCan't create the context, host is out of memory.");
+	        }
+	        mContext = 0;
+	        return false;
+	    }
+	    // Create command queues for each device
+	    mQueues = new cl_command_queue[mNumberOfDevices];
+	    for(i=0;i<mNumberOfDevices;i++) {
+	        mQueues[i] = 0;
+	    }
+	    for(i=0;i<mNumberOfDevices;i++) {
+	        cl_command_queue_properties props = mProfiling ? CL_QUEUE_PROFILING_ENABLE : 0;
+	        mQueues[i] = clCreateCommandQueue(mContext, mDevices[i], props, &clFlag);
+	        if(clFlag != CL_SUCCESS) {
+	            HydrOCLLOG("\t\tCan't create command queue.");
+	            mQueues[i] = 0;
+	            return false;
+	        }
+	    }
+	    return true;
+	}
+
+	void HydrOCLRuntime::_getCandidates(cl_device_type DeviceType, std::vector<Candidate> &Candidates)
+	{
+	    cl_uint i, j, NumberOfPlatforms=0, NumberOfDevices=0;
+	    cl_int clFlag;
+	    char PlatformName[1024], DeviceName[1024];
+
+	    // Gets the number of valid platforms
+	    clFlag = clGetPlatformIDs(0, NULL, &NumberOfPlatforms);
+	    if(clFlag != CL_SUCCESS) {
+	        HydrOCLLOG("\t\tCan't get number of platforms.");
+	        return;
+	    }
+	    if(NumberOfPlatforms <= 0) {
+	        HydrOCLLOG("\t\tNot valid platforms present.");
+	        return;
+	    }
+	    // Gets the platform array
+	    std::vector<cl_platform_id> Platforms(NumberOfPlatforms);
+	    clFlag = clGetPlatformIDs(NumberOfPlatforms, &Platforms[0], NULL);
+	    if(clFlag != CL_SUCCESS) {
+	        HydrOCLLOG("\t\tPlatforms can't be written.");
+	        return;
+	    }
+	    for(i=0;i<NumberOfPlatforms;i++) {
+	        clFlag = clGetPlatformInfo(Platforms[i], CL_PLATFORM_NAME, 1024*sizeof(char), &PlatformName, NULL);
+	        if(clFlag != CL_SUCCESS) {
+	            continue;
+	        }
+	        HydrOCLLOG(Ogre::String("\t\tFound platform: ") + PlatformName);
+	        // Look for valid devices into the platform
+	        clFlag = clGetDeviceIDs(Platforms[i], DeviceType, 0, NULL, &NumberOfDevices);
+	        if( (clFlag != CL_SUCCESS) || (NumberOfDevices <= 0) ){
+	            HydrOCLLOG("\t\tDiscarded.");
+	            continue;
+	        }
+	        std::vector<cl_device_id> Devices(NumberOfDevices);
+	        clFlag = clGetDeviceIDs(Platforms[i], DeviceType, NumberOfDevices, &Devices[0], &NumberOfDevices);
+	        if(clFlag != CL_SUCCESS) {
+	            HydrOCLLOG("\t\tCan't write devices array.");
+	            continue;
+	        }
+	        for(j=0;j<NumberOfDevices;j++) {
+	            Candidate C;
+	            cl_device_type Type = 0;
+	            cl_ulong GlobalMemory = 0;
+	            cl_bool Images = CL_FALSE;
+	            C.Device = Devices[j];
+	            C.ComputeUnits = 0;
+	            C.Clock = 0;
+	            clGetDeviceInfo(C.Device, CL_DEVICE_NAME, 1024*sizeof(char), &DeviceName, NULL);
+	            clGetDeviceInfo(C.Device, CL_DEVICE_TYPE, sizeof(cl_device_type), &Type, NULL);
+	            clGetDeviceInfo(C.Device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &C.ComputeUnits, NULL);
+	            clGetDeviceInfo(C.Device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(cl_uint), &C.Clock, NULL);
+	            clGetDeviceInfo(C.Device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &GlobalMemory, NULL);
+	            clGetDeviceInfo(C.Device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &Images, NULL);
+	            C.DeviceName = DeviceName;
+	            Ogre::StringUtil::trim(C.DeviceName);
+	            C.Name = Ogre::String(PlatformName) + ": " + C.DeviceName;
+	            C.GlobalMemory = GlobalMemory >> 20;
+	            C.Images = Images == CL_TRUE;
+	            // Peak rate estimation: GPU compute units run several times
+	            // more lanes than the CPU cores vector units
+	            C.Score = (float)C.ComputeUnits * C.Clock * 1.e-3f;
+	            C.Score *= (Type & CL_DEVICE_TYPE_GPU) ? _def_GPULanes : vectorWidth(C.Device);
+	            // Devices without room for a large grid, its noise and the
+	            // other applications are penalized
+	            if(C.GlobalMemory < _def_MinGlobalMemory)
+	                C.Score *= (float)C.GlobalMemory / _def_MinGlobalMemory;
+	            if(C.Images)
+	                C.Score *= 1.25f;
+	            C.Throughput = 0.f;
+	            Candidates.push_back(C);
+	        }
+	    }
+	    if(!Candidates.size())
+	        HydrOCLLOG("\t\tAny platform matchs with requested platform (probaly because device type is not available).");
+	}
+
+	float HydrOCLRuntime::_calibrate(cl_device_id Device)
+	{
+	    unsigned int i;
+	    cl_int clFlag;
+	    float Throughput = 0.f;
+	    cl_context Context = clCreateContext(0, 1, &Device, NULL, NULL, &clFlag);
+	    if(clFlag != CL_SUCCESS)
+	        return 0.f;
+	    cl_command_queue Queue = clCreateCommandQueue(Context, Device, 0, &clFlag);
+	    if(clFlag != CL_SUCCESS) {
+	        clReleaseContext(Context);
+	        return 0.f;
+	    }
+	    // The smallest tile is used, which fits in any device
+	    cl_program Program = buildProgram(Context, Device, "grid.cl", "-DTILE_SIZE=8 -DVECTOR_WIDTH=1");
+	    cl_kernel kGeometry = Program ? ::loadKernel(Program, "geometry") : 0;
+	    cl_kernel kNormals  = Program ? ::loadKernel(Program, "normals") : 0;
+	    cl_uint2 N;
+	    N.x = N.y = _def_CalibrationN;
+	    size_t size = N.x*N.y*sizeof(cl_float4);
+	    cl_mem Pos = clCreateBuffer(Context, CL_MEM_READ_WRITE, size, NULL, &clFlag);
+	    cl_mem Nor = clCreateBuffer(Context, CL_MEM_READ_WRITE, size, NULL, &clFlag);
+	    if(kGeometry && kNormals && Pos && Nor) {
+	        // A plane seen from above
+	        cl_float4 c[4];
+	        for(i=0;i<4;i++) {
+	            c[i].s[0] = (i & 1) ? 100.f : -100.f;
+	            c[i].s[1] = 0.f;
+	            c[i].s[2] = (i & 2) ? 100.f : -100.f;
+	            c[i].s[3] = 1.f;
+	        }
+	        clFlag  = sendArgument(kGeometry, 0, sizeof(cl_mem   ), (void*)&Pos);
+	        for(i=0;i<4;i++)
+	            clFlag |= sendArgument(kGeometry, i + 1, sizeof(cl_float4), (void*)&c[i]);
+	        clFlag |= sendArgument(kGeometry, 5, sizeof(cl_uint2 ), (void*)&N);
+	        clFlag |= sendArgument(kNormals,  0, sizeof(cl_mem   ), (void*)&Pos);
+	        clFlag |= sendArgument(kNormals,  1, sizeof(cl_mem   ), (void*)&Nor);
+	        clFlag |= sendArgument(kNormals,  2, sizeof(cl_uint2 ), (void*)&N);
+	        size_t localWorkSize[2] = {8, 8};
+	        size_t globalWorkSize[2] = {N.x, N.y};
+	        Ogre::Timer timer;
+	        // The first iteration warms the device up, and is not timed
+	        for(i=0;(clFlag == CL_SUCCESS) && (i<=_def_CalibrationIters);i++) {
+	            if(i == 1) {
+	                clFinish(Queue);
+	                timer.reset();
+	            }
+	            clFlag |= clEnqueueNDRangeKernel(Queue, kGeometry, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	            clFlag |= clEnqueueNDRangeKernel(Queue, kNormals, 2, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	        }
+	        clFlag |= clFinish(Queue);
+	        unsigned long us = timer.getMicroseconds();
+	        if(clFlag == CL_SUCCESS)
+	            Throughput = (float)_def_CalibrationIters*N.x*N.y / (us ? us : 1);
+	    }
+	    if(Pos) clReleaseMemObject(Pos);
+	    if(Nor) clReleaseMemObject(Nor);
+	    if(kGeometry) clReleaseKernel(kGeometry);
+	    if(kNormals) clReleaseKernel(kNormals);
+	    if(Program) clReleaseProgram(Program);
+	    clReleaseCommandQueue(Queue);
+	    clReleaseContext(Context);
+	    return Throughput;
+	}
+
+	bool HydrOCLRuntime::_better(const Candidate &a, const Candidate &b)
+	{
+	    // Calibrated devices first, and the ones that can't run the kernels
+	    // at the end
+	    if(a.Throughput != b.Throughput)
+	        return a.Throughput > b.Throughput;
+	    return a.Score > b.Score;
+	}
+}}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <string.h>
+
+#include <hydrocl/HydrOCLUtils.h>
+
+// ----------------------------------------------------------------------------
+// OpenCL programs, embedded at build time. Each src/hydrocl/cl/*.cl file is
+// turned into a string literal (see the makefile sources target), so the
+// library doesn't depend on the resources to build its kernels, and can't
+// pick up a stale copy of them.
+// ----------------------------------------------------------------------------
+
+/// grid.cl source
+static const char sGridSource[] =
+#include "grid.cl.inc"
+;
+
+/// perlin.cl source
+static const char sPerlinSource[] =
+#include "perlin.cl.inc"
+;
+
+/// waves.cl source
+static const char sWavesSource[] =
+#include "waves.cl.inc"
+;
+
+/// Embedded program
+struct EmbeddedProgram
+{
+    /// Program name
+    const char *Name;
+    /// Program source
+    const char *Source;
+    /// Program source length
+    size_t Length;
+};
+
+/// Embedded programs
+static const EmbeddedProgram sPrograms[] =
+{
+    {"grid.cl",   sGridSource,   sizeof(sGridSource) - 1},
+    {"perlin.cl", sPerlinSource, sizeof(sPerlinSource) - 1},
+    {"waves.cl",  sWavesSource,  sizeof(sWavesSource) - 1}
+};
+
+const char* embeddedSource(const char* name, size_t *length)
+{
+    unsigned int i;
+    for(i=0;i<sizeof(sPrograms)/sizeof(EmbeddedProgram);i++){
+        if(strcmp(sPrograms[i].Name, name))
+            continue;
+        if(length)
+            *length = sPrograms[i].Length;
+        return sPrograms[i].Source;
+    }
+    return NULL;
+}
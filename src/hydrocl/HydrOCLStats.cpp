@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <algorithm>
+
+#include <hydrocl/HydrOCLStats.h>
+
+/// Number of frames of the rolling window
+#define _def_StatsWindow 256
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLStats::Window::Window()
+		: mSamples(_def_StatsWindow, 0.f)
+		, mNext(0)
+		, mCount(0)
+	{
+	}
+
+	void HydrOCLStats::Window::add(float v)
+	{
+	    mSamples[mNext] = v;
+	    mNext = (mNext + 1) % _def_StatsWindow;
+	    if(mCount < _def_StatsWindow)
+	        mCount++;
+	}
+
+	void HydrOCLStats::Window::clear()
+	{
+	    mNext  = 0;
+	    mCount = 0;
+	}
+
+	HydrOCLStats::Summary HydrOCLStats::Window::get() const
+	{
+	    Summary S;
+	    if(!mCount)
+	        return S;
+	    unsigned int i;
+	    std::vector<float> v(mSamples.begin(), mSamples.begin() + mCount);
+	    std::sort(v.begin(), v.end());
+	    float sum = 0.f;
+	    for(i=0;i<mCount;i++)
+	        sum += v[i];
+	    S.Samples = mCount;
+	    S.Mean    = sum / mCount;
+	    S.P50     = v[(mCount - 1) / 2];
+	    S.P99     = v[(99*mCount - 1) / 100];
+	    S.Max     = v[mCount - 1];
+	    return S;
+	}
+
+	HydrOCLStats::HydrOCLStats()
+		: mBytesSent(0)
+		, mBytesRead(0)
+	{
+	}
+
+	HydrOCLStats::~HydrOCLStats()
+	{
+		reset();
+	}
+
+	void HydrOCLStats::event(Stage s, cl_event Event, size_t Bytes)
+	{
+	    Command c;
+	    c.s     = s;
+	    c.Event = Event;
+	    c.Bytes = Bytes;
+	    mCommands.push_back(c);
+	}
+
+	bool HydrOCLStats::resolve(HydrOCLTrace *Trace)
+	{
+	    unsigned int i;
+	    bool ok = true;
+	    bool used[N_STAGES];
+	    double device[N_STAGES], queued[N_STAGES], submitted[N_STAGES];
+	    std::vector<cl_ulong> start, end;
+	    std::vector<Stage> stage;
+	    cl_ulong last = 0;
+	    for(i=0;i<N_STAGES;i++) {
+	        used[i] = false;
+	        device[i] = 0.0; queued[i] = 0.0; submitted[i] = 0.0;
+	    }
+	    for(i=0;i<mCommands.size();i++) {
+	        const Command &c = mCommands[i];
+	        cl_ulong tQueued, tSubmit, tStart, tEnd;
+	        cl_int clFlag = CL_SUCCESS;
+	        clFlag |= clGetEventProfilingInfo(c.Event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &tQueued, NULL);
+	        clFlag |= clGetEventProfilingInfo(c.Event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &tSubmit, NULL);
+	        clFlag |= clGetEventProfilingInfo(c.Event, CL_PROFILING_COMMAND_START,  sizeof(cl_ulong), &tStart,  NULL);
+	        clFlag |= clGetEventProfilingInfo(c.Event, CL_PROFILING_COMMAND_END,    sizeof(cl_ulong), &tEnd,    NULL);
+	        clReleaseEvent(c.Event);
+	        if(clFlag != CL_SUCCESS) {
+	            ok = false;
+	            continue;
+	        }
+	        // Nanoseconds to milliseconds
+	        used[c.s] = true;
+	        device[c.s]    += 1e-6*(tEnd    - tStart);
+	        queued[c.s]    += 1e-6*(tSubmit - tQueued);
+	        submitted[c.s] += 1e-6*(tStart  - tSubmit);
+	        if(c.s == STAGE_READ)
+	            mBytesRead += c.Bytes;
+	        else
+	            mBytesSent += c.Bytes;
+	        if(Trace) {
+	            stage.push_back(c.s);
+	            start.push_back(tStart);
+	            end.push_back(tEnd);
+	            if(tEnd > last) last = tEnd;
+	        }
+	    }
+	    mCommands.clear();
+	    if(Trace && !stage.empty()) {
+	        // Device nanoseconds to trace microseconds, relative to the last
+	        // completed command to keep the precision
+	        double now = Trace->now();
+	        for(i=0;i<stage.size();i++) {
+	            Trace->span(getStageName(stage[i]),
+	                        now - 1e-3*(double)(last - start[i]),
+	                        now - 1e-3*(double)(last - end[i]),
+	                        HydrOCLTrace::TRACK_DEVICE);
+	        }
+	    }
+	    for(i=0;i<N_STAGES;i++) {
+	        if(!used[i])
+	            continue;
+	        mDevice[i].add((float)device[i]);
+	        mQueued[i].add((float)queued[i]);
+	        mSubmitted[i].add((float)submitted[i]);
+	    }
+	    if(!ok) {
+	        HydraxLOG("Can't get the commands profiling info.");
+	    }
+	    return ok;
+	}
+
+	void HydrOCLStats::repackBegin()
+	{
+	    mTimer.reset();
+	}
+
+	void HydrOCLStats::repackEnd()
+	{
+	    mRepack.add(1e-3f*mTimer.getMicroseconds());
+	}
+
+	void HydrOCLStats::reset()
+	{
+	    unsigned int i;
+	    for(i=0;i<mCommands.size();i++)
+	        clReleaseEvent(mCommands[i].Event);
+	    mCommands.clear();
+	    for(i=0;i<N_STAGES;i++) {
+	        mDevice[i].clear();
+	        mQueued[i].clear();
+	        mSubmitted[i].clear();
+	    }
+	    mRepack.clear();
+	    mBytesSent = 0;
+	    mBytesRead = 0;
+	}
+
+	HydrOCLStats::Summary HydrOCLStats::getDevice(Stage s) const
+	{
+	    return mDevice[s].get();
+	}
+
+	HydrOCLStats::Summary HydrOCLStats::getQueued(Stage s) const
+	{
+	    return mQueued[s].get();
+	}
+
+	HydrOCLStats::Summary HydrOCLStats::getSubmitted(Stage s) const
+	{
+	    return mSubmitted[s].get();
+	}
+
+	HydrOCLStats::Summary HydrOCLStats::getRepack() const
+	{
+	    return mRepack.get();
+	}
+
+	const char* HydrOCLStats::getStageName(Stage s)
+	{
+	    static const char* names[N_STAGES] =
+	    {
+	        "geometry", "basePlane", "noise", "smooth", "normals", "choppyWaves", "read"
+	    };
+	    return names[s];
+	}
+}}
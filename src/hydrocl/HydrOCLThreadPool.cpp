@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <unistd.h>
+
+#include <hydrocl/HydrOCLThreadPool.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLThreadPool::HydrOCLThreadPool(unsigned int nThreads)
+		: mNumberOfThreads(nThreads)
+		, mThreads(NULL)
+		, mWorkers(NULL)
+		, mQueues(NULL)
+		, mJob(NULL)
+		, mGeneration(0)
+		, mActive(0)
+		, mExit(false)
+	{
+	    unsigned int i;
+	    if(!mNumberOfThreads) {
+	        long n = sysconf(_SC_NPROCESSORS_ONLN);
+	        mNumberOfThreads = (n > 0) ? (unsigned int)n : 1;
+	    }
+	    pthread_mutex_init(&mMutex, NULL);
+	    pthread_cond_init(&mJobReady, NULL);
+	    pthread_cond_init(&mJobDone, NULL);
+	    mQueues  = new Queue[mNumberOfThreads];
+	    mWorkers = new Worker[mNumberOfThreads];
+	    for(i=0;i<mNumberOfThreads;i++) {
+	        pthread_mutex_init(&mQueues[i].mutex, NULL);
+	        mWorkers[i].pool = this;
+	        mWorkers[i].id   = i;
+	    }
+	    // The calling thread works as the worker 0
+	    mThreads = new pthread_t[mNumberOfThreads];
+	    for(i=1;i<mNumberOfThreads;i++) {
+	        if(pthread_create(&mThreads[i], NULL, _main, &mWorkers[i])) {
+	            // Work with the threads that could be launched
+	            mNumberOfThreads = i;
+	            break;
+	        }
+	    }
+	}
+
+	HydrOCLThreadPool::~HydrOCLThreadPool()
+	{
+	    unsigned int i;
+	    pthread_mutex_lock(&mMutex);
+	    mExit = true;
+	    pthread_cond_broadcast(&mJobReady);
+	    pthread_mutex_unlock(&mMutex);
+	    for(i=1;i<mNumberOfThreads;i++) {
+	        pthread_join(mThreads[i], NULL);
+	    }
+	    for(i=0;i<mNumberOfThreads;i++) {
+	        pthread_mutex_destroy(&mQueues[i].mutex);
+	    }
+	    delete[] mThreads; mThreads=NULL;
+	    delete[] mWorkers; mWorkers=NULL;
+	    delete[] mQueues; mQueues=NULL;
+	    pthread_cond_destroy(&mJobDone);
+	    pthread_cond_destroy(&mJobReady);
+	    pthread_mutex_destroy(&mMutex);
+	}
+
+	void HydrOCLThreadPool::run(Job *job, unsigned int nTasks)
+	{
+	    unsigned int i, t;
+	    if(!nTasks)
+	        return;
+	    if(mNumberOfThreads == 1) {
+	        for(t=0;t<nTasks;t++)
+	            job->run(t);
+	        return;
+	    }
+	    // Contiguous blocks of tasks to each worker, so the owners compute
+	    // neighbour tasks while the thieves take the far ones.
+	    for(i=0;i<mNumberOfThreads;i++) {
+	        unsigned int first = (unsigned int)(((unsigned long)nTasks*i)/mNumberOfThreads);
+	        unsigned int last  = (unsigned int)(((unsigned long)nTasks*(i+1))/mNumberOfThreads);
+	        pthread_mutex_lock(&mQueues[i].mutex);
+	        for(t=first;t<last;t++)
+	            mQueues[i].tasks.push_back(t);
+	        pthread_mutex_unlock(&mQueues[i].mutex);
+	    }
+	    // Wake up the workers
+	    pthread_mutex_lock(&mMutex);
+	    mJob = job;
+	    mActive = mNumberOfThreads - 1;
+	    mGeneration++;
+	    pthread_cond_broadcast(&mJobReady);
+	    pthread_mutex_unlock(&mMutex);
+	    _work(0);
+	    // The queues are empty, but the last tasks may be still running
+	    pthread_mutex_lock(&mMutex);
+	    while(mActive)
+	        pthread_cond_wait(&mJobDone, &mMutex);
+	    mJob = NULL;
+	    pthread_mutex_unlock(&mMutex);
+	}
+
+	void* HydrOCLThreadPool::_main(void *data)
+	{
+	    Worker *worker = (Worker*)data;
+	    HydrOCLThreadPool *pool = worker->pool;
+	    unsigned int generation = 0;
+	    deferLog();
+	    while(true) {
+	        pthread_mutex_lock(&pool->mMutex);
+	        while(!pool->mExit && (pool->mGeneration == generation))
+	            pthread_cond_wait(&pool->mJobReady, &pool->mMutex);
+	        if(pool->mExit) {
+	            pthread_mutex_unlock(&pool->mMutex);
+	            break;
+	        }
+	        generation = pool->mGeneration;
+	        pthread_mutex_unlock(&pool->mMutex);
+
+	        pool->_work(worker->id);
+
+	        pthread_mutex_lock(&pool->mMutex);
+	        pool->mActive--;
+	        if(!pool->mActive)
+	            pthread_cond_signal(&pool->mJobDone);
+	        pthread_mutex_unlock(&pool->mMutex);
+	    }
+	    return NULL;
+	}
+
+	void HydrOCLThreadPool::_work(unsigned int id)
+	{
+	    unsigned int task;
+	    // Tasks don't spawn new tasks, so once all the queues are empty
+	    // there is nothing else to do.
+	    while(_pop(id, task) || _steal(id, task)) {
+	        mJob->run(task);
+	    }
+	}
+
+	bool HydrOCLThreadPool::_pop(unsigned int id, unsigned int &task)
+	{
+	    bool found = false;
+	    Queue &q = mQueues[id];
+	    pthread_mutex_lock(&q.mutex);
+	    if(!q.tasks.empty()) {
+	        task = q.tasks.front();
+	        q.tasks.pop_front();
+	        found = true;
+	    }
+	    pthread_mutex_unlock(&q.mutex);
+	    return found;
+	}
+
+	bool HydrOCLThreadPool::_steal(unsigned int id, unsigned int &task)
+	{
+	    unsigned int i;
+	    for(i=1;i<mNumberOfThreads;i++) {
+	        Queue &q = mQueues[(id + i) % mNumberOfThreads];
+	        bool found = false;
+	        pthread_mutex_lock(&q.mutex);
+	        if(!q.tasks.empty()) {
+	            task = q.tasks.back();
+	            q.tasks.pop_back();
+	            found = true;
+	        }
+	        pthread_mutex_unlock(&q.mutex);
+	        if(found)
+	            return true;
+	    }
+	    return false;
+	}
+}}
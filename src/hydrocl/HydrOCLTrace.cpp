@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <unistd.h>
+
+#include <hydrocl/HydrOCLTrace.h>
+
+/// Number of spans that the ring buffer can store
+#define _def_TraceBuffer 65536
+/// Flushing period [us]
+#define _def_TraceFlushPeriod 20000
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLTrace::HydrOCLTrace()
+		: mSpans(NULL)
+		, mHead(0)
+		, mTail(0)
+		, mDropped(0)
+		, mFile(NULL)
+		, mRunning(false)
+	{
+	}
+
+	HydrOCLTrace::~HydrOCLTrace()
+	{
+		stop();
+	}
+
+	bool HydrOCLTrace::start(const Ogre::String &File)
+	{
+	    stop();
+	    mFile = fopen(File.c_str(), "w");
+	    if(!mFile) {
+	        HydraxLOG("Can't open the trace file " + File);
+	        return false;
+	    }
+	    fprintf(mFile, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	    fprintf(mFile, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"Host\"}},\n", TRACK_HOST);
+	    fprintf(mFile, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"Device\"}}", TRACK_DEVICE);
+	    mSpans   = new Span[_def_TraceBuffer];
+	    mHead    = 0;
+	    mTail    = 0;
+	    mDropped = 0;
+	    mRunning = true;
+	    if(pthread_create(&mThread, NULL, _run, this)) {
+	        HydraxLOG("Can't create the trace flushing thread.");
+	        mRunning = false;
+	        fclose(mFile); mFile=NULL;
+	        delete[] mSpans; mSpans=NULL;
+	        return false;
+	    }
+	    mTimer.reset();
+	    HydraxLOG("Tracing frames into " + File);
+	    return true;
+	}
+
+	void HydrOCLTrace::stop()
+	{
+	    if(!mFile)
+	        return;
+	    mRunning = false;
+	    pthread_join(mThread, NULL);
+	    _flush();
+	    fprintf(mFile, "\n]}\n");
+	    fclose(mFile); mFile=NULL;
+	    delete[] mSpans; mSpans=NULL;
+	    if(mDropped) {
+	        HydraxLOG("Trace buffer was full, " + Ogre::StringConverter::toString(mDropped) + " spans dropped.");
+	    }
+	}
+
+	void HydrOCLTrace::span(const char *Name, double Begin, double End, Track t)
+	{
+	    if(!mSpans)
+	        return;
+	    unsigned int head = mHead;
+	    unsigned int next = (head + 1) % _def_TraceBuffer;
+	    if(next == mTail) {
+	        mDropped++;
+	        return;
+	    }
+	    mSpans[head].Name  = Name;
+	    mSpans[head].Begin = Begin;
+	    mSpans[head].End   = End;
+	    mSpans[head].t     = t;
+	    // The span must be written before it is published
+	    __sync_synchronize();
+	    mHead = next;
+	}
+
+	void* HydrOCLTrace::_run(void *Trace)
+	{
+	    HydrOCLTrace *trace = (HydrOCLTrace*)Trace;
+	    while(trace->mRunning) {
+	        trace->_flush();
+	        usleep(_def_TraceFlushPeriod);
+	    }
+	    return NULL;
+	}
+
+	void HydrOCLTrace::_flush()
+	{
+	    unsigned int tail = mTail;
+	    while(tail != mHead) {
+	        // Don't read the span before it has been published
+	        __sync_synchronize();
+	        const Span &s = mSpans[tail];
+	        double dur = s.End > s.Begin ? s.End - s.Begin : 0.0;
+	        fprintf(mFile, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+	                s.Name, s.t == TRACK_HOST ? "host" : "device", s.t, s.Begin, dur);
+	        // The slot can't be reused until it has been written
+	        __sync_synchronize();
+	        tail = (tail + 1) % _def_TraceBuffer;
+	        mTail = tail;
+	    }
+	    fflush(mFile);
+	}
+}}
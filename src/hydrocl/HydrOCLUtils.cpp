@@ -16,9 +16,69 @@
  * You should have received a copy of the GNU General Public License
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
- */
+ */
 
-#include <hydrocl/HydrOCLUtils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <list>
+#include <pthread.h>
+
+#include <hydrocl/HydrOCLUtils.h>
+
+/// Queued log messages of the background threads
+static std::list<Ogre::String> sLog;
+/// Queued log messages lock
+static pthread_mutex_t sLogMutex = PTHREAD_MUTEX_INITIALIZER;
+/// Key of the background threads mark
+static pthread_key_t sLogKey;
+/// sLogKey creation
+static pthread_once_t sLogOnce = PTHREAD_ONCE_INIT;
+
+static void createLogKey()
+{
+    pthread_key_create(&sLogKey, NULL);
+}
+
+/** Get if the log messages of the calling thread must be queued
+ * @return true if it is a background thread (see deferLog())
+ */
+static bool isLogDeferred()
+{
+    pthread_once(&sLogOnce, createLogKey);
+    return pthread_getspecific(sLogKey) != NULL;
+}
+
+void logMessage(const Ogre::String &msg)
+{
+    if(isLogDeferred()) {
+        pthread_mutex_lock(&sLogMutex);
+        sLog.push_back(msg);
+        pthread_mutex_unlock(&sLogMutex);
+        return;
+    }
+    flushLog();
+    HydraxLOG(msg);
+}
+
+void deferLog()
+{
+    pthread_once(&sLogOnce, createLogKey);
+    pthread_setspecific(sLogKey, &sLog);
+}
+
+void flushLog()
+{
+    if(isLogDeferred())
+        return;
+    std::list<Ogre::String> Messages;
+    pthread_mutex_lock(&sLogMutex);
+    Messages.swap(sLog);
+    pthread_mutex_unlock(&sLogMutex);
+    std::list<Ogre::String>::iterator it;
+    for(it=Messages.begin();it!=Messages.end();++it)
+        HydraxLOG(*it);
+}
 
 unsigned int roundUp(unsigned int n, unsigned int divisor)
 {
@@ -31,130 +91,225 @@ unsigned int roundUp(unsigned int n, unsigned int divisor)
     return N;
 }
 
-size_t readFile(char* SourceCode, const char* FileName)
+unsigned int vectorWidth(cl_device_id device)
 {
-    size_t Length = 0;
-    FILE *File = NULL;
+    cl_device_type type = CL_DEVICE_TYPE_GPU;
+    cl_uint width = 0;
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+    if(!(type & CL_DEVICE_TYPE_CPU))
+        return 1;
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &width, NULL);
+    if(width >= 8)
+        return 8;
+    return 4;
+}
 
-    //! 1st.- Open the file
-    File = fopen(FileName, "rb");
+unsigned int tileSize(cl_kernel kernel, cl_device_id device, unsigned int tile)
+{
+    size_t workGroupSize = 0;
+    cl_ulong localMem = 0, deviceLocalMem = 0;
+    if(clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &workGroupSize, NULL) != CL_SUCCESS)
+        return tile;
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMem, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &deviceLocalMem, NULL);
+    // The tiles local memory grows with the square of the work-group side
+    while(tile > 1 && (tile*tile > workGroupSize || (deviceLocalMem && localMem > deviceLocalMem))) {
+        tile /= 2;
+        localMem /= 4;
+    }
+    return tile;
+}
+
+/** Index of a vertex into the device buffers (see vertexId at grid.cl)
+ * @param i Vertex column.
+ * @param j Vertex row.
+ * @param BufferN Number of stored vertexes at each direction.
+ * @param Tiled true if the vertexes are stored by 8x8 blocks.
+ * @return Vertex index.
+ */
+static inline unsigned int vertexId(unsigned int i, unsigned int j, const cl_uint2 &BufferN, bool Tiled)
+{
+    if(!Tiled)
+        return j*BufferN.x + i;
+    unsigned int tiles = BufferN.x / 8;
+    return ((j / 8)*tiles + i / 8)*64 + (j % 8)*8 + i % 8;
+}
+
+void repackVertexes(const cl_float4 *Pos, const cl_float4 *Nor, unsigned int N, cl_uint2 BufferN,
+                    bool Tiled, bool SoA, Hydrax::Mesh::POS_NORM_VERTEX *Vertices)
+{
+    unsigned int i, j, id, k=0;
+    if(SoA) {
+        // Four planes of S floats (x, y, z, w)
+        unsigned int S = BufferN.x*BufferN.y;
+        const float *pos = (const float*)Pos, *nor = (const float*)Nor;
+        for(j=0;j<N;j++){
+            for(i=0;i<N;i++){
+                id = vertexId(i, j, BufferN, Tiled);
+                Vertices[k].x  = pos[id]; Vertices[k].y  = pos[S+id]; Vertices[k].z  = pos[2*S+id];
+                Vertices[k].nx = nor[id]; Vertices[k].ny = nor[S+id]; Vertices[k].nz = nor[2*S+id];
+                k++;
+            }
+        }
+        return;
+    }
+    for(j=0;j<N;j++){
+        for(i=0;i<N;i++){
+            id = vertexId(i, j, BufferN, Tiled);
+            Vertices[k].x  = Pos[id].x; Vertices[k].y  = Pos[id].y; Vertices[k].z  = Pos[id].z;
+            Vertices[k].nx = Nor[id].x; Vertices[k].ny = Nor[id].y; Vertices[k].nz = Nor[id].z;
+            k++;
+        }
+    }
+}
+
+/** Read a whole file.
+ * @param FileName File path.
+ * @param Content Output file content.
+ * @return false if the file can't be read, or it is empty.
+ */
+static bool readFile(const char* FileName, Ogre::String &Content)
+{
+    FILE *File = fopen(FileName, "rb");
     if(File == NULL) {
-        return 0;
+        return false;
     }
-    //! 2nd.- Gets the file length
     fseek(File, 0, SEEK_END);
-    Length = ftell(File);
+    long Length = ftell(File);
     fseek(File, 0, SEEK_SET);
-    if(Length == 0) {
-        fclose(File);
-        return 0;
-    }
-    //! 3rd.- Reads content
-    if(!SourceCode) {
+    if(Length <= 0) {
         fclose(File);
-        return Length;
+        return false;
     }
-    size_t readed = fread(SourceCode, Length, 1, File);
-    SourceCode[Length] = '\0';
-
+    Content.resize((size_t)Length);
+    size_t readed = fread(&Content[0], 1, (size_t)Length, File);
     fclose(File);
-    return Length;
+    return readed == (size_t)Length;
 }
 
+/// Resolved resource paths, empty if the file can't be found
+static std::map<Ogre::String, Ogre::String> sResources;
+/// Resolved resource paths lock
+static pthread_mutex_t sResourcesMutex = PTHREAD_MUTEX_INITIALIZER;
+
 const char* fileFromResources(const char* fileName)
 {
-    if(!Ogre::ResourceGroupManager::getSingleton().resourceExists(HYDRAX_RESOURCE_GROUP, fileName))
-        return NULL;
-    Ogre::ResourceGroupManager::LocationList locs = Ogre::ResourceGroupManager::getSingleton().getResourceLocationList(HYDRAX_RESOURCE_GROUP);
-    Ogre::ResourceGroupManager::LocationList::iterator loc;
-    for(loc=locs.begin();loc!=locs.end();++loc){
-        Ogre::ResourceGroupManager::ResourceLocation *kk = *loc;
-        Ogre::String path = kk->archive->getName() + "/" + fileName;
-        if(readFile(NULL, path.c_str()) <= 0)
-            continue;
-        static char out[512]; strcpy(out, path.c_str());
-        return out;
+    pthread_mutex_lock(&sResourcesMutex);
+    std::map<Ogre::String, Ogre::String>::iterator it = sResources.find(fileName);
+    if(it == sResources.end()) {
+        Ogre::String &out = sResources[fileName];
+        if(Ogre::ResourceGroupManager::getSingleton().resourceExists(HYDRAX_RESOURCE_GROUP, fileName)) {
+            Ogre::ResourceGroupManager::LocationList locs = Ogre::ResourceGroupManager::getSingleton().getResourceLocationList(HYDRAX_RESOURCE_GROUP);
+            Ogre::ResourceGroupManager::LocationList::iterator loc;
+            for(loc=locs.begin();loc!=locs.end();++loc){
+                Ogre::ResourceGroupManager::ResourceLocation *kk = *loc;
+                Ogre::String path = kk->archive->getName() + "/" + fileName;
+                FILE *f = fopen(path.c_str(), "rb");
+                if(!f)
+                    continue;
+                fclose(f);
+                out = path;
+                break;
+            }
+        }
+        it = sResources.find(fileName);
+    }
+    // The entries are never removed, so the path remains valid
+    const char *path = it->second.empty() ? NULL : it->second.c_str();
+    pthread_mutex_unlock(&sResourcesMutex);
+    return path;
+}
+
+bool programSource(const char* name, Ogre::String &source)
+{
+    const char *dir = getenv("HYDROCL_PROGRAMS");
+    if(dir && *dir) {
+        Ogre::String path = Ogre::String(dir) + "/" + name;
+        if(readFile(path.c_str(), source)) {
+            HydrOCLLOG(Ogre::String("Using ") + path + " instead of the embedded program.");
+            return true;
+        }
     }
-    return NULL;
+    size_t length = 0;
+    const char *embedded = embeddedSource(name, &length);
+    if(!embedded)
+        return false;
+    source.assign(embedded, length);
+    return true;
 }
 
-cl_kernel loadKernelFromFile(cl_context clContext, cl_device_id clDevice,
-                          const char* path, const char* entryPoint, const char* flags)
+cl_program buildProgram(cl_context clContext, cl_device_id clDevice,
+                        const char* name, const char* flags)
 {
-    char* clSource = NULL;
-    char* clFlags = NULL;
-    size_t clSourceLength;
     int clFlag;
     cl_program program = 0;
-    cl_kernel kernel = 0;
 
-    HydraxLOG(Ogre::String("Loading ") + path + "::" + entryPoint + "...");
+    HydrOCLLOG(Ogre::String("Building ") + name + "...");
     //! Get source code
-    clSourceLength = readFile(NULL, path);
-    if(clSourceLength <= 0){
-        HydraxLOG("Can't read source file.");
-        return 0;
-    }
-    clSource = new char[clSourceLength+1];
-    if(!clSource) {
-        HydraxLOG("Can't allocate memory on host for the source code.");
-        return 0;
-    }
-    clSourceLength = readFile(clSource, path);
-    if(clSourceLength <= 0){
-        HydraxLOG("Can't read source file.");
-        delete[] clSource; clSource=0;
+    Ogre::String source;
+    if(!programSource(name, source)){
+        HydrOCLLOG("Can't find the program source.");
         return 0;
     }
+    const char *clSource = source.c_str();
+    size_t clSourceLength = source.size();
     //! Compile program
-    program = clCreateProgramWithSource(clContext, 1, (const char **)&clSource, &clSourceLength, &clFlag);
+    program = clCreateProgramWithSource(clContext, 1, &clSource, &clSourceLength, &clFlag);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("Can't create OpenCL program.");
-        delete[] clSource; clSource=0;
+        HydrOCLLOG("Can't create OpenCL program.");
         return 0;
     }
-    clFlags = new char[512]; strcpy(clFlags, "");
-    strcpy(clFlags, "-cl-mad-enable -cl-no-signed-zeros -cl-finite-math-only -cl-fast-relaxed-math ");
-    strcat(clFlags, flags);
-    clFlag = clBuildProgram(program, 0, NULL, clFlags, NULL, NULL);
+    Ogre::String clFlags = Ogre::String("-cl-mad-enable -cl-no-signed-zeros -cl-finite-math-only -cl-fast-relaxed-math ") + flags;
+    clFlag = clBuildProgram(program, 0, NULL, clFlags.c_str(), NULL, NULL);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("--- Build log ---------------------------------");
+        HydrOCLLOG("--- Build log ---------------------------------");
         char Log[10240];
         clGetProgramBuildInfo(program, clDevice, CL_PROGRAM_BUILD_LOG, 10240*sizeof(char), Log, NULL );
-        HydraxLOG(Log);
-        HydraxLOG("--------------------------------- Build log ---");
-        delete[] clSource; clSource=0;
-        delete[] clFlags; clFlags=0;
+        HydrOCLLOG(Log);
+        HydrOCLLOG("--------------------------------- Build log ---");
+        clReleaseProgram(program); program=0;
         return 0;
     }
     char Log[10240];
     clGetProgramBuildInfo(program, clDevice, CL_PROGRAM_BUILD_LOG, 10240*sizeof(char), Log, NULL );
     if(strcmp(Log, "") && (strcmp(Log, "\n")) && strcmp(Log, "\EOF")){
-        HydraxLOG("--- Build log ---------------------------------");
-        HydraxLOG(Log);
-        HydraxLOG("--------------------------------- Build log ---");
+        HydrOCLLOG("--- Build log ---------------------------------");
+        HydrOCLLOG(Log);
+        HydrOCLLOG("--------------------------------- Build log ---");
     }
+    return program;
+}
 
-    kernel = clCreateKernel(program, entryPoint, &clFlag);
+cl_kernel loadKernel(cl_program program, const char* entryPoint)
+{
+    int clFlag;
+    HydrOCLLOG(Ogre::String("Loading ") + entryPoint + "...");
+    cl_kernel kernel = clCreateKernel(program, entryPoint, &clFlag);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("Can't create the kernel.");
+        HydrOCLLOG("Can't create the kernel.");
         if(clFlag == CL_OUT_OF_HOST_MEMORY) {
-            HydraxLOG("\tNot enought kernel resources.");
+            HydrOCLLOG("\tNot enought kernel resources.");
         }
         else if(clFlag == CL_INVALID_KERNEL_NAME) {
-            HydraxLOG(Ogre::String("\tCan't find ") + entryPoint + " function.");
+            HydrOCLLOG(Ogre::String("\tCan't find ") + entryPoint + " function.");
         }
         else if(clFlag == CL_INVALID_KERNEL_DEFINITION) {
-            HydraxLOG(Ogre::String("\tInvalid function: ") + entryPoint + ". Did you forgive __kernel modifier?");
+            HydrOCLLOG(Ogre::String("\tInvalid function: ") + entryPoint + ". Did you forgive __kernel modifier?");
         }
-        if(program)clReleaseProgram(program); program=0;
-        delete[] clSource; clSource=0;
-        delete[] clFlags; clFlags=0;
         return 0;
     }
-    if(program)clReleaseProgram(program); program=0;
-    delete[] clSource; clSource=0;
-    delete[] clFlags; clFlags=0;
+    return kernel;
+}
+
+cl_kernel buildKernel(cl_context clContext, cl_device_id clDevice,
+                      const char* name, const char* entryPoint, const char* flags)
+{
+    cl_program program = buildProgram(clContext, clDevice, name, flags);
+    if(!program)
+        return 0;
+    // The kernel retains the program
+    cl_kernel kernel = loadKernel(program, entryPoint);
+    clReleaseProgram(program);
     return kernel;
 }
 
@@ -163,101 +318,238 @@ int sendArgument(cl_kernel kernel, int index, size_t size, void* ptr)
     int clFlag;
     clFlag = clSetKernelArg(kernel, index, size, ptr);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("Can't send argument to kernel.");
+        HydrOCLLOG("Can't send argument to kernel.");
         if(clFlag == CL_INVALID_KERNEL) {
-            HydraxLOG("\tInvalid kernel.");
+            HydrOCLLOG("\tInvalid kernel.");
         }
         else if(clFlag == CL_INVALID_ARG_INDEX) {
-            HydraxLOG("\tInvalid argument index.");
+            HydrOCLLOG("\tInvalid argument index.");
         }
         else if(clFlag == CL_INVALID_ARG_VALUE) {
-            HydraxLOG("\tInvalid argument value.");
+            HydrOCLLOG("\tInvalid argument value.");
         }
         else if(clFlag == CL_INVALID_MEM_OBJECT) {
-            HydraxLOG("\tcl_mem mismatch fail.");
+            HydrOCLLOG("\tcl_mem mismatch fail.");
         }
         else if(clFlag == CL_INVALID_SAMPLER) {
-            HydraxLOG("\tcl_sampler mismatch fail.");
+            HydrOCLLOG("\tcl_sampler mismatch fail.");
         }
         else if(clFlag == CL_INVALID_ARG_SIZE) {
-            HydraxLOG("\tArgument type doesn't match.");
+            HydrOCLLOG("\tArgument type doesn't match.");
         }
         return 1;
     }
     return 0;
 }
 
-bool getData(cl_command_queue Queue, void *Dest, cl_mem Orig, size_t Size)
+bool getData(cl_command_queue Queue, void *Dest, cl_mem Orig, size_t Size, cl_event *Event)
 {
     cl_int clFlag;
-    clFlag  = clEnqueueReadBuffer(Queue, Orig, CL_TRUE, 0, Size, Dest, 0, NULL, NULL);
+    clFlag  = clEnqueueReadBuffer(Queue, Orig, CL_TRUE, 0, Size, Dest, 0, NULL, Event);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("Failure retrieving memory from server.");
+        HydrOCLLOG("Failure retrieving memory from server.");
         if(clFlag == CL_INVALID_COMMAND_QUEUE){
-            HydraxLOG("\tInvalid command queue.");
+            HydrOCLLOG("\tInvalid command queue.");
         }
         else if(clFlag == CL_INVALID_CONTEXT){
-            HydraxLOG("\tInvalid context.");
+            HydrOCLLOG("\tInvalid context.");
         }
         else if(clFlag == CL_INVALID_MEM_OBJECT){
-            HydraxLOG("\tInvalid buffer object.");
+            HydrOCLLOG("\tInvalid buffer object.");
         }
         else if(clFlag == CL_INVALID_VALUE){
             if(Dest == NULL){
-                HydraxLOG("\tMemory address to write is a NULL pointer");
+                HydrOCLLOG("\tMemory address to write is a NULL pointer");
             }
             else{
-                HydraxLOG("\tUnreadable region (Probably Size is out of bounds).");
+                HydrOCLLOG("\tUnreadable region (Probably Size is out of bounds).");
             }
         }
         else if(clFlag == CL_INVALID_EVENT_WAIT_LIST){
-            HydraxLOG("\tUnhandled event wait list error.");
+            HydrOCLLOG("\tUnhandled event wait list error.");
         }
         else if(clFlag == CL_MEM_OBJECT_ALLOCATION_FAILURE){
-            HydraxLOG("\tFailure to allocate memory for data store associated with buffer.");
+            HydrOCLLOG("\tFailure to allocate memory for data store associated with buffer.");
         }
         else if(clFlag == CL_OUT_OF_HOST_MEMORY){
-            HydraxLOG("\tFailure to allocate resources required by the OpenCL implementation on the host.");
+            HydrOCLLOG("\tFailure to allocate resources required by the OpenCL implementation on the host.");
         }
         else{
-            HydraxLOG("\tUnhandled failure.");
+            HydrOCLLOG("\tUnhandled failure.");
         }
         return true;
     }
     return false;
 }
 
-bool sendData(cl_command_queue Queue, cl_mem Dest, void* Orig, size_t Size)
+bool sendData(cl_command_queue Queue, cl_mem Dest, void* Orig, size_t Size, cl_event *Event)
 {
     cl_int clFlag;
-    clFlag  = clEnqueueWriteBuffer(Queue, Dest, CL_TRUE, 0, Size, Orig, 0, NULL, NULL);
+    clFlag  = clEnqueueWriteBuffer(Queue, Dest, CL_TRUE, 0, Size, Orig, 0, NULL, Event);
     if(clFlag != CL_SUCCESS) {
-        HydraxLOG("Failure sending memory to server.");
+        HydrOCLLOG("Failure sending memory to server.");
         if(clFlag == CL_INVALID_COMMAND_QUEUE){
-            HydraxLOG("\tInvalid command queue.");
+            HydrOCLLOG("\tInvalid command queue.");
         }
         else if(clFlag == CL_INVALID_CONTEXT){
-            HydraxLOG("\tInvalid context.");
+            HydrOCLLOG("\tInvalid context.");
         }
         else if(clFlag == CL_INVALID_MEM_OBJECT){
-            HydraxLOG("\tInvalid buffer object.");
+            HydrOCLLOG("\tInvalid buffer object.");
         }
         else if(clFlag == CL_INVALID_VALUE){
-            HydraxLOG("\tUnreadable region or invalid memory addres to write.");
+            HydrOCLLOG("\tUnreadable region or invalid memory addres to write.");
         }
         else if(clFlag == CL_INVALID_EVENT_WAIT_LIST){
-            HydraxLOG("\tUnhandled event wait list error.");
+            HydrOCLLOG("\tUnhandled event wait list error.");
         }
         else if(clFlag == CL_MEM_OBJECT_ALLOCATION_FAILURE){
-            HydraxLOG("\tFailure to allocate memory for data store associated with buffer.");
+            HydrOCLLOG("\tFailure to allocate memory for data store associated with buffer.");
         }
         else if(clFlag == CL_OUT_OF_HOST_MEMORY){
-            HydraxLOG("\tFailure to allocate resources required by the OpenCL implementation on the host.");
+            HydrOCLLOG("\tFailure to allocate resources required by the OpenCL implementation on the host.");
         }
         else{
-            HydraxLOG("\tUnhandled failure.");
+            HydrOCLLOG("\tUnhandled failure.");
         }
         return true;
     }
     return false;
 }
+
+cl_mem createBuffer(Hydrax::Module::HydrOCLMemory *Memory, Hydrax::Module::HydrOCLMemory::Subsystem Subsystem,
+                    cl_context context, cl_mem_flags flags, size_t size, cl_int *clFlag,
+                    Hydrax::Module::HydrOCLBufferPool *Pool)
+{
+    if(Pool)
+        return Pool->acquire(Subsystem, flags, size, clFlag);
+    cl_mem buffer = clCreateBuffer(context, flags, size, NULL, clFlag);
+    if(*clFlag != CL_SUCCESS)
+        return 0;
+    if(Memory) {
+        Hydrax::Module::HydrOCLMemory::Location Where = (flags & CL_MEM_ALLOC_HOST_PTR) ?
+            Hydrax::Module::HydrOCLMemory::MEM_HOST : Hydrax::Module::HydrOCLMemory::MEM_DEVICE;
+        Memory->allocated(Subsystem, Where, buffer, size);
+    }
+    return buffer;
+}
+
+void releaseBuffer(Hydrax::Module::HydrOCLMemory *Memory, cl_mem buffer,
+                   Hydrax::Module::HydrOCLBufferPool *Pool)
+{
+    if(!buffer)
+        return;
+    if(Pool) {
+        Pool->release(buffer);
+        return;
+    }
+    if(Memory) Memory->released(buffer);
+    clReleaseMemObject(buffer);
+}
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLBufferPool::HydrOCLBufferPool(cl_context Context, HydrOCLMemory *Memory, size_t MaxCached)
+		: mContext(Context)
+		, mMemory(Memory)
+		, mMaxCached(MaxCached)
+		, mCached(0)
+		, mHits(0)
+		, mMisses(0)
+		, mEvictions(0)
+	{
+	}
+
+	HydrOCLBufferPool::~HydrOCLBufferPool()
+	{
+	    HydrOCLLOG("\tBuffer pool: " + Ogre::StringConverter::toString(mHits) + " hits, " +
+	              Ogre::StringConverter::toString(mMisses) + " misses, " +
+	              Ogre::StringConverter::toString(mEvictions) + " evictions.");
+	    trim();
+	}
+
+	cl_mem HydrOCLBufferPool::acquire(HydrOCLMemory::Subsystem Subsystem, cl_mem_flags flags, size_t size, cl_int *clFlag)
+	{
+	    size = sizeClass(size);
+	    HydrOCLMemory::Location Where = (flags & CL_MEM_ALLOC_HOST_PTR) ?
+	        HydrOCLMemory::MEM_HOST : HydrOCLMemory::MEM_DEVICE;
+	    std::list<Entry>::iterator it;
+	    for(it=mFree.begin();it!=mFree.end();++it) {
+	        if((it->Flags != flags) || (it->Size != size))
+	            continue;
+	        cl_mem buffer = it->Buffer;
+	        mFree.erase(it);
+	        mCached -= size;
+	        mHits++;
+	        // Move it from the pool to its new owner
+	        if(mMemory) mMemory->allocated(Subsystem, Where, buffer, size);
+	        *clFlag = CL_SUCCESS;
+	        return buffer;
+	    }
+	    mMisses++;
+	    cl_mem buffer = clCreateBuffer(mContext, flags, size, NULL, clFlag);
+	    if(*clFlag != CL_SUCCESS) {
+	        // Maybe the cached buffers are taking the required memory
+	        if(mFree.empty())
+	            return 0;
+	        trim();
+	        buffer = clCreateBuffer(mContext, flags, size, NULL, clFlag);
+	        if(*clFlag != CL_SUCCESS)
+	            return 0;
+	    }
+	    if(mMemory) mMemory->allocated(Subsystem, Where, buffer, size);
+	    return buffer;
+	}
+
+	void HydrOCLBufferPool::release(cl_mem buffer)
+	{
+	    Entry E;
+	    E.Buffer = buffer;
+	    clGetMemObjectInfo(buffer, CL_MEM_FLAGS, sizeof(cl_mem_flags), &E.Flags, NULL);
+	    clGetMemObjectInfo(buffer, CL_MEM_SIZE, sizeof(size_t), &E.Size, NULL);
+	    if(E.Size > mMaxCached) {
+	        if(mMemory) mMemory->released(buffer);
+	        clReleaseMemObject(buffer);
+	        mEvictions++;
+	        return;
+	    }
+	    while(mCached + E.Size > mMaxCached)
+	        _evict();
+	    mFree.push_back(E);
+	    mCached += E.Size;
+	    if(mMemory) {
+	        HydrOCLMemory::Location Where = (E.Flags & CL_MEM_ALLOC_HOST_PTR) ?
+	            HydrOCLMemory::MEM_HOST : HydrOCLMemory::MEM_DEVICE;
+	        mMemory->allocated(HydrOCLMemory::MEM_POOL, Where, buffer, E.Size);
+	    }
+	}
+
+	void HydrOCLBufferPool::trim()
+	{
+	    while(!mFree.empty()) {
+	        _evict();
+	    }
+	}
+
+	size_t HydrOCLBufferPool::sizeClass(size_t size)
+	{
+	    size_t base = 256;
+	    if(size <= base)
+	        return base;
+	    while(2*base < size)
+	        base *= 2;
+	    // base < size <= 2*base, rounded up to quarters of base
+	    size_t step = base / 4;
+	    return base + ((size - base + step - 1) / step) * step;
+	}
+
+	void HydrOCLBufferPool::_evict()
+	{
+	    Entry &E = mFree.front();
+	    if(mMemory) mMemory->released(E.Buffer);
+	    clReleaseMemObject(E.Buffer);
+	    mCached -= E.Size;
+	    mEvictions++;
+	    mFree.pop_front();
+	}
+}}
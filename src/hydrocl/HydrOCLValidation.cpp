@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <math.h>
+
+#include <hydrocl/HydrOCLValidation.h>
+#include <hydrocl/HydrOCLUtils.h>
+
+/// Position tolerance, relative to the reference coordinate (fast math kernels)
+#define _def_PositionTolerance 1e-3f
+/// Normals tolerance
+#define _def_NormalTolerance 1e-2f
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLValidation::HydrOCLValidation(HydrOCLBackend *Backend)
+		: mBackend(Backend)
+		, mReference(NULL)
+		, mVertices(NULL)
+		, mN(0)
+		, mChecks(0)
+		, mFailures(0)
+		, mMemory(NULL)
+	{
+	}
+
+	HydrOCLValidation::~HydrOCLValidation()
+	{
+		remove();
+		delete mBackend; mBackend=NULL;
+	}
+
+	bool HydrOCLValidation::create(const HydrOCL::Options &Options, Noise::HydrOCLNoise *NoiseModule)
+	{
+	    mN = (unsigned int)Options.Complexity;
+	    mReference = new HydrOCLReference();
+	    mReference->setMemory(mMemory);
+	    if(!mReference->create(Options, NoiseModule)) {
+	        remove();
+	        return false;
+	    }
+	    mVertices = allocHost<Mesh::POS_NORM_VERTEX>(mMemory, HydrOCLMemory::MEM_VERTEXES, mN*mN);
+	    mStages = "";
+	    mChecks = 0;
+	    mFailures = 0;
+	    HydrOCLLOG(Ogre::String("\tValidating the ") + mBackend->getName() + " backend against the reference one.");
+	    return true;
+	}
+
+	void HydrOCLValidation::remove()
+	{
+	    if(mChecks) {
+	        HydrOCLLOG("Validation: " + Ogre::StringConverter::toString(mFailures) + " of " +
+	                  Ogre::StringConverter::toString(mChecks) + " reads out of tolerance.");
+	    }
+	    mChecks = 0;
+	    mFailures = 0;
+	    if(mReference) delete mReference; mReference=NULL;
+	    releaseHost(mMemory, mVertices); mVertices=NULL;
+	    if(mBackend) mBackend->remove();
+	}
+
+	void HydrOCLValidation::setOptions(const HydrOCL::Options &Options)
+	{
+		mBackend->setOptions(Options);
+		mReference->setOptions(Options);
+	}
+
+	bool HydrOCLValidation::resize(const HydrOCL::Options &Options)
+	{
+	    if(!mBackend->resize(Options) || !mReference->resize(Options))
+	        return false;
+	    mN = (unsigned int)Options.Complexity;
+	    releaseHost(mMemory, mVertices);
+	    mVertices = allocHost<Mesh::POS_NORM_VERTEX>(mMemory, HydrOCLMemory::MEM_VERTEXES, mN*mN);
+	    return true;
+	}
+
+	bool HydrOCLValidation::geometry(const Ogre::Vector4 *Corners)
+	{
+	    mStages += "geometry ";
+	    mReference->geometry(Corners);
+	    return mBackend->geometry(Corners);
+	}
+
+	bool HydrOCLValidation::basePlane(const float &h)
+	{
+	    mStages += "basePlane ";
+	    mReference->basePlane(h);
+	    return mBackend->basePlane(h);
+	}
+
+	bool HydrOCLValidation::noise(const Ogre::Vector3 &World)
+	{
+	    mStages += "noise ";
+	    mReference->noise(World);
+	    return mBackend->noise(World);
+	}
+
+	bool HydrOCLValidation::smooth()
+	{
+	    mStages += "smooth ";
+	    mReference->smooth();
+	    return mBackend->smooth();
+	}
+
+	bool HydrOCLValidation::normals()
+	{
+	    mStages += "normals ";
+	    mReference->normals();
+	    return mBackend->normals();
+	}
+
+	bool HydrOCLValidation::choppyWaves(const Ogre::Vector3 &CameraDir, const float &Underwater)
+	{
+	    mStages += "choppyWaves ";
+	    mReference->choppyWaves(CameraDir, Underwater);
+	    return mBackend->choppyWaves(CameraDir, Underwater);
+	}
+
+	bool HydrOCLValidation::read(Mesh::POS_NORM_VERTEX *Vertices)
+	{
+	    unsigned int k, kPos=0, kNor=0;
+	    if(!mBackend->read(Vertices))
+	        return false;
+	    mReference->read(mVertices);
+	    float ePos=0.f, eNor=0.f;
+	    for(k=0;k<mN*mN;k++) {
+	        const Mesh::POS_NORM_VERTEX &a = Vertices[k], &b = mVertices[k];
+	        float e;
+	        e = fabs(a.x - b.x) / (1.f + fabs(b.x));
+	        if(e > ePos) {ePos = e; kPos = k;}
+	        e = fabs(a.y - b.y) / (1.f + fabs(b.y));
+	        if(e > ePos) {ePos = e; kPos = k;}
+	        e = fabs(a.z - b.z) / (1.f + fabs(b.z));
+	        if(e > ePos) {ePos = e; kPos = k;}
+	        e = fabs(a.nx - b.nx) + fabs(a.ny - b.ny) + fabs(a.nz - b.nz);
+	        if(e > eNor) {eNor = e; kNor = k;}
+	    }
+	    mChecks++;
+	    // NaN errors fail as well
+	    if(!(ePos <= _def_PositionTolerance) || !(eNor <= _def_NormalTolerance)) {
+	        mFailures++;
+	        HydrOCLLOG("Validation: [ " + mStages + "] out of tolerance. Position error " +
+	                  Ogre::StringConverter::toString(ePos) + " at vertex (" +
+	                  Ogre::StringConverter::toString(kPos % mN) + ", " +
+	                  Ogre::StringConverter::toString(kPos / mN) + "), normal error " +
+	                  Ogre::StringConverter::toString(eNor) + " at vertex (" +
+	                  Ogre::StringConverter::toString(kNor % mN) + ", " +
+	                  Ogre::StringConverter::toString(kNor / mN) + ").");
+	    }
+	    mStages = "";
+	    return true;
+	}
+
+	bool HydrOCLValidation::finish()
+	{
+	    return mBackend->finish();
+	}
+}}
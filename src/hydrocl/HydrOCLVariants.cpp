@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <stdio.h>
+
+#include <hydrocl/HydrOCLVariants.h>
+
+/// Requests of the same constants before building their variant
+#define _def_StableRequests 30
+/// Variants programs of each kernel kept by the runtime
+#define _def_MaxVariants 8
+
+namespace Hydrax{namespace Module
+{
+	HydrOCLVariants::HydrOCLVariants()
+		: mRuntime(NULL)
+		, mStable(0)
+	{
+	}
+
+	HydrOCLVariants::~HydrOCLVariants()
+	{
+	    release();
+	}
+
+	void HydrOCLVariants::setup(HydrOCLRuntime *Runtime, const char *EntryPoint)
+	{
+	    release();
+	    mRuntime    = Runtime;
+	    mEntryPoint = EntryPoint;
+	}
+
+	void HydrOCLVariants::release()
+	{
+	    _evict();
+	    mFlags = "";
+	    mStable = 0;
+	    mRuntime = NULL;
+	}
+
+	cl_kernel HydrOCLVariants::get(const HydrOCLRuntime::Program &Generic, const Ogre::String &Constants)
+	{
+	    if(!mRuntime)
+	        return 0;
+	    Ogre::String flags = Generic.Flags + Constants;
+	    std::map<Ogre::String, cl_kernel>::iterator it = mVariants.find(flags);
+	    if(it != mVariants.end())
+	        return it->second;
+	    // Wait until the options become stable
+	    if(flags != mFlags) {
+	        mFlags = flags;
+	        mStable = 0;
+	    }
+	    if(++mStable < _def_StableRequests)
+	        return 0;
+	    if(mStable == _def_StableRequests) {
+	        // The runtime keeps the variants programs, so the continuous
+	        // options may pile them up
+	        if(mRequested.size() >= _def_MaxVariants)
+	            _evict();
+	        mName = Generic.Name;
+	        // Each request is forgotten once (see _evict())
+	        if(mRequested.insert(flags).second)
+	            mRuntime->request(HydrOCLRuntime::Program(Generic.Name, flags));
+	    }
+	    cl_kernel kernel = mRuntime->findKernel(Generic.Name.c_str(), mEntryPoint.c_str(), flags.c_str());
+	    if(!kernel)
+	        return 0;
+	    mVariants[flags] = kernel;
+	    return kernel;
+	}
+
+	void HydrOCLVariants::_evict()
+	{
+	    std::map<Ogre::String, cl_kernel>::iterator it;
+	    for(it=mVariants.begin();it!=mVariants.end();it++)
+	        clReleaseKernel(it->second);
+	    mVariants.clear();
+	    std::set<Ogre::String>::iterator flags;
+	    for(flags=mRequested.begin();flags!=mRequested.end();flags++)
+	        mRuntime->forget(HydrOCLRuntime::Program(mName, *flags));
+	    mRequested.clear();
+	}
+
+	Ogre::String HydrOCLVariants::constant(const char *Name, unsigned int Value)
+	{
+	    char flag[128];
+	    sprintf(flag, " -D%s=%uu", Name, Value);
+	    return flag;
+	}
+
+	Ogre::String HydrOCLVariants::constant(const char *Name, float Value)
+	{
+	    char flag[128];
+	    sprintf(flag, " -D%s=%.9ef", Name, Value);
+	    return flag;
+	}
+}}
@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef uint
+	#define uint unsigned int
+#endif
+#ifndef vec
+	#define vec float4
+#endif
+
+#ifdef _g
+	#error '_g' is already defined.
+#endif
+#define _g __global
+
+#ifdef _c
+	#error '_c' is already defined.
+#endif
+#define _c __constant
+
+#ifdef _l
+	#error '_l' is already defined.
+#endif
+#define _l __local
+
+// ----------------------------------------------------------------------------
+// Kernels compiled. The optional stages are built as separate programs, just
+// when they are used: SMOOTH_KERNEL builds the smooth kernel, CHOPPY_KERNEL
+// the choppyWaves one, and otherwise the geometry, setBasePlane and normals
+// kernels are built.
+// ----------------------------------------------------------------------------
+#if !defined(SMOOTH_KERNEL) && !defined(CHOPPY_KERNEL)
+	#define GRID_KERNELS
+#endif
+
+#ifndef TILE_SIZE
+	#define TILE_SIZE 16
+#endif
+#ifndef SMOOTH_RADIUS
+	#define SMOOTH_RADIUS 1
+#endif
+#ifndef LAYOUT_TILE
+	#define LAYOUT_TILE 8
+#endif
+
+// ----------------------------------------------------------------------------
+// Specialisation constants (see HydrOCLVariants). When the number of
+// vertexes (CONST_NX, CONST_NY) or the choppy waves strength
+// (CONST_CHOPPY_STRENGTH) are defined they replace the kernels arguments,
+// so the compiler can fold the indexes and the boundaries checks.
+// ----------------------------------------------------------------------------
+#ifdef CONST_NX
+	#define SPECIALISE_N(N) N = (uint2)(CONST_NX, CONST_NY)
+#else
+	#define SPECIALISE_N(N)
+#endif
+
+// ----------------------------------------------------------------------------
+// Vertexes storage. By default each vertex is stored as a float4 (AoS). If
+// SOA_LAYOUT is defined the buffers store four planes of floats instead
+// (all the x components, then the y, z and w ones), so the kernels that
+// only touch some components don't need to gather them. S is the number
+// of stored vertexes (the plane length).
+// ----------------------------------------------------------------------------
+#ifdef SOA_LAYOUT
+	#define vbuf _g float*
+	#define VX(p, id, S) (p)[(id)]
+	#define VY(p, id, S) (p)[(S) + (id)]
+	#define VZ(p, id, S) (p)[2*(S) + (id)]
+	#define VW(p, id, S) (p)[3*(S) + (id)]
+	#define VLOAD(p, id, S) ((vec)(VX(p, id, S), VY(p, id, S), VZ(p, id, S), VW(p, id, S)))
+	#define VSTORE(p, id, S, v) { \
+		VX(p, id, S) = (v).x; VY(p, id, S) = (v).y; \
+		VZ(p, id, S) = (v).z; VW(p, id, S) = (v).w; }
+#else
+	#define vbuf _g vec*
+	#define VX(p, id, S) (p)[(id)].x
+	#define VY(p, id, S) (p)[(id)].y
+	#define VZ(p, id, S) (p)[(id)].z
+	#define VW(p, id, S) (p)[(id)].w
+	#define VLOAD(p, id, S) (p)[(id)]
+	#define VSTORE(p, id, S, v) { (p)[(id)] = (v); }
+#endif
+
+// ----------------------------------------------------------------------------
+// Work-items coarsening. Each work-item processes VECTOR_WIDTH consecutive
+// vertexes of a row (1, 4 or 8), using vector math when the whole vector
+// fits in the row.
+// ----------------------------------------------------------------------------
+#ifndef VECTOR_WIDTH
+	#define VECTOR_WIDTH 1
+#endif
+#if VECTOR_WIDTH == 8
+	#define vecN float8
+	#define vloadN vload8
+	#define vstoreN vstore8
+	#define IOTA_N (float8)(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f)
+#elif VECTOR_WIDTH == 4
+	#define vecN float4
+	#define vloadN vload4
+	#define vstoreN vstore4
+	#define IOTA_N (float4)(0.f, 1.f, 2.f, 3.f)
+#endif
+
+#if VECTOR_WIDTH > 1
+/** Loads a component of VECTOR_WIDTH consecutive vertexes.
+ * @param p Vertexes.
+ * @param c Component (0 = x, 1 = y, 2 = z, 3 = w).
+ * @param id Index of the first vertex.
+ * @param S Number of stored vertexes.
+ * @return Components vector.
+ */
+vecN loadComponent( vbuf p, uint c, uint id, uint S )
+{
+#ifdef SOA_LAYOUT
+	return vloadN(0, p + c*S + id);
+#else
+	_g float* f = (_g float*)p;
+	float a[VECTOR_WIDTH];
+	uint k;
+	for(k=0;k<VECTOR_WIDTH;k++)
+		a[k] = f[4*(id + k) + c];
+	return vloadN(0, a);
+#endif
+}
+
+/** Stores a component of VECTOR_WIDTH consecutive vertexes.
+ * @param v Components vector.
+ * @param p Vertexes.
+ * @param c Component (0 = x, 1 = y, 2 = z, 3 = w).
+ * @param id Index of the first vertex.
+ * @param S Number of stored vertexes.
+ */
+void storeComponent( vecN v, vbuf p, uint c, uint id, uint S )
+{
+#ifdef SOA_LAYOUT
+	vstoreN(v, 0, p + c*S + id);
+#else
+	_g float* f = (_g float*)p;
+	float a[VECTOR_WIDTH];
+	uint k;
+	vstoreN(v, 0, a);
+	for(k=0;k<VECTOR_WIDTH;k++)
+		f[4*(id + k) + c] = a[k];
+#endif
+}
+#endif
+
+/** Index of a vertex into the device buffers. By default vertexes are
+ * stored in row-major order. If TILED_LAYOUT is defined, they are stored
+ * by blocks of LAYOUT_TILE x LAYOUT_TILE vertexes (row-major inside the
+ * block), so the vertical neighbours are close in memory too. In that
+ * case the buffers must be padded to a multiple of LAYOUT_TILE vertexes
+ * at each direction.
+ * @param i Vertex column.
+ * @param j Vertex row.
+ * @param N Total number of vertices at each direction.
+ * @return Vertex index.
+ */
+uint vertexId( uint i, uint j, uint2 N )
+{
+#ifdef TILED_LAYOUT
+	uint tiles = (N.x + LAYOUT_TILE - 1) / LAYOUT_TILE;
+	return ((j / LAYOUT_TILE)*tiles + i / LAYOUT_TILE)*LAYOUT_TILE*LAYOUT_TILE
+	       + (j % LAYOUT_TILE)*LAYOUT_TILE + i % LAYOUT_TILE;
+#else
+	return j*N.x + i;
+#endif
+}
+
+/** Number of vertexes stored in the device buffers, padding included.
+ * @param N Total number of vertices at each direction.
+ * @return Number of stored vertexes.
+ */
+uint bufferLength( uint2 N )
+{
+#ifdef TILED_LAYOUT
+	return ((N.x + LAYOUT_TILE - 1) / LAYOUT_TILE) * ((N.y + LAYOUT_TILE - 1) / LAYOUT_TILE)
+	       * LAYOUT_TILE*LAYOUT_TILE;
+#else
+	return N.x*N.y;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Stencil kernels (smooth, normals and choppyWaves) are launched with
+// TILE_SIZE x TILE_SIZE work-groups. Each work-group loads its vertexes,
+// plus a halo of R vertexes at each side, into local memory once, so the
+// neighbours are not fetched again from global memory.
+// ----------------------------------------------------------------------------
+
+/** Tile width (halo included).
+ * @param R Halo radius.
+ */
+#define TILE_W(R) (TILE_SIZE + 2*(R))
+
+/** Index of the work-item vertex into the tile.
+ * @param R Halo radius.
+ */
+#define TILE_ID(R) ((get_local_id(1) + (R))*TILE_W(R) + get_local_id(0) + (R))
+
+/** Loads the work-group tile of vertexes into local memory. Halo
+ * vertexes out of the grid are clamped to the grid bounds.
+ * @param tile Local memory tile, TILE_W(R)*TILE_W(R) vertexes.
+ * @param vertex Geometry vertexes.
+ * @param R Halo radius.
+ * @param N Total number of vertices at each direction.
+ * @warning All the work-items of the group must call it, including the
+ * ones out of the grid bounds.
+ */
+void loadTile( _l vec* tile, vbuf vertex, uint R, uint2 N )
+{
+	uint w   = TILE_W(R);
+	int  i0  = (int)(get_group_id(0)*TILE_SIZE) - (int)R;
+	int  j0  = (int)(get_group_id(1)*TILE_SIZE) - (int)R;
+	uint lid = get_local_id(1)*get_local_size(0) + get_local_id(0);
+	uint lsz = get_local_size(0)*get_local_size(1);
+	uint S   = bufferLength(N);
+	uint k;
+	for(k=lid;k<w*w;k+=lsz){
+		int i = clamp(i0 + (int)(k%w), 0, (int)N.x - 1);
+		int j = clamp(j0 + (int)(k/w), 0, (int)N.y - 1);
+		tile[k] = VLOAD(vertex, vertexId(i, j, N), S);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+/** Loads the work-group tile of heights (y coordinates) into local
+ * memory. Halo vertexes out of the grid are clamped to the grid bounds.
+ * @param tile Local memory tile, TILE_W(R)*TILE_W(R) heights.
+ * @param vertex Geometry vertexes.
+ * @param R Halo radius.
+ * @param N Total number of vertices at each direction.
+ * @warning All the work-items of the group must call it, including the
+ * ones out of the grid bounds.
+ */
+void loadTileHeights( _l float* tile, vbuf vertex, uint R, uint2 N )
+{
+	uint w   = TILE_W(R);
+	int  i0  = (int)(get_group_id(0)*TILE_SIZE) - (int)R;
+	int  j0  = (int)(get_group_id(1)*TILE_SIZE) - (int)R;
+	uint lid = get_local_id(1)*get_local_size(0) + get_local_id(0);
+	uint lsz = get_local_size(0)*get_local_size(1);
+	uint S   = bufferLength(N);
+	uint k;
+	for(k=lid;k<w*w;k+=lsz){
+		int i = clamp(i0 + (int)(k%w), 0, (int)N.x - 1);
+		int j = clamp(j0 + (int)(k/w), 0, (int)N.y - 1);
+		tile[k] = VY(vertex, vertexId(i, j, N), S);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+/** Normal of an interior vertex from its tile neighbours.
+ * @param tile Local memory tile with a halo of 1 vertex.
+ * @param t Vertex index into the tile.
+ * @return Vertex normal.
+ */
+vec tileNormal( _l vec* tile, uint t )
+{
+	vec vec1, vec2;
+	vec1 = tile[t-1]         - tile[t+1];
+	vec2 = tile[t-TILE_W(1)] - tile[t+TILE_W(1)];
+	return normalize(cross(vec2, vec1));
+}
+
+#ifdef SMOOTH_KERNEL
+/** Performs a vertex smoothing operation, averaging the height of each
+ * vertex with the SMOOTH_RADIUS closest ones at each direction. Since the
+ * results are written in a different buffer, they don't depend on the
+ * work-items execution order.
+ * @param vertex Vertexes to smooth.
+ * @param smoothed Output smoothed vertexes.
+ * @param N Total number of vertices at each direction.
+ */
+__kernel void smooth( vbuf vertex, vbuf smoothed, uint2 N )
+{
+	SPECIALISE_N(N);
+	_l float tile[TILE_W(SMOOTH_RADIUS)*TILE_W(SMOOTH_RADIUS)];
+	loadTileHeights(tile, vertex, SMOOTH_RADIUS, N);
+
+	uint i  = get_global_id(0);
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+	uint id = vertexId(i, j, N);
+	uint S  = bufferLength(N);
+
+	vec v = VLOAD(vertex, id, S);
+	// Boundaries are not smoothed, but must be written anyway
+	if( (i < SMOOTH_RADIUS) || (j < SMOOTH_RADIUS) || (i >= N.x-SMOOTH_RADIUS) || (j >= N.y-SMOOTH_RADIUS) ){
+		VSTORE(smoothed, id, S, v);
+		return;
+	}
+
+	uint t = TILE_ID(SMOOTH_RADIUS);
+	uint r;
+	float y = tile[t];
+	for(r=1;r<=SMOOTH_RADIUS;r++){
+		y += tile[t-r] + tile[t+r] + tile[t-r*TILE_W(SMOOTH_RADIUS)] + tile[t+r*TILE_W(SMOOTH_RADIUS)];
+	}
+	v.y = y / (4*SMOOTH_RADIUS + 1);
+	VSTORE(smoothed, id, S, v);
+}
+#endif
+
+#ifdef GRID_KERNELS
+/** Normals computation.
+ * @param vertex Geometry vertexes.
+ * @param normal Resultant normals.
+ * @param N Total number of vertices at each direction.
+ */
+__kernel void normals( vbuf vertex, vbuf normal, uint2 N )
+{
+	SPECIALISE_N(N);
+	_l vec tile[TILE_W(1)*TILE_W(1)];
+	loadTile(tile, vertex, 1, N);
+
+	uint i  = get_global_id(0);
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+	uint id = vertexId(i, j, N);
+	uint S  = bufferLength(N);
+
+	// Set boundaries with plane normal
+	if( (i < 1) || (j < 1) || (i >= N.x-1) || (j >= N.y-1) ){
+		VSTORE(normal, id, S, (vec)(0.f, -1.f, 0.f, 0.f));
+		return;
+	}
+	// Interpolate the rest of vertexes
+	VSTORE(normal, id, S, tileNormal(tile, TILE_ID(1)));
+}
+#endif
+
+#ifdef CHOPPY_KERNEL
+/** Normals and choppy waves computation, both fed from the same tile. The
+ * undisplaced vertexes are preserved, so the displaced ones must be
+ * written in a different buffer.
+ * @param vertex Undisplaced geometry vertexes.
+ * @param choppy Output choppy waves displaced vertexes.
+ * @param normal Resultant normals.
+ * @param camDir Camera direction.
+ * @param strength Choppy waves strength.
+ * @param underwater -1.f if frame is being rendered underwater, 1 otherwise.
+ * @param N Total number of vertices at each direction.
+ */
+__kernel void choppyWaves( vbuf vertex, vbuf choppy, vbuf normal, vec camDir, float strength, float underwater, uint2 N )
+{
+	SPECIALISE_N(N);
+#ifdef CONST_CHOPPY_STRENGTH
+	strength = CONST_CHOPPY_STRENGTH;
+#endif
+	_l vec tile[TILE_W(1)*TILE_W(1)];
+	loadTile(tile, vertex, 1, N);
+
+	uint i  = get_global_id(0);
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+	uint id = vertexId(i, j, N);
+	uint S  = bufferLength(N);
+
+	uint t = TILE_ID(1);
+	vec  v = tile[t];
+	// Boundaries are not displaced, but must be written anyway
+	if( (i < 1) || (j < 1) || (i >= N.x-1) || (j >= N.y-1) ){
+		VSTORE(normal, id, S, (vec)(0.f, -1.f, 0.f, 0.f));
+		VSTORE(choppy, id, S, v);
+		return;
+	}
+
+	vec n = tileNormal(tile, t);
+	VSTORE(normal, id, S, n);
+
+	float Dis1, Dis2;
+	float2 Dir, Perp, Norm2;
+	// Get directions
+	Dir  = fabs(normalize(camDir.xz));
+	Perp = (float2)(-Dir.y, Dir.x);
+	// Get distances
+	Dis1  = distance(v.xz, tile[t+TILE_W(1)].xz);
+	Dis2  = distance(v.xz, tile[t+1].xz);
+	Norm2 = n.xz * (Dir*Dis1 + Perp*Dis2) * strength;
+	// Final result
+	v.xz = v.xz + underwater*Norm2;
+	VSTORE(choppy, id, S, v);
+}
+#endif
+
+#ifdef GRID_KERNELS
+/** Base plane coordinates of a vertex of the grid.
+ * @param vertexes Output vertexes.
+ * @param corner0 1st grid bounds corner.
+ * @param corner1 2nd grid bounds corner.
+ * @param corner2 3rd grid bounds corner.
+ * @param corner3 4th grid bounds corner.
+ * @param i Vertex column.
+ * @param j Vertex row.
+ * @param N Total number of vertices at each direction.
+ */
+void geometryVertex( vbuf vertexes, vec corner0, vec corner1, vec corner2, vec corner3, uint i, uint j, uint2 N )
+{
+	uint id = vertexId(i, j, N);
+	uint S  = bufferLength(N);
+	float2 uv, uvDi;
+	vec result;
+	float divide;
+	// Get uv coordinates
+	uv.x = i/(float)N.x;
+	uv.y = j/(float)N.y;
+	uvDi = (float2)(1.f, 1.f) - uv;
+	// Get base plane coordinates
+    result.x = uvDi.y*(uvDi.x*corner0.x + uv.x*corner1.x) + uv.y*(uvDi.x*corner2.x + uv.x*corner3.x);
+    result.z = uvDi.y*(uvDi.x*corner0.z + uv.x*corner1.z) + uv.y*(uvDi.x*corner2.z + uv.x*corner3.z);
+    result.w = uvDi.y*(uvDi.x*corner0.w + uv.x*corner1.w) + uv.y*(uvDi.x*corner2.w + uv.x*corner3.w);
+
+    divide = 1.f/result.w;
+    result.x *= divide;
+    result.z *= divide;
+
+	// Set vertexes, but delegating all heigh operation to following kernels
+    VX(vertexes, id, S) = result.x;
+    VZ(vertexes, id, S) = result.z;
+    // VY(vertexes, id, S) = 0.f;
+	VW(vertexes, id, S) = 1.f;
+}
+
+/** Fully geometry regeneration when camera has been moved. Each work-item
+ * processes VECTOR_WIDTH consecutive vertexes of a row, which are
+ * consecutive in the buffers for both layouts too (LAYOUT_TILE is a
+ * multiple of VECTOR_WIDTH).
+ * @param vertexes Output vertexes.
+ * @param corner0 1st grid bounds corner.
+ * @param corner1 2nd grid bounds corner.
+ * @param corner2 3rd grid bounds corner.
+ * @param corner3 4th grid bounds corner.
+ * @param N Total number of vertices at each direction.
+ */
+__kernel void geometry( vbuf vertexes, vec corner0, vec corner1, vec corner2, vec corner3, uint2 N )
+{
+	SPECIALISE_N(N);
+	uint i  = get_global_id(0)*VECTOR_WIDTH;
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+
+	// ---- | ------------------------ | ----
+	// ---- V ---- Your code here ---- V ----
+
+#if VECTOR_WIDTH > 1
+	if(i + VECTOR_WIDTH <= N.x){
+		uint id = vertexId(i, j, N);
+		uint S  = bufferLength(N);
+		vecN u   = (IOTA_N + (float)i) / (float)N.x;
+		vecN uDi = 1.f - u;
+		float v   = j/(float)N.y;
+		float vDi = 1.f - v;
+		vecN x = vDi*(uDi*corner0.x + u*corner1.x) + v*(uDi*corner2.x + u*corner3.x);
+		vecN z = vDi*(uDi*corner0.z + u*corner1.z) + v*(uDi*corner2.z + u*corner3.z);
+		vecN w = vDi*(uDi*corner0.w + u*corner1.w) + v*(uDi*corner2.w + u*corner3.w);
+		vecN divide = 1.f/w;
+		storeComponent(x*divide, vertexes, 0, id, S);
+		storeComponent(z*divide, vertexes, 2, id, S);
+		storeComponent((vecN)(1.f), vertexes, 3, id, S);
+		return;
+	}
+#endif
+	// Vertex by vertex (rows end)
+	uint last = min(i + VECTOR_WIDTH, N.x);
+	for(;i<last;i++){
+		geometryVertex(vertexes, corner0, corner1, corner2, corner3, i, j, N);
+	}
+
+	// ---- A ---- Your code here ---- A ----
+	// ---- | ------------------------ | ----
+
+}
+
+/** Sets base plane coordinate to all vertexes. This kernel does not
+ * depend on the vertexes layout, so it is launched over the full buffers,
+ * padding included. Each work-item processes VECTOR_WIDTH consecutive
+ * vertexes of a row.
+ * @param vertexes Output vertexes.
+ * @param h Base plane y coordinate.
+ * @param N Total number of stored vertices at each direction.
+ * @warning Y coordinate set will be -h, not h.
+ */
+__kernel void setBasePlane( vbuf vertexes, float h, uint2 N )
+{
+	uint i  = get_global_id(0)*VECTOR_WIDTH;
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+	uint id = j*N.x + i;
+	uint S  = N.x*N.y;
+
+	// ---- | ------------------------ | ----
+	// ---- V ---- Your code here ---- V ----
+
+#if VECTOR_WIDTH > 1
+	if(i + VECTOR_WIDTH <= N.x){
+		storeComponent((vecN)(-h), vertexes, 1, id, S);
+		return;
+	}
+#endif
+	uint last = min(i + VECTOR_WIDTH, N.x);
+	for(;i<last;i++,id++){
+		VY(vertexes, id, S) = -h;
+	}
+
+	// ---- A ---- Your code here ---- A ----
+	// ---- | ------------------------ | ----
+
+}
+#endif
@@ -40,6 +40,28 @@
 #endif
 #define _l __local
 
+// ----------------------------------------------------------------------------
+// Vertexes storage (see grid.cl). If SOA_LAYOUT is defined the buffers
+// store four planes of floats (x, y, z and w components) of S vertexes
+// each, otherwise each vertex is stored as a float4.
+// ----------------------------------------------------------------------------
+#ifdef SOA_LAYOUT
+	#define vbuf _g float*
+	#define VX(p, id, S) (p)[(id)]
+	#define VY(p, id, S) (p)[(S) + (id)]
+	#define VZ(p, id, S) (p)[2*(S) + (id)]
+#else
+	#define vbuf _g vec*
+	#define VX(p, id, S) (p)[(id)].x
+	#define VY(p, id, S) (p)[(id)].y
+	#define VZ(p, id, S) (p)[(id)].z
+#endif
+
+/// Number of consecutive vertexes processed by each work-item
+#ifndef VECTOR_WIDTH
+	#define VECTOR_WIDTH 1
+#endif
+
 #ifndef n_packsize
 	#define n_packsize 4
 #endif
@@ -86,6 +108,33 @@
 	#define noise_magnitude (1<<(noise_decimalbits-1))
 #endif
 
+// ----------------------------------------------------------------------------
+// Specialisation constants (see HydrOCLVariants). When the number of
+// octaves (CONST_OCTAVES), the strength (CONST_STRENGTH), the octaves
+// allocator (CONST_MAGNITUDE) or the number of vertexes (CONST_NX,
+// CONST_NY) are defined they replace the kernel arguments, so the compiler
+// can unroll the octaves loop and fold the scaling.
+// ----------------------------------------------------------------------------
+#ifdef CONST_NX
+	#define SPECIALISE_N(N) N = (uint2)(CONST_NX, CONST_NY)
+#else
+	#define SPECIALISE_N(N)
+#endif
+#ifdef CONST_OCTAVES
+	#define SPECIALISE_OCTAVES(octaves) octaves = CONST_OCTAVES
+#else
+	#define SPECIALISE_OCTAVES(octaves)
+#endif
+#ifdef CONST_STRENGTH
+	#define SPECIALISE_STRENGTH(strength) strength = CONST_STRENGTH
+#else
+	#define SPECIALISE_STRENGTH(strength)
+#endif
+#ifdef CONST_MAGNITUDE
+	#define SPECIALISE_MAGNITUDE(magnitude) magnitude = CONST_MAGNITUDE
+#else
+	#define SPECIALISE_MAGNITUDE(magnitude)
+#endif
 
 /** Reads a noise texel.
  * @param uv UV coordinates.
@@ -112,7 +161,30 @@ int readTexelLinearDual(int2 uv, _g int* noise){
 
 }
 
-/** Compute vertex height.
+/** Perlin noise value at a point.
+ * @param uv Point world coordinates.
+ * @param noise Perlin noise.
+ * @param magnitude Perlin octaves allocator.
+ * @param octaves Number of octaves.
+ * @return Noise value, noise_magnitude scaled.
+ */
+float perlinValue( float2 uv, _g int* noise, float magnitude, uint octaves )
+{
+	_g int* r_noise = noise;
+	int2   uvi = (int2)((int)(uv.x*magnitude), (int)(uv.y*magnitude));
+	uint   o, hoct = octaves / n_packsize;
+	float value=0.f;
+	for(o=0;o<hoct;o++){
+		value += (float)readTexelLinearDual(uvi, r_noise);
+		uvi.x = uvi.x << n_packsize;
+		uvi.y = uvi.y << n_packsize;
+		r_noise += np_size_sq;
+	}
+	return value;
+}
+
+/** Compute vertex height. Each work-item computes VECTOR_WIDTH
+ * consecutive vertexes of a row.
  * @param vertex Geometry vertexes.
  * @param noise Perlin noise.
  * @param world Rendering camera position.
@@ -120,31 +192,29 @@ int readTexelLinearDual(int2 uv, _g int* noise){
  * @param magnitude Perlin octaves allocator.
  * @param N Total number of vertices at each direction.
  */
-__kernel void height( _g vec* vertex, _g int* noise, vec world, float strength, float magnitude, uint octaves, uint2 N )
+__kernel void height( vbuf vertex, _g int* noise, vec world, float strength, float magnitude, uint octaves, uint2 N )
 {
-	uint i  = get_global_id(0);
+	SPECIALISE_N(N);
+	SPECIALISE_OCTAVES(octaves);
+	SPECIALISE_STRENGTH(strength);
+	SPECIALISE_MAGNITUDE(magnitude);
+	uint i  = get_global_id(0)*VECTOR_WIDTH;
 	uint j  = get_global_id(1);
 	if( (i >= N.x) || (j >= N.y) )
 		return;
 	uint id = j*N.x + i;
+	uint S  = N.x*N.y;
 
 	// ---- | ------------------------ | ----
 	// ---- V ---- Your code here ---- V ----
 
-	_g int* r_noise = noise;
-	float2 uv  = world.xz + vertex[id].xz;
-	int2   uvi = (int2)((int)(uv.x*magnitude), (int)(uv.y*magnitude));
-	uint   o, hoct = octaves / n_packsize;
-	float value=0.f;
-	for(o=0;o<hoct;o++){
-		value += (float)readTexelLinearDual(uvi, r_noise);
-		uvi.x = uvi.x << n_packsize;
-		uvi.y = uvi.y << n_packsize;
-		r_noise += np_size_sq;
+	uint last = min(i + VECTOR_WIDTH, N.x);
+	for(;i<last;i++,id++){
+		float2 uv  = world.xz + (float2)(VX(vertex, id, S), VZ(vertex, id, S));
+		float value = perlinValue(uv, noise, magnitude, octaves);
+		VY(vertex, id, S) += strength*value/noise_magnitude;
 	}
 
-	vertex[id].y += strength*value/noise_magnitude;
-
 	// ---- A ---- Your code here ---- A ----
 	// ---- | ------------------------ | ----
 
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2012  Jose Luis Cercos Pita (jlcercos@gmail.com)
+ *
+ * This source file is part of SonSilentSea.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef uint
+	#define uint unsigned int
+#endif
+#ifndef vec
+	#define vec float4
+#endif
+
+#ifdef _g
+	#error '_g' is already defined.
+#endif
+#define _g __global
+
+#ifdef _c
+	#error '_c' is already defined.
+#endif
+#define _c __constant
+
+#ifdef _l
+	#error '_l' is already defined.
+#endif
+#define _l __local
+
+// ----------------------------------------------------------------------------
+// Vertexes storage (see grid.cl). If SOA_LAYOUT is defined the buffers
+// store four planes of floats (x, y, z and w components) of S vertexes
+// each, otherwise each vertex is stored as a float4.
+// ----------------------------------------------------------------------------
+#ifdef SOA_LAYOUT
+	#define vbuf _g float*
+	#define VX(p, id, S) (p)[(id)]
+	#define VY(p, id, S) (p)[(S) + (id)]
+	#define VZ(p, id, S) (p)[2*(S) + (id)]
+#else
+	#define vbuf _g vec*
+	#define VX(p, id, S) (p)[(id)].x
+	#define VY(p, id, S) (p)[(id)].y
+	#define VZ(p, id, S) (p)[(id)].z
+#endif
+
+// ----------------------------------------------------------------------------
+// Specialisation constants (see HydrOCLVariants). When the number of waves
+// (CONST_WAVES) or the number of vertexes (CONST_NX, CONST_NY) are defined
+// they replace the kernel arguments, so the compiler can unroll the waves
+// loop.
+// ----------------------------------------------------------------------------
+#ifdef CONST_NX
+	#define SPECIALISE_N(N) N = (uint2)(CONST_NX, CONST_NY)
+#else
+	#define SPECIALISE_N(N)
+#endif
+#ifdef CONST_WAVES
+	#define SPECIALISE_WAVES(n) n = CONST_WAVES
+#else
+	#define SPECIALISE_WAVES(n)
+#endif
+
+// ----------------------------------------------------------------------------
+// Work-items coarsening. Each work-item processes VECTOR_WIDTH consecutive
+// vertexes of a row (1, 4 or 8), using vector math when the whole vector
+// fits in the row.
+// ----------------------------------------------------------------------------
+#ifndef VECTOR_WIDTH
+	#define VECTOR_WIDTH 1
+#endif
+#if VECTOR_WIDTH == 8
+	#define vecN float8
+	#define vloadN vload8
+	#define vstoreN vstore8
+#elif VECTOR_WIDTH == 4
+	#define vecN float4
+	#define vloadN vload4
+	#define vstoreN vstore4
+#endif
+
+#if VECTOR_WIDTH > 1
+/** Loads a component of VECTOR_WIDTH consecutive vertexes.
+ * @param p Vertexes.
+ * @param c Component (0 = x, 1 = y, 2 = z, 3 = w).
+ * @param id Index of the first vertex.
+ * @param S Number of stored vertexes.
+ * @return Components vector.
+ */
+vecN loadComponent( vbuf p, uint c, uint id, uint S )
+{
+#ifdef SOA_LAYOUT
+	return vloadN(0, p + c*S + id);
+#else
+	_g float* f = (_g float*)p;
+	float a[VECTOR_WIDTH];
+	uint k;
+	for(k=0;k<VECTOR_WIDTH;k++)
+		a[k] = f[4*(id + k) + c];
+	return vloadN(0, a);
+#endif
+}
+
+/** Stores a component of VECTOR_WIDTH consecutive vertexes.
+ * @param v Components vector.
+ * @param p Vertexes.
+ * @param c Component (0 = x, 1 = y, 2 = z, 3 = w).
+ * @param id Index of the first vertex.
+ * @param S Number of stored vertexes.
+ */
+void storeComponent( vecN v, vbuf p, uint c, uint id, uint S )
+{
+#ifdef SOA_LAYOUT
+	vstoreN(v, 0, p + c*S + id);
+#else
+	_g float* f = (_g float*)p;
+	float a[VECTOR_WIDTH];
+	uint k;
+	vstoreN(v, 0, a);
+	for(k=0;k<VECTOR_WIDTH;k++)
+		f[4*(id + k) + c] = a[k];
+#endif
+}
+#endif
+
+/** Height due to waves at a point.
+ * @param uv Point world coordinates.
+ * @param wDir Waves direction.
+ * @param wA Waves amplitude [m].
+ * @param wT Waves period [s].
+ * @param wP Waves phase [rad].
+ * @param time Simulation time [s].
+ * @param n Number of waves.
+ * @return Height.
+ */
+float wavesHeight( float2 uv, _g float2* wDir, _g float* wA, _g float* wT, _g float* wP, float time, uint n )
+{
+	float R, L, y=0.f;
+	uint k;
+	for(k=0;k<n;k++){
+		R = dot(wDir[k], uv);
+		L = 1.5625f*wT[k]*wT[k];
+		y += wA[k]*sin( 2.f*M_PI_F*( time/wT[k] - R/L ) + wP[k] );
+	}
+	return y;
+}
+
+#if VECTOR_WIDTH > 1
+/** Height due to waves at VECTOR_WIDTH points.
+ * @param x Points world x coordinates.
+ * @param z Points world z coordinates.
+ * @param wDir Waves direction.
+ * @param wA Waves amplitude [m].
+ * @param wT Waves period [s].
+ * @param wP Waves phase [rad].
+ * @param time Simulation time [s].
+ * @param n Number of waves.
+ * @return Heights.
+ */
+vecN wavesHeightN( vecN x, vecN z, _g float2* wDir, _g float* wA, _g float* wT, _g float* wP, float time, uint n )
+{
+	vecN R, y = (vecN)(0.f);
+	float L;
+	uint k;
+	for(k=0;k<n;k++){
+		R = wDir[k].x*x + wDir[k].y*z;
+		L = 1.5625f*wT[k]*wT[k];
+		y += wA[k]*sin( 2.f*M_PI_F*( time/wT[k] - R/L ) + wP[k] );
+	}
+	return y;
+}
+#endif
+
+/** Compute vertex height due to waves.
+ * @param vertex Geometry vertexes.
+ * @param wDir Waves direction.
+ * @param wA Waves amplitude [m].
+ * @param wT Waves period [s].
+ * @param wP Waves phase [rad].
+ * @param N Total number of vertices at each direction.
+ */
+__kernel void height( vbuf vertex, _g float2* wDir, _g float* wA, _g float* wT, _g float* wP, vec world, float time, uint n, uint2 N )
+{
+	SPECIALISE_N(N);
+	SPECIALISE_WAVES(n);
+	uint i  = get_global_id(0)*VECTOR_WIDTH;
+	uint j  = get_global_id(1);
+	if( (i >= N.x) || (j >= N.y) )
+		return;
+	uint id = j*N.x + i;
+	uint S  = N.x*N.y;
+
+	// ---- | ------------------------ | ----
+	// ---- V ---- Your code here ---- V ----
+
+#if VECTOR_WIDTH > 1
+	if(i + VECTOR_WIDTH <= N.x){
+		vecN x = loadComponent(vertex, 0, id, S) + world.x;
+		vecN z = loadComponent(vertex, 2, id, S) + world.z;
+		vecN y = loadComponent(vertex, 1, id, S);
+		y += wavesHeightN(x, z, wDir, wA, wT, wP, time, n);
+		storeComponent(y, vertex, 1, id, S);
+		return;
+	}
+#endif
+	// Vertex by vertex (rows end)
+	uint last = min(i + VECTOR_WIDTH, N.x);
+	for(;i<last;i++,id++){
+		float2 uv = world.xz + (float2)(VX(vertex, id, S), VZ(vertex, id, S));
+		VY(vertex, id, S) += wavesHeight(uv, wDir, wA, wT, wP, time, n);
+	}
+
+	// ---- A ---- Your code here ---- A ----
+	// ---- | ------------------------ | ----
+
+}
+